@@ -2,8 +2,10 @@
 
 #include <concurrent_hashmap/concurrent_hashmap.h>
 
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <mutex>
 #include <unordered_map>
 #include <utility>
@@ -46,10 +48,205 @@ public:
         return (*this)() % range;
     }
 
+    // Uniform in [0, 1).
+    double next_double() {
+        return static_cast<double>((*this)()) / 2147483648.0;
+    }
+
 private:
     uint64_t state_;
 };
 
+// ===========================================================================
+// Key distributions
+//
+// Each maps a FastRng draw to a record id in [0, n).  The distribution
+// objects are immutable after construction, so one instance can be shared
+// by every benchmark thread; each thread passes its own FastRng.
+// ===========================================================================
+
+// 64-bit finalizer (splitmix64), used to scatter ranks over the keyspace.
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// ---------------------------------------------------------------------------
+// Zipfian -- rank r drawn with probability proportional to 1 / (r+1)^theta,
+// using the rejection-free method of Gray et al., "Quickly Generating
+// Billion-Record Synthetic Databases" (as in YCSB).  Rank 0 is the most
+// popular; theta = 0.99 is YCSB's default skew.  Construction is O(n).
+// ---------------------------------------------------------------------------
+class ZipfianDistribution {
+public:
+    explicit ZipfianDistribution(uint64_t n, double theta = 0.99)
+        : n_(n), theta_(theta) {
+        double zeta2 = 0;
+        for (uint64_t i = 1; i <= 2 && i <= n; ++i) {
+            zeta2 += 1.0 / std::pow(static_cast<double>(i), theta);
+        }
+        zetan_ = 0;
+        for (uint64_t i = 1; i <= n; ++i) {
+            zetan_ += 1.0 / std::pow(static_cast<double>(i), theta);
+        }
+        alpha_ = 1.0 / (1.0 - theta);
+        eta_ = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta)) /
+               (1.0 - zeta2 / zetan_);
+        half_pow_theta_ = 1.0 + std::pow(0.5, theta);
+    }
+
+    uint64_t operator()(FastRng& rng) const {
+        double u = rng.next_double();
+        double uz = u * zetan_;
+        if (uz < 1.0) return 0;
+        if (uz < half_pow_theta_) return n_ > 1 ? 1 : 0;
+        auto r = static_cast<uint64_t>(
+            static_cast<double>(n_) * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+        return r < n_ ? r : n_ - 1;
+    }
+
+    uint64_t size() const { return n_; }
+
+private:
+    uint64_t n_;
+    double   theta_;
+    double   zetan_;
+    double   alpha_;
+    double   eta_;
+    double   half_pow_theta_;
+};
+
+// Zipfian popularity with the popular ids scattered over [0, n) rather
+// than clustered at 0, so hot keys do not share shards or cache lines by
+// construction (YCSB's "scrambled zipfian").
+class ScrambledZipfianDistribution {
+public:
+    explicit ScrambledZipfianDistribution(uint64_t n, double theta = 0.99)
+        : zipf_(n, theta) {}
+
+    uint64_t operator()(FastRng& rng) const {
+        return mix64(zipf_(rng)) % zipf_.size();
+    }
+
+private:
+    ZipfianDistribution zipf_;
+};
+
+// ---------------------------------------------------------------------------
+// Hotspot -- hot_op_fraction of draws land uniformly in a hot set of
+// hot_fraction * n ids, the rest uniformly in the cold remainder.  With
+// churn_ops > 0 the hot set moves on by its own size every churn_ops
+// draws of a thread, modelling keys that are hot for a while and then go
+// cold.
+// ---------------------------------------------------------------------------
+class HotspotDistribution {
+public:
+    HotspotDistribution(uint64_t n, double hot_fraction = 0.2,
+                        double hot_op_fraction = 0.8,
+                        uint64_t churn_ops = 0)
+        : n_(n)
+        , hot_(static_cast<uint64_t>(static_cast<double>(n) * hot_fraction))
+        , hot_op_fraction_(hot_op_fraction)
+        , churn_ops_(churn_ops) {
+        if (hot_ == 0) hot_ = 1;
+        if (hot_ > n_) hot_ = n_;
+    }
+
+    // draw_index is the caller's count of draws so far (for churn).
+    uint64_t operator()(FastRng& rng, uint64_t draw_index = 0) const {
+        uint64_t base = churn_ops_ ? (draw_index / churn_ops_) * hot_ : 0;
+        uint64_t offset;
+        if (rng.next_double() < hot_op_fraction_ || hot_ == n_) {
+            offset = rng() % hot_;
+        } else {
+            offset = hot_ + rng() % (n_ - hot_);
+        }
+        return (base + offset) % n_;
+    }
+
+private:
+    uint64_t n_;
+    uint64_t hot_;
+    double   hot_op_fraction_;
+    uint64_t churn_ops_;
+};
+
+// ===========================================================================
+// Record types
+//
+// KeyString is a YCSB-style key ("user" plus 20 digits, unterminated)
+// in a fixed buffer, and LargeValue a multi-field record of several hundred bytes.
+// Both are trivially copyable, which the map needs for lock-free reads
+// that race with writers (see README, Thread Safety Guarantees);
+// LargeValue is big enough to be stored in nodes by default.
+// ===========================================================================
+struct KeyString {
+    char data[24];
+
+    bool operator==(const KeyString& o) const {
+        return std::memcmp(data, o.data, sizeof(data)) == 0;
+    }
+};
+
+struct KeyStringHash {
+    size_t operator()(const KeyString& k) const noexcept {
+        // FNV-1a over the bytes, then a finalizer for the shard bits.
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (char c : k.data) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 0x100000001b3ULL;
+        }
+        return static_cast<size_t>(mix64(h));
+    }
+};
+
+struct LargeValue {
+    static constexpr size_t kFields = 4;
+    static constexpr size_t kFieldSize = 100;
+    char fields[kFields][kFieldSize];
+};
+
+// Record id -> key / value, for every key and value type used here.
+template <typename T>
+T make_record(uint64_t id);
+
+template <>
+inline int make_record<int>(uint64_t id) {
+    return static_cast<int>(id);
+}
+
+template <>
+inline uint64_t make_record<uint64_t>(uint64_t id) {
+    return id;
+}
+
+template <>
+inline KeyString make_record<KeyString>(uint64_t id) {
+    // "user" and the id in 20 zero-padded digits; formatted by hand
+    // because snprintf would dominate the cheaper operations.
+    KeyString k;
+    std::memcpy(k.data, "user", 4);
+    for (int i = 23; i >= 4; --i) {
+        k.data[i] = static_cast<char>('0' + id % 10);
+        id /= 10;
+    }
+    return k;
+}
+
+template <>
+inline LargeValue make_record<LargeValue>(uint64_t id) {
+    LargeValue v;
+    for (size_t f = 0; f < LargeValue::kFields; ++f) {
+        std::memset(v.fields[f], static_cast<int>('a' + (id + f) % 26),
+                    LargeValue::kFieldSize);
+    }
+    return v;
+}
+
 // ===========================================================================
 // StdMutexMap<K, V>
 //
@@ -117,6 +314,15 @@ public:
         map_.reserve(count);
     }
 
+    template <typename F>
+    bool update(const Key& key, F&& fn) {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = map_.find(key);
+        if (it == map_.end()) return false;
+        fn(it->second);
+        return true;
+    }
+
 private:
     mutable std::mutex mu_;
     std::unordered_map<Key, Value, Hash> map_;
@@ -128,6 +334,12 @@ using ConcurrentMap = concurrent_hashmap::ConcurrentHashMap<
 
 using BaselineMap = StdMutexMap<int, int, MixHash>;
 
+// YCSB-style records: string keys, values of several hundred bytes.
+using RecordMap = concurrent_hashmap::ConcurrentHashMap<
+    KeyString, LargeValue, KeyStringHash, std::equal_to<KeyString>, 6>;
+
+using BaselineRecordMap = StdMutexMap<KeyString, LargeValue, KeyStringHash>;
+
 // ===========================================================================
 // MapHolder -- manages map lifetime safely across benchmark runs.
 //
@@ -137,7 +349,7 @@ using BaselineMap = StdMutexMap<int, int, MixHash>;
 // (per type) and reuses it across all benchmark invocations, clearing it
 // between runs as needed.
 // ===========================================================================
-template <typename MapType>
+template <typename MapType, typename Key = int, typename Value = int>
 struct MapHolder {
     static MapType& get() {
         static MapType* instance = new MapType();
@@ -154,10 +366,25 @@ struct MapHolder {
         auto& m = get();
         m.reserve(count);
         for (int i = 0; i < count; ++i) {
-            m.insert(i, i);
+            m.insert(make_record<Key>(i), make_record<Value>(i));
         }
     }
 };
 
+// ConcurrentMap with flat combining of locked writes.
+struct CombiningMap : ConcurrentMap {
+    CombiningMap() : ConcurrentMap(options()) {}
+
+    static concurrent_hashmap::MapOptions options() {
+        concurrent_hashmap::MapOptions opts;
+        opts.flat_combining = true;
+        return opts;
+    }
+};
+
 using ConcurrentHolder = MapHolder<ConcurrentMap>;
+using CombiningHolder  = MapHolder<CombiningMap>;
+using RecordHolder     = MapHolder<RecordMap, KeyString, LargeValue>;
+using BaselineRecordHolder =
+    MapHolder<BaselineRecordMap, KeyString, LargeValue>;
 using BaselineHolder   = MapHolder<BaselineMap>;
@@ -6,13 +6,15 @@
 static const int kHotKeys = 100;
 
 // ---------------------------------------------------------------------------
-// ConcurrentHashMap
+// Shared workload: 40% find, 20% insert_or_assign, 20% get_or_set,
+// 20% contains, all on the hot keys.
 // ---------------------------------------------------------------------------
-static void BM_ConcurrentHashMap(benchmark::State& state) {
-    auto& map = ConcurrentHolder::get();
+template <typename Holder>
+static void hot_key_workload(benchmark::State& state) {
+    auto& map = Holder::get();
 
     if (state.thread_index() == 0) {
-        ConcurrentHolder::reset();
+        Holder::reset();
         for (int i = 0; i < kHotKeys; ++i) {
             map.insert(i, i);
         }
@@ -41,52 +43,37 @@ static void BM_ConcurrentHashMap(benchmark::State& state) {
     state.SetItemsProcessed(ops);
 
     if (state.thread_index() == 0) {
-        ConcurrentHolder::reset();
+        Holder::reset();
     }
 }
 
+// ---------------------------------------------------------------------------
+// ConcurrentHashMap
+// ---------------------------------------------------------------------------
+static void BM_ConcurrentHashMap(benchmark::State& state) {
+    hot_key_workload<ConcurrentHolder>(state);
+}
+
 BENCHMARK(BM_ConcurrentHashMap)
     ->Threads(1)->Threads(2)->Threads(4)->Threads(8)->Threads(16)
     ->UseRealTime();
 
 // ---------------------------------------------------------------------------
-// StdMutexMap (baseline)
+// ConcurrentHashMap with flat combining (MapOptions::flat_combining)
 // ---------------------------------------------------------------------------
-static void BM_StdMutexMap(benchmark::State& state) {
-    auto& map = BaselineHolder::get();
-
-    if (state.thread_index() == 0) {
-        BaselineHolder::reset();
-        for (int i = 0; i < kHotKeys; ++i) {
-            map.insert(i, i);
-        }
-    }
-
-    FastRng rng(99 + state.thread_index());
-    int64_t ops = 0;
-
-    for (auto _ : state) {
-        int key = static_cast<int>(rng.next_in_range(kHotKeys));
-        uint32_t r = rng.next_in_range(100);
-        if (r < 40) {
-            auto result = map.find(key);
-            benchmark::DoNotOptimize(result);
-        } else if (r < 60) {
-            benchmark::DoNotOptimize(map.insert_or_assign(key, key + 1));
-        } else if (r < 80) {
-            auto val = map.get_or_set(key, key);
-            benchmark::DoNotOptimize(val);
-        } else {
-            benchmark::DoNotOptimize(map.contains(key));
-        }
-        ++ops;
-    }
+static void BM_CombiningMap(benchmark::State& state) {
+    hot_key_workload<CombiningHolder>(state);
+}
 
-    state.SetItemsProcessed(ops);
+BENCHMARK(BM_CombiningMap)
+    ->Threads(1)->Threads(2)->Threads(4)->Threads(8)->Threads(16)
+    ->UseRealTime();
 
-    if (state.thread_index() == 0) {
-        BaselineHolder::reset();
-    }
+// ---------------------------------------------------------------------------
+// StdMutexMap (baseline)
+// ---------------------------------------------------------------------------
+static void BM_StdMutexMap(benchmark::State& state) {
+    hot_key_workload<BaselineHolder>(state);
 }
 
 BENCHMARK(BM_StdMutexMap)
@@ -0,0 +1,332 @@
+// bench_latency.cpp -- per-operation latency percentiles, reads and
+// writes reported separately.
+//
+// Google Benchmark reports mean throughput; this records every operation
+// into a per-thread log-linear histogram and prints p50 / p99 / p99.9 /
+// max per scenario:
+//
+//   steady   -- prefilled map, 90% find / 10% insert_or_assign
+//   growth   -- every write inserts a new key, so shards keep growing
+//               (full and incremental resizes); the map is cleared and
+//               refilled whenever it reaches kGrowthLimit entries
+//   reclaim  -- node-stored values rewritten constantly, so every write
+//               retires a node through the epoch manager
+//
+// Usage: bench_latency [--threads=N] [--duration_ms=N] [--scenario=NAME]
+//                      [--json=PATH]
+
+#include "bench_common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ===========================================================================
+// LatencyHistogram -- HDR-style: values below 2^kSubBits ns get a bucket
+// each, and every power-of-two range above is split into 2^kSubBits
+// equal buckets, so a recorded value is within 1/2^kSubBits (about 1.6%)
+// of the true one.  Fixed size, no allocation on record().
+// ===========================================================================
+class LatencyHistogram {
+public:
+    static const unsigned kSubBits = 6;
+    static const unsigned kSub = 1u << kSubBits;
+    static const unsigned kBuckets = (64 - kSubBits + 1) * kSub;
+
+    void record(uint64_t ns) {
+        ++counts_[index(ns)];
+        ++total_;
+        if (ns > max_) max_ = ns;
+    }
+
+    void merge(const LatencyHistogram& o) {
+        for (unsigned i = 0; i < kBuckets; ++i) counts_[i] += o.counts_[i];
+        total_ += o.total_;
+        if (o.max_ > max_) max_ = o.max_;
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+
+    // Upper bound of the bucket holding the q-quantile, q in [0, 1].
+    uint64_t percentile(double q) const {
+        if (total_ == 0) return 0;
+        auto rank = static_cast<uint64_t>(q * static_cast<double>(total_));
+        if (rank >= total_) rank = total_ - 1;
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < kBuckets; ++i) {
+            seen += counts_[i];
+            if (seen > rank) return std::min(upper(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    uint64_t counts_[kBuckets] = {};
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+
+    static unsigned index(uint64_t v) {
+        if (v < kSub) return static_cast<unsigned>(v);
+        unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(v));
+        unsigned shift = msb - kSubBits;
+        unsigned sub = static_cast<unsigned>(v >> shift) - kSub;
+        return (shift + 1) * kSub + sub;
+    }
+
+    static uint64_t upper(unsigned i) {
+        if (i < kSub) return i;
+        unsigned shift = i / kSub - 1;
+        uint64_t sub = i % kSub + kSub;
+        return ((sub + 1) << shift) - 1;
+    }
+};
+
+struct OpLatencies {
+    LatencyHistogram reads;
+    LatencyHistogram writes;
+};
+
+static inline uint64_t now_ns() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Lookup results land here so they are not optimised away.
+static volatile bool g_sink;
+
+// Time op() into h.
+template <typename Op>
+static inline void timed(LatencyHistogram& h, Op&& op) {
+    uint64_t start = now_ns();
+    op();
+    h.record(now_ns() - start);
+}
+
+// ===========================================================================
+// Scenarios
+// ===========================================================================
+static const int kKeyRange    = 1 << 20;
+static const int kGrowthLimit = 1 << 21;
+
+struct Config {
+    int         threads = 4;
+    int         duration_ms = 2000;
+    std::string scenario;  // empty: all
+    std::string json;
+};
+
+// Run body(thread_index, stop, latencies) on cfg.threads threads for
+// cfg.duration_ms and merge what they recorded.
+template <typename Body>
+static OpLatencies run_threads(const Config& cfg, Body body) {
+    std::atomic<bool> stop{false};
+    std::vector<OpLatencies*> per_thread(cfg.threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < cfg.threads; ++t) {
+        per_thread[t] = new OpLatencies();
+        threads.emplace_back([&, t] { body(t, stop, *per_thread[t]); });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(cfg.duration_ms));
+    stop.store(true);
+    for (auto& th : threads) th.join();
+
+    OpLatencies total;
+    for (OpLatencies* l : per_thread) {
+        total.reads.merge(l->reads);
+        total.writes.merge(l->writes);
+        delete l;
+    }
+    return total;
+}
+
+static OpLatencies run_steady(const Config& cfg) {
+    auto& map = ConcurrentHolder::get();
+    ConcurrentHolder::reset();
+    ConcurrentHolder::prefill(kKeyRange / 2);
+
+    OpLatencies result = run_threads(cfg, [&](int t, std::atomic<bool>& stop,
+                                              OpLatencies& lat) {
+        FastRng rng(17 + t);
+        while (!stop.load(std::memory_order_relaxed)) {
+            int key = static_cast<int>(rng.next_in_range(kKeyRange));
+            if (rng.next_in_range(100) < 90) {
+                timed(lat.reads, [&] { g_sink = map.find(key).second; });
+            } else {
+                timed(lat.writes, [&] { map.insert_or_assign(key, key); });
+            }
+        }
+    });
+    ConcurrentHolder::reset();
+    return result;
+}
+
+static OpLatencies run_growth(const Config& cfg) {
+    auto& map = ConcurrentHolder::get();
+    ConcurrentHolder::reset();
+    std::atomic<int> next_key{0};
+
+    OpLatencies result = run_threads(cfg, [&](int t, std::atomic<bool>& stop,
+                                              OpLatencies& lat) {
+        FastRng rng(23 + t);
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (rng.next_in_range(100) < 50) {
+                int hi = next_key.load(std::memory_order_relaxed);
+                int key = static_cast<int>(
+                    rng.next_in_range(static_cast<uint32_t>(hi) + 1));
+                timed(lat.reads, [&] { g_sink = map.find(key).second; });
+            } else {
+                int key = next_key.fetch_add(1, std::memory_order_relaxed);
+                if (key >= kGrowthLimit) {
+                    // The thread that hit the limit restarts the growth;
+                    // the others skip their writes until it has.
+                    if (key == kGrowthLimit) {
+                        map.clear();
+                        next_key.store(0, std::memory_order_relaxed);
+                    }
+                    continue;
+                }
+                timed(lat.writes, [&] { map.insert(key, key); });
+            }
+        }
+    });
+    ConcurrentHolder::reset();
+    return result;
+}
+
+static OpLatencies run_reclaim(const Config& cfg) {
+    auto& map = RecordHolder::get();
+    const int kRecords = 1 << 16;
+    RecordHolder::reset();
+    RecordHolder::prefill(kRecords);
+
+    OpLatencies result = run_threads(cfg, [&](int t, std::atomic<bool>& stop,
+                                              OpLatencies& lat) {
+        FastRng rng(29 + t);
+        const LargeValue value = make_record<LargeValue>(t);
+        while (!stop.load(std::memory_order_relaxed)) {
+            KeyString key = make_record<KeyString>(
+                rng.next_in_range(kRecords));
+            if (rng.next_in_range(100) < 50) {
+                timed(lat.reads, [&] { g_sink = map.find(key).second; });
+            } else {
+                timed(lat.writes, [&] { map.insert_or_assign(key, value); });
+            }
+        }
+    });
+    RecordHolder::reset();
+    return result;
+}
+
+// ===========================================================================
+// Reporting
+// ===========================================================================
+struct Result {
+    std::string name;
+    OpLatencies lat;
+};
+
+static void print_line(const char* scenario, const char* op,
+                       const LatencyHistogram& h) {
+    std::printf("%-8s %-6s %12llu %10llu %10llu %10llu %10llu\n", scenario,
+                op, static_cast<unsigned long long>(h.count()),
+                static_cast<unsigned long long>(h.percentile(0.50)),
+                static_cast<unsigned long long>(h.percentile(0.99)),
+                static_cast<unsigned long long>(h.percentile(0.999)),
+                static_cast<unsigned long long>(h.max()));
+}
+
+static void json_op(std::FILE* f, const char* op, const LatencyHistogram& h,
+                    bool last) {
+    std::fprintf(f,
+                 "      \"%s\": {\"count\": %llu, \"p50_ns\": %llu, "
+                 "\"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}%s\n",
+                 op, static_cast<unsigned long long>(h.count()),
+                 static_cast<unsigned long long>(h.percentile(0.50)),
+                 static_cast<unsigned long long>(h.percentile(0.99)),
+                 static_cast<unsigned long long>(h.percentile(0.999)),
+                 static_cast<unsigned long long>(h.max()), last ? "" : ",");
+}
+
+static bool write_json(const Config& cfg, const std::vector<Result>& results) {
+    std::FILE* f = std::fopen(cfg.json.c_str(), "w");
+    if (!f) return false;
+    std::fprintf(f, "{\n  \"threads\": %d,\n  \"duration_ms\": %d,\n"
+                    "  \"scenarios\": {\n", cfg.threads, cfg.duration_ms);
+    for (size_t i = 0; i < results.size(); ++i) {
+        std::fprintf(f, "    \"%s\": {\n", results[i].name.c_str());
+        json_op(f, "find", results[i].lat.reads, false);
+        json_op(f, "write", results[i].lat.writes, true);
+        std::fprintf(f, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(f, "  }\n}\n");
+    return std::fclose(f) == 0;
+}
+
+static bool parse_flag(const char* arg, const char* name, std::string& out) {
+    size_t n = std::strlen(name);
+    if (std::strncmp(arg, name, n) != 0 || arg[n] != '=') return false;
+    out = arg + n + 1;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Config cfg;
+    for (int i = 1; i < argc; ++i) {
+        std::string v;
+        if (parse_flag(argv[i], "--threads", v)) {
+            cfg.threads = std::max(1, std::atoi(v.c_str()));
+        } else if (parse_flag(argv[i], "--duration_ms", v)) {
+            cfg.duration_ms = std::max(1, std::atoi(v.c_str()));
+        } else if (parse_flag(argv[i], "--scenario", v)) {
+            cfg.scenario = v;
+        } else if (parse_flag(argv[i], "--json", v)) {
+            cfg.json = v;
+        } else {
+            std::fprintf(stderr,
+                         "usage: %s [--threads=N] [--duration_ms=N] "
+                         "[--scenario=steady|growth|reclaim] [--json=PATH]\n",
+                         argv[0]);
+            return 2;
+        }
+    }
+
+    struct Scenario {
+        const char* name;
+        OpLatencies (*run)(const Config&);
+    };
+    const Scenario scenarios[] = {
+        {"steady", run_steady},
+        {"growth", run_growth},
+        {"reclaim", run_reclaim},
+    };
+
+    std::printf("%-8s %-6s %12s %10s %10s %10s %10s   (ns, %d threads)\n",
+                "scenario", "op", "count", "p50", "p99", "p99.9", "max",
+                cfg.threads);
+    std::vector<Result> results;
+    for (const Scenario& s : scenarios) {
+        if (!cfg.scenario.empty() && cfg.scenario != s.name) continue;
+        Result r{s.name, s.run(cfg)};
+        print_line(s.name, "find", r.lat.reads);
+        print_line(s.name, "write", r.lat.writes);
+        results.push_back(std::move(r));
+    }
+    if (results.empty()) {
+        std::fprintf(stderr, "unknown scenario: %s\n", cfg.scenario.c_str());
+        return 2;
+    }
+
+    if (!cfg.json.empty() && !write_json(cfg, results)) {
+        std::fprintf(stderr, "cannot write %s\n", cfg.json.c_str());
+        return 1;
+    }
+    return 0;
+}
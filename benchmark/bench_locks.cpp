@@ -0,0 +1,104 @@
+// bench_locks.cpp -- the bench_contention workload (100 hot keys, all
+// threads contend on them) with each bundled shard mutex, plus a bare
+// lock/unlock loop.  Thread counts past the core count show how each lock
+// behaves when holders are preempted.
+
+#include "bench_common.h"
+#include <concurrent_hashmap/locks.h>
+#include <benchmark/benchmark.h>
+
+#include <mutex>
+
+using concurrent_hashmap::AdaptiveLock;
+using concurrent_hashmap::FutexLock;
+using concurrent_hashmap::McsLock;
+using concurrent_hashmap::TicketLock;
+using concurrent_hashmap::detail::SpinLock;
+
+static const int kHotKeys = 100;
+
+template <typename Mutex>
+using LockedMap = concurrent_hashmap::ConcurrentHashMap<
+    int, int, MixHash, std::equal_to<int>, 6, Mutex>;
+
+// ---------------------------------------------------------------------------
+// Hot-key map workload
+// ---------------------------------------------------------------------------
+template <typename Mutex>
+static void BM_HotKeys(benchmark::State& state) {
+    using Holder = MapHolder<LockedMap<Mutex>>;
+    auto& map = Holder::get();
+
+    if (state.thread_index() == 0) {
+        Holder::reset();
+        for (int i = 0; i < kHotKeys; ++i) {
+            map.insert(i, i);
+        }
+    }
+
+    FastRng rng(99 + state.thread_index());
+    int64_t ops = 0;
+
+    for (auto _ : state) {
+        int key = static_cast<int>(rng.next_in_range(kHotKeys));
+        uint32_t r = rng.next_in_range(100);
+        if (r < 40) {
+            auto result = map.find(key);
+            benchmark::DoNotOptimize(result);
+        } else if (r < 60) {
+            // erase + insert: always locked, unlike insert_or_assign on
+            // the CAS path
+            benchmark::DoNotOptimize(map.erase(key));
+            benchmark::DoNotOptimize(map.insert(key, key + 1));
+        } else if (r < 80) {
+            auto val = map.get_or_set(key, key);
+            benchmark::DoNotOptimize(val);
+        } else {
+            benchmark::DoNotOptimize(map.contains(key));
+        }
+        ++ops;
+    }
+
+    state.SetItemsProcessed(ops);
+
+    if (state.thread_index() == 0) {
+        Holder::reset();
+    }
+}
+
+#define CHM_LOCK_BENCH(fn, Mutex)                                     \
+    BENCHMARK_TEMPLATE(fn, Mutex)                                      \
+        ->Threads(1)->Threads(2)->Threads(4)->Threads(8)->Threads(16)  \
+        ->Threads(32)->UseRealTime()
+
+CHM_LOCK_BENCH(BM_HotKeys, SpinLock);
+CHM_LOCK_BENCH(BM_HotKeys, FutexLock);
+CHM_LOCK_BENCH(BM_HotKeys, AdaptiveLock);
+CHM_LOCK_BENCH(BM_HotKeys, TicketLock);
+CHM_LOCK_BENCH(BM_HotKeys, McsLock);
+CHM_LOCK_BENCH(BM_HotKeys, std::mutex);
+
+// ---------------------------------------------------------------------------
+// One lock, short critical section
+// ---------------------------------------------------------------------------
+template <typename Mutex>
+static void BM_LockUnlock(benchmark::State& state) {
+    static Mutex mutex;
+    static uint64_t counter = 0;
+
+    for (auto _ : state) {
+        std::lock_guard<Mutex> lk(mutex);
+        benchmark::DoNotOptimize(++counter);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+CHM_LOCK_BENCH(BM_LockUnlock, SpinLock);
+CHM_LOCK_BENCH(BM_LockUnlock, FutexLock);
+CHM_LOCK_BENCH(BM_LockUnlock, AdaptiveLock);
+CHM_LOCK_BENCH(BM_LockUnlock, TicketLock);
+CHM_LOCK_BENCH(BM_LockUnlock, McsLock);
+CHM_LOCK_BENCH(BM_LockUnlock, std::mutex);
+
+BENCHMARK_MAIN();
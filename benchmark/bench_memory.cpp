@@ -0,0 +1,349 @@
+// bench_memory.cpp -- memory per entry and, optionally, hardware counters
+// per operation.
+//
+// For each Key/Value type and each size from 1K to --max_entries (100M by
+// default), a child process fills a fresh map and reports:
+//
+//   alloc/entry  -- bytes held through the map's Allocator (tables, value
+//                   nodes) divided by the entry count
+//   rss/entry    -- growth of the resident set while filling, per entry;
+//                   includes malloc overhead and retired tables not yet
+//                   freed
+//   capacity     -- total slots, to show where the load factor sits
+//   retired      -- objects still waiting in the epoch manager
+//
+// Each size runs in its own process, so RSS is not polluted by memory an
+// earlier run freed but the allocator kept.
+//
+// With --perf (Linux, perf_event_open permitted), LLC misses, dTLB misses
+// and branch mispredicts per operation are read around random finds and
+// around inserts into a fresh map of --perf_entries entries.
+//
+// Usage: bench_memory [--max_entries=N] [--perf] [--perf_entries=N]
+
+#include "bench_common.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+// ===========================================================================
+// CountingAllocator -- std::allocator that tallies live bytes in one
+// process-wide counter.
+// ===========================================================================
+inline std::atomic<size_t>& allocated_bytes() {
+    static std::atomic<size_t> bytes{0};
+    return bytes;
+}
+
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    CountingAllocator() = default;
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        allocated_bytes().fetch_add(n * sizeof(T), std::memory_order_relaxed);
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, size_t n) {
+        allocated_bytes().fetch_sub(n * sizeof(T), std::memory_order_relaxed);
+        std::allocator<T>().deallocate(p, n);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const CountingAllocator<T>&, const CountingAllocator<U>&) {
+    return true;
+}
+template <typename T, typename U>
+bool operator!=(const CountingAllocator<T>&, const CountingAllocator<U>&) {
+    return false;
+}
+
+template <typename Key, typename Value, typename Hash>
+using CountedMap = concurrent_hashmap::ConcurrentHashMap<
+    Key, Value, Hash, std::equal_to<Key>, 6,
+    concurrent_hashmap::detail::SpinLock,
+    CountingAllocator<std::pair<const Key, Value>>>;
+
+// Resident set size in bytes (0 if unknown).
+static size_t resident_bytes() {
+#if defined(__linux__)
+    long pages = 0, resident = 0;
+    if (std::FILE* f = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        std::fclose(f);
+    }
+    return static_cast<size_t>(resident) *
+           static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+// ===========================================================================
+// PerfCounters -- a perf_event group of LLC misses, dTLB load misses and
+// branch mispredicts for the calling thread.  ok() is false when the
+// kernel refuses (no PMU, perf_event_paranoid, containers).
+// ===========================================================================
+class PerfCounters {
+public:
+    static const int kEvents = 3;
+
+    PerfCounters() {
+#if defined(__linux__)
+        const uint64_t dtlb_miss =
+            PERF_COUNT_HW_CACHE_DTLB |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        const struct {
+            uint32_t type;
+            uint64_t config;
+        } events[kEvents] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HW_CACHE, dtlb_miss},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        };
+        for (int i = 0; i < kEvents; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].type;
+            attr.config = events[i].config;
+            attr.disabled = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0,
+                                               -1, i == 0 ? -1 : fds_[0], 0));
+            if (fds_[i] < 0) {
+                close_all();
+                return;
+            }
+        }
+#endif
+    }
+
+    ~PerfCounters() { close_all(); }
+
+    bool ok() const { return fds_[0] >= 0; }
+
+    void start() {
+#if defined(__linux__)
+        ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    // Stop and fill values[kEvents].
+    bool stop(uint64_t* values) {
+#if defined(__linux__)
+        ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t buf[1 + kEvents];
+        if (read(fds_[0], buf, sizeof(buf)) !=
+            static_cast<ssize_t>(sizeof(buf))) {
+            return false;
+        }
+        for (int i = 0; i < kEvents; ++i) values[i] = buf[1 + i];
+        return true;
+#else
+        (void)values;
+        return false;
+#endif
+    }
+
+private:
+    int fds_[kEvents] = {-1, -1, -1};
+
+    void close_all() {
+#if defined(__linux__)
+        for (int& fd : fds_) {
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+#endif
+    }
+};
+
+// ===========================================================================
+// Measurements
+// ===========================================================================
+struct MemoryResult {
+    size_t entries;
+    size_t allocated;
+    size_t resident;
+    size_t capacity;
+    size_t retired;
+};
+
+template <typename Key, typename Value, typename Hash>
+static MemoryResult fill_and_measure(size_t n) {
+    using Map = CountedMap<Key, Value, Hash>;
+    size_t rss_before = resident_bytes();
+    size_t alloc_before = allocated_bytes().load();
+    Map* map = new Map();
+    for (size_t i = 0; i < n; ++i) {
+        map->insert(make_record<Key>(i), make_record<Value>(i));
+    }
+    concurrent_hashmap::MapStats stats = map->stats();
+    MemoryResult r;
+    r.entries = map->size();
+    r.allocated = allocated_bytes().load() - alloc_before;
+    r.resident = resident_bytes() - rss_before;
+    r.capacity = stats.total.capacity;
+    r.retired = stats.retired_pending;
+    delete map;
+    return r;
+}
+
+// Run fill_and_measure in a child process.  Returns false if the child
+// failed (typically out of memory).
+template <typename Key, typename Value, typename Hash>
+static bool measure_isolated(size_t n, MemoryResult& out) {
+#if defined(__linux__)
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    std::fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        MemoryResult r = fill_and_measure<Key, Value, Hash>(n);
+        ssize_t w = write(fds[1], &r, sizeof(r));
+        _exit(w == static_cast<ssize_t>(sizeof(r)) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t got = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return got == static_cast<ssize_t>(sizeof(out)) &&
+           WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#else
+    out = fill_and_measure<Key, Value, Hash>(n);  // RSS not isolated
+    return true;
+#endif
+}
+
+template <typename Key, typename Value, typename Hash>
+static void report_memory(const char* name, size_t max_entries) {
+    for (size_t n = 1000; n <= max_entries; n *= 10) {
+        MemoryResult r;
+        if (!measure_isolated<Key, Value, Hash>(n, r)) {
+            std::printf("%-22s %11zu  failed (out of memory?)\n", name, n);
+            break;
+        }
+        double e = static_cast<double>(r.entries ? r.entries : 1);
+        std::printf("%-22s %11zu %12.1f %12.1f %12zu %6.3f %8zu\n", name, n,
+                    static_cast<double>(r.allocated) / e,
+                    static_cast<double>(r.resident) / e, r.capacity,
+                    e / static_cast<double>(r.capacity), r.retired);
+    }
+}
+
+template <typename Key, typename Value, typename Hash>
+static void report_perf(const char* name, size_t n) {
+    using Map = CountedMap<Key, Value, Hash>;
+    PerfCounters perf;
+    if (!perf.ok()) {
+        std::printf("%-22s perf_event_open unavailable\n", name);
+        return;
+    }
+    Map* map = new Map();
+    uint64_t insert_counts[PerfCounters::kEvents] = {};
+    uint64_t find_counts[PerfCounters::kEvents] = {};
+
+    perf.start();
+    for (size_t i = 0; i < n; ++i) {
+        map->insert(make_record<Key>(i), make_record<Value>(i));
+    }
+    bool ok = perf.stop(insert_counts);
+
+    FastRng rng(5);
+    size_t hits = 0;
+    perf.start();
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t id = mix64(rng()) % n;
+        hits += map->contains(make_record<Key>(id));
+    }
+    ok = perf.stop(find_counts) && ok && hits == n;
+    delete map;
+
+    if (!ok) {
+        std::printf("%-22s counters could not be read\n", name);
+        return;
+    }
+    double ops = static_cast<double>(n);
+    const char* op_names[2] = {"insert", "find"};
+    const uint64_t* counts[2] = {insert_counts, find_counts};
+    for (int op = 0; op < 2; ++op) {
+        std::printf("%-22s %-6s %10.3f %10.3f %10.3f\n", name, op_names[op],
+                    static_cast<double>(counts[op][0]) / ops,
+                    static_cast<double>(counts[op][1]) / ops,
+                    static_cast<double>(counts[op][2]) / ops);
+    }
+}
+
+static bool parse_size(const char* arg, const char* name, size_t& out) {
+    size_t n = std::strlen(name);
+    if (std::strncmp(arg, name, n) != 0 || arg[n] != '=') return false;
+    out = static_cast<size_t>(std::strtoull(arg + n + 1, nullptr, 10));
+    return true;
+}
+
+int main(int argc, char** argv) {
+    size_t max_entries = 100000000;
+    size_t perf_entries = 1000000;
+    bool perf = false;
+    for (int i = 1; i < argc; ++i) {
+        if (parse_size(argv[i], "--max_entries", max_entries) ||
+            parse_size(argv[i], "--perf_entries", perf_entries)) {
+            continue;
+        }
+        if (std::strcmp(argv[i], "--perf") == 0) {
+            perf = true;
+            continue;
+        }
+        std::fprintf(stderr,
+                     "usage: %s [--max_entries=N] [--perf] "
+                     "[--perf_entries=N]\n", argv[0]);
+        return 2;
+    }
+
+    std::printf("%-22s %11s %12s %12s %12s %6s %8s\n", "type", "entries",
+                "alloc/entry", "rss/entry", "capacity", "load", "retired");
+    report_memory<int, int, MixHash>("int/int", max_entries);
+    report_memory<uint64_t, uint64_t, std::hash<uint64_t>>(
+        "uint64/uint64", max_entries);
+    report_memory<KeyString, uint64_t, KeyStringHash>(
+        "KeyString/uint64", max_entries);
+    report_memory<uint64_t, LargeValue, std::hash<uint64_t>>(
+        "uint64/LargeValue", max_entries);
+
+    if (perf) {
+        std::printf("\n%-22s %-6s %10s %10s %10s   (per op, %zu entries)\n",
+                    "type", "op", "LLC-miss", "dTLB-miss", "br-miss",
+                    perf_entries);
+        report_perf<int, int, MixHash>("int/int", perf_entries);
+        report_perf<uint64_t, uint64_t, std::hash<uint64_t>>(
+            "uint64/uint64", perf_entries);
+        report_perf<KeyString, uint64_t, KeyStringHash>(
+            "KeyString/uint64", perf_entries);
+        report_perf<uint64_t, LargeValue, std::hash<uint64_t>>(
+            "uint64/LargeValue", perf_entries);
+    }
+    return 0;
+}
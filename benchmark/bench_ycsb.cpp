@@ -0,0 +1,132 @@
+// bench_ycsb.cpp -- YCSB core workloads A-F on string keys and 400-byte
+// records, with scrambled-Zipfian (or, for D, latest-biased) key choice.
+//
+//   A  50% read / 50% update                 (session store)
+//   B  95% read /  5% update                 (photo tagging)
+//   C 100% read                              (user profile cache)
+//   D  95% read /  5% insert, reads favour recent inserts
+//   E  95% scan /  5% insert                 (threaded conversations)
+//   F  50% read / 50% read-modify-write      (user database)
+//
+// A hash map has no key order, so a scan of E is a run of 1-16 point
+// reads of consecutive record ids starting at a Zipfian id.  Inserts
+// append new ids; the run's first thread resets the table.
+
+#include "bench_common.h"
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+
+static const uint64_t kRecordCount = 100000;
+static const uint32_t kMaxScan     = 16;
+
+struct Workload {
+    uint32_t read;    // percentages; the rest are read-modify-writes
+    uint32_t update;
+    uint32_t insert;
+    uint32_t scan;
+    bool     latest;  // read keys near the most recent insert
+};
+
+static const Workload kWorkloadA = {50, 50, 0, 0, false};
+static const Workload kWorkloadB = {95, 5, 0, 0, false};
+static const Workload kWorkloadC = {100, 0, 0, 0, false};
+static const Workload kWorkloadD = {95, 0, 5, 0, true};
+static const Workload kWorkloadE = {0, 0, 5, 95, false};
+static const Workload kWorkloadF = {50, 0, 0, 0, false};
+
+// Records inserted so far, shared by the threads of a run.
+static std::atomic<uint64_t> g_records{kRecordCount};
+
+static const ScrambledZipfianDistribution& key_chooser() {
+    static const ScrambledZipfianDistribution dist(kRecordCount);
+    return dist;
+}
+
+static const ZipfianDistribution& recency_chooser() {
+    static const ZipfianDistribution dist(kRecordCount);
+    return dist;
+}
+
+template <typename Holder>
+static void run_workload(benchmark::State& state, const Workload& w) {
+    auto& map = Holder::get();
+
+    if (state.thread_index() == 0) {
+        Holder::reset();
+        Holder::prefill(static_cast<int>(kRecordCount));
+        g_records.store(kRecordCount);
+    }
+
+    FastRng rng(1234 + state.thread_index());
+    const LargeValue update_value = make_record<LargeValue>(
+        static_cast<uint64_t>(state.thread_index()));
+    int64_t ops = 0;
+
+    for (auto _ : state) {
+        uint64_t records = g_records.load(std::memory_order_relaxed);
+        uint64_t id;
+        if (w.latest) {
+            uint64_t back = recency_chooser()(rng);
+            id = back < records ? records - 1 - back : 0;
+        } else {
+            id = key_chooser()(rng);
+        }
+
+        uint32_t r = rng.next_in_range(100);
+        if (r < w.read) {
+            auto result = map.find(make_record<KeyString>(id));
+            benchmark::DoNotOptimize(result);
+        } else if (r < w.read + w.update) {
+            benchmark::DoNotOptimize(
+                map.insert_or_assign(make_record<KeyString>(id),
+                                     update_value));
+        } else if (r < w.read + w.update + w.insert) {
+            uint64_t next = g_records.fetch_add(1, std::memory_order_relaxed);
+            benchmark::DoNotOptimize(
+                map.insert(make_record<KeyString>(next),
+                           make_record<LargeValue>(next)));
+        } else if (r < w.read + w.update + w.insert + w.scan) {
+            uint32_t len = 1 + rng.next_in_range(kMaxScan);
+            for (uint32_t i = 0; i < len; ++i) {
+                auto result = map.find(make_record<KeyString>(
+                    (id + i) % records));
+                benchmark::DoNotOptimize(result);
+            }
+        } else {
+            benchmark::DoNotOptimize(map.update(
+                make_record<KeyString>(id),
+                [](LargeValue& v) { v.fields[0][0]++; }));
+        }
+        ++ops;
+    }
+
+    state.SetItemsProcessed(ops);
+
+    if (state.thread_index() == 0) {
+        Holder::reset();
+    }
+}
+
+#define CHM_YCSB(name, workload)                                          \
+    static void BM_ConcurrentHashMap_##name(benchmark::State& state) {    \
+        run_workload<RecordHolder>(state, workload);                      \
+    }                                                                     \
+    static void BM_StdMutexMap_##name(benchmark::State& state) {          \
+        run_workload<BaselineRecordHolder>(state, workload);              \
+    }                                                                     \
+    BENCHMARK(BM_ConcurrentHashMap_##name)                                \
+        ->Threads(1)->Threads(2)->Threads(4)->Threads(8)->Threads(16)     \
+        ->UseRealTime();                                                  \
+    BENCHMARK(BM_StdMutexMap_##name)                                      \
+        ->Threads(1)->Threads(2)->Threads(4)->Threads(8)->Threads(16)     \
+        ->UseRealTime()
+
+CHM_YCSB(A, kWorkloadA);
+CHM_YCSB(B, kWorkloadB);
+CHM_YCSB(C, kWorkloadC);
+CHM_YCSB(D, kWorkloadD);
+CHM_YCSB(E, kWorkloadE);
+CHM_YCSB(F, kWorkloadF);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,93 @@
+#pragma once
+
+// Awaitable forms of the map's non-blocking writes (async_insert,
+// async_insert_or_assign, async_erase).  Defines CHM_HAS_COROUTINES and
+// WriteAwaitable when the compiler supports C++20 coroutines; otherwise
+// empty, and the map has only the try_ writes.
+
+#include <concurrent_hashmap/types.h>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#  if __has_include(<coroutine>)
+#    define CHM_HAS_COROUTINES 1
+#  endif
+#endif
+
+#if defined(CHM_HAS_COROUTINES)
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+namespace concurrent_hashmap {
+namespace detail {
+
+// ---------------------------------------------------------------------------
+// WriteAwaitable -- co_await of a try_ write.  attempt() runs the write;
+// if it would block, the coroutine suspends and schedule(task) is handed
+// a void() task that retries it, and again each time it would block.
+// The coroutine resumes in the task that completes the write, so no
+// thread ever waits on the shard lock.
+//
+// schedule must defer the task -- post it to the event loop or a thread
+// pool -- rather than run it inline, which would spin.  The coroutine
+// resumes on whichever thread runs the task.  An exception from the
+// write is rethrown from co_await.
+// ---------------------------------------------------------------------------
+template <typename Attempt, typename Schedule>
+class WriteAwaitable {
+public:
+    WriteAwaitable(Attempt attempt, Schedule schedule)
+        : attempt_(std::move(attempt)), schedule_(std::move(schedule)) {}
+
+    bool await_ready() {
+        result_ = attempt_();
+        return result_ != TryResult::would_block;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+        retry_later();
+    }
+
+    bool await_resume() {
+        if (error_) std::rethrow_exception(error_);
+        return result_ == TryResult::yes;
+    }
+
+private:
+    Attempt                 attempt_;
+    Schedule                schedule_;
+    TryResult               result_ = TryResult::would_block;
+    std::exception_ptr      error_;
+    std::coroutine_handle<> handle_;
+
+    void retry() {
+        try {
+            result_ = attempt_();
+            if (result_ == TryResult::would_block) return retry_later();
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+        handle_.resume();
+    }
+
+    // The task may resume the coroutine, destroying *this, before
+    // schedule returns, so a copy is called.
+    void retry_later() {
+        Schedule schedule = schedule_;
+        schedule([this] { retry(); });
+    }
+};
+
+template <typename Attempt, typename Schedule>
+WriteAwaitable<Attempt, Schedule> make_write_awaitable(Attempt attempt,
+                                                       Schedule schedule) {
+    return WriteAwaitable<Attempt, Schedule>(std::move(attempt),
+                                             std::move(schedule));
+}
+
+}  // namespace detail
+}  // namespace concurrent_hashmap
+
+#endif  // CHM_HAS_COROUTINES
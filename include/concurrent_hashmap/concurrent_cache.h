@@ -0,0 +1,378 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#include <concurrent_hashmap/hash.h>
+#include <concurrent_hashmap/types.h>
+#include <concurrent_hashmap/detail/epoch.h>
+#include <concurrent_hashmap/detail/hash_utils.h>
+#include <concurrent_hashmap/detail/numa.h>
+#include <concurrent_hashmap/detail/shard.h>
+#include <concurrent_hashmap/detail/spinlock.h>
+
+namespace concurrent_hashmap {
+namespace detail {
+
+// What a cache slot holds: the value, its expiry time in Clock ticks
+// since the clock's epoch (0 for none) and its reference stamp (see
+// ConcurrentCache).  Readers store the stamp in place, inside a slot the
+// table may be moving meanwhile; a stamp lost that way or landing on the
+// entry that moved in only makes one eviction decision less precise.
+// Copies and moves carry the stamp along.
+template <typename Value, typename Rep>
+struct CacheEntry {
+    Value                        value;
+    Rep                          expires;
+    mutable std::atomic<uint8_t> stamp;
+
+    CacheEntry() : value(), expires(0), stamp(0) {}
+    CacheEntry(Value v, Rep e, uint8_t s)
+        : value(std::move(v)), expires(e), stamp(s) {}
+
+    CacheEntry(const CacheEntry& o)
+        : value(o.value), expires(o.expires), stamp(o.load_stamp()) {}
+    CacheEntry(CacheEntry&& o)
+        : value(std::move(o.value)), expires(o.expires)
+        , stamp(o.load_stamp()) {}
+
+    CacheEntry& operator=(const CacheEntry& o) {
+        value = o.value;
+        expires = o.expires;
+        stamp.store(o.load_stamp(), std::memory_order_relaxed);
+        return *this;
+    }
+    CacheEntry& operator=(CacheEntry&& o) {
+        value = std::move(o.value);
+        expires = o.expires;
+        stamp.store(o.load_stamp(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    uint8_t load_stamp() const {
+        return stamp.load(std::memory_order_relaxed);
+    }
+};
+
+}  // namespace detail
+
+// =========================================================================
+// ConcurrentCache
+//
+// A bounded cache on the same sharded tables as ConcurrentHashMap: at
+// most capacity() entries, with CLOCK (second-chance) eviction and an
+// optional expiry time per entry.
+//
+// Capacity is split evenly across a fixed set of shards, each of which
+// reserves its table up front, so memory stays flat however many
+// distinct keys pass through.  Inserting a new key into a full shard
+// advances that shard's clock hand over its table, under its lock, to
+// the first entry that is expired or was not referenced since the hand
+// last came by, and evicts it.
+//
+// Instead of a reference bit that the hand clears, each entry carries a
+// one-byte reference stamp: the hand's lap (revolution count, mod 256)
+// when it was last found or overwritten.  An entry is spared while its
+// stamp is from this lap or the previous one.  Nothing is reset as the
+// hand passes, so Robin Hood displacement, which can carry an entry from
+// behind the hand to just ahead of it, does not cost a hot entry its
+// second chance.  A successful find stores the stamp with a relaxed
+// store, and only when it differs, so hot entries cost readers no lock
+// and, within a lap, no shared cache-line writes.  A new entry starts
+// two laps old: a key that is written once and never read goes first.
+//
+// Expired entries are misses for find and contains, are overwritten by
+// insert, go first when the clock hand passes, and are removed in bulk
+// by purge_expired.  Until then they count towards size().
+//
+// Template parameters are as for ConcurrentHashMap, plus:
+//   Clock -- time source for expiry (default std::chrono::steady_clock)
+// =========================================================================
+template <typename Key,
+          typename Value,
+          typename Hash     = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>,
+          uint8_t  ShardBits = 6,
+          typename Mutex    = detail::SpinLock,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>,
+          typename Clock    = std::chrono::steady_clock>
+class ConcurrentCache {
+    using Rep = typename Clock::rep;
+    using Entry = detail::CacheEntry<Value, Rep>;
+    using ShardType = detail::Shard<Key, Entry, Hash, KeyEqual, Mutex,
+                                    Allocator>;
+
+public:
+    // Default shard count.
+    static constexpr size_t kNumShards = size_t{1} << ShardBits;
+
+    using allocator_type = Allocator;
+    using clock_type = Clock;
+
+    // ------------------------------------------------------------------
+    // Construction / Destruction
+    // ------------------------------------------------------------------
+
+    /// A cache of at most capacity entries (at least one per shard).
+    explicit ConcurrentCache(size_t capacity,
+                             const CacheOptions& options = CacheOptions(),
+                             const Allocator& alloc = Allocator())
+        : epoch_(options.reclaim, options.reclaim_interval)
+        , default_ttl_(options.default_ttl), alloc_(alloc) {
+        size_t n = detail::next_power_of_2(
+            options.shards ? options.shards : kNumShards);
+        while (n > 1 && n > capacity) n >>= 1;
+        depth_ = detail::log2_pow2(n);
+        num_shards_ = n;
+        per_shard_ = capacity / n + (capacity % n != 0 ? 1 : 0);
+        if (per_shard_ == 0) per_shard_ = 1;
+
+        void* p = detail::cache_line_alloc(n * sizeof(CacheShard));
+        shards_ = static_cast<CacheShard*>(p);
+        for (size_t i = 0; i < n; ++i) {
+            CacheShard* c = new (&shards_[i]) CacheShard();
+            c->shard.init(detail::numa_node_for_shard(options.numa, i, n),
+                          alloc_);
+            c->shard.reserve(per_shard_, epoch_);
+        }
+    }
+
+    ~ConcurrentCache() {
+        for (size_t i = 0; i < num_shards_; ++i) shards_[i].~CacheShard();
+        detail::cache_line_free(shards_);
+    }
+
+    // Non-copyable, non-movable.
+    ConcurrentCache(const ConcurrentCache&) = delete;
+    ConcurrentCache& operator=(const ConcurrentCache&) = delete;
+    ConcurrentCache(ConcurrentCache&&) = delete;
+    ConcurrentCache& operator=(ConcurrentCache&&) = delete;
+
+    // ------------------------------------------------------------------
+    // Lock-free reads
+    // ------------------------------------------------------------------
+
+    /// Look up a key and mark it recently used.  Returns {value, true}
+    /// if present and unexpired, {Value(), false} otherwise.
+    CHM_NO_TSAN
+    std::pair<Value, bool> find(const Key& key) const {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        const CacheShard& c = shard_for(h);
+        std::pair<Value, bool> result(Value(), false);
+        uint8_t lap = c.lap.load(std::memory_order_relaxed);
+        // read may run on a torn window that the lookup then retries, so
+        // its result only counts if the lookup ends in a hit.
+        bool found = c.shard.find_with(h, key, [&](const Entry& e) {
+            result.second = !expired(e);
+            if (!result.second) return;
+            result.first = e.value;
+            // Test before set: a hot entry is usually stamped already,
+            // and the load leaves its cache line shared.
+            if (e.load_stamp() != lap) {
+                e.stamp.store(lap, std::memory_order_relaxed);
+            }
+        });
+        if (!found || !result.second) return {Value(), false};
+        return result;
+    }
+
+    /// Whether key is present and unexpired, without marking it used.
+    CHM_NO_TSAN
+    bool contains(const Key& key) const {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        bool live = false;
+        bool found = shard_for(h).shard.find_with(h, key,
+                                                  [&live](const Entry& e) {
+            live = !expired(e);
+        });
+        return found && live;
+    }
+
+    // ------------------------------------------------------------------
+    // Locked writes
+    //
+    // A write that adds a key to a full shard first evicts one entry
+    // from it.  ttl is measured from the write; a zero ttl never expires,
+    // and the overloads without one use CacheOptions::default_ttl.
+    // ------------------------------------------------------------------
+
+    /// Insert if the key is absent or expired.  Returns true if inserted.
+    bool insert(const Key& key, Value value) {
+        return write(key, std::move(value), default_ttl_, false);
+    }
+    bool insert(const Key& key, Value value, std::chrono::nanoseconds ttl) {
+        return write(key, std::move(value), ttl, false);
+    }
+
+    /// Insert or overwrite, restarting the entry's ttl.  Returns true if
+    /// the key was absent or expired.
+    bool insert_or_assign(const Key& key, Value value) {
+        return write(key, std::move(value), default_ttl_, true);
+    }
+    bool insert_or_assign(const Key& key, Value value,
+                          std::chrono::nanoseconds ttl) {
+        return write(key, std::move(value), ttl, true);
+    }
+
+    /// Erase a key, expired or not.  Returns true if it was present.
+    bool erase(const Key& key) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        CacheShard& c = shard_for(h);
+        std::lock_guard<Mutex> lk(c.shard.mutex());
+        return c.shard.erase_no_shrink(h, key, epoch_);
+    }
+
+    /// Erase every expired entry now, shard by shard.  Returns how many
+    /// were erased.
+    size_t purge_expired() {
+        detail::EpochGuard guard(epoch_);
+        size_t erased = 0;
+        for (size_t i = 0; i < num_shards_; ++i) {
+            ShardType& s = shards_[i].shard;
+            std::lock_guard<Mutex> lk(s.mutex());
+            erased += s.erase_if([](size_t, const Key&, const Entry& e) {
+                return expired(e);
+            }, epoch_);
+        }
+        return erased;
+    }
+
+    // ------------------------------------------------------------------
+    // Utility
+    // ------------------------------------------------------------------
+
+    /// Approximate number of entries, including expired ones not yet
+    /// evicted or purged.
+    size_t size() const {
+        size_t total = 0;
+        for (size_t i = 0; i < num_shards_; ++i) {
+            total += shards_[i].shard.size();
+        }
+        return total;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    /// Upper bound on size(): the per-shard limit times the shard count.
+    size_t capacity() const { return per_shard_ * num_shards_; }
+
+    size_t shard_count() const { return num_shards_; }
+
+    /// Remove every entry; each shard keeps its reserved capacity.
+    void clear() {
+        detail::EpochGuard guard(epoch_);
+        for (size_t i = 0; i < num_shards_; ++i) {
+            ShardType& s = shards_[i].shard;
+            s.clear(epoch_);
+            s.reserve(per_shard_, epoch_);
+        }
+    }
+
+    /// As ConcurrentHashMap::collect.
+    size_t collect() { return epoch_.collect(); }
+
+    allocator_type get_allocator() const { return alloc_; }
+
+private:
+    // A shard with its CLOCK state.  hand counts the slots the hand has
+    // passed and lap is hand's revolution count; both change only under
+    // the shard lock, and readers load lap to stamp entries.
+    struct CacheShard {
+        ShardType            shard;
+        std::atomic<uint8_t> lap{0};
+        size_t               hand = 0;
+    };
+
+    // Declared before the shards, which retire into it (see
+    // ConcurrentHashMap::epoch_).
+    mutable detail::EpochManager epoch_;
+
+    CacheShard*              shards_ = nullptr;
+    size_t                   num_shards_ = 0;
+    unsigned                 depth_ = 0;
+    size_t                   per_shard_ = 0;
+    std::chrono::nanoseconds default_ttl_;
+
+    detail::MixedHash<Key, Hash> hash_;
+    Allocator alloc_;
+
+    CacheShard& shard_for(size_t hash) {
+        return shards_[detail::shard_index(hash, depth_)];
+    }
+    const CacheShard& shard_for(size_t hash) const {
+        return shards_[detail::shard_index(hash, depth_)];
+    }
+
+    static Rep now() { return Clock::now().time_since_epoch().count(); }
+
+    // The clock is only read for entries that can expire.
+    static bool expired(const Entry& e) {
+        return e.expires != 0 && e.expires <= now();
+    }
+
+    static Rep deadline(std::chrono::nanoseconds ttl) {
+        if (ttl.count() <= 0) return 0;
+        Rep t = (Clock::now() + std::chrono::duration_cast<
+                     typename Clock::duration>(ttl)).time_since_epoch().count();
+        return t != 0 ? t : 1;
+    }
+
+    bool write(const Key& key, Value&& value, std::chrono::nanoseconds ttl,
+               bool assign) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        CacheShard& c = shard_for(h);
+        Rep expires = deadline(ttl);
+
+        std::lock_guard<Mutex> lk(c.shard.mutex());
+        uint8_t lap = c.lap.load(std::memory_order_relaxed);
+        bool live = false;
+        bool present = c.shard.find_with(h, key, [&live](const Entry& e) {
+            live = !expired(e);
+        });
+        if (present) {
+            if (live && !assign) return false;
+            c.shard.insert_or_assign(h, key,
+                                     Entry(std::move(value), expires, lap),
+                                     epoch_);
+            return !live;
+        }
+        if (c.shard.size() >= per_shard_) lap = evict(c);
+        c.shard.insert(h, key,
+                       Entry(std::move(value), expires,
+                             static_cast<uint8_t>(lap - 2)),
+                       epoch_);
+        return true;
+    }
+
+    // Advance the hand to the next entry that is expired or was not
+    // stamped this lap or the last, evict it and return the lap the hand
+    // is on.  If readers keep every entry fresh, the entry after two
+    // laps' worth of candidates goes regardless.
+    uint8_t evict(CacheShard& c) {
+        size_t budget = 2 * c.shard.size();
+        unsigned shift = detail::log2_pow2(c.shard.capacity());
+        uint8_t lap = c.lap.load(std::memory_order_relaxed);
+        c.shard.evict_next(c.hand, [&](size_t, const Key&, const Entry& e) {
+            // evict_next advances c.hand as it goes, and leaves it on
+            // the evicted slot.
+            lap = static_cast<uint8_t>(c.hand >> shift);
+            if (expired(e) || budget-- == 0) return false;
+            return static_cast<uint8_t>(lap - e.load_stamp()) < 2;
+        }, epoch_);
+        c.lap.store(lap, std::memory_order_relaxed);
+        return lap;
+    }
+};
+
+}  // namespace concurrent_hashmap
@@ -1,12 +1,30 @@
 #pragma once
 
-#include <array>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
 #include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
+#include <concurrent_hashmap/async.h>
+#include <concurrent_hashmap/frozen_hashmap.h>
+#include <concurrent_hashmap/hash.h>
+#include <concurrent_hashmap/snapshot.h>
+#include <concurrent_hashmap/stats.h>
+#include <concurrent_hashmap/traits.h>
+#include <concurrent_hashmap/types.h>
 #include <concurrent_hashmap/detail/epoch.h>
 #include <concurrent_hashmap/detail/hash_utils.h>
 #include <concurrent_hashmap/detail/shard.h>
@@ -25,24 +43,77 @@ namespace concurrent_hashmap {
 //   Value     -- mapped value type
 //   Hash      -- hash function (default: std::hash<Key>)
 //   KeyEqual  -- key equality predicate (default: std::equal_to<Key>)
-//   ShardBits -- log2 of the number of shards (default: 6 => 64 shards)
+//   ShardBits -- log2 of the default number of shards (default: 6 => 64
+//                shards); MapOptions::shards overrides it at run time
 //   Mutex     -- per-shard mutex type (default: detail::SpinLock)
+//   Allocator -- allocator for table memory, rebound to the internal slot
+//                and control-byte types (default: std::allocator)
+//   Stats     -- instrumentation policy (default: NoStats, which compiles
+//                to nothing); CountingStats records the counters that
+//                stats() reports (see stats.h)
 // =========================================================================
 template <typename Key,
           typename Value,
           typename Hash     = std::hash<Key>,
           typename KeyEqual = std::equal_to<Key>,
           uint8_t  ShardBits = 6,
-          typename Mutex    = detail::SpinLock>
+          typename Mutex    = detail::SpinLock,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>,
+          typename Stats    = NoStats>
 class ConcurrentHashMap {
 public:
+    // Default shard count; see shard_count() for the actual one.
     static constexpr size_t kNumShards = size_t{1} << ShardBits;
 
+    using allocator_type = Allocator;
+    using frozen_type = FrozenHashMap<Key, Value, Hash, KeyEqual, Allocator>;
+
     // ------------------------------------------------------------------
     // Construction / Destruction
     // ------------------------------------------------------------------
-    ConcurrentHashMap() = default;
-    ~ConcurrentHashMap() = default;
+    ConcurrentHashMap() : ConcurrentHashMap(MapOptions()) {}
+
+    /// Construct with options; see MapOptions.  options.shards sets the
+    /// shard count, and options.max_shards lets hot shards split later.
+    /// With a NUMA policy other than none, each shard's tables are
+    /// allocated on the node the policy assigns to it (see
+    /// shard_numa_node).  Every table is allocated from a copy of alloc.
+    /// options.reclaim picks who frees retired tables (see collect).
+    explicit ConcurrentHashMap(const MapOptions& options,
+                               const Allocator& alloc = Allocator())
+        : epoch_(options.reclaim, options.reclaim_interval)
+        , alloc_(alloc), numa_(options.numa)
+        , split_threshold_(options.split_threshold)
+        , combining_(options.flat_combining &&
+                     detail::has_try_lock<Mutex>::value) {
+        size_t n = detail::next_power_of_2(
+            options.shards ? options.shards : kNumShards);
+        size_t max = options.max_shards > n
+                     ? detail::next_power_of_2(options.max_shards) : n;
+        unsigned depth = detail::log2_pow2(n);
+        max_depth_ = detail::log2_pow2(max);
+
+        shards_.reset(new ShardType*[max]);
+        Directory* dir = new Directory(depth);
+        for (size_t i = 0; i < n; ++i) {
+            ShardType* s = new_shard(
+                detail::numa_node_for_shard(numa_, i, n));
+            s->set_directory_info(i, depth);
+            shards_[i] = s;
+            dir->entries[i] = s;
+        }
+        num_shards_.store(n, std::memory_order_relaxed);
+        dir_.store(dir, std::memory_order_release);
+    }
+
+    explicit ConcurrentHashMap(const Allocator& alloc)
+        : ConcurrentHashMap(MapOptions(), alloc) {}
+
+    ~ConcurrentHashMap() {
+        size_t n = num_shards_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < n; ++i) delete_shard(shards_[i]);
+        delete dir_.load(std::memory_order_relaxed);
+    }
 
     // Non-copyable, non-movable.
     ConcurrentHashMap(const ConcurrentHashMap&) = delete;
@@ -58,14 +129,25 @@ public:
     std::pair<Value, bool> find(const Key& key) const {
         detail::EpochGuard guard(epoch_);
         size_t h = hash_(key);
-        return shard_for(h).find(h, key);
+        return find_routed(h, key, NodeValues());
+    }
+
+    /// Look up a key and assign its value into out.  Returns true if found.
+    /// Lets a reader reuse out's storage across lookups; on a miss out is
+    /// left in a valid but unspecified state.
+    bool find_into(const Key& key, Value& out) const {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        return read_routed(h, [&](const ShardType& s) {
+            return s.find_into(h, key, out);
+        });
     }
 
     /// Returns true if the key exists.
     bool contains(const Key& key) const {
         detail::EpochGuard guard(epoch_);
         size_t h = hash_(key);
-        return shard_for(h).contains(h, key);
+        return contains_routed(h, key);
     }
 
     /// Returns 0 or 1 (like std::unordered_map::count for unique keys).
@@ -73,6 +155,81 @@ public:
         return contains(key) ? 1 : 0;
     }
 
+    // Heterogeneous lookup: when Hash and KeyEqual both define
+    // is_transparent, any key-like K they accept can be used without
+    // constructing a Key (e.g. a string view for std::string keys).
+
+    template <typename K, typename H = Hash,
+              typename = typename std::enable_if<
+                  detail::is_transparent_lookup<H, KeyEqual>::value>::type>
+    std::pair<Value, bool> find(const K& key) const {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        return find_routed(h, key, NodeValues());
+    }
+
+    template <typename K, typename H = Hash,
+              typename = typename std::enable_if<
+                  detail::is_transparent_lookup<H, KeyEqual>::value>::type>
+    bool find_into(const K& key, Value& out) const {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        return read_routed(h, [&](const ShardType& s) {
+            return s.find_into(h, key, out);
+        });
+    }
+
+    template <typename K, typename H = Hash,
+              typename = typename std::enable_if<
+                  detail::is_transparent_lookup<H, KeyEqual>::value>::type>
+    bool contains(const K& key) const {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        return contains_routed(h, key);
+    }
+
+    template <typename K, typename H = Hash,
+              typename = typename std::enable_if<
+                  detail::is_transparent_lookup<H, KeyEqual>::value>::type>
+    size_t count(const K& key) const {
+        return contains(key) ? 1 : 0;
+    }
+
+    // ------------------------------------------------------------------
+    // ValueRef -- a value read in place, in its node (node_values maps
+    // only; see traits.h).  It pins the epoch while it lives, so the node
+    // survives the entry being erased or replaced meanwhile and keeps
+    // showing the value that was looked up.  Keep it short-lived, since
+    // the pin holds back reclamation, and destroy it on the thread that
+    // created it.
+    // ------------------------------------------------------------------
+    class ValueRef {
+    public:
+        explicit operator bool() const { return value_ != nullptr; }
+        const Value& operator*() const { return *value_; }
+        const Value* operator->() const { return value_; }
+        const Value* get() const { return value_; }
+
+    private:
+        friend class ConcurrentHashMap;
+        ValueRef(detail::EpochGuard&& guard, const Value* value)
+            : guard_(std::move(guard)), value_(value) {}
+
+        detail::EpochGuard guard_;
+        const Value*       value_;
+    };
+
+    /// Look up a key without copying its value.  The ValueRef is empty if
+    /// the key is absent.
+    template <bool N = node_values<Key, Value>::value,
+              typename = typename std::enable_if<N>::type>
+    ValueRef find_ref(const Key& key) const {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        const Value* found = find_ref_routed(h, key);
+        return ValueRef(std::move(guard), found);
+    }
+
     // ------------------------------------------------------------------
     // Locked writes
     // ------------------------------------------------------------------
@@ -81,21 +238,103 @@ public:
     bool insert(const Key& key, const Value& value) {
         detail::EpochGuard guard(epoch_);
         size_t h = hash_(key);
-        return shard_for(h).insert(h, key, value, epoch_);
+        if (ShardType::kAtomicSlots && contains_routed(h, key)) return false;
+        return locked(h, [&](ShardType& s) {
+            return s.insert(h, key, value, epoch_);
+        });
+    }
+
+    /// Move-aware inserts: rvalue arguments are moved into the slot and
+    /// left untouched if the key already exists.
+    bool insert(const Key& key, Value&& value) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        if (ShardType::kAtomicSlots && contains_routed(h, key)) return false;
+        return locked(h, [&](ShardType& s) {
+            return s.insert(h, key, std::move(value), epoch_);
+        });
+    }
+
+    bool insert(Key&& key, Value&& value) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        if (ShardType::kAtomicSlots && contains_routed(h, key)) return false;
+        return locked(h, [&](ShardType& s) {
+            return s.insert(h, std::move(key), std::move(value), epoch_);
+        });
     }
 
     /// Erase a key.  Returns true if the key was found and erased.
     bool erase(const Key& key) {
         detail::EpochGuard guard(epoch_);
         size_t h = hash_(key);
-        return shard_for(h).erase(h, key, epoch_);
+        return locked(h, [&](ShardType& s) { return s.erase(h, key, epoch_); });
+    }
+
+    /// Heterogeneous erase (requires transparent Hash and KeyEqual).
+    template <typename K, typename H = Hash,
+              typename = typename std::enable_if<
+                  detail::is_transparent_lookup<H, KeyEqual>::value>::type>
+    bool erase(const K& key) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        return locked(h, [&](ShardType& s) { return s.erase(h, key, epoch_); });
     }
 
     /// Insert or update.  Returns true if newly inserted, false if updated.
     bool insert_or_assign(const Key& key, const Value& value) {
         detail::EpochGuard guard(epoch_);
         size_t h = hash_(key);
-        return shard_for(h).insert_or_assign(h, key, value, epoch_);
+        if (assign_lock_free(h, key, value)) return false;
+        return locked(h, [&](ShardType& s) {
+            return s.insert_or_assign(h, key, value, epoch_);
+        });
+    }
+
+    /// Move-aware insert_or_assign: the value is move-assigned over an
+    /// existing entry or moved into a new slot.
+    bool insert_or_assign(const Key& key, Value&& value) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        if (assign_lock_free(h, key, value)) return false;
+        return locked(h, [&](ShardType& s) {
+            return s.insert_or_assign(h, key, std::move(value), epoch_);
+        });
+    }
+
+    bool insert_or_assign(Key&& key, Value&& value) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        if (assign_lock_free(h, key, value)) return false;
+        return locked(h, [&](ShardType& s) {
+            return s.insert_or_assign(h, std::move(key), std::move(value),
+                                      epoch_);
+        });
+    }
+
+    /// Construct Value(args...) for key if it is absent.  Returns true if
+    /// inserted.  The value is built once, under the shard lock, only when
+    /// the key is missing, then moved into its slot.
+    template <typename... Args>
+    bool emplace(const Key& key, Args&&... args) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        return locked(h, [&](ShardType& s) {
+            return s.try_emplace(
+                h, key, [&]() { return Value(std::forward<Args>(args)...); },
+                epoch_);
+        });
+    }
+
+    template <typename... Args>
+    bool emplace(Key&& key, Args&&... args) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        return locked(h, [&](ShardType& s) {
+            return s.try_emplace(
+                h, std::move(key),
+                [&]() { return Value(std::forward<Args>(args)...); }, epoch_);
+        });
     }
 
     /// Try to emplace using a factory.  Returns true if inserted; factory is
@@ -104,14 +343,18 @@ public:
     bool try_emplace(const Key& key, F&& factory) {
         detail::EpochGuard guard(epoch_);
         size_t h = hash_(key);
-        return shard_for(h).try_emplace(h, key, std::forward<F>(factory), epoch_);
+        return locked(h, [&](ShardType& s) {
+            return s.try_emplace(h, key, factory, epoch_);
+        });
     }
 
     /// Return existing value, or insert default_value and return it.
     Value get_or_set(const Key& key, const Value& default_value) {
         detail::EpochGuard guard(epoch_);
         size_t h = hash_(key);
-        return shard_for(h).get_or_set(h, key, default_value, epoch_);
+        return locked(h, [&](ShardType& s) {
+            return s.get_or_set(h, key, default_value, epoch_);
+        });
     }
 
     /// Return existing value, or call factory(), insert result, and return it.
@@ -123,7 +366,285 @@ public:
     Value get_or_set(const Key& key, F&& factory) {
         detail::EpochGuard guard(epoch_);
         size_t h = hash_(key);
-        return shard_for(h).get_or_set_f(h, key, std::forward<F>(factory), epoch_);
+        return locked(h, [&](ShardType& s) {
+            return s.get_or_set_f(h, key, factory, epoch_);
+        });
+    }
+
+    // ------------------------------------------------------------------
+    // Atomic read-modify-write
+    //
+    // The functor runs on the stored value under the shard lock, bracketed
+    // by the slot's seqlock, so it is atomic with respect to other writers
+    // and lock-free readers see either the old or the new value.  Keep
+    // functors short: they hold up every writer on the shard.
+    // ------------------------------------------------------------------
+
+    /// Call fn(Value&) on the value for key.  Returns false if absent.
+    template <typename F>
+    bool update(const Key& key, F&& fn) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        if (update_lock_free(h, key, fn)) return true;
+        return locked(h, [&](ShardType& s) {
+            return s.update(h, key, fn, epoch_);
+        });
+    }
+
+    /// Call fn(Value&) on the existing value, or insert init if the key is
+    /// absent (fn is not called then).  Returns true if init was inserted.
+    template <typename F>
+    bool upsert(const Key& key, const Value& init, F&& fn) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        if (update_lock_free(h, key, fn)) return false;
+        return locked(h, [&](ShardType& s) {
+            return s.upsert(h, key, init, fn, epoch_);
+        });
+    }
+
+    template <typename F>
+    bool upsert(const Key& key, Value&& init, F&& fn) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        if (update_lock_free(h, key, fn)) return false;
+        return locked(h, [&](ShardType& s) {
+            return s.upsert(h, key, std::move(init), fn, epoch_);
+        });
+    }
+
+    /// Call fn(Value& value, bool exists) and act on the ComputeAction it
+    /// returns.  For an absent key, value is default-constructed and
+    /// inserted on ComputeAction::keep; ComputeAction::erase removes an
+    /// existing entry.  Returns true if the key is present afterwards.
+    template <typename F>
+    bool compute(const Key& key, F&& fn) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        return locked(h, [&](ShardType& s) {
+            return s.compute(h, key, fn, epoch_);
+        });
+    }
+
+    /// Add delta to the value for key, inserting delta if the key is
+    /// absent.  Returns the previous value (Value() if newly inserted).
+    /// For atomic-slot maps (see traits.h) an existing key is updated
+    /// without taking the shard lock.
+    template <typename V = Value,
+              typename = typename std::enable_if<
+                  std::is_arithmetic<V>::value>::type>
+    Value fetch_add(const Key& key, Value delta) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        Value prev = Value();
+        auto add = [&](Value& v) { prev = v; v += delta; };
+        if (update_lock_free(h, key, add)) return prev;
+        locked(h, [&](ShardType& s) {
+            return s.upsert(h, key, delta, add, epoch_);
+        });
+        return prev;
+    }
+
+    // ------------------------------------------------------------------
+    // Non-blocking writes
+    //
+    // Each try_ write takes the shard lock with try_lock and returns
+    // TryResult::would_block, having done nothing, if another thread
+    // holds it -- e.g. while that thread rebuilds the shard's table.  They
+    // skip the lock-free paths of atomic-slot maps, which wait out a
+    // resize, and split a shard only if no other split is under way.
+    // Requires a Mutex with try_lock.  With C++20 coroutines, async_
+    // forms that suspend instead of returning would_block follow.
+    // ------------------------------------------------------------------
+
+    /// insert without waiting: yes if inserted, no if the key exists.
+    TryResult try_insert(const Key& key, const Value& value) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        return try_locked(h, [&](ShardType& s) {
+            return s.insert(h, key, value, epoch_);
+        });
+    }
+
+    /// insert_or_assign without waiting: yes if inserted, no if updated.
+    TryResult try_insert_or_assign(const Key& key, const Value& value) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        return try_locked(h, [&](ShardType& s) {
+            return s.insert_or_assign(h, key, value, epoch_);
+        });
+    }
+
+    /// erase without waiting: yes if erased, no if the key was absent.
+    TryResult try_erase(const Key& key) {
+        detail::EpochGuard guard(epoch_);
+        size_t h = hash_(key);
+        return try_locked(h, [&](ShardType& s) {
+            return s.erase(h, key, epoch_);
+        });
+    }
+
+#if defined(CHM_HAS_COROUTINES)
+    /// co_await map.async_insert(key, value, schedule) -- try_insert that
+    /// suspends the coroutine while the shard is locked, retrying in
+    /// tasks handed to schedule (see WriteAwaitable in async.h).  Yields
+    /// insert's bool.  key and value are copied into the awaitable.
+    template <typename Schedule>
+    auto async_insert(const Key& key, const Value& value,
+                      Schedule schedule) {
+        return detail::make_write_awaitable(
+            [this, key, value] { return try_insert(key, value); },
+            std::move(schedule));
+    }
+
+    template <typename Schedule>
+    auto async_insert_or_assign(const Key& key, const Value& value,
+                                Schedule schedule) {
+        return detail::make_write_awaitable(
+            [this, key, value] { return try_insert_or_assign(key, value); },
+            std::move(schedule));
+    }
+
+    template <typename Schedule>
+    auto async_erase(const Key& key, Schedule schedule) {
+        return detail::make_write_awaitable(
+            [this, key] { return try_erase(key); }, std::move(schedule));
+    }
+#endif
+
+    // ------------------------------------------------------------------
+    // Batched operations
+    //
+    // Each call pins the epoch once and hashes keys a chunk at a time.
+    // Lookups prefetch every home slot of the chunk before probing; writes
+    // group the chunk by shard and take each shard's lock once per group.
+    // Results go to caller-provided arrays, so nothing is allocated.
+    // ------------------------------------------------------------------
+
+    /// Look up keys[0..n).  values[i] and found[i] receive the result for
+    /// keys[i] (values[i] is unspecified when found[i] is false).
+    /// Returns the number of keys found.
+    size_t find_many(const Key* keys, size_t n, Value* values,
+                     bool* found) const {
+        detail::EpochGuard guard(epoch_);
+        size_t hits = 0;
+        size_t hashes[kBatchChunk];
+        for (size_t base = 0; base < n; base += kBatchChunk) {
+            size_t m = chunk_size(base, n);
+            for (size_t i = 0; i < m; ++i) {
+                hashes[i] = hash_(keys[base + i]);
+                shard_for(hashes[i]).prefetch(hashes[i]);
+            }
+            for (size_t i = 0; i < m; ++i) {
+                size_t idx = base + i;
+                found[idx] = read_routed(hashes[i], [&](const ShardType& s) {
+                    return s.find_into(hashes[i], keys[idx], values[idx]);
+                });
+                hits += found[idx] ? 1 : 0;
+            }
+        }
+        return hits;
+    }
+
+    /// Insert (keys[i], values[i]) for i in [0, n).  inserted, if non-null,
+    /// receives the per-key result.  Returns the number inserted.
+    size_t insert_many(const Key* keys, const Value* values, size_t n,
+                       bool* inserted = nullptr) {
+        detail::EpochGuard guard(epoch_);
+        size_t done = 0;
+        detail::BatchItem items[kBatchChunk];
+        for (size_t base = 0; base < n; base += kBatchChunk) {
+            const Directory* dir = dir_.load(std::memory_order_acquire);
+            size_t m = group_by_shard(dir, keys, base, chunk_size(base, n),
+                                      items);
+            for (size_t i = 0; i < m;) {
+                size_t run = shard_run(dir, items, i, m);
+                done += locked_run(dir, items + i, run,
+                    [&](ShardType& s, const detail::BatchItem* it, size_t c) {
+                        return s.insert_batch(it, c, keys, values, inserted,
+                                              epoch_);
+                    });
+                i += run;
+            }
+        }
+        return done;
+    }
+
+    /// Erase keys[0..n).  erased, if non-null, receives the per-key
+    /// result.  Returns the number erased.
+    size_t erase_many(const Key* keys, size_t n, bool* erased = nullptr) {
+        detail::EpochGuard guard(epoch_);
+        size_t done = 0;
+        detail::BatchItem items[kBatchChunk];
+        for (size_t base = 0; base < n; base += kBatchChunk) {
+            const Directory* dir = dir_.load(std::memory_order_acquire);
+            size_t m = group_by_shard(dir, keys, base, chunk_size(base, n),
+                                      items);
+            for (size_t i = 0; i < m;) {
+                size_t run = shard_run(dir, items, i, m);
+                done += locked_run(dir, items + i, run,
+                    [&](ShardType& s, const detail::BatchItem* it, size_t c) {
+                        return s.erase_batch(it, c, keys, erased, epoch_);
+                    });
+                i += run;
+            }
+        }
+        return done;
+    }
+
+    // ------------------------------------------------------------------
+    // Bulk loading
+    //
+    // bulk_load inserts a whole range without going through insert: the
+    // entries are hashed and partitioned by shard, then each shard builds
+    // one table sized for everything it receives and publishes it with a
+    // single swap, so there is no per-entry lock, duplicate probe of a
+    // growing table, or resize.  Hashing, partitioning and building run
+    // on `tasks` concurrent workers; exec(task) must run the void()
+    // callable task on some thread, as for parallel_for_each.  The
+    // partition takes 16 bytes per entry while the load runs.
+    //
+    // The map stays usable throughout.  Lookups in a shard that already
+    // held entries retry while those move to the new table (as during a
+    // resize), and writers to a shard wait while it is built.  With
+    // max_shards set, a loaded shard splits at most once; later writes
+    // split it further.  Entries are copied from the range; if a copy
+    // throws, shards already built keep their entries and the first
+    // exception is rethrown.
+    // ------------------------------------------------------------------
+
+    /// Insert the entries of [first, last), a random-access range of
+    /// std::pair<Key, Value> (or anything with .first and .second), as
+    /// insert would: a key already present, or repeated in the range,
+    /// keeps its first value.  Returns the number inserted.
+    template <typename RandomIt, typename Executor>
+    size_t bulk_load(RandomIt first, RandomIt last, Executor&& exec,
+                     size_t tasks) {
+        return bulk_load_impl<false>(first, last, exec, tasks);
+    }
+
+    /// bulk_load on one std::thread per hardware thread.
+    template <typename RandomIt>
+    size_t bulk_load(RandomIt first, RandomIt last) {
+        ThreadExecutor exec;
+        return bulk_load_impl<false>(first, last, exec,
+                                     exec.hardware_threads());
+    }
+
+    /// bulk_load for a range whose keys are distinct and not yet in the
+    /// map, which skips the duplicate checks.  A key that breaks this is
+    /// stored twice, and which copy find returns is unspecified.
+    template <typename RandomIt, typename Executor>
+    size_t bulk_load_unique(RandomIt first, RandomIt last, Executor&& exec,
+                            size_t tasks) {
+        return bulk_load_impl<true>(first, last, exec, tasks);
+    }
+
+    template <typename RandomIt>
+    size_t bulk_load_unique(RandomIt first, RandomIt last) {
+        ThreadExecutor exec;
+        return bulk_load_impl<true>(first, last, exec,
+                                    exec.hardware_threads());
     }
 
     // ------------------------------------------------------------------
@@ -133,8 +654,9 @@ public:
     /// Approximate total size (sum of all shard sizes with relaxed loads).
     size_t size() const {
         size_t total = 0;
-        for (size_t i = 0; i < kNumShards; ++i) {
-            total += shards_[i].size();
+        size_t n = shard_count();
+        for (size_t i = 0; i < n; ++i) {
+            total += shards_[i]->size();
         }
         return total;
     }
@@ -147,38 +669,927 @@ public:
     /// Clear all shards.
     void clear() {
         detail::EpochGuard guard(epoch_);
-        for (size_t i = 0; i < kNumShards; ++i) {
-            shards_[i].clear(epoch_);
+        size_t n = shard_count();
+        for (size_t i = 0; i < n; ++i) {
+            shards_[i]->clear(epoch_);
         }
     }
 
     /// Reserve capacity distributed evenly across shards.
     void reserve(size_t count) {
         detail::EpochGuard guard(epoch_);
-        size_t per_shard = count / kNumShards + (count % kNumShards != 0 ? 1 : 0);
-        for (size_t i = 0; i < kNumShards; ++i) {
-            shards_[i].reserve(per_shard, epoch_);
+        size_t n = shard_count();
+        size_t per_shard = count / n + (count % n != 0 ? 1 : 0);
+        for (size_t i = 0; i < n; ++i) {
+            shards_[i]->reserve(per_shard, epoch_);
+        }
+    }
+
+    /// Free retired tables that no reader can still see, and return how
+    /// many objects were freed.  With Reclamation::manual this is the
+    /// only place they are freed; a thread's own recent retirements are
+    /// handed over first.  Returns 0 if another thread is collecting.
+    size_t collect() {
+        return epoch_.collect();
+    }
+
+    /// Copy every entry into an immutable, densely packed FrozenHashMap
+    /// with wait-free lookups (see frozen_hashmap.h).  Each shard is
+    /// copied under its lock, so the result is consistent per shard; a
+    /// split that lands meanwhile restarts the copy.  Concurrent writers
+    /// are only held up one shard at a time.
+    frozen_type freeze() const {
+        detail::EpochGuard guard(epoch_);
+        std::vector<std::pair<Key, Value>> entries;
+        for (;;) {
+            entries.clear();
+            entries.reserve(size());
+            size_t n = shard_count();
+            for (size_t i = 0; i < n; ++i) {
+                ShardType& s = *shards_[i];
+                std::lock_guard<ShardLock> lk(s.mutex());
+                s.for_each_locked([&](const Key& k, const Value& v) {
+                    entries.emplace_back(k, v);
+                });
+            }
+            // A split moves entries to a shard past n, possibly after
+            // they were copied from its source.
+            if (shard_count() == n) break;
+        }
+        return frozen_type(std::move(entries), hash_.hasher(), KeyEqual(),
+                           alloc_);
+    }
+
+    // ------------------------------------------------------------------
+    // Scans
+    //
+    // Weakly consistent visits of every entry: each shard is visited
+    // under its lock, so a shard's entries are seen as of one moment, but
+    // writes to other shards may land before or after.  An entry present
+    // for the whole scan is visited exactly once, even if a split moves
+    // it meanwhile; one inserted or erased during the scan may or may not
+    // be.  fn(const Key&, const Value&) runs under the shard lock: it
+    // must not write to the map, and writers to that shard wait for it.
+    // ------------------------------------------------------------------
+
+    /// Visit every entry on the calling thread, one shard at a time.
+    template <typename F>
+    void for_each(F&& fn) const {
+        detail::EpochGuard guard(epoch_);
+        ScanState scan(size_t{1} << max_depth_, shard_count());
+        scan_shards(scan, fn);
+    }
+
+    /// Visit the entries of shard i, in [0, shard_count()), under its
+    /// lock.  Entries a concurrent split moves out of i are not visited.
+    template <typename F>
+    void for_each_shard(size_t i, F&& fn) const {
+        detail::EpochGuard guard(epoch_);
+        ShardType& s = *shards_[i];
+        std::lock_guard<ShardLock> lk(s.mutex());
+        s.for_each_locked(fn);
+    }
+
+    /// Visit every entry from `tasks` concurrent workers that claim
+    /// shards one at a time, so a full scan runs at memory bandwidth
+    /// rather than one core's.  exec(task) must run the void() callable
+    /// task on some thread, e.g. by posting it to a thread pool; the
+    /// calling thread works too and returns once every task has finished.
+    /// fn is called concurrently and must be thread-safe.
+    template <typename F, typename Executor>
+    void parallel_for_each(F&& fn, Executor&& exec, size_t tasks) const {
+        detail::EpochGuard guard(epoch_);
+        size_t n = shard_count();
+        ScanState scan(size_t{1} << max_depth_, n);
+        if (tasks > n) tasks = n;
+        run_tasks(exec, tasks, [&](size_t) {
+            detail::EpochGuard task_guard(epoch_);
+            scan_shards(scan, fn);
+        });
+    }
+
+    /// parallel_for_each on one std::thread per hardware thread.
+    template <typename F>
+    void parallel_for_each(F&& fn) const {
+        ThreadExecutor exec;
+        parallel_for_each(fn, exec, exec.hardware_threads());
+    }
+
+    // ------------------------------------------------------------------
+    // Snapshots
+    //
+    // save writes every shard's table in a versioned binary format (see
+    // snapshot.h); Key and Value go through snapshot_codec, which copies
+    // the bytes of trivially copyable types and can be specialised for
+    // others.  load reads such a file back, placing every entry in the
+    // same slot it was saved from, so a restart costs about one pass over
+    // the file instead of one insert (and its share of resizes) per key.
+    // ------------------------------------------------------------------
+
+    /// Write the map to path.  Shards are encoded one at a time under
+    /// their lock, so the map stays writable and the snapshot is
+    /// consistent per shard; a split that lands meanwhile restarts the
+    /// save.  The file is written beside path and renamed into place,
+    /// so a failed save leaves any earlier snapshot intact.  Returns
+    /// false if the file could not be written.
+    bool save(const char* path) const {
+        detail::EpochGuard guard(epoch_);
+        SnapshotWriter buf;
+        std::string tmp = std::string(path) + ".tmp";
+        for (;;) {
+            std::FILE* f = std::fopen(tmp.c_str(), "wb");
+            if (!f) return false;
+
+            // Count before directory: a split publishes in that order, so
+            // a directory newer than n is caught by the check below.
+            size_t n = shard_count();
+            const Directory* dir = dir_.load(std::memory_order_acquire);
+            detail::SnapshotHeader h = {};
+            std::memcpy(h.magic, detail::kSnapshotMagic, sizeof(h.magic));
+            h.version = detail::kSnapshotVersion;
+            h.flags = snapshot_flags();
+            h.key_size = sizeof(Key);
+            h.value_size = sizeof(Value);
+            h.depth = dir->depth;
+            h.shards = n;
+            buf.clear();
+            buf.write_pod(h);
+            for (const ShardType* e : dir->entries) {
+                buf.write_pod(static_cast<uint32_t>(e->id()));
+            }
+            bool ok = write_all(f, buf);
+
+            // The check is only known once a shard with an entry has
+            // been encoded; it is patched into the header afterwards.
+            bool checked = false;
+            for (size_t i = 0; ok && i < n; ++i) {
+                ShardType& s = *shards_[i];
+                buf.clear();
+                {
+                    std::lock_guard<ShardLock> lk(s.mutex());
+                    s.save_locked(buf);
+                    size_t first = 0;
+                    if (!checked && s.first_hash(first)) {
+                        h.check = static_cast<uint32_t>(first);
+                        checked = true;
+                    }
+                }
+                ok = write_all(f, buf);
+            }
+            ok = ok && std::fseek(f, static_cast<long>(
+                                         offsetof(detail::SnapshotHeader,
+                                                  check)),
+                                  SEEK_SET) == 0 &&
+                 std::fwrite(&h.check, sizeof(h.check), 1, f) == 1;
+            ok = std::fclose(f) == 0 && ok;
+            if (!ok) break;
+            if (shard_count() != n) continue;
+            if (std::rename(tmp.c_str(), path) == 0) return true;
+            break;
         }
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    /// Replace the contents of this (empty) map with a file written by
+    /// save from a map of the same type and Hash.  The file's shard
+    /// layout is restored, so it must fit within this map's max_shards
+    /// (or shard count).  Must not run concurrently with other
+    /// operations on the map.  Returns false, leaving the map unchanged,
+    /// if the map is not empty or the file is missing, from a different
+    /// version, layout or Hash, or malformed.
+    bool load(const char* path) {
+        detail::MappedFile file(path);
+        if (!file.ok() || !empty()) return false;
+        SnapshotReader in(file.data(), file.size());
+
+        detail::SnapshotHeader h;
+        size_t max = size_t{1} << max_depth_;
+        if (!in.read_pod(h) ||
+            std::memcmp(h.magic, detail::kSnapshotMagic, sizeof(h.magic)) ||
+            h.version != detail::kSnapshotVersion ||
+            h.flags != snapshot_flags() || h.key_size != sizeof(Key) ||
+            h.value_size != sizeof(Value) || h.depth > max_depth_ ||
+            h.shards == 0 || h.shards > max) {
+            return false;
+        }
+        size_t n = static_cast<size_t>(h.shards);
+
+        std::unique_ptr<Directory> dir(new Directory(h.depth));
+        std::vector<uint32_t> ids(dir->entries.size());
+        for (uint32_t& id : ids) {
+            if (!in.read_pod(id) || id >= n) return false;
+        }
+
+        detail::EpochGuard guard(epoch_);
+        std::vector<ShardType*> loaded;
+        std::vector<unsigned> depths;
+        bool ok = true, checked = false;
+        for (size_t i = 0; ok && i < n; ++i) {
+            detail::SnapshotShardHeader sh;
+            ok = in.read_pod(sh) && sh.local_depth <= h.depth;
+            if (!ok) break;
+            ShardType* s = new_shard(detail::numa_node_for_shard(numa_, i, n));
+            loaded.push_back(s);
+            depths.push_back(sh.local_depth);
+            s->set_directory_info(i, sh.local_depth);
+            size_t first = 0;
+            ok = s->load_table(in, sh, epoch_, &first);
+            if (ok && !checked && sh.entries) {
+                ok = static_cast<uint32_t>(first) == h.check;
+                checked = true;
+            }
+        }
+        ok = ok && (checked || h.check == 0) &&
+             directory_consistent(ids, depths, h.depth);
+        if (!ok) {
+            for (ShardType* s : loaded) delete_shard(s);
+            return false;
+        }
+
+        for (size_t j = 0; j < ids.size(); ++j) dir->entries[j] = loaded[ids[j]];
+        size_t old = num_shards_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < old; ++i) delete_shard(shards_[i]);
+        for (size_t i = 0; i < n; ++i) shards_[i] = loaded[i];
+        num_shards_.store(n, std::memory_order_release);
+        delete dir_.exchange(dir.release(), std::memory_order_acq_rel);
+        return true;
+    }
+
+    allocator_type get_allocator() const { return alloc_; }
+
+    /// Per-shard and total counters, read with relaxed loads while the
+    /// map runs.  Entry counts and capacities are always filled; the
+    /// rest needs an enabled Stats policy such as CountingStats.
+    MapStats stats() const {
+        MapStats out;
+        size_t n = shard_count();
+        out.shards.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            shards_[i]->collect_stats(out.shards[i]);
+            out.total += out.shards[i];
+        }
+        out.retired_pending = epoch_.retired_pending();
+        return out;
+    }
+
+    /// Current number of shards (grows only when splitting is enabled).
+    size_t shard_count() const {
+        return num_shards_.load(std::memory_order_acquire);
+    }
+
+    /// Shard that holds key, in [0, shard_count()).
+    size_t shard_of(const Key& key) const {
+        detail::EpochGuard guard(epoch_);
+        return shard_for(hash_(key)).id();
+    }
+
+    /// NUMA node the tables of shard i are placed on, or -1 if the map was
+    /// built without a NUMA policy.  Threads pinned to a node can route
+    /// work so that shard_numa_node(shard_of(key)) is local.
+    int shard_numa_node(size_t i) const {
+        return shards_[i]->numa_node();
     }
 
 private:
-    using ShardType = detail::Shard<Key, Value, Hash, KeyEqual, Mutex>;
+    using ShardType = detail::Shard<Key, Value, Hash, KeyEqual, Mutex,
+                                    Allocator, Stats>;
+    using ShardLock = typename ShardType::Lock;
+
+    // ------------------------------------------------------------------
+    // Directory -- routes the top `depth` bits of a hash to a shard.
+    //
+    // A shard of local depth d < depth owns 2^(depth - d) adjacent
+    // entries.  Splitting it (see maybe_split) publishes a new directory,
+    // so a directory never changes once published; the old one is
+    // retired through the epoch manager.
+    // ------------------------------------------------------------------
+    struct Directory : detail::EpochManager::Retired {
+        unsigned                depth;
+        std::vector<ShardType*> entries;  // 1 << depth
+
+        explicit Directory(unsigned d) : depth(d), entries(size_t{1} << d) {}
+
+        ShardType* route(size_t hash) const {
+            return entries[detail::shard_index(hash, depth)];
+        }
+    };
+
+    // ------------------------------------------------------------------
+    // ScanState -- shared by the workers of one scan.  Shards are claimed
+    // in id order; claiming never runs past shard_count(), so a sibling
+    // split off after a worker gave up is still claimed by the worker
+    // that visits its source.  depth[id] is the local depth a shard had
+    // when it was visited (-1 if not yet), which fixes the hash prefix
+    // it covered; a later shard inside a covered prefix holds only
+    // entries already visited or inserted since, and is skipped.
+    // ------------------------------------------------------------------
+    struct ScanState {
+        ScanState(size_t max_shards, size_t n)
+            : depth(max_shards, -1), initial(n) {}
+
+        std::atomic<size_t> next{0};
+        std::mutex          mutex;     // guards depth
+        std::vector<int>    depth;
+        size_t              initial;   // shards when the scan started
+    };
+
+    template <typename F>
+    void scan_shards(ScanState& scan, F& fn) const {
+        for (;;) {
+            size_t i = scan.next.load(std::memory_order_relaxed);
+            do {
+                if (i >= shard_count()) return;
+            } while (!scan.next.compare_exchange_weak(
+                i, i + 1, std::memory_order_relaxed));
+
+            ShardType& s = *shards_[i];
+            std::lock_guard<ShardLock> lk(s.mutex());
+            // Shards that existed at the start have disjoint prefixes.
+            if (i >= scan.initial && scanned(scan, s)) continue;
+            s.for_each_locked(fn);
+            std::lock_guard<std::mutex> sl(scan.mutex);
+            scan.depth[i] = static_cast<int>(s.local_depth());
+        }
+    }
+
+    // Whether s (whose lock the caller holds, so its place in the
+    // directory is fixed) lies inside a prefix some shard covered when
+    // it was visited.
+    bool scanned(ScanState& scan, const ShardType& s) const {
+        const Directory* dir = dir_.load(std::memory_order_acquire);
+        size_t self = 0;
+        while (dir->entries[self] != &s) ++self;
+        std::lock_guard<std::mutex> sl(scan.mutex);
+        for (size_t j = 0; j < dir->entries.size(); ++j) {
+            int d = scan.depth[dir->entries[j]->id()];
+            unsigned shift = dir->depth - static_cast<unsigned>(d);
+            if (d >= 0 && (j >> shift) == (self >> shift)) return true;
+        }
+        return false;
+    }
+
+    // One std::thread per task, joined on destruction.
+    struct ThreadExecutor {
+        std::vector<std::thread> threads;
+
+        void operator()(std::function<void()> task) {
+            threads.emplace_back(std::move(task));
+        }
+        static size_t hardware_threads() {
+            size_t hw = std::thread::hardware_concurrency();
+            return hw ? hw : 1;
+        }
+        ~ThreadExecutor() {
+            for (std::thread& th : threads) th.join();
+        }
+    };
+
+    // Run body(t) for every t in [0, tasks): t = 0 on the calling
+    // thread, the rest through exec.  Returns once all have finished,
+    // rethrowing the first exception one of them threw.
+    template <typename Executor, typename Body>
+    void run_tasks(Executor& exec, size_t tasks, Body&& body) const {
+        std::mutex done_mutex;
+        std::condition_variable done_cv;
+        std::exception_ptr error;
+        size_t running = tasks > 0 ? tasks - 1 : 0;
+        for (size_t t = 1; t < tasks; ++t) {
+            exec([&, t] {
+                std::exception_ptr e;
+                try {
+                    body(t);
+                } catch (...) {
+                    e = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lk(done_mutex);
+                if (e && !error) error = e;
+                if (--running == 0) done_cv.notify_one();
+            });
+        }
+        try {
+            body(0);
+        } catch (...) {
+            std::lock_guard<std::mutex> lk(done_mutex);
+            if (!error) error = std::current_exception();
+        }
+        std::unique_lock<std::mutex> lk(done_mutex);
+        done_cv.wait(lk, [&] { return running == 0; });
+        if (error) std::rethrow_exception(error);
+    }
+
+    // bulk_load: hash and count per (task, shard), scatter the entries
+    // into one array grouped by shard, then build shards as workers
+    // claim them.  A shard whose routing a concurrent split has changed
+    // since the partition takes its entries one insert at a time.
+    template <bool Unique, typename RandomIt, typename Executor>
+    size_t bulk_load_impl(RandomIt first, RandomIt last, Executor& exec,
+                          size_t tasks) {
+        static_assert(std::is_base_of<std::random_access_iterator_tag,
+                          typename std::iterator_traits<
+                              RandomIt>::iterator_category>::value,
+                      "bulk_load needs random-access iterators");
+        detail::EpochGuard guard(epoch_);
+        size_t n = static_cast<size_t>(last - first);
+        if (n == 0) return 0;
+        if (tasks == 0) tasks = 1;
+        if (tasks > n) tasks = n;
+
+        // Directory before count: a split publishes the count first, so
+        // every shard the directory names is below shards.
+        const Directory* dir = dir_.load(std::memory_order_acquire);
+        size_t shards = shard_count();
+        // Task t hashes entries [slice(t), slice(t + 1)).
+        auto slice = [&](size_t t) {
+            return n / tasks * t + (t < n % tasks ? t : n % tasks);
+        };
+
+        std::vector<size_t> offsets(tasks * shards, 0);
+        run_tasks(exec, tasks, [&](size_t t) {
+            size_t* count = &offsets[t * shards];
+            for (size_t i = slice(t), end = slice(t + 1); i < end; ++i) {
+                ++count[dir->route(hash_(first[i].first))->id()];
+            }
+        });
+        std::vector<size_t> shard_begin(shards + 1, 0);
+        size_t pos = 0;
+        for (size_t id = 0; id < shards; ++id) {
+            shard_begin[id] = pos;
+            for (size_t t = 0; t < tasks; ++t) {
+                size_t c = offsets[t * shards + id];
+                offsets[t * shards + id] = pos;
+                pos += c;
+            }
+        }
+        shard_begin[shards] = pos;
+
+        std::vector<detail::BatchItem> items(n);
+        run_tasks(exec, tasks, [&](size_t t) {
+            size_t* next = &offsets[t * shards];
+            for (size_t i = slice(t), end = slice(t + 1); i < end; ++i) {
+                size_t h = hash_(first[i].first);
+                items[next[dir->route(h)->id()]++] = detail::BatchItem{h, i};
+            }
+        });
+
+        auto entry = [&](size_t i) -> decltype(first[i]) { return first[i]; };
+        std::atomic<size_t> next_shard{0};
+        std::atomic<size_t> added{0};
+        run_tasks(exec, tasks, [&](size_t) {
+            detail::EpochGuard task_guard(epoch_);
+            size_t id;
+            while ((id = next_shard.fetch_add(1, std::memory_order_relaxed))
+                   < shards) {
+                const detail::BatchItem* it = items.data() + shard_begin[id];
+                size_t count = shard_begin[id + 1] - shard_begin[id];
+                if (count == 0) continue;
+                added.fetch_add(load_shard<Unique>(*shards_[id], dir, it,
+                                                   count, entry),
+                                std::memory_order_relaxed);
+            }
+        });
+        return added.load(std::memory_order_relaxed);
+    }
+
+    template <bool Unique, typename Get>
+    size_t load_shard(ShardType& s, const Directory* dir,
+                      const detail::BatchItem* items, size_t count,
+                      Get& entry) {
+        {
+            std::lock_guard<ShardLock> lk(s.mutex());
+            if (routes_to(s, dir, items, count)) {
+                size_t done = s.template bulk_insert<Unique>(items, count,
+                                                            entry, epoch_);
+                maybe_split(s);
+                return done;
+            }
+        }
+        size_t done = 0;
+        for (size_t i = 0; i < count; ++i) {
+            size_t h = items[i].hash;
+            const auto& e = entry(items[i].index);
+            done += locked(h, [&](ShardType& owner) {
+                return owner.insert(h, e.first, e.second, epoch_);
+            }) ? 1 : 0;
+        }
+        return done;
+    }
+
+    // Whether every item, partitioned with dir, still routes to s.  The
+    // caller holds s's lock, so s cannot split meanwhile.
+    bool routes_to(const ShardType& s, const Directory* dir,
+                   const detail::BatchItem* items, size_t count) const {
+        const Directory* now = dir_.load(std::memory_order_acquire);
+        if (now == dir) return true;
+        for (size_t i = 0; i < count; ++i) {
+            if (now->route(items[i].hash) != &s) return false;
+        }
+        return true;
+    }
+
+    static uint32_t snapshot_flags() {
+        return ShardType::kCacheHash ? detail::kSnapshotCachedHash : 0;
+    }
+
+    static bool write_all(std::FILE* f, const SnapshotWriter& buf) {
+        return std::fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+    }
+
+    // Whether a loaded directory of 2^depth entries, ids[j] naming the
+    // shard of entry j, is one the map could have built: shard i, of
+    // local depth depths[i], fills exactly one aligned run of
+    // 2^(depth - depths[i]) entries.
+    static bool directory_consistent(const std::vector<uint32_t>& ids,
+                                     const std::vector<unsigned>& depths,
+                                     unsigned depth) {
+        std::vector<size_t> count(depths.size(), 0), first(depths.size(), 0);
+        for (size_t j = 0; j < ids.size(); ++j) {
+            size_t run = size_t{1} << (depth - depths[ids[j]]);
+            if (count[ids[j]]++ == 0) first[ids[j]] = j;
+            if ((j & ~(run - 1)) != (first[ids[j]] & ~(run - 1))) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < depths.size(); ++i) {
+            if (count[i] != size_t{1} << (depth - depths[i])) return false;
+        }
+        return true;
+    }
+
+    // Keys hashed (and, for writes, grouped) per step of a batched call.
+    static constexpr size_t kBatchChunk = 512;
 
     // The epoch manager must be declared before shards so that it is
     // destroyed after the shards (shards may reference it during cleanup).
     // Mutable because const read operations still need to pin the epoch.
     mutable detail::EpochManager epoch_;
-    mutable std::array<ShardType, kNumShards> shards_;
 
-    Hash hash_;
+    // shards_ holds room for every shard the directory may grow to;
+    // entries [0, num_shards_) are live and never move.
+    std::atomic<Directory*>       dir_{nullptr};
+    std::unique_ptr<ShardType*[]> shards_;
+    std::atomic<size_t>           num_shards_{0};
+    unsigned                      max_depth_ = 0;
+    std::mutex                    split_mutex_;  // serialises splits
+
+    detail::MixedHash<Key, Hash> hash_;
+    Allocator alloc_;
+    NumaPolicy numa_;
+    size_t split_threshold_;
+    bool combining_;  // MapOptions::flat_combining
+
+    // Shards are cache-line aligned, which operator new only honours
+    // from C++17 on.
+    ShardType* new_shard(int node) {
+        void* p = detail::cache_line_alloc(sizeof(ShardType));
+        ShardType* s = new (p) ShardType();
+        s->init(node, alloc_);
+        return s;
+    }
+
+    static void delete_shard(ShardType* s) {
+        s->~ShardType();
+        detail::cache_line_free(s);
+    }
 
     // Route to the correct shard using the high bits of the hash.
     ShardType& shard_for(size_t hash) {
-        return shards_[detail::shard_index<ShardBits>(hash)];
+        return *dir_.load(std::memory_order_acquire)->route(hash);
     }
 
     const ShardType& shard_for(size_t hash) const {
-        return shards_[detail::shard_index<ShardBits>(hash)];
+        return *dir_.load(std::memory_order_acquire)->route(hash);
+    }
+
+    // Run probe(shard) on the shard routed to by hash.  A miss is only
+    // trusted if no split republished the directory meanwhile: the key
+    // may have moved to the new sibling.
+    template <typename Probe>
+    bool read_routed(size_t hash, Probe&& probe) const {
+        for (;;) {
+            const Directory* dir = dir_.load(std::memory_order_acquire);
+            if (probe(static_cast<const ShardType&>(*dir->route(hash)))) {
+                return true;
+            }
+            if (dir_.load(std::memory_order_acquire) == dir) return false;
+        }
+    }
+
+    // Inline values are copied inside the seqlock window; a node's value
+    // is copy-constructed from the node, so it need not be assignable.
+    using NodeValues = std::integral_constant<bool, ShardType::kNodeValues>;
+
+    template <typename K>
+    std::pair<Value, bool> find_routed(size_t hash, const K& key,
+                                       std::false_type) const {
+        std::pair<Value, bool> result;
+        read_routed(hash, [&](const ShardType& s) {
+            result = s.find(hash, key);
+            return result.second;
+        });
+        return result;
+    }
+    template <typename K>
+    std::pair<Value, bool> find_routed(size_t hash, const K& key,
+                                       std::true_type) const {
+        const Value* found = find_ref_routed(hash, key);
+        if (!found) return std::pair<Value, bool>(Value(), false);
+        return std::pair<Value, bool>(*found, true);
+    }
+
+    template <typename K>
+    const Value* find_ref_routed(size_t hash, const K& key) const {
+        const Value* found = nullptr;
+        read_routed(hash, [&](const ShardType& s) {
+            found = s.find_ref(hash, key);
+            return found != nullptr;
+        });
+        return found;
+    }
+
+    template <typename K>
+    bool contains_routed(size_t hash, const K& key) const {
+        return read_routed(hash, [&](const ShardType& s) {
+            return s.contains(hash, key);
+        });
+    }
+
+    // Atomic-slot fast paths (see traits.h): fn(value) on an existing
+    // entry without the shard lock.  False means "take the locked path".
+    template <typename K, typename F>
+    bool update_lock_free(size_t hash, const K& key, F& fn) {
+        return ShardType::kAtomicSlots &&
+               shard_for(hash).update_lock_free(hash, key, fn);
+    }
+
+    template <typename K, typename V>
+    bool assign_lock_free(size_t hash, const K& key, const V& value) {
+        return assign_lock_free(
+            hash, key, value,
+            std::integral_constant<bool, ShardType::kAtomicSlots>());
+    }
+    template <typename K, typename V>
+    bool assign_lock_free(size_t, const K&, const V&, std::false_type) {
+        return false;
+    }
+    template <typename K, typename V>
+    bool assign_lock_free(size_t hash, const K& key, const V& value,
+                          std::true_type) {
+        auto assign = [&](Value& v) { v = value; };
+        return update_lock_free(hash, key, assign);
+    }
+
+    // Run op(shard) under the lock of the shard that owns hash, possibly
+    // on another thread when combining.  The route is re-read once the
+    // lock is held, because a split may have moved the key while this
+    // thread waited.
+    template <typename Op>
+    auto locked(size_t hash, Op&& op)
+        -> decltype(op(std::declval<ShardType&>())) {
+        if (combining_) return combined(hash, op, detail::has_try_lock<Mutex>());
+        return locked_direct(hash, op);
+    }
+
+    template <typename Op>
+    auto locked_direct(size_t hash, Op& op)
+        -> decltype(op(std::declval<ShardType&>())) {
+        for (;;) {
+            ShardType& s = shard_for(hash);
+            std::lock_guard<ShardLock> lk(s.mutex());
+            if (&shard_for(hash) != &s) continue;
+            auto result = op(s);
+            maybe_split(s);
+            return result;
+        }
+    }
+
+    // locked for the try_ writes: would_block instead of waiting for the
+    // shard lock or for another thread's split.  Ops published for flat
+    // combining are left to their writers, who poll the lock themselves.
+    template <typename Op>
+    TryResult try_locked(size_t hash, Op&& op) {
+        static_assert(detail::has_try_lock<Mutex>::value,
+                      "try_ writes need a Mutex with try_lock");
+        for (;;) {
+            ShardType& s = shard_for(hash);
+            if (!s.mutex().try_lock()) return TryResult::would_block;
+            std::lock_guard<ShardLock> lk(s.mutex(), std::adopt_lock);
+            if (&shard_for(hash) != &s) continue;
+            bool result = op(s);
+            if (split_due(s) && split_mutex_.try_lock()) {
+                std::lock_guard<std::mutex> sl(split_mutex_, std::adopt_lock);
+                split(s);
+            }
+            return result ? TryResult::yes : TryResult::no;
+        }
+    }
+
+    // ------------------------------------------------------------------
+    // Flat combining (MapOptions::flat_combining).  A writer that gets
+    // the shard lock at once applies its op and then everything
+    // published meanwhile.  One that does not publishes a CombinedOp and
+    // waits for a holder to apply it, trying the lock itself now and
+    // then so that published ops never wait on an idle lock.
+    // ------------------------------------------------------------------
+    using Published = typename ShardType::Published;
+
+    // Op and its result (built in place: Value need not be assignable).
+    template <typename Op, typename R>
+    struct CombinedOp : Published {
+        Op* op;
+        typename std::aligned_storage<sizeof(R), alignof(R)>::type result;
+
+        CombinedOp(Op& o, size_t h) : op(&o) {
+            this->run = &CombinedOp::apply;
+            this->hash = h;
+        }
+
+        static void apply(Published& p, ShardType& s) {
+            CombinedOp& self = static_cast<CombinedOp&>(p);
+            new (&self.result) R((*self.op)(s));
+        }
+
+        R take() {
+            if (this->error) std::rethrow_exception(this->error);
+            R* r = reinterpret_cast<R*>(&result);
+            R out(std::move(*r));
+            r->~R();
+            return out;
+        }
+    };
+
+    template <typename Op>
+    auto combined(size_t hash, Op& op, std::false_type)
+        -> decltype(op(std::declval<ShardType&>())) {
+        return locked_direct(hash, op);  // not reached: see combining_
+    }
+
+    template <typename Op>
+    auto combined(size_t hash, Op& op, std::true_type)
+        -> decltype(op(std::declval<ShardType&>())) {
+        using R = decltype(op(std::declval<ShardType&>()));
+        for (;;) {
+            ShardType& s = shard_for(hash);
+            if (s.mutex().try_lock()) {
+                std::lock_guard<ShardLock> lk(s.mutex(), std::adopt_lock);
+                if (&shard_for(hash) != &s) continue;
+                R result = op(s);
+                maybe_split(s);
+                combine(s);
+                return result;
+            }
+            CombinedOp<Op, R> rec(op, hash);
+            s.publish(&rec);
+            if (wait_combined(s, rec) == detail::kOpRerouted) continue;
+            return rec.take();
+        }
+    }
+
+    unsigned wait_combined(ShardType& s, const Published& rec) {
+        detail::Backoff backoff;
+        for (;;) {
+            unsigned state = rec.state.load(std::memory_order_acquire);
+            if (state != detail::kOpPending) return state;
+            if (s.mutex().try_lock()) {
+                std::lock_guard<ShardLock> lk(s.mutex(), std::adopt_lock);
+                combine(s);
+            } else {
+                backoff.pause();
+            }
+        }
+    }
+
+    // Apply every op published on s, whose lock the caller holds.  An op
+    // whose key a split has moved elsewhere is handed back to its writer.
+    void combine(ShardType& s) {
+        Published* p = s.take_published();
+        while (p) {
+            Published* next = p->next;  // p is the writer's once released
+            unsigned state = detail::kOpRerouted;
+            if (&shard_for(p->hash) == &s) {
+                try {
+                    p->run(*p, s);
+                } catch (...) {
+                    p->error = std::current_exception();
+                }
+                maybe_split(s);
+                state = detail::kOpApplied;
+            }
+            p->state.store(state, std::memory_order_release);
+            p = next;
+        }
+    }
+
+    // Batched form of locked for items[0..count), which dir routes to a
+    // single shard.  If a split changed the directory since the items
+    // were grouped, they are applied one at a time instead.
+    template <typename Op>
+    size_t locked_run(const Directory* dir, const detail::BatchItem* items,
+                      size_t count, Op&& op) {
+        ShardType& s = *dir->route(items[0].hash);
+        {
+            std::lock_guard<ShardLock> lk(s.mutex());
+            if (dir_.load(std::memory_order_acquire) == dir) {
+                size_t done = op(s, items, count);
+                maybe_split(s);
+                return done;
+            }
+        }
+        size_t done = 0;
+        for (size_t i = 0; i < count; ++i) {
+            done += locked(items[i].hash, [&](ShardType& owner) {
+                return op(owner, items + i, 1);
+            });
+        }
+        return done;
+    }
+
+    // ------------------------------------------------------------------
+    // maybe_split -- split s (whose lock the caller holds) once it holds
+    // more than split_threshold_ entries and the directory may still
+    // grow.  s keeps the keys whose next hash bit is 0; a new sibling
+    // takes the rest.  The new directory is published after the sibling
+    // is complete and before s drops the moved entries, so every key is
+    // always reachable through one of the two (see Shard::split_into).
+    // ------------------------------------------------------------------
+    void maybe_split(ShardType& s) {
+        if (!split_due(s)) return;
+        std::lock_guard<std::mutex> sl(split_mutex_);
+        split(s);
+    }
+
+    bool split_due(const ShardType& s) const {
+        return s.local_depth() < max_depth_ && s.size() > split_threshold_;
+    }
+
+    // Caller holds s's lock and split_mutex_.
+    void split(ShardType& s) {
+        Directory* old_dir = dir_.load(std::memory_order_relaxed);
+        unsigned d = s.local_depth();
+        size_t id = num_shards_.load(std::memory_order_relaxed);
+
+        int node = numa_ == NumaPolicy::interleave
+                   ? detail::numa_node_for_shard(numa_, id, id + 1)
+                   : s.numa_node();
+        ShardType* sibling = new_shard(node);
+        sibling->set_directory_info(id, d + 1);
+
+        // Bit d (counting from the top) picks the half.
+        unsigned bit = static_cast<unsigned>(sizeof(size_t) * 8) - d - 1;
+        s.split_into(*sibling, bit, epoch_, [&] {
+            unsigned depth = old_dir->depth > d ? old_dir->depth : d + 1;
+            Directory* dir = new Directory(depth);
+            unsigned grow = depth - old_dir->depth;
+            for (size_t j = 0; j < dir->entries.size(); ++j) {
+                ShardType* e = old_dir->entries[j >> grow];
+                if (e == &s && ((j >> (depth - d - 1)) & 1)) e = sibling;
+                dir->entries[j] = e;
+            }
+            shards_[id] = sibling;
+            num_shards_.store(id + 1, std::memory_order_release);
+            dir_.store(dir, std::memory_order_release);
+        });
+        s.set_directory_info(s.id(), d + 1);
+        epoch_.retire(old_dir, true);
+    }
+
+    static size_t chunk_size(size_t base, size_t n) {
+        return n - base < kBatchChunk ? n - base : kBatchChunk;
+    }
+
+    // Hash keys[base..base+m) into items, sorted by directory entry (so
+    // shards are contiguous) and prefetched.  Ties keep batch order, so
+    // the first copy of a repeated key is the one inserted.
+    size_t group_by_shard(const Directory* dir, const Key* keys, size_t base,
+                          size_t m, detail::BatchItem* items) const {
+        for (size_t i = 0; i < m; ++i) {
+            items[i].hash  = hash_(keys[base + i]);
+            items[i].index = base + i;
+        }
+        unsigned depth = dir->depth;
+        std::sort(items, items + m,
+                  [depth](const detail::BatchItem& a,
+                          const detail::BatchItem& b) {
+                      size_t sa = detail::shard_index(a.hash, depth);
+                      size_t sb = detail::shard_index(b.hash, depth);
+                      return sa != sb ? sa < sb : a.index < b.index;
+                  });
+        for (size_t i = 0; i < m; ++i) {
+            dir->route(items[i].hash)->prefetch(items[i].hash);
+        }
+        return m;
+    }
+
+    // Length of the run of items starting at i that share a shard.
+    static size_t shard_run(const Directory* dir,
+                            const detail::BatchItem* items, size_t i,
+                            size_t m) {
+        const ShardType* shard = dir->route(items[i].hash);
+        size_t j = i + 1;
+        while (j < m && dir->route(items[j].hash) == shard) {
+            ++j;
+        }
+        return j - i;
     }
 };
 
@@ -2,17 +2,23 @@
 
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <utility>
 
 #include <concurrent_hashmap/detail/spinlock.h>
 
 namespace concurrent_hashmap {
 
+struct NoStats;
+
 template <typename Key,
           typename Value,
           typename Hash     = std::hash<Key>,
           typename KeyEqual = std::equal_to<Key>,
           uint8_t  ShardBits = 6,
-          typename Mutex    = detail::SpinLock>
+          typename Mutex    = detail::SpinLock,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>,
+          typename Stats    = NoStats>
 class ConcurrentHashMap;
 
 }  // namespace concurrent_hashmap
@@ -2,7 +2,13 @@
 
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../types.h"
 
 namespace concurrent_hashmap {
 namespace detail {
@@ -13,57 +19,41 @@ namespace detail {
 // Objects retired in epoch N are safe to free once global_epoch reaches N+2,
 // because by then every thread has moved past epoch N.
 //
-// Thread registration is transparent: a thread_local ThreadEntry is lazily
-// created on first use and automatically deregistered when the OS thread
-// exits (via thread_local destructor).
+// Thread registration is transparent: a ThreadEntry is lazily created the
+// first time a thread touches a manager and is kept in a small per-thread
+// table, so a thread moving between many managers keeps one entry in each.
+// Entries are marked dead when the OS thread exits (via thread_local
+// destructor) and are recycled by the next thread that registers.
+//
+// Retired objects collect in the retiring thread's entry and are handed to
+// the manager in batches; a retired table or directory is handed over at
+// once with whatever is buffered.  Who frees a batch once it is safe
+// depends on the Reclamation mode: the thread that advances the epoch
+// (on_advance), a caller of collect() (manual), or a background thread
+// (background).
 // ---------------------------------------------------------------------------
 class EpochManager {
 public:
     // ------------------------------------------------------------------
     // Retired -- base class for any object managed by epoch reclamation.
     // Clients derive from this and override the virtual destructor to
-    // release their payload.
+    // release their payload, or dispose() to free it other than by delete
+    // (e.g. back to a pool).
     // ------------------------------------------------------------------
     struct Retired {
         virtual ~Retired() = default;
-        Retired* next = nullptr;
+        virtual void dispose() { delete this; }
+        Retired* next = nullptr;        // within a batch
+        Retired* next_batch = nullptr;  // set on a batch's first node
+        uint64_t epoch = 0;             // epoch of retirement
     };
 
 private:
-    // Forward declaration so ThreadEntry can be used in ThreadHandle.
-    struct ThreadEntry;
-
     // ------------------------------------------------------------------
-    // RetireList -- thread-safe singly-linked list of Retired objects.
-    // Implemented as a lock-free Treiber stack.
-    // ------------------------------------------------------------------
-    struct RetireList {
-        std::atomic<Retired*> head{nullptr};
-
-        void push(Retired* node) {
-            Retired* old_head = head.load(std::memory_order_relaxed);
-            do {
-                node->next = old_head;
-            } while (!head.compare_exchange_weak(
-                old_head, node,
-                std::memory_order_release,
-                std::memory_order_relaxed));
-        }
-
-        // Atomically detach the entire list and delete every node.
-        void drain() {
-            Retired* list = head.exchange(nullptr, std::memory_order_acquire);
-            while (list) {
-                Retired* nxt = list->next;
-                delete list;
-                list = nxt;
-            }
-        }
-    };
-
-    // ------------------------------------------------------------------
-    // ThreadEntry -- per-OS-thread metadata.
+    // ThreadEntry -- per-(thread, manager) metadata.
     // Linked into an intrusive lock-free list owned by the EpochManager.
+    // Entries are never unlinked while the manager lives, so the list can
+    // be walked without a lock; `alive` is claimed by CAS to reuse one.
     // ------------------------------------------------------------------
     struct ThreadEntry {
         std::atomic<uint64_t>     local_epoch{0};
@@ -76,24 +66,37 @@ private:
         // Reference count: one for the EpochManager (thread_list_),
         // one for the ThreadHandle.  The last to release deletes.
         std::atomic<int>          ref_count{2};
+        // Retire buffer in retirement order; owned by whoever holds alive.
+        Retired*                  retired_head{nullptr};
+        Retired*                  retired_tail{nullptr};
+        unsigned                  retired_count{0};
     };
 
+    // Drop one reference; the last holder deletes the entry.
+    static void release(ThreadEntry* entry) {
+        if (entry->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete entry;
+        }
+    }
+
     // ------------------------------------------------------------------
-    // ThreadHandle -- thread_local destructor marks entry as dead.
-    // A single handle per thread tracks the most-recently-used entry.
+    // ThreadHandle -- the calling thread's entries, one per manager.
+    //
+    // entries[0] is the most recently used.  An entry whose manager has
+    // been destroyed has owner == nullptr and is dropped on the next miss.
+    // The thread_local destructor marks every remaining entry as dead;
+    // its retire buffer stays behind for the manager to collect.
     // ------------------------------------------------------------------
     struct ThreadHandle {
-        ThreadEntry* entry{nullptr};
+        std::vector<ThreadEntry*> entries;
 
         ~ThreadHandle() {
-            if (entry) {
+            for (ThreadEntry* entry : entries) {
                 entry->active.store(false, std::memory_order_release);
                 entry->alive.store(false, std::memory_order_release);
-                if (entry->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
-                    delete entry;
-                }
-                entry = nullptr;
+                release(entry);
             }
+            entries.clear();
         }
     };
 
@@ -101,18 +104,46 @@ private:
     // Manager state
     // ------------------------------------------------------------------
     static const unsigned     kAdvanceInterval = 64;
+    static const unsigned     kRetireBatch = 32;
     std::atomic<uint64_t>     global_epoch_{0};
     std::atomic<ThreadEntry*> thread_list_{nullptr};
-    RetireList                retire_lists_[3];
-    std::mutex                advance_mutex_;
+    std::atomic<Retired*>     pending_{nullptr};  // stack of batches
+    std::atomic<size_t>       pending_count_{0};  // objects in pending_
+    std::atomic<bool>         collecting_{false};
+    Reclamation               mode_;
+
+    // Background reclaimer (Reclamation::background only).
+    std::chrono::milliseconds reclaim_interval_;
+    std::thread               reclaimer_;
+    std::mutex                reclaim_mutex_;
+    std::condition_variable   reclaim_cv_;
+    bool                      stop_{false};
 
 public:
-    EpochManager() = default;
+    explicit EpochManager(
+        Reclamation mode = Reclamation::on_advance,
+        std::chrono::milliseconds interval = std::chrono::milliseconds(10))
+        : mode_(mode), reclaim_interval_(interval) {
+        if (mode_ == Reclamation::background) {
+            reclaimer_ = std::thread([this] { reclaim_loop(); });
+        }
+    }
 
     ~EpochManager() {
-        // Drain all three retire lists.
-        for (int i = 0; i < 3; ++i) {
-            retire_lists_[i].drain();
+        if (reclaimer_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(reclaim_mutex_);
+                stop_ = true;
+            }
+            reclaim_cv_.notify_all();
+            reclaimer_.join();
+        }
+        // Free everything still waiting, batched or buffered.
+        Retired* batch = pending_.exchange(nullptr, std::memory_order_acquire);
+        while (batch) {
+            Retired* nxt = batch->next_batch;
+            free_chain(batch);
+            batch = nxt;
         }
         // Release the manager's reference to each ThreadEntry.
         // The ThreadHandle destructor holds the other reference;
@@ -120,10 +151,11 @@ public:
         ThreadEntry* e = thread_list_.load(std::memory_order_relaxed);
         while (e) {
             ThreadEntry* nxt = e->next.load(std::memory_order_relaxed);
+            free_chain(e->retired_head);
+            e->retired_head = e->retired_tail = nullptr;
+            e->retired_count = 0;
             e->owner.store(nullptr, std::memory_order_release);
-            if (e->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
-                delete e;
-            }
+            release(e);
             e = nxt;
         }
     }
@@ -133,12 +165,44 @@ public:
     EpochManager& operator=(const EpochManager&) = delete;
 
     // ------------------------------------------------------------------
-    // retire -- place a Retired object on the current epoch's list.
+    // retire -- append a Retired object to the calling thread's buffer.
+    // A full buffer is handed to the manager as one batch.  A large
+    // object (a table or directory) hands the buffer over at once, so
+    // it can be freed even if this thread then goes idle.
     // ------------------------------------------------------------------
-    void retire(Retired* obj) {
-        uint64_t epoch = global_epoch_.load(std::memory_order_relaxed);
-        retire_lists_[epoch % 3].push(obj);
-        try_advance();
+    void retire(Retired* obj, bool large = false) {
+        ThreadEntry* entry = get_thread_entry();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        obj->next = nullptr;
+        obj->next_batch = nullptr;
+        obj->epoch = global_epoch_.load(std::memory_order_relaxed);
+        if (entry->retired_tail) entry->retired_tail->next = obj;
+        else entry->retired_head = obj;
+        entry->retired_tail = obj;
+        if (++entry->retired_count >= kRetireBatch || large) {
+            flush(entry);
+            try_advance();
+            if (mode_ == Reclamation::on_advance) reclaim();
+        }
+    }
+
+    // ------------------------------------------------------------------
+    // collect -- hand over the calling thread's buffer, try to advance
+    // the epoch, and free every batch that is safe.  Returns the number
+    // of objects freed; returns 0 at once if another thread is freeing.
+    // ------------------------------------------------------------------
+    size_t collect() {
+        flush(get_thread_entry());
+        return reclaim();
+    }
+
+    Reclamation reclamation() const { return mode_; }
+
+    /// Objects handed over in batches and not yet freed.  Updated once
+    /// per batch; retirements still buffered by their thread (fewer than
+    /// kRetireBatch each) are not included.
+    size_t retired_pending() const {
+        return pending_count_.load(std::memory_order_relaxed);
     }
 
     // ------------------------------------------------------------------
@@ -147,10 +211,12 @@ public:
     void pin(ThreadEntry* entry) {
         ++entry->nesting;
         if (entry->nesting == 1) {
-            entry->active.store(true, std::memory_order_relaxed);
             entry->local_epoch.store(
-                global_epoch_.load(std::memory_order_acquire),
-                std::memory_order_release);
+                global_epoch_.load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+            entry->active.store(true, std::memory_order_relaxed);
+            // Publish the pin before any shared pointer is read.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
         }
     }
 
@@ -160,10 +226,12 @@ public:
         if (entry->nesting == 0) {
             entry->active.store(false, std::memory_order_release);
             // Amortise try_advance: only attempt every kAdvanceInterval
-            // unpins to reduce mutex contention and thread-list scans.
+            // unpins to keep thread-list scans off the fast path.
             if (++entry->ops_since_advance >= kAdvanceInterval) {
                 entry->ops_since_advance = 0;
+                flush(entry);
                 try_advance();
+                if (mode_ == Reclamation::on_advance) reclaim();
             }
         }
     }
@@ -171,36 +239,77 @@ public:
     // ------------------------------------------------------------------
     // get_thread_entry -- obtain (or create) the calling thread's entry.
     //
-    // A function-local thread_local stores ONE ThreadHandle per thread
-    // (shared across all EpochManager instances).  When a thread first
-    // touches a given manager, a new ThreadEntry is allocated and CAS-
-    // pushed onto that manager's thread_list.  If the thread later
-    // accesses a different manager, the old entry is orphaned (marked
-    // alive=false via the handle destructor logic below).
-    //
-    // For the primary use-case -- a single ConcurrentHashMap per
-    // application -- this is a non-issue.
+    // Each thread keeps a small table of entries, one per manager it has
+    // touched, with the most recently used first.  Alternating between
+    // managers moves an existing entry to the front instead of allocating
+    // a new one.  On a miss, entries of destroyed managers are dropped and
+    // a dead entry of this manager is reused, or a new ThreadEntry is
+    // CAS-pushed onto its thread_list.
     // ------------------------------------------------------------------
     ThreadEntry* get_thread_entry() {
         thread_local ThreadHandle handle;
+        std::vector<ThreadEntry*>& entries = handle.entries;
 
-        ThreadEntry* entry = handle.entry;
-        if (entry && entry->owner == this) {
-            return entry;
+        if (!entries.empty() &&
+            entries[0]->owner.load(std::memory_order_relaxed) == this) {
+            return entries[0];
         }
 
-        // If the handle currently points to a different manager's entry,
-        // mark that entry as dead and release the handle's reference.
-        if (entry) {
-            entry->active.store(false, std::memory_order_release);
-            entry->alive.store(false, std::memory_order_release);
-            if (entry->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
-                delete entry;
+        size_t kept = 0;
+        ThreadEntry* found = nullptr;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            ThreadEntry* e = entries[i];
+            EpochManager* owner = e->owner.load(std::memory_order_acquire);
+            if (owner == nullptr) {
+                release(e);
+                continue;
             }
+            if (owner == this) found = e;
+            entries[kept++] = e;
         }
+        entries.resize(kept);
+
+        if (!found) {
+            found = acquire_entry();
+            entries.push_back(found);
+        }
+
+        // Move to the front so the next lookup hits immediately.
+        size_t pos = 0;
+        while (entries[pos] != found) ++pos;
+        for (; pos > 0; --pos) entries[pos] = entries[pos - 1];
+        entries[0] = found;
+        return found;
+    }
 
-        // Allocate a new entry for this (manager, thread) pair.
-        entry = new ThreadEntry;
+    // Number of ThreadEntry nodes linked into this manager's thread list,
+    // live or waiting to be reused.  Diagnostic only.
+    size_t registered_threads() const {
+        size_t n = 0;
+        for (ThreadEntry* e = thread_list_.load(std::memory_order_acquire); e;
+             e = e->next.load(std::memory_order_acquire)) {
+            ++n;
+        }
+        return n;
+    }
+
+private:
+    // Claim a dead entry of this manager, or link a new one.
+    ThreadEntry* acquire_entry() {
+        for (ThreadEntry* e = thread_list_.load(std::memory_order_acquire); e;
+             e = e->next.load(std::memory_order_acquire)) {
+            bool expected = false;
+            if (!e->alive.load(std::memory_order_relaxed) &&
+                e->alive.compare_exchange_strong(
+                    expected, true, std::memory_order_acq_rel)) {
+                e->ref_count.fetch_add(1, std::memory_order_relaxed);
+                e->nesting = 0;
+                e->ops_since_advance = 0;
+                return e;  // its leftover retire buffer comes along
+            }
+        }
+
+        ThreadEntry* entry = new ThreadEntry;
         entry->owner = this;
 
         // Lock-free CAS push onto the intrusive thread list.
@@ -211,53 +320,120 @@ public:
             head, entry,
             std::memory_order_release,
             std::memory_order_relaxed));
-
-        handle.entry = entry;
         return entry;
     }
 
-private:
+    // ------------------------------------------------------------------
+    // flush -- move an entry's retire buffer onto pending_ as one batch.
+    // The batch is tagged with its newest epoch (the tail's).
+    // ------------------------------------------------------------------
+    void flush(ThreadEntry* entry) {
+        Retired* head = entry->retired_head;
+        if (!head) return;
+        head->epoch = entry->retired_tail->epoch;
+        pending_count_.fetch_add(entry->retired_count,
+                                 std::memory_order_relaxed);
+        entry->retired_head = entry->retired_tail = nullptr;
+        entry->retired_count = 0;
+        push_batch(head);
+    }
+
+    void push_batch(Retired* batch) {
+        Retired* old_head = pending_.load(std::memory_order_relaxed);
+        do {
+            batch->next_batch = old_head;
+        } while (!pending_.compare_exchange_weak(
+            old_head, batch,
+            std::memory_order_release,
+            std::memory_order_relaxed));
+    }
+
+    static size_t free_chain(Retired* list) {
+        size_t n = 0;
+        while (list) {
+            Retired* nxt = list->next;
+            list->dispose();
+            list = nxt;
+            ++n;
+        }
+        return n;
+    }
+
     // ------------------------------------------------------------------
     // try_advance -- attempt to advance the global epoch.
     //
-    // Scans all ThreadEntry nodes.  If every active entry has
-    // local_epoch >= global_epoch, it is safe to advance.  After
-    // advancing, drain the retire list two generations behind.
+    // Scans all ThreadEntry nodes without a lock.  If every active entry
+    // has local_epoch >= global_epoch, CAS the epoch forward; a racing
+    // advancer that wins instead is just as good.
     // ------------------------------------------------------------------
-    void try_advance() {
-        // Serialise so two threads don't race on draining the same list.
-        std::unique_lock<std::mutex> lock(advance_mutex_, std::try_to_lock);
-        if (!lock.owns_lock()) {
-            return;
+    bool try_advance() {
+        uint64_t epoch = global_epoch_.load(std::memory_order_seq_cst);
+        for (ThreadEntry* e = thread_list_.load(std::memory_order_acquire); e;
+             e = e->next.load(std::memory_order_acquire)) {
+            if (e->active.load(std::memory_order_seq_cst) &&
+                e->local_epoch.load(std::memory_order_acquire) < epoch) {
+                return false;  // This thread is still in an older epoch.
+            }
         }
+        return global_epoch_.compare_exchange_strong(
+            epoch, epoch + 1, std::memory_order_seq_cst);
+    }
 
-        uint64_t epoch = global_epoch_.load(std::memory_order_acquire);
+    // ------------------------------------------------------------------
+    // reclaim -- single-consumer pass over pending_.
+    //
+    // Adopts the buffers of dead entries, advances if possible, then
+    // frees every batch at least two epochs old and pushes the rest back.
+    // ------------------------------------------------------------------
+    size_t reclaim() {
+        if (collecting_.exchange(true, std::memory_order_acquire)) return 0;
+
+        for (ThreadEntry* e = thread_list_.load(std::memory_order_acquire); e;
+             e = e->next.load(std::memory_order_acquire)) {
+            bool expected = false;
+            if (!e->alive.load(std::memory_order_relaxed) &&
+                e->alive.compare_exchange_strong(
+                    expected, true, std::memory_order_acq_rel)) {
+                flush(e);
+                e->alive.store(false, std::memory_order_release);
+            }
+        }
 
-        // Check all active threads.
-        ThreadEntry* e = thread_list_.load(std::memory_order_acquire);
-        while (e) {
-            if (e->alive.load(std::memory_order_acquire) &&
-                e->active.load(std::memory_order_acquire)) {
-                if (e->local_epoch.load(std::memory_order_acquire) < epoch) {
-                    return;  // This thread is still in an older epoch.
-                }
+        try_advance();
+        uint64_t epoch = global_epoch_.load(std::memory_order_seq_cst);
+
+        size_t freed = 0;
+        Retired* keep = nullptr;
+        Retired* batch = pending_.exchange(nullptr, std::memory_order_acquire);
+        while (batch) {
+            Retired* nxt = batch->next_batch;
+            if (batch->epoch + 2 <= epoch) {
+                freed += free_chain(batch);
+            } else {
+                batch->next_batch = keep;
+                keep = batch;
             }
-            e = e->next.load(std::memory_order_acquire);
+            batch = nxt;
         }
+        while (keep) {
+            Retired* nxt = keep->next_batch;
+            push_batch(keep);
+            keep = nxt;
+        }
+        pending_count_.fetch_sub(freed, std::memory_order_relaxed);
 
-        // All active threads are caught up.  Advance.
-        uint64_t new_epoch = epoch + 1;
-        global_epoch_.store(new_epoch, std::memory_order_release);
-
-        // Drain the retire list two generations behind new_epoch.
-        //
-        //   retire_lists_[new_epoch % 3]       -- current (new retirements)
-        //   retire_lists_[(new_epoch - 1) % 3] -- one gen old (may be read)
-        //   retire_lists_[(new_epoch - 2) % 3] -- two gens old (safe)
-        //
-        // new_epoch >= 2 guarantees (new_epoch - 2) doesn't underflow.
-        if (new_epoch >= 2) {
-            retire_lists_[(new_epoch - 2) % 3].drain();
+        collecting_.store(false, std::memory_order_release);
+        return freed;
+    }
+
+    void reclaim_loop() {
+        std::unique_lock<std::mutex> lock(reclaim_mutex_);
+        while (!stop_) {
+            reclaim_cv_.wait_for(lock, reclaim_interval_,
+                                 [this] { return stop_; });
+            lock.unlock();
+            reclaim();
+            lock.lock();
         }
     }
 
@@ -269,27 +445,34 @@ private:
 // EpochGuard -- RAII critical-section guard for epoch-based reclamation.
 //
 // While an EpochGuard is alive on a thread, objects retired in the
-// current epoch will NOT be freed.  Guards may nest.
+// current epoch will NOT be freed.  Guards may nest.  A guard can be
+// moved (to hand a pin out with a reference), but must be destroyed on
+// the thread that created it.
 // -----------------------------------------------------------------------
 class EpochGuard {
 public:
     explicit EpochGuard(EpochManager& mgr)
-        : mgr_(mgr)
+        : mgr_(&mgr)
         , entry_(mgr.get_thread_entry())
     {
-        mgr_.pin(entry_);
+        mgr_->pin(entry_);
+    }
+
+    EpochGuard(EpochGuard&& other) noexcept
+        : mgr_(other.mgr_), entry_(other.entry_) {
+        other.mgr_ = nullptr;
     }
 
     ~EpochGuard() {
-        mgr_.unpin(entry_);
+        if (mgr_) mgr_->unpin(entry_);
     }
 
-    // Non-copyable, non-movable.
     EpochGuard(const EpochGuard&) = delete;
     EpochGuard& operator=(const EpochGuard&) = delete;
+    EpochGuard& operator=(EpochGuard&&) = delete;
 
 private:
-    EpochManager&              mgr_;
+    EpochManager*              mgr_;
     EpochManager::ThreadEntry* entry_;
 };
 
@@ -0,0 +1,139 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Select the widest control-byte scan available at compile time.  Define
+// CHM_DISABLE_SIMD to force the portable scalar scan.
+#if !defined(CHM_DISABLE_SIMD)
+#  if defined(__AVX2__)
+#    include <immintrin.h>
+#    define CHM_GROUP_AVX2 1
+#  elif defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#    define CHM_GROUP_SSE2 1
+#  elif defined(__aarch64__)
+#    include <arm_neon.h>
+#    define CHM_GROUP_NEON 1
+#  endif
+#endif
+
+namespace concurrent_hashmap {
+namespace detail {
+
+// Number of control bytes screened per probe step.
+#if defined(CHM_GROUP_AVX2)
+static const size_t kGroupWidth = 32;
+#else
+static const size_t kGroupWidth = 16;
+#endif
+
+// ---------------------------------------------------------------------------
+// ProbeMask -- result of screening one group of control bytes.
+//
+// Control bytes hold the Robin Hood distance of each slot (0 == empty).
+// Scanning a probe chain that starts at distance first_dist, byte i is
+// expected to hold first_dist + i.  Bit i of `candidates` is set when it
+// does (the slot may hold the key); `stop` is true when some byte in the
+// group is below its expected distance, which ends the chain.  Candidates
+// at or past the first stopping byte are already masked off.
+// ---------------------------------------------------------------------------
+struct ProbeMask {
+    uint32_t candidates;
+    bool     stop;
+};
+
+inline ProbeMask make_probe_mask(uint32_t eq, uint32_t lt) {
+    uint32_t limit = lt ? (lt & (0u - lt)) - 1 : ~uint32_t{0};
+    return ProbeMask{eq & limit, lt != 0};
+}
+
+// Screen kGroupWidth control bytes starting at ctrl.  The caller must make
+// kGroupWidth bytes readable (Table mirrors its first bytes past the end).
+inline ProbeMask match_probe_group(const uint8_t* ctrl, uint8_t first_dist) {
+#if defined(CHM_GROUP_AVX2)
+    const __m256i ramp = _mm256_setr_epi8(
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+        16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+    __m256i c   = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ctrl));
+    __m256i exp = _mm256_adds_epu8(
+        _mm256_set1_epi8(static_cast<char>(first_dist)), ramp);
+    __m256i eq  = _mm256_cmpeq_epi8(c, exp);
+    __m256i le  = _mm256_cmpeq_epi8(_mm256_max_epu8(c, exp), exp);
+    __m256i lt  = _mm256_andnot_si256(eq, le);
+    return make_probe_mask(
+        static_cast<uint32_t>(_mm256_movemask_epi8(eq)),
+        static_cast<uint32_t>(_mm256_movemask_epi8(lt)));
+#elif defined(CHM_GROUP_SSE2)
+    const __m128i ramp = _mm_setr_epi8(
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i c   = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    __m128i exp = _mm_adds_epu8(
+        _mm_set1_epi8(static_cast<char>(first_dist)), ramp);
+    __m128i eq  = _mm_cmpeq_epi8(c, exp);
+    __m128i le  = _mm_cmpeq_epi8(_mm_max_epu8(c, exp), exp);
+    __m128i lt  = _mm_andnot_si128(eq, le);
+    return make_probe_mask(
+        static_cast<uint32_t>(_mm_movemask_epi8(eq)),
+        static_cast<uint32_t>(_mm_movemask_epi8(lt)));
+#elif defined(CHM_GROUP_NEON)
+    static const uint8_t kRamp[16] = {
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    static const uint8_t kBits[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t c    = vld1q_u8(ctrl);
+    uint8x16_t exp  = vqaddq_u8(vdupq_n_u8(first_dist), vld1q_u8(kRamp));
+    uint8x16_t bits = vld1q_u8(kBits);
+    uint8x16_t eq   = vandq_u8(vceqq_u8(c, exp), bits);
+    uint8x16_t lt   = vandq_u8(vcltq_u8(c, exp), bits);
+    uint32_t eq_mask = vaddv_u8(vget_low_u8(eq)) |
+                       (static_cast<uint32_t>(vaddv_u8(vget_high_u8(eq))) << 8);
+    uint32_t lt_mask = vaddv_u8(vget_low_u8(lt)) |
+                       (static_cast<uint32_t>(vaddv_u8(vget_high_u8(lt))) << 8);
+    return make_probe_mask(eq_mask, lt_mask);
+#else
+    uint32_t eq = 0;
+    uint32_t lt = 0;
+    for (unsigned i = 0; i < kGroupWidth; ++i) {
+        unsigned exp = first_dist + i;
+        if (exp > 255) exp = 255;
+        if (ctrl[i] == exp) eq |= uint32_t{1} << i;
+        else if (ctrl[i] < exp) lt |= uint32_t{1} << i;
+    }
+    return make_probe_mask(eq, lt);
+#endif
+}
+
+// Bit i set when byte i of the kGroupWidth bytes at p equals b.  Used to
+// screen slot fingerprints alongside the distance screen.
+inline uint32_t match_byte_group(const uint8_t* p, uint8_t b) {
+#if defined(CHM_GROUP_AVX2)
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(v, _mm256_set1_epi8(static_cast<char>(b)))));
+#elif defined(CHM_GROUP_SSE2)
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    return static_cast<uint32_t>(_mm_movemask_epi8(
+        _mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(b)))));
+#elif defined(CHM_GROUP_NEON)
+    static const uint8_t kBits[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t eq = vandq_u8(vceqq_u8(vld1q_u8(p), vdupq_n_u8(b)),
+                             vld1q_u8(kBits));
+    return vaddv_u8(vget_low_u8(eq)) |
+           (static_cast<uint32_t>(vaddv_u8(vget_high_u8(eq))) << 8);
+#else
+    uint32_t eq = 0;
+    for (unsigned i = 0; i < kGroupWidth; ++i) {
+        if (p[i] == b) eq |= uint32_t{1} << i;
+    }
+    return eq;
+#endif
+}
+
+// Index of the lowest set bit (mask must be non-zero).
+inline unsigned lowest_bit(uint32_t mask) {
+    return static_cast<unsigned>(__builtin_ctz(mask));
+}
+
+} // namespace detail
+} // namespace concurrent_hashmap
@@ -1,6 +1,7 @@
 #pragma once
 #include <cstddef>
 #include <cstdint>
+#include <type_traits>
 
 namespace concurrent_hashmap {
 namespace detail {
@@ -12,6 +13,11 @@ inline size_t shard_index(size_t hash) {
     return hash >> (sizeof(size_t) * 8 - ShardBits);
 }
 
+// Runtime form for a shard directory of 2^bits entries (0 if bits == 0).
+inline size_t shard_index(size_t hash, unsigned bits) {
+    return bits == 0 ? 0 : hash >> (sizeof(size_t) * 8 - bits);
+}
+
 // Extract remaining bits for in-shard table indexing
 // This returns the full hash (used with mask inside shard)
 // We keep the full hash so Robin Hood probing uses all bits
@@ -31,10 +37,36 @@ inline size_t next_power_of_2(size_t n) {
     return result;
 }
 
+// log2 of a power of 2
+constexpr unsigned log2_pow2(size_t n) {
+    unsigned bits = 0;
+    while (n > 1) {
+        n >>= 1;
+        ++bits;
+    }
+    return bits;
+}
+
 // Check if n is a power of 2
 inline bool is_power_of_2(size_t n) {
     return n > 0 && (n & (n - 1)) == 0;
 }
 
+// is_transparent_lookup -- true when both Hash and KeyEqual declare
+// is_transparent (as for C++14 std::less<>), so lookups may use any key
+// type they accept instead of constructing a Key.
+template <typename...>
+struct make_void { typedef void type; };
+
+template <typename Hash, typename KeyEqual, typename = void>
+struct is_transparent_lookup : std::false_type {};
+
+template <typename Hash, typename KeyEqual>
+struct is_transparent_lookup<
+    Hash, KeyEqual,
+    typename make_void<typename Hash::is_transparent,
+                       typename KeyEqual::is_transparent>::type>
+    : std::true_type {};
+
 } // namespace detail
 } // namespace concurrent_hashmap
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <concurrent_hashmap/detail/epoch.h>
+#include <concurrent_hashmap/detail/numa.h>
+
+namespace concurrent_hashmap {
+namespace detail {
+
+// ---------------------------------------------------------------------------
+// NodePool -- out-of-line value nodes for node_values maps (see traits.h).
+//
+// Nodes are carved from slabs of kSlabNodes, allocated from Allocator
+// (rebound) and bound to the owning shard's NUMA node.  create() is only
+// called by the owner's writers, which are serialised by the shard mutex;
+// destroy() may run on any thread (usually whichever frees a retired node)
+// and pushes the node onto a lock-free return stack that create() takes
+// whole once its own free list runs dry.
+//
+// Nodes can outlive their shard's hold on them: a split hands them to a
+// sibling shard, and retired nodes are freed by the epoch manager, which
+// may only happen after the map has destroyed its shards.  The pool
+// therefore counts a reference for its owner plus one per live node, and
+// frees its slabs when the last is dropped.
+// ---------------------------------------------------------------------------
+template <typename T, typename Allocator>
+class NodePool {
+public:
+    struct Node : EpochManager::Retired {
+        NodePool* pool;
+        T         value;
+
+        template <typename... Args>
+        explicit Node(NodePool* p, Args&&... args)
+            : pool(p), value(std::forward<Args>(args)...) {}
+
+        // A reclaimed node goes back to its pool, not to the heap.
+        void dispose() override { pool->destroy(this); }
+    };
+
+    static NodePool* make(int node, const Allocator& alloc) {
+        return new NodePool(node, alloc);
+    }
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    // Build a node holding T(args...).  Owner's writers only.
+    template <typename... Args>
+    Node* create(Args&&... args) {
+        // Returns the storage if T's constructor throws.
+        struct Reserve {
+            NodePool* pool;
+            FreeNode* f;
+            ~Reserve() { if (f) pool->push_free(f); }
+        } r{this, take()};
+        Node* n = new (static_cast<void*>(r.f))
+            Node(this, std::forward<Args>(args)...);
+        r.f = nullptr;
+        refs_.fetch_add(1, std::memory_order_relaxed);
+        return n;
+    }
+
+    // Destroy a node created by this pool.  Any thread.
+    void destroy(Node* n) {
+        n->~Node();
+        push_free(reinterpret_cast<FreeNode*>(n));
+        release();
+    }
+
+    // Drop the owner's reference.
+    void release() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+    }
+
+private:
+    static const size_t kSlabNodes = 64;
+
+    struct FreeNode {
+        FreeNode* next;
+    };
+    using Storage = typename std::aligned_storage<
+        sizeof(Node) < sizeof(FreeNode) ? sizeof(FreeNode) : sizeof(Node),
+        alignof(Node)>::type;
+    using StorageAlloc = typename std::allocator_traits<
+        Allocator>::template rebind_alloc<Storage>;
+    using StorageTraits = std::allocator_traits<StorageAlloc>;
+
+    int                    node_;
+    Allocator              alloc_;
+    std::atomic<size_t>    refs_{1};
+    FreeNode*              free_ = nullptr;  // owner's writers only
+    std::atomic<FreeNode*> returned_{nullptr};
+    std::vector<Storage*>  slabs_;
+
+    NodePool(int node, const Allocator& alloc) : node_(node), alloc_(alloc) {}
+
+    ~NodePool() {
+        StorageAlloc sa(alloc_);
+        for (Storage* s : slabs_) StorageTraits::deallocate(sa, s, kSlabNodes);
+    }
+
+    FreeNode* take() {
+        if (!free_) free_ = returned_.exchange(nullptr,
+                                                std::memory_order_acquire);
+        if (!free_) grow();
+        FreeNode* f = free_;
+        free_ = f->next;
+        return f;
+    }
+
+    void push_free(FreeNode* f) {
+        FreeNode* head = returned_.load(std::memory_order_relaxed);
+        do {
+            f->next = head;
+        } while (!returned_.compare_exchange_weak(
+            head, f, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    void grow() {
+        StorageAlloc sa(alloc_);
+        slabs_.reserve(slabs_.size() + 1);
+        Storage* slab = StorageTraits::allocate(sa, kSlabNodes);
+        numa_bind(slab, kSlabNodes * sizeof(Storage), node_);
+        slabs_.push_back(slab);
+        for (size_t i = kSlabNodes; i-- > 0;) {
+            FreeNode* f = reinterpret_cast<FreeNode*>(&slab[i]);
+            f->next = free_;
+            free_ = f;
+        }
+    }
+};
+
+}  // namespace detail
+}  // namespace concurrent_hashmap
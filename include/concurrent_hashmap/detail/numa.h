@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <new>
+
+#include <concurrent_hashmap/types.h>
+
+#if defined(__linux__)
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+// Destructive-interference size used to pad per-shard state.  Override
+// with -DCHM_CACHE_LINE_SIZE=128 on parts that prefetch line pairs.
+#ifndef CHM_CACHE_LINE_SIZE
+#  define CHM_CACHE_LINE_SIZE 64
+#endif
+
+namespace concurrent_hashmap {
+namespace detail {
+
+static const size_t kCacheLineSize = CHM_CACHE_LINE_SIZE;
+
+// Cache-line aligned heap allocation.  Operator new only honours
+// alignof(T) > alignof(max_align_t) from C++17 on, so over-aligned objects
+// such as shards are allocated through these and placement-constructed.
+inline void* cache_line_alloc(size_t bytes) {
+    void* raw = ::operator new(bytes + kCacheLineSize);
+    size_t addr = reinterpret_cast<size_t>(raw) + kCacheLineSize;
+    addr &= ~(kCacheLineSize - 1);
+    void* p = reinterpret_cast<void*>(addr);
+    static_cast<void**>(p)[-1] = raw;  // at least sizeof(void*) below p
+    return p;
+}
+
+inline void cache_line_free(void* p) noexcept {
+    if (p) ::operator delete(static_cast<void**>(p)[-1]);
+}
+
+// ---------------------------------------------------------------------------
+// NUMA placement helpers.  Linux only; elsewhere binding is a no-op.
+// Failures (no NUMA support, mbind blocked by a sandbox) are not errors:
+// the memory is simply placed by first touch.
+// ---------------------------------------------------------------------------
+
+// Number of NUMA nodes the kernel reports as possible (1 if unknown).
+inline int numa_node_count() {
+    static const int count = [] {
+        int max_node = 0;
+#if defined(__linux__)
+        if (FILE* f = std::fopen("/sys/devices/system/node/possible", "r")) {
+            // Format is a range list such as "0" or "0-1"; the last
+            // number is the highest node id.
+            int n = 0;
+            char sep = 0;
+            while (std::fscanf(f, "%d%c", &n, &sep) >= 1) {
+                if (n > max_node) max_node = n;
+                if (sep == '\n') break;
+            }
+            std::fclose(f);
+        }
+#endif
+        return max_node + 1;
+    }();
+    return count;
+}
+
+// Node for shard `shard` of `num_shards` under policy, or -1 for none.
+inline int numa_node_for_shard(NumaPolicy policy, size_t shard,
+                               size_t num_shards) {
+    size_t nodes = static_cast<size_t>(numa_node_count());
+    switch (policy) {
+    case NumaPolicy::interleave:
+        return static_cast<int>(shard % nodes);
+    case NumaPolicy::shard_affinity:
+        return static_cast<int>(shard * nodes / num_shards);
+    case NumaPolicy::none:
+        break;
+    }
+    return -1;
+}
+
+// Ask for the pages wholly inside [p, p + bytes) to live on NUMA node
+// `node` (node < 0: no-op).  Pages at either end may be shared with other
+// allocations and are left alone, so this only has an effect on regions
+// spanning whole pages -- in practice large tables.  Pages already
+// touched are migrated.
+inline void numa_bind(void* p, size_t bytes, int node) {
+#if defined(__linux__)
+    if (node < 0) return;
+    static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = (reinterpret_cast<size_t>(p) + page - 1) & ~(page - 1);
+    size_t end = (reinterpret_cast<size_t>(p) + bytes) & ~(page - 1);
+    if (end <= begin) return;
+
+    const unsigned long kBits = sizeof(unsigned long) * 8;
+    unsigned long mask[4] = {0, 0, 0, 0};
+    if (static_cast<unsigned long>(node) >= 4 * kBits) return;
+    mask[node / kBits] = 1ul << (node % kBits);
+    // MPOL_PREFERRED rather than MPOL_BIND: a full node should spill to
+    // its neighbour, not fail the allocation.  MPOL_MF_MOVE migrates.
+    const int kMpolPreferred = 1;
+    const unsigned kMpolMfMove = 1u << 1;
+    syscall(SYS_mbind, reinterpret_cast<void*>(begin), end - begin,
+            kMpolPreferred, mask, 4 * kBits, kMpolMfMove);
+#else
+    (void)p;
+    (void)bytes;
+    (void)node;
+#endif
+}
+
+} // namespace detail
+} // namespace concurrent_hashmap
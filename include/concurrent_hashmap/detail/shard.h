@@ -5,12 +5,22 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <exception>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <utility>
 
+#include <concurrent_hashmap/snapshot.h>
+#include <concurrent_hashmap/stats.h>
+#include <concurrent_hashmap/hash.h>
+#include <concurrent_hashmap/traits.h>
+#include <concurrent_hashmap/types.h>
 #include <concurrent_hashmap/detail/epoch.h>
+#include <concurrent_hashmap/detail/group.h>
 #include <concurrent_hashmap/detail/hash_utils.h>
+#include <concurrent_hashmap/detail/node_pool.h>
+#include <concurrent_hashmap/detail/numa.h>
 #include <concurrent_hashmap/detail/spinlock.h>
 
 #if defined(__has_feature)
@@ -31,69 +41,260 @@
 namespace concurrent_hashmap {
 namespace detail {
 
+// One entry of a batched call: the key's hash and its position in the
+// caller's arrays.
+struct BatchItem {
+    size_t hash;
+    size_t index;
+};
+
+// Progress of a write published for flat combining (Shard::Published).
+enum : unsigned {
+    kOpPending,   // waiting for a lock holder to apply it
+    kOpApplied,   // done; result or error filled in
+    kOpRerouted,  // a split moved the key to another shard: not applied
+};
+
+// Where a slot's seqlock counter lives: in the slot itself, or (striped)
+// in a side array of the table, in which case the slot carries none.
+template <bool Embedded>
+struct SlotSeqWord {
+    std::atomic<uint32_t> seq{0};
+};
+template <>
+struct SlotSeqWord<false> {};
+
+// The cached full hash, unless cache_hash says to keep a fingerprint only.
+template <bool Cached>
+struct SlotHashWord {
+    size_t hash = 0;
+};
+template <>
+struct SlotHashWord<false> {};
+
 // Concurrency contract: lock-free readers use a per-slot SeqLock to
 // detect concurrent writes and retry.  Writers (always under mutex_)
-// bracket slot mutations with seq increments.  This gives readers
+// bracket slot mutations with seq increments.  With seq_stripe_slots set,
+// one counter covers a stripe of consecutive slots instead.  This gives readers
 // wait-free fast-path and correct synchronization for any Key/Value
 // type, including non-trivially-copyable types like std::string.
 template <typename Key, typename Value,
           typename Hash     = std::hash<Key>,
           typename KeyEqual = std::equal_to<Key>,
-          typename Mutex    = SpinLock>
+          typename Mutex    = SpinLock,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>,
+          typename Stats    = NoStats>
 class Shard {
 public:
+    // Whether values live in pool nodes, the slot holding a pointer.
+    static constexpr bool kNodeValues = node_values<Key, Value>::value;
+
+    // Small trivially copyable entries: value-only updates claim the slot
+    // by CAS on its seq instead of taking mutex_ (see update_lock_free).
+    static constexpr bool kAtomicSlots =
+        use_atomic_slots<Key, Value>::value && !kNodeValues;
+
+    // Slots per seqlock counter; 0 means one counter inside each slot.
+    static constexpr size_t kSeqStripe = seq_stripe_slots<Key, Value>::value;
+    static_assert((kSeqStripe & (kSeqStripe - 1)) == 0,
+                  "seq_stripe_slots must be 0 or a power of two");
+    static constexpr unsigned kStripeShift = log2_pow2(kSeqStripe);
+
+    // Whether slots cache the full hash; otherwise Table::tags holds a
+    // fingerprint per slot and hashes are recomputed when entries move.
+    static constexpr bool kCacheHash = cache_hash<Key, Hash>::value;
+
+    // The shard mutex: Mutex itself, or with an enabled Stats policy a
+    // wrapper that reports acquisitions (see StatLock).
+    using Lock = typename std::conditional<
+        Stats::enabled, StatLock<Mutex, Stats>, Mutex>::type;
+
+    using NodePoolType = NodePool<Value, Allocator>;
+    using Node = typename NodePoolType::Node;
+    // What a slot holds for its value.
+    using Stored = typename std::conditional<kNodeValues, Node*, Value>::type;
+
     // ------------------------------------------------------------------
-    // Slot -- one bucket in the Robin Hood table.
-    // dist == 0 means empty.  dist == 1 means home position.
-    // dist == k means the element is displaced k-1 positions from home.
+    // Slot -- one bucket in the Robin Hood table.  Its probe distance is
+    // kept only in the table's ctrl array (see Table).
+    //
+    // hash (with kCacheHash) is cached to avoid recomputing during resize
+    // and to enable fast early-exit comparisons (compare hash before
+    // comparing key).
     //
-    // hash is cached to avoid recomputing during resize and to enable
-    // fast early-exit comparisons (compare hash before comparing key).
+    // seq (unless striped) is a SeqLock sequence number.  Even means
+    // stable, odd means a writer is currently modifying this slot.
     //
-    // seq is a SeqLock sequence number.  Even means stable, odd means
-    // a writer is currently modifying this slot.
+    // value is the value itself, or with kNodeValues a pointer to its
+    // node (null in empty slots).
     // ------------------------------------------------------------------
-    struct Slot {
-        std::atomic<uint32_t> seq{0};
-        uint8_t dist;
-        size_t  hash;
+    struct Slot : SlotSeqWord<kSeqStripe == 0>, SlotHashWord<kCacheHash> {
         Key     key;
-        Value   value;
+        Stored  value;
 
-        Slot() : seq(0), dist(0), hash(0), key(), value() {}
+        Slot() : key(), value() {}
     };
 
     // ------------------------------------------------------------------
     // Table -- heap-allocated slot array, inherits from Retired so it
     // can be deferred-freed through epoch-based reclamation.
+    //
+    // ctrl holds every slot's Robin Hood distance: 0 means empty, 1 home
+    // position, k displaced k-1 positions from home.  Being dense, it lets
+    // probes screen a whole group of slots (see group.h) and only touch
+    // the slots that can hold the key.  The first kGroupWidth bytes are
+    // mirrored past the end so a group load starting near the end never
+    // wraps.
+    //
+    // Without kCacheHash, tags holds each slot's hash fingerprint, laid
+    // out (and mirrored) like ctrl in the same allocation.
+    //
+    // With striped seqlocks, stripes holds one counter per kSeqStripe
+    // slots; seq(pos) finds a slot's counter either way.
+    //
+    // Both arrays come from Allocator (rebound to Slot / uint8_t), which
+    // the table keeps a copy of for deallocation.  A table whose shard
+    // has a NUMA node (node >= 0) has its pages bound to that node.
     // ------------------------------------------------------------------
     struct Table : EpochManager::Retired {
-        size_t capacity;
-        size_t mask;    // capacity - 1
-        Slot*  slots;
+        using SlotAlloc = typename std::allocator_traits<
+            Allocator>::template rebind_alloc<Slot>;
+        using CtrlAlloc = typename std::allocator_traits<
+            Allocator>::template rebind_alloc<uint8_t>;
+        using SeqAlloc = typename std::allocator_traits<
+            Allocator>::template rebind_alloc<std::atomic<uint32_t>>;
+        using SlotTraits = std::allocator_traits<SlotAlloc>;
+        using CtrlTraits = std::allocator_traits<CtrlAlloc>;
+        using SeqTraits  = std::allocator_traits<SeqAlloc>;
+
+        size_t    capacity;
+        size_t    mask;    // capacity - 1
+        Slot*     slots;
+        uint8_t*  ctrl;    // capacity + kGroupWidth bytes
+        uint8_t*  tags;    // same size, right after ctrl; null if cached
+        std::atomic<uint32_t>* stripes;  // stripe_count() counters, or null
+        // Odd while writers move entries between slots (Robin Hood
+        // displacement, backward-shift delete); see probe_table.
+        std::atomic<uint32_t> shift_seq;
+        int       node;
+        Allocator alloc;
+
+        explicit Table(size_t cap, int numa_node = -1,
+                       const Allocator& a = Allocator())
+            : capacity(cap), mask(cap - 1), slots(nullptr), ctrl(nullptr)
+            , tags(nullptr), stripes(nullptr), shift_seq(0), node(numa_node)
+            , alloc(a) {
+            SlotAlloc sa(alloc);
+            CtrlAlloc ca(alloc);
+            slots = SlotTraits::allocate(sa, capacity);
+            ctrl = CtrlTraits::allocate(ca, byte_array_bytes());
+            numa_bind(slots, capacity * sizeof(Slot), node);
+            numa_bind(ctrl, byte_array_bytes(), node);
+            for (size_t i = 0; i < capacity; ++i) {
+                SlotTraits::construct(sa, &slots[i]);
+            }
+            std::memset(ctrl, 0, byte_array_bytes());
+            if (!kCacheHash) tags = ctrl + ctrl_bytes();
+            if (kSeqStripe != 0) {
+                SeqAlloc qa(alloc);
+                stripes = SeqTraits::allocate(qa, stripe_count());
+                for (size_t i = 0; i < stripe_count(); ++i) {
+                    SeqTraits::construct(qa, &stripes[i], 0u);
+                }
+            }
+        }
+
+        ~Table() override {
+            SlotAlloc sa(alloc);
+            CtrlAlloc ca(alloc);
+            for (size_t i = 0; i < capacity; ++i) {
+                SlotTraits::destroy(sa, &slots[i]);
+            }
+            CtrlTraits::deallocate(ca, ctrl, byte_array_bytes());
+            SlotTraits::deallocate(sa, slots, capacity);
+            if (stripes) {
+                SeqAlloc qa(alloc);
+                SeqTraits::deallocate(qa, stripes, stripe_count());
+            }
+        }
+
+        size_t ctrl_bytes() const { return capacity + kGroupWidth; }
+        size_t byte_array_bytes() const {
+            return kCacheHash ? ctrl_bytes() : 2 * ctrl_bytes();
+        }
+        size_t stripe_count() const {
+            return kSeqStripe ? ((capacity - 1) >> kStripeShift) + 1 : 0;
+        }
 
-        explicit Table(size_t cap)
-            : capacity(cap), mask(cap - 1), slots(new Slot[cap]()) {}
+        // Index of the counter covering slot pos, and the counter itself.
+        size_t seq_index(size_t pos) const {
+            return kSeqStripe ? pos >> kStripeShift : pos;
+        }
+        std::atomic<uint32_t>& seq_word(size_t index) const {
+            return seq_word(index,
+                            std::integral_constant<bool, kSeqStripe != 0>());
+        }
+        std::atomic<uint32_t>& seq(size_t pos) const {
+            return seq_word(seq_index(pos));
+        }
+
+        // Update the dist of slot pos (its control byte(s)).
+        void set_dist(size_t pos, uint8_t d) { set_byte(ctrl, pos, d); }
+        void set_tag(size_t pos, uint8_t tag) { set_byte(tags, pos, tag); }
 
-        ~Table() override { delete[] slots; }
+    private:
+        void set_byte(uint8_t* bytes, size_t pos, uint8_t v) {
+            bytes[pos] = v;
+            for (size_t m = pos + capacity; m < capacity + kGroupWidth;
+                 m += capacity) {
+                bytes[m] = v;
+            }
+        }
+
+        std::atomic<uint32_t>& seq_word(size_t i, std::false_type) const {
+            return slots[i].seq;
+        }
+        std::atomic<uint32_t>& seq_word(size_t i, std::true_type) const {
+            return stripes[i];
+        }
     };
 
     // ------------------------------------------------------------------
     // Construction / Destruction
     // ------------------------------------------------------------------
-    Shard() : table_(new Table(kDefaultCapacity)), size_(0), shrink_counter_(0) {}
+    Shard()
+        : table_(new Table(kDefaultCapacity)), old_table_(nullptr)
+        , size_(0), shrink_counter_(0), migrate_pos_(0), migrate_left_(0)
+        , node_(-1), id_(0), local_depth_(0), alloc_(), pool_(make_pool(-1, alloc_, NodeValues())) {
+        bind_stats(StatsEnabled());
+    }
 
     explicit Shard(size_t initial_capacity)
         : table_(new Table(initial_capacity < kDefaultCapacity
                            ? kDefaultCapacity
                            : next_power_of_2(initial_capacity)))
+        , old_table_(nullptr)
         , size_(0)
         , shrink_counter_(0)
-    {}
+        , migrate_pos_(0)
+        , migrate_left_(0)
+        , node_(-1)
+        , id_(0)
+        , local_depth_(0)
+        , alloc_()
+        , pool_(make_pool(-1, alloc_, NodeValues()))
+    {
+        bind_stats(StatsEnabled());
+    }
 
     ~Shard() {
+        Table* o = old_table_.load(std::memory_order_relaxed);
         Table* t = table_.load(std::memory_order_relaxed);
+        if (o) free_values(o, NodeValues());
+        free_values(t, NodeValues());
+        delete o;
         delete t;
+        if (pool_) pool_->release();
     }
 
     // Non-copyable, non-movable.
@@ -107,224 +308,359 @@ public:
     // If seq changed or was odd, the slot was being modified -- restart
     // the entire probe from the beginning (the table pointer itself may
     // have changed via resize).
+    //
+    // Only dist and the cached hash are read for every candidate; the key
+    // is compared in place once the hash matches, and the value is copied
+    // out only for the confirmed match.  A node value is read after the
+    // window has validated, since published nodes never change.
+    //
+    // The lookup key may be any type K that Hash and KeyEqual accept
+    // (heterogeneous lookup); the map only enables K != Key when both are
+    // transparent.
     // ------------------------------------------------------------------
+    template <typename K>
     CHM_NO_TSAN
-    std::pair<Value, bool> find(size_t hash, const Key& key) const {
-    restart:
-        const Table* t = table_.load(std::memory_order_acquire);
-        size_t pos = hash & t->mask;
-        uint8_t expected_dist = 1;
-
-        for (;;) {
-            const Slot& s = t->slots[pos];
-            uint32_t seq1 = s.seq.load(std::memory_order_acquire);
-            if (seq1 & 1) goto restart;  // writer active
+    std::pair<Value, bool> find(size_t hash, const K& key) const {
+        std::pair<Value, bool> result(Value(), false);
+        result.second = find_into(hash, key, result.first);
+        return result;
+    }
 
-            uint8_t d    = s.dist;
-            size_t  h    = s.hash;
-            Key     k    = s.key;
-            Value   v    = s.value;
+    /// Assign the value for key into out.  Returns false if absent; out is
+    /// left in a valid but unspecified state in that case.
+    template <typename K>
+    CHM_NO_TSAN
+    bool find_into(size_t hash, const K& key, Value& out) const {
+        return read_slot(hash, key, [&out](const Value& v) { out = v; });
+    }
 
-            uint32_t seq2 = s.seq.load(std::memory_order_acquire);
-            if (seq2 != seq1) goto restart;  // slot changed
+    template <typename K>
+    CHM_NO_TSAN
+    bool contains(size_t hash, const K& key) const {
+        return read_slot(hash, key, [](const Value&) {});
+    }
 
-            if (d == 0) {
-                return std::pair<Value, bool>(Value(), false);
-            }
-            if (d < expected_dist) {
-                return std::pair<Value, bool>(Value(), false);
-            }
-            __builtin_prefetch(&t->slots[(pos + 1) & t->mask], 0, 1);
-            if (d == expected_dist && h == hash && KeyEqual()(k, key)) {
-                return std::pair<Value, bool>(std::move(v), true);
-            }
-            pos = (pos + 1) & t->mask;
-            ++expected_dist;
-            if (expected_dist == 0) {
-                return std::pair<Value, bool>(Value(), false);
-            }
-        }
+    /// The value stored for key, in its node, or null if absent.  Only
+    /// with kNodeValues; valid while the caller's EpochGuard is held.
+    template <typename K>
+    CHM_NO_TSAN
+    const Value* find_ref(size_t hash, const K& key) const {
+        static_assert(kNodeValues, "find_ref requires node_values");
+        const Value* found = nullptr;
+        read_slot(hash, key, [&found](const Value& v) { found = &v; });
+        return found;
     }
 
+    /// read(value) on the entry for key, if present; returns whether it
+    /// was.  read may run more than once (once per attempt that raced a
+    /// writer), even when the lookup then misses, so it must only record
+    /// what it sees, and what it saw counts only on a true return.
+    template <typename K, typename Read>
     CHM_NO_TSAN
-    bool contains(size_t hash, const Key& key) const {
-        return find(hash, key).second;
+    bool find_with(size_t hash, const K& key, Read&& read) const {
+        return read_slot(hash, key, read);
+    }
+
+    /// Prefetch the control bytes and home slot a lookup of hash will hit.
+    void prefetch(size_t hash) const {
+        const Table* t = table_.load(std::memory_order_acquire);
+        size_t pos = hash & t->mask;
+        __builtin_prefetch(t->ctrl + pos, 0, 1);
+        __builtin_prefetch(&t->slots[pos], 0, 1);
     }
 
     // ------------------------------------------------------------------
-    // Locked writes (caller must hold an EpochGuard)
+    // Locked writes (caller must hold an EpochGuard and mutex())
+    //
+    // The map takes mutex() itself so that it can check, once the lock is
+    // held, that the key is still routed to this shard (see split_into).
+    //
+    // Every write first migrates one chunk of an in-progress incremental
+    // resize (see migrate_step), then looks the key up in both tables.
+    //
+    // Key and value arguments are forwarded: rvalues are moved into the
+    // slot, and nothing is constructed when the key turns out to exist.
     // ------------------------------------------------------------------
-    bool insert(size_t hash, const Key& key, const Value& value,
-                EpochManager& epoch) {
-        std::lock_guard<Mutex> lk(mutex_);
-        Table* t = table_.load(std::memory_order_relaxed);
-
-        // Check for existing key first.
-        if (find_in_table(t, hash, key) != nullptr) {
-            return false;  // key already exists
-        }
-
-        // Expand before insert to guarantee sufficient capacity.
-        maybe_expand_for_insert(epoch);
-        t = table_.load(std::memory_order_relaxed);
-
-        while (!insert_into_table(t, hash, key, value)) {
-            resize(t->capacity * 2, epoch);
-            t = table_.load(std::memory_order_relaxed);
-        }
-        size_.fetch_add(1, std::memory_order_relaxed);
-        shrink_counter_ = 0;
-        return true;
+    template <typename KArg, typename VArg>
+    bool insert(size_t hash, KArg&& key, VArg&& value, EpochManager& epoch) {
+        return insert_locked(hash, std::forward<KArg>(key),
+                             std::forward<VArg>(value), epoch);
     }
 
-    bool erase(size_t hash, const Key& key, EpochManager& epoch) {
-        std::lock_guard<Mutex> lk(mutex_);
-        Table* t = table_.load(std::memory_order_relaxed);
+    template <typename K>
+    bool erase(size_t hash, const K& key, EpochManager& epoch) {
+        return erase_locked(hash, key, epoch, true);
+    }
 
-        size_t pos = hash & t->mask;
-        uint8_t expected_dist = 1;
+    // erase that never shrinks the table, for a bounded cache whose
+    // shards keep the capacity they reserved.
+    template <typename K>
+    bool erase_no_shrink(size_t hash, const K& key, EpochManager& epoch) {
+        return erase_locked(hash, key, epoch, false);
+    }
 
-        // Find the key.
-        for (;;) {
-            Slot& s = t->slots[pos];
-            if (s.dist == 0) return false;
-            if (s.dist < expected_dist) return false;
-            if (s.dist == expected_dist && s.hash == hash &&
-                KeyEqual()(s.key, key)) {
-                break;  // found at pos
-            }
-            pos = (pos + 1) & t->mask;
-            ++expected_dist;
-            if (expected_dist == 0) return false;
+    // Batched writes: apply items[0..count), all routed to this shard.
+    // items[i].index selects the key (and value) in the caller's arrays;
+    // results, if non-null, is indexed the same way.  Returns the number
+    // of entries inserted / erased.
+    size_t insert_batch(const BatchItem* items, size_t count,
+                        const Key* keys, const Value* values,
+                        bool* results, EpochManager& epoch) {
+        size_t done = 0;
+        for (size_t i = 0; i < count; ++i) {
+            size_t idx = items[i].index;
+            bool ok = insert_locked(items[i].hash, keys[idx], values[idx], epoch);
+            if (results) results[idx] = ok;
+            done += ok ? 1 : 0;
         }
+        return done;
+    }
 
-        // Backward-shift delete: shift subsequent elements backward.
-        for (;;) {
-            size_t next_pos = (pos + 1) & t->mask;
-            Slot& next_slot = t->slots[next_pos];
-            if (next_slot.dist <= 1) {
-                // next is empty (dist==0) or at home (dist==1): stop.
-                // Reset the slot to release held resources.
-                seq_lock(t->slots[pos]);
-                t->slots[pos].dist  = 0;
-                t->slots[pos].hash  = 0;
-                t->slots[pos].key   = Key();
-                t->slots[pos].value = Value();
-                seq_unlock(t->slots[pos]);
-                break;
-            }
-            // Move next_slot backward into pos, decrement its dist.
-            // Lock both slots: source and destination.
-            seq_lock(t->slots[pos]);
-            seq_lock(next_slot);
-            t->slots[pos].key   = std::move(next_slot.key);
-            t->slots[pos].value = std::move(next_slot.value);
-            t->slots[pos].hash  = next_slot.hash;
-            t->slots[pos].dist  = next_slot.dist - 1;
-            seq_unlock(next_slot);
-            seq_unlock(t->slots[pos]);
-            pos = next_pos;
+    size_t erase_batch(const BatchItem* items, size_t count,
+                       const Key* keys, bool* results, EpochManager& epoch) {
+        size_t done = 0;
+        for (size_t i = 0; i < count; ++i) {
+            size_t idx = items[i].index;
+            bool ok = erase_locked(items[i].hash, keys[idx], epoch, true);
+            if (results) results[idx] = ok;
+            done += ok ? 1 : 0;
         }
-
-        size_.fetch_sub(1, std::memory_order_relaxed);
-        maybe_shrink(epoch);
-        return true;
+        return done;
     }
 
-    bool insert_or_assign(size_t hash, const Key& key, const Value& value,
+    template <typename KArg, typename VArg>
+    bool insert_or_assign(size_t hash, KArg&& key, VArg&& value,
                           EpochManager& epoch) {
-        std::lock_guard<Mutex> lk(mutex_);
-        Table* t = table_.load(std::memory_order_relaxed);
+        migrate_step(epoch);
 
-        Slot* existing = find_in_table_mut(t, hash, key);
+        Table* t = nullptr;
+        Slot* existing = locate(hash, key, &t);
         if (existing) {
-            seq_lock(*existing);
-            existing->value = value;
-            seq_unlock(*existing);
+            assign_value(t, existing, std::forward<VArg>(value), epoch,
+                         NodeValues());
             return false;  // updated, not inserted
         }
-
-        maybe_expand_for_insert(epoch);
-        t = table_.load(std::memory_order_relaxed);
-
-        while (!insert_into_table(t, hash, key, value)) {
-            resize(t->capacity * 2, epoch);
-            t = table_.load(std::memory_order_relaxed);
-        }
-        size_.fetch_add(1, std::memory_order_relaxed);
-        shrink_counter_ = 0;
+        add_new(hash, Key(std::forward<KArg>(key)),
+                Value(std::forward<VArg>(value)), epoch);
         return true;  // newly inserted
     }
 
     Value get_or_set(size_t hash, const Key& key, const Value& default_value,
                      EpochManager& epoch) {
-        std::lock_guard<Mutex> lk(mutex_);
-        Table* t = table_.load(std::memory_order_relaxed);
+        migrate_step(epoch);
 
-        const Slot* existing = find_in_table(t, hash, key);
+        const Slot* existing = locate(hash, key);
         if (existing) {
-            return existing->value;
-        }
-
-        maybe_expand_for_insert(epoch);
-        t = table_.load(std::memory_order_relaxed);
-
-        while (!insert_into_table(t, hash, key, default_value)) {
-            resize(t->capacity * 2, epoch);
-            t = table_.load(std::memory_order_relaxed);
+            return value_of(*existing);
         }
-        size_.fetch_add(1, std::memory_order_relaxed);
-        shrink_counter_ = 0;
+        add_new(hash, Key(key), Value(default_value), epoch);
         return default_value;
     }
 
     template <typename F>
     Value get_or_set_f(size_t hash, const Key& key, F&& factory,
                        EpochManager& epoch) {
-        std::lock_guard<Mutex> lk(mutex_);
-        Table* t = table_.load(std::memory_order_relaxed);
+        migrate_step(epoch);
 
-        const Slot* existing = find_in_table(t, hash, key);
+        const Slot* existing = locate(hash, key);
         if (existing) {
-            return existing->value;
+            return value_of(*existing);
         }
 
-        maybe_expand_for_insert(epoch);
-        t = table_.load(std::memory_order_relaxed);
-
+        // One copy is unavoidable: the caller and the table both keep it.
         Value val = factory();
-        while (!insert_into_table(t, hash, key, val)) {
-            resize(t->capacity * 2, epoch);
-            t = table_.load(std::memory_order_relaxed);
-        }
-        size_.fetch_add(1, std::memory_order_relaxed);
-        shrink_counter_ = 0;
+        add_new(hash, Key(key), Value(val), epoch);
         return val;
     }
 
-    template <typename F>
-    bool try_emplace(size_t hash, const Key& key, F&& factory,
+    // factory() is only invoked when the key is absent; its result is
+    // moved straight into the slot.
+    template <typename KArg, typename F>
+    bool try_emplace(size_t hash, KArg&& key, F&& factory,
                      EpochManager& epoch) {
-        std::lock_guard<Mutex> lk(mutex_);
-        Table* t = table_.load(std::memory_order_relaxed);
+        migrate_step(epoch);
 
-        if (find_in_table(t, hash, key) != nullptr) {
+        if (locate(hash, key) != nullptr) {
             return false;
         }
+        add_new(hash, Key(std::forward<KArg>(key)), Value(factory()), epoch);
+        return true;
+    }
 
-        maybe_expand_for_insert(epoch);
-        t = table_.load(std::memory_order_relaxed);
+    // ------------------------------------------------------------------
+    // In-place read-modify-write.  The functor runs on the slot's value
+    // under mutex_, inside a seq_lock/seq_unlock bracket, so lock-free
+    // readers never observe a half-updated value.  With kAtomicSlots the
+    // map first tries update_lock_free and only takes mutex_ when the key
+    // was not found there.  With kNodeValues it runs on a copy instead,
+    // which then replaces the node (see modify_value).
+    // ------------------------------------------------------------------
 
-        Value val = factory();
-        while (!insert_into_table(t, hash, key, val)) {
-            resize(t->capacity * 2, epoch);
-            t = table_.load(std::memory_order_relaxed);
+    // fn(value) on an existing entry.  Returns false if key is absent.
+    template <typename K, typename F>
+    bool update(size_t hash, const K& key, F&& fn, EpochManager& epoch) {
+        migrate_step(epoch);
+
+        Table* t = nullptr;
+        Slot* existing = locate(hash, key, &t);
+        if (existing == nullptr) return false;
+
+        modify_value(t, existing, fn, epoch, NodeValues());
+        return true;
+    }
+
+    // fn(value) on an existing entry, or insert init unchanged.  Returns
+    // true if init was inserted.
+    template <typename KArg, typename VArg, typename F>
+    bool upsert(size_t hash, KArg&& key, VArg&& init, F&& fn,
+                EpochManager& epoch) {
+        migrate_step(epoch);
+
+        Table* t = nullptr;
+        Slot* existing = locate(hash, key, &t);
+        if (existing) {
+            modify_value(t, existing, fn, epoch, NodeValues());
+            return false;
         }
-        size_.fetch_add(1, std::memory_order_relaxed);
-        shrink_counter_ = 0;
+        add_new(hash, Key(std::forward<KArg>(key)),
+                Value(std::forward<VArg>(init)), epoch);
         return true;
     }
 
+    // fn(value, exists) -> ComputeAction.  An absent key is offered a
+    // default-constructed value, which is inserted unless fn says erase.
+    // Returns true if the key is present afterwards.
+    template <typename KArg, typename F>
+    bool compute(size_t hash, KArg&& key, F&& fn, EpochManager& epoch) {
+        migrate_step(epoch);
+
+        Table* t = nullptr;
+        Slot* existing = locate(hash, key, &t);
+        if (existing) {
+            ComputeAction action = ComputeAction::keep;
+            auto apply = [&](Value& v) { action = fn(v, true); };
+            modify_value(t, existing, apply, epoch, NodeValues());
+            if (action == ComputeAction::erase) {
+                erase_at(t, static_cast<size_t>(existing - t->slots), epoch);
+                size_.fetch_sub(1, std::memory_order_relaxed);
+                maybe_shrink(epoch);
+                return false;
+            }
+            return true;
+        }
+
+        Value value = Value();
+        if (fn(value, false) == ComputeAction::erase) return false;
+        add_new(hash, Key(std::forward<KArg>(key)), std::move(value), epoch);
+        return true;
+    }
+
+    // ------------------------------------------------------------------
+    // Eviction (caller must hold an EpochGuard and mutex()).  Both sweep
+    // the current table in slot order, finishing any migration first.
+    // An erase pulls the next entry of its run back into the freed slot,
+    // so that slot is looked at again.  Neither shrinks the table: a
+    // bounded cache keeps its memory.
+    // ------------------------------------------------------------------
+
+    // Advance the clock hand `hand` (a slot index, kept by the caller)
+    // until spare(hash, key, value) returns false, and erase that entry.
+    // Returns false, erasing nothing, if the shard is empty.  spare may
+    // have side effects (a CLOCK hand clears reference bits), and it must
+    // eventually decline, since the sweep only ends with an eviction.
+    template <typename F>
+    bool evict_next(size_t& hand, F&& spare, EpochManager& epoch) {
+        finish_migration(epoch);
+        if (size_.load(std::memory_order_relaxed) == 0) return false;
+        Table* t = table_.load(std::memory_order_relaxed);
+        for (;; ++hand) {
+            size_t pos = hand & t->mask;
+            if (t->ctrl[pos] == 0) continue;
+            const Slot& s = t->slots[pos];
+            if (spare(entry_hash(t, pos), s.key, value_of(s))) continue;
+            // hand stays on pos, keeping its lap count in the high bits;
+            // the entry pulled back into pos is looked at next time.
+            erase_at(t, pos, epoch);
+            size_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Erase every entry for which pred(hash, key, value) holds, and
+    // return how many were erased.
+    template <typename F>
+    size_t erase_if(F&& pred, EpochManager& epoch) {
+        finish_migration(epoch);
+        Table* t = table_.load(std::memory_order_relaxed);
+        size_t erased = 0;
+        for (size_t pos = 0; pos < t->capacity; ++pos) {
+            while (t->ctrl[pos] != 0) {
+                const Slot& s = t->slots[pos];
+                if (!pred(entry_hash(t, pos), s.key, value_of(s))) break;
+                erase_at(t, pos, epoch);
+                ++erased;
+            }
+        }
+        size_.fetch_sub(erased, std::memory_order_relaxed);
+        return erased;
+    }
+
+    // ------------------------------------------------------------------
+    // update_lock_free -- fn(value) on an existing entry without mutex_.
+    // Only available with kAtomicSlots (always returns false otherwise).
+    //
+    // The slot is found as in read_slot, then claimed by CAS-ing its seq
+    // (or its stripe's) from the even value that was validated to odd; a successful CAS
+    // proves the slot still holds the key.  In this mode writers under
+    // mutex_ claim slots by CAS as well (seq_lock), so both kinds of
+    // writer serialise per slot.  Inserting new keys, erasing, resizing
+    // and splitting still take mutex_.  Returns false if the key was not
+    // found; callers fall back to the locked path then, since a probe
+    // can miss an entry that a locked writer is carrying.
+    // ------------------------------------------------------------------
+    template <typename K, typename F>
+    CHM_NO_TSAN
+    bool update_lock_free(size_t hash, const K& key, F&& fn) {
+        if (!kAtomicSlots) return false;
+        for (;;) {
+            Table* t = table_.load(std::memory_order_acquire);
+            Table* o = old_table_.load(std::memory_order_acquire);
+
+            Slot* s = nullptr;
+            std::atomic<uint32_t>* word = nullptr;
+            uint32_t seq = 0;
+            ProbeResult r = o ? probe_slot(o, hash, key, &s, &word, &seq)
+                              : kProbeMissing;
+            if (r == kProbeMissing) {
+                r = probe_slot(t, hash, key, &s, &word, &seq);
+            }
+
+            if (r == kProbeFound) {
+                if (!word->compare_exchange_strong(
+                        seq, seq + 1, std::memory_order_acquire,
+                        std::memory_order_relaxed)) {
+                    continue;  // slot changed since it was validated
+                }
+                // Released even if fn throws.
+                struct Release {
+                    std::atomic<uint32_t>* word;
+                    uint32_t seq;
+                    ~Release() {
+                        word->store(seq + 2, std::memory_order_release);
+                    }
+                } release{word, seq};
+                // kAtomicSlots implies inline values.
+                fn(const_cast<Value&>(value_of(*s)));
+                return true;
+            }
+            if (r == kProbeMissing &&
+                table_.load(std::memory_order_acquire) == t &&
+                old_table_.load(std::memory_order_acquire) == o) {
+                return false;
+            }
+        }
+    }
+
     // ------------------------------------------------------------------
     // Utility
     // ------------------------------------------------------------------
@@ -332,170 +668,1102 @@ public:
         return size_.load(std::memory_order_relaxed);
     }
 
+    /// Slots in the current table (an old one being migrated aside).
+    size_t capacity() const {
+        return table_.load(std::memory_order_acquire)->capacity;
+    }
+
     void clear(EpochManager& epoch) {
-        std::lock_guard<Mutex> lk(mutex_);
+        std::lock_guard<Lock> lk(mutex_);
         Table* old_table = table_.load(std::memory_order_relaxed);
-        Table* new_table = new Table(kDefaultCapacity);
+        Table* migrating = old_table_.load(std::memory_order_relaxed);
+        Table* new_table = new Table(kDefaultCapacity, node_, alloc_);
+        old_table_.store(nullptr, std::memory_order_release);
         table_.store(new_table, std::memory_order_release);
         size_.store(0, std::memory_order_relaxed);
         shrink_counter_ = 0;
-        epoch.retire(old_table);
+        migrate_left_ = 0;
+        retire_values(old_table, epoch, NodeValues());
+        epoch.retire(old_table, true);
+        if (migrating) {
+            retire_values(migrating, epoch, NodeValues());
+            epoch.retire(migrating, true);
+        }
+    }
+
+    // Allocate this shard's tables from alloc, placed on NUMA node
+    // `node` (-1: no preference).  Replaces the (empty) initial table, so
+    // it is only valid while the shard is empty and not yet shared.
+    void init(int node, const Allocator& alloc) {
+        assert(size_.load(std::memory_order_relaxed) == 0);
+        node_ = node;
+        alloc_ = alloc;
+        if (pool_) {
+            pool_->release();
+            pool_ = make_pool(node_, alloc_, NodeValues());
+        }
+        Table* t = table_.load(std::memory_order_relaxed);
+        table_.store(new Table(t->capacity, node_, alloc_),
+                     std::memory_order_relaxed);
+        delete t;
+    }
+
+    int numa_node() const { return node_; }
+
+    Lock& mutex() { return mutex_; }
+
+    // ------------------------------------------------------------------
+    // Flat combining.  A writer that finds the lock taken may publish its
+    // operation on this shard's list and wait; whoever holds the lock
+    // takes the whole list and applies it in one pass, so the shard's
+    // lines stay in one cache instead of moving with every handoff.
+    // Records live on their writers' stacks and must not be touched by
+    // the applier once their state leaves kOpPending.
+    // ------------------------------------------------------------------
+    struct Published {
+        Published*            next = nullptr;
+        void                (*run)(Published&, Shard&) = nullptr;
+        size_t                hash = 0;
+        std::atomic<unsigned> state{kOpPending};
+        std::exception_ptr    error;
+    };
+
+    void publish(Published* p) {
+        Published* head = published_.load(std::memory_order_relaxed);
+        do {
+            p->next = head;
+        } while (!published_.compare_exchange_weak(
+                     head, p, std::memory_order_release,
+                     std::memory_order_relaxed));
+    }
+
+    /// Detach every published record, oldest first.  Must be called
+    /// under mutex_.
+    Published* take_published() {
+        if (!published_.load(std::memory_order_relaxed)) return nullptr;
+        Published* p = published_.exchange(nullptr, std::memory_order_acquire);
+        Published* ordered = nullptr;
+        while (p) {
+            Published* next = p->next;
+            p->next = ordered;
+            ordered = p;
+            p = next;
+        }
+        return ordered;
+    }
+
+    /// Add this shard's entry count, capacity and Stats counters to out.
+    void collect_stats(StatsSnapshot& out) const {
+        out.entries += size();
+        out.capacity += capacity();
+        stats_.collect(out);
+    }
+
+    // Directory bookkeeping for the owning map: the shard's index in the
+    // map and the number of leading hash bits shared by every key routed
+    // here.  Changed only under mutex_.
+    size_t   id() const { return id_; }
+    unsigned local_depth() const { return local_depth_; }
+    void set_directory_info(size_t id, unsigned depth) {
+        id_ = id;
+        local_depth_ = depth;
+    }
+
+    // ------------------------------------------------------------------
+    // split_into -- move every entry whose hash has bit `bit` set into
+    // sibling, a fresh unpublished shard.  Caller holds mutex_.
+    //
+    // Both halves are built in new tables while the old table's occupied
+    // slots are held odd, so readers spin instead of missing.  publish()
+    // runs once the sibling is complete; it must route the moved half to
+    // sibling.  Only then is this shard's table swapped, and the old one
+    // is cleared (so late lock-free updaters cannot match it) and retired.
+    // ------------------------------------------------------------------
+    template <typename F>
+    void split_into(Shard& sibling, unsigned bit, EpochManager& epoch,
+                    F&& publish) {
+        finish_migration(epoch);
+        Table* t = table_.load(std::memory_order_relaxed);
+
+        size_t moving = 0;
+        for (size_t i = 0; i < t->capacity; ++i) {
+            if (t->ctrl[i] != 0 && ((entry_hash(t, i) >> bit) & 1)) ++moving;
+        }
+        size_t staying = size_.load(std::memory_order_relaxed) - moving;
+
+        Table* mine = new Table(capacity_for(staying), node_, alloc_);
+        Table* theirs = new Table(capacity_for(moving), sibling.node_,
+                                  sibling.alloc_);
+        SeqRun held(t);
+        for (size_t i = 0; i < t->capacity; ++i) {
+            if (t->ctrl[i] == 0) continue;
+            Slot& s = t->slots[i];
+            size_t h = entry_hash(t, i);
+            held.lock(i);
+            rehash_insert(((h >> bit) & 1) ? theirs : mine,
+                          std::move(s.key), std::move(s.value), h);
+        }
+
+        delete sibling.table_.load(std::memory_order_relaxed);
+        sibling.table_.store(theirs, std::memory_order_relaxed);
+        sibling.size_.store(moving, std::memory_order_relaxed);
+        publish();
+
+        table_.store(mine, std::memory_order_release);
+        size_.store(staying, std::memory_order_relaxed);
+        shrink_counter_ = 0;
+        SeqRun release(t);
+        for (size_t i = 0; i < t->capacity; ++i) {
+            if (t->ctrl[i] == 0) continue;
+            release.unlock_before(i);
+            t->set_dist(i, 0);
+        }
+        release.finish();
+        epoch.retire(t, true);
     }
 
     void reserve(size_t count, EpochManager& epoch) {
-        std::lock_guard<Mutex> lk(mutex_);
-        // We need capacity such that count / capacity <= kMaxLoadFactor.
-        // So capacity >= count / kMaxLoadFactor.
-        size_t needed = static_cast<size_t>(
-            static_cast<double>(count) / kMaxLoadFactor) + 1;
-        needed = next_power_of_2(needed);
-        if (needed < kDefaultCapacity) needed = kDefaultCapacity;
+        std::lock_guard<Lock> lk(mutex_);
+        finish_migration(epoch);
 
+        size_t needed = capacity_for(count);
         Table* t = table_.load(std::memory_order_relaxed);
         if (needed <= t->capacity) return;
 
         resize(needed, epoch);
     }
 
+    // ------------------------------------------------------------------
+    // bulk_insert -- add items[0..count) in one table swap.  get(index)
+    // returns the item's entry, with .first and .second.  A table sized
+    // for the result is filled with the new entries while readers still
+    // use the current one; the current entries are then moved over, as in
+    // resize, and the filled table is published.  Unless Unique, keys
+    // already present or repeated in items are skipped (the first one
+    // wins).  Caller holds mutex_.  Returns the number added; if copying
+    // an entry throws, the shard is left as it was.
+    // ------------------------------------------------------------------
+    template <bool Unique, typename Get>
+    size_t bulk_insert(const BatchItem* items, size_t count, Get&& get,
+                       EpochManager& epoch) {
+        finish_migration(epoch);
+        uint64_t start = stats_clock<Stats::enabled>();
+        const Table* cur = table_.load(std::memory_order_relaxed);
+        size_t old_capacity = cur->capacity;
+        size_t existing = size_.load(std::memory_order_relaxed);
+        size_t capacity = capacity_for(existing + count);
+        Table* t = new Table(capacity, node_, alloc_);
+        size_t added = 0;
+        try {
+            for (size_t i = 0; i < count; ++i) {
+                size_t h = items[i].hash;
+                const auto& e = get(items[i].index);
+                if (!Unique && (find_in_table(cur, h, e.first) ||
+                                find_in_table(t, h, e.first))) {
+                    continue;
+                }
+                rehash_insert(t, Key(e.first),
+                              make_stored(Value(e.second), NodeValues()), h);
+                ++added;
+            }
+        } catch (...) {
+            free_values(t, NodeValues());
+            delete t;
+            throw;
+        }
+
+        publish_table(t, epoch);
+        size_.store(existing + added, std::memory_order_relaxed);
+        shrink_counter_ = 0;
+        stats_.resized(old_capacity, capacity,
+                       stats_clock<Stats::enabled>() - start);
+        return added;
+    }
+
+    /// True while an incremental resize is still draining the old table.
+    bool migrating() const {
+        return old_table_.load(std::memory_order_acquire) != nullptr;
+    }
+
+    // ------------------------------------------------------------------
+    // for_each_locked -- fn(key, value) for every entry, in table order.
+    // Caller holds mutex().  With kAtomicSlots a lock-free updater may be
+    // writing a value meanwhile, so each value is copied out under its
+    // seqlock first.
+    // ------------------------------------------------------------------
+    template <typename F>
+    void for_each_locked(F&& fn) const {
+        auto visit = [&fn](size_t, const Key& k, const Value& v) { fn(k, v); };
+        const Table* o = old_table_.load(std::memory_order_relaxed);
+        if (o) visit_table(o, visit);
+        visit_table(table_.load(std::memory_order_relaxed), visit);
+    }
+
+    // ------------------------------------------------------------------
+    // Snapshots (see snapshot.h for the format).
+    //
+    // save_locked encodes the shard; caller holds mutex().  The current
+    // table is stored as is -- its ctrl (and fingerprint) bytes plus the
+    // entries in slot order -- so load_table puts every entry back in
+    // the same slot with no probing.  Entries an incremental resize has
+    // not yet moved are stored loose, with their hashes, and re-inserted.
+    //
+    // load_table fills a fresh shard that is not yet shared, keeping its
+    // directory info.  Returns false (leaving the shard empty) if the
+    // input is malformed.  With entries in slot order, *first_hash (if
+    // given) receives first_hash() of the table as loaded, before the
+    // loose entries are re-inserted.
+    //
+    // first_hash recomputes the hash of the current table's first entry
+    // in slot order, the first record save_locked writes; false if that
+    // table is empty.  Snapshots keep it to check that the loading map
+    // hashes keys the same way.  Caller holds mutex().
+    // ------------------------------------------------------------------
+    bool first_hash(size_t& out) const {
+        const Table* t = table_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < t->capacity; ++i) {
+            if (t->ctrl[i] != 0) {
+                out = MixedHash<Key, Hash>()(t->slots[i].key);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void save_locked(SnapshotWriter& out) const {
+        const Table* t = table_.load(std::memory_order_relaxed);
+        const Table* o = old_table_.load(std::memory_order_relaxed);
+        SnapshotShardHeader h = {};
+        h.local_depth = local_depth_;
+        h.capacity = t->capacity;
+        h.entries = occupied(t);
+        h.loose = o ? occupied(o) : 0;
+        out.write_pod(h);
+        out.write(t->ctrl, t->capacity);
+        if (!kCacheHash) out.write(t->tags, t->capacity);
+
+        visit_table(t, [&](size_t pos, const Key& k, const Value& v) {
+            if (kCacheHash) {
+                out.write_pod(static_cast<uint64_t>(entry_hash(t, pos)));
+            }
+            snapshot_codec<Key>::save(out, k);
+            snapshot_codec<Value>::save(out, v);
+        });
+        if (o) {
+            visit_table(o, [&](size_t pos, const Key& k, const Value& v) {
+                out.write_pod(static_cast<uint64_t>(entry_hash(o, pos)));
+                snapshot_codec<Key>::save(out, k);
+                snapshot_codec<Value>::save(out, v);
+            });
+        }
+    }
+
+    bool load_table(SnapshotReader& in, const SnapshotShardHeader& h,
+                    EpochManager& epoch, size_t* first_hash = nullptr) {
+        size_t cap = static_cast<size_t>(h.capacity);
+        if (cap < kDefaultCapacity || (cap & (cap - 1)) != 0 ||
+            h.entries > cap || cap > in.remaining()) {
+            return false;
+        }
+        const unsigned char* ctrl = in.take(cap);
+        const unsigned char* tags = kCacheHash ? nullptr : in.take(cap);
+        if (!ctrl || (!kCacheHash && !tags)) return false;
+
+        // A slot gets its dist only once its entry has loaded, so a
+        // failed load can free exactly what it built.
+        Table* t = new Table(cap, node_, alloc_);
+        size_t loaded = 0;
+        bool ok = true;
+        for (size_t i = 0; ok && i < cap; ++i) {
+            if (ctrl[i] == 0) continue;
+            ok = ctrl[i] < kMaxDist && loaded < h.entries &&
+                 load_entry(in, t, i);
+            if (ok) {
+                t->set_dist(i, ctrl[i]);
+                if (tags) t->set_tag(i, tags[i]);
+                ++loaded;
+            }
+        }
+        if (!ok || loaded != h.entries) {
+            free_values(t, NodeValues());
+            delete t;
+            return false;
+        }
+
+        delete table_.load(std::memory_order_relaxed);
+        table_.store(t, std::memory_order_relaxed);
+        size_.store(loaded, std::memory_order_relaxed);
+        if (first_hash) this->first_hash(*first_hash);
+
+        for (uint64_t j = 0; ok && j < h.loose; ++j) {
+            uint64_t hash = 0;
+            Key k = Key();
+            Value v = Value();
+            ok = in.read_pod(hash) && snapshot_codec<Key>::load(in, k) &&
+                 snapshot_codec<Value>::load(in, v);
+            if (ok) {
+                add_new(static_cast<size_t>(hash), std::move(k), std::move(v),
+                        epoch);
+            }
+        }
+        if (!ok) clear(epoch);
+        return ok;
+    }
+
 private:
+    // Readers only touch the table pointers; writer state starts on its
+    // own cache line so lock and counter traffic does not evict them.
     std::atomic<Table*> table_;
-    Mutex               mutex_;
+    std::atomic<Table*> old_table_;   // non-null during incremental resize
+    alignas(kCacheLineSize) Lock mutex_;
+    std::atomic<Published*> published_{nullptr};  // flat-combining list
     std::atomic<size_t> size_;
     size_t              shrink_counter_;
+    size_t              migrate_pos_;   // next old-table slot to migrate
+    size_t              migrate_left_;  // old-table slots not yet scanned
+    int                 node_;          // NUMA node for new tables, or -1
+    size_t              id_;            // see set_directory_info
+    unsigned            local_depth_;
+    Allocator           alloc_;         // source of table memory
+    NodePoolType*       pool_;          // value nodes; kNodeValues only
+    Stats               stats_;
 
     static const size_t  kDefaultCapacity = 16;
     static const uint8_t kMaxDist = 128;
 
+    // Growth of tables at least this large is incremental; smaller ones
+    // are rehashed in one go since that is cheaper than tracking progress.
+    static const size_t kIncrementalResizeMin = 4096;
+    // Minimum number of old-table slots each write migrates.
+    static const size_t kMigrateChunk = 256;
+
     static constexpr double kMaxLoadFactor    = 0.75;
     static constexpr double kShrinkLoadFactor = 0.15;
 
+    enum ProbeResult { kProbeMissing, kProbeFound, kProbeRetry };
+
+    // Bracket a run of entry moves within t (writers only, under mutex_).
+    static void begin_shift(Table* t) {
+        uint32_t v = t->shift_seq.load(std::memory_order_relaxed);
+        t->shift_seq.store(v + 1, std::memory_order_release);
+    }
+    static void end_shift(Table* t) {
+        uint32_t v = t->shift_seq.load(std::memory_order_relaxed);
+        t->shift_seq.store(v + 1, std::memory_order_release);
+    }
+
     // SeqLock helpers -- bracket slot mutations on the write side.
-    static void seq_lock(Slot& s) {
-        uint32_t v = s.seq.load(std::memory_order_relaxed);
-        s.seq.store(v + 1, std::memory_order_release);  // odd → write in progress
+    // With kAtomicSlots a lock-free updater may own the slot, so the
+    // even -> odd transition is a CAS that waits for it to finish.
+    // A counter must not be locked twice, which matters once several
+    // slots share it: see lock_pair and SeqRun.
+    static void seq_lock(std::atomic<uint32_t>& seq) {
+        uint32_t v = seq.load(std::memory_order_relaxed);
+        if (kAtomicSlots) {
+            for (;;) {
+                if (!(v & 1) &&
+                    seq.compare_exchange_weak(v, v + 1,
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed)) {
+                    return;
+                }
+                cpu_relax();
+                v = seq.load(std::memory_order_relaxed);
+            }
+        }
+        seq.store(v + 1, std::memory_order_release);  // odd → write in progress
+    }
+    static void seq_unlock(std::atomic<uint32_t>& seq) {
+        uint32_t v = seq.load(std::memory_order_relaxed);
+        seq.store(v + 1, std::memory_order_release);  // even → stable
+    }
+
+    // Lock the counters of two slots, once if they share one.
+    static void lock_pair(Table* t, size_t a, size_t b) {
+        seq_lock(t->seq(a));
+        if (t->seq_index(b) != t->seq_index(a)) seq_lock(t->seq(b));
+    }
+    static void unlock_pair(Table* t, size_t a, size_t b) {
+        if (t->seq_index(b) != t->seq_index(a)) seq_unlock(t->seq(b));
+        seq_unlock(t->seq(a));
+    }
+
+    // ------------------------------------------------------------------
+    // SeqRun -- holds the counters of a run of slots visited in circular
+    // order (resize, split, migration), locking each one once.
+    //
+    // lock(pos) before a slot's entry is moved out; the counters stay odd
+    // until a second run over the same slots releases them.  There,
+    // unlock_before(pos) comes before each slot is cleared and releases
+    // the previous counter once the run has passed it; finish() releases
+    // the rest.  The first counter is held to the end, since a run that
+    // wraps all the way around returns to it.
+    // ------------------------------------------------------------------
+    struct SeqRun {
+        static const size_t kNone = ~size_t{0};
+        Table* t;
+        size_t first = kNone;
+        size_t last  = kNone;
+
+        explicit SeqRun(Table* table) : t(table) {}
+
+        void lock(size_t pos) {
+            size_t k = t->seq_index(pos);
+            if (k == last || k == first) return;
+            if (first == kNone) first = k;
+            last = k;
+            seq_lock(t->seq_word(k));
+        }
+        void unlock_before(size_t pos) {
+            size_t k = t->seq_index(pos);
+            if (k == last || k == first) return;
+            if (last != kNone && last != first) {
+                seq_unlock(t->seq_word(last));
+            }
+            if (first == kNone) first = k;
+            last = k;
+        }
+        void finish() {
+            if (last != kNone && last != first) {
+                seq_unlock(t->seq_word(last));
+            }
+            if (first != kNone) seq_unlock(t->seq_word(first));
+            first = last = kNone;
+        }
+    };
+
+    // Holds a slot's seqlock for a scope, so a throwing user functor
+    // cannot leave the slot odd forever.
+    struct SlotWriteGuard {
+        std::atomic<uint32_t>& seq;
+        SlotWriteGuard(Table* t, Slot* s)
+            : seq(t->seq(static_cast<size_t>(s - t->slots))) {
+            seq_lock(seq);
+        }
+        ~SlotWriteGuard() { seq_unlock(seq); }
+        SlotWriteGuard(const SlotWriteGuard&) = delete;
+        SlotWriteGuard& operator=(const SlotWriteGuard&) = delete;
+    };
+
+    // ------------------------------------------------------------------
+    // Hash cache helpers.  With kCacheHash a slot stores its full hash;
+    // otherwise only the fingerprint in Table::tags, and the hash of an
+    // entry that moves is recomputed from its key.
+    // ------------------------------------------------------------------
+    using HashCached = std::integral_constant<bool, kCacheHash>;
+
+    static uint8_t fingerprint(size_t hash) {
+        return static_cast<uint8_t>(
+            (static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ull) >> 56);
+    }
+
+    static size_t entry_hash(const Table* t, size_t pos) {
+        return entry_hash(t->slots[pos], HashCached());
     }
-    static void seq_unlock(Slot& s) {
-        uint32_t v = s.seq.load(std::memory_order_relaxed);
-        s.seq.store(v + 1, std::memory_order_release);  // even → stable
+    static size_t entry_hash(const Slot& s, std::true_type) { return s.hash; }
+    static size_t entry_hash(const Slot& s, std::false_type) {
+        return MixedHash<Key, Hash>()(s.key);
+    }
+
+    static void set_entry_hash(Table* t, size_t pos, size_t hash) {
+        set_entry_hash(t, pos, hash, HashCached());
+    }
+    static void set_entry_hash(Table* t, size_t pos, size_t hash,
+                               std::true_type) {
+        t->slots[pos].hash = hash;
+    }
+    static void set_entry_hash(Table* t, size_t pos, size_t hash,
+                               std::false_type) {
+        t->set_tag(pos, fingerprint(hash));
+    }
+
+    // Move slot from's hash (or fingerprint) to slot to.
+    static void move_entry_hash(Table* t, size_t to, size_t from) {
+        move_entry_hash(t, to, from, HashCached());
+    }
+    static void move_entry_hash(Table* t, size_t to, size_t from,
+                                std::true_type) {
+        t->slots[to].hash = t->slots[from].hash;
+    }
+    static void move_entry_hash(Table* t, size_t to, size_t from,
+                                std::false_type) {
+        t->set_tag(to, t->tags[from]);
+    }
+
+    // Early-out before the key compare: the cached hash must match.  The
+    // fingerprint was already screened for the whole group (probe_mask).
+    static bool hash_matches(const Slot& s, size_t hash) {
+        return hash_matches(s, hash, HashCached());
+    }
+    static bool hash_matches(const Slot& s, size_t hash, std::true_type) {
+        return s.hash == hash;
+    }
+    static bool hash_matches(const Slot&, size_t, std::false_type) {
+        return true;
+    }
+
+    // Distance screen of the group at pos, narrowed by fingerprint when
+    // hashes are not cached.
+    static ProbeMask probe_mask(const Table* t, size_t pos, unsigned base_dist,
+                                uint8_t tag) {
+        ProbeMask m = match_probe_group(t->ctrl + pos,
+                                        static_cast<uint8_t>(base_dist));
+        if (!kCacheHash) m.candidates &= match_byte_group(t->tags + pos, tag);
+        return m;
+    }
+
+    // ------------------------------------------------------------------
+    // Value storage helpers.  Inline values are read and written in the
+    // slot under its seqlock.  With kNodeValues the slot holds a Node*
+    // instead, and a published node is never written: writers build a
+    // replacement outside the seqlock window, swap the pointer inside it
+    // and retire the old node.  Readers therefore only copy the pointer
+    // in the window and read the value once it has validated.
+    // ------------------------------------------------------------------
+    using NodeValues = std::integral_constant<bool, kNodeValues>;
+    using StatsEnabled = std::integral_constant<bool, Stats::enabled>;
+
+    void bind_stats(std::true_type) { mutex_.set_stats(&stats_); }
+    void bind_stats(std::false_type) {}
+
+    static NodePoolType* make_pool(int, const Allocator&, std::false_type) {
+        return nullptr;
+    }
+    static NodePoolType* make_pool(int node, const Allocator& alloc,
+                                   std::true_type) {
+        return NodePoolType::make(node, alloc);
+    }
+
+    Stored make_stored(Value&& v, std::false_type) { return std::move(v); }
+    Stored make_stored(Value&& v, std::true_type) {
+        return pool_->create(std::move(v));
+    }
+
+    static const Value& value_of(const Slot& s) {
+        return value_of(s, NodeValues());
+    }
+    static const Value& value_of(const Slot& s, std::false_type) {
+        return s.value;
+    }
+    static const Value& value_of(const Slot& s, std::true_type) {
+        return s.value->value;
+    }
+
+    // Reader side, inside the seqlock window: read an inline value, or
+    // just capture the node to read after the window.
+    template <typename Read>
+    static const Node* read_in_window(const Slot& s, Read& read,
+                                      std::false_type) {
+        read(s.value);
+        return nullptr;
+    }
+    template <typename Read>
+    static const Node* read_in_window(const Slot& s, Read&, std::true_type) {
+        return s.value;
+    }
+
+    template <typename VArg>
+    void assign_value(Table* t, Slot* s, VArg&& v, EpochManager&,
+                      std::false_type) {
+        SlotWriteGuard g(t, s);
+        s->value = std::forward<VArg>(v);
+    }
+    template <typename VArg>
+    void assign_value(Table* t, Slot* s, VArg&& v, EpochManager& epoch,
+                      std::true_type) {
+        swap_node(t, s, pool_->create(std::forward<VArg>(v)), epoch);
+    }
+
+    // fn(value) in place, or on a copy that then replaces the node.
+    template <typename F>
+    void modify_value(Table* t, Slot* s, F& fn, EpochManager&,
+                      std::false_type) {
+        SlotWriteGuard g(t, s);
+        fn(s->value);
+    }
+    template <typename F>
+    void modify_value(Table* t, Slot* s, F& fn, EpochManager& epoch,
+                      std::true_type) {
+        // The copy goes back to the pool if fn throws.
+        struct Draft {
+            Node* n;
+            ~Draft() { if (n) n->pool->destroy(n); }
+        } draft{pool_->create(s->value->value)};
+        fn(draft.n->value);
+        Node* n = draft.n;
+        draft.n = nullptr;
+        swap_node(t, s, n, epoch);
+    }
+
+    static void swap_node(Table* t, Slot* s, Node* n, EpochManager& epoch) {
+        Node* old = s->value;
+        {
+            SlotWriteGuard g(t, s);
+            s->value = n;
+        }
+        epoch.retire(old);
+    }
+
+    static void retire_value(Slot&, EpochManager&, std::false_type) {}
+    static void retire_value(Slot& s, EpochManager& epoch, std::true_type) {
+        epoch.retire(s.value);
+    }
+
+    // Retire (readers may hold them) or free (no readers left) the nodes
+    // of every entry of t.
+    static void retire_values(Table*, EpochManager&, std::false_type) {}
+    static void retire_values(Table* t, EpochManager& epoch, std::true_type) {
+        for (size_t i = 0; i < t->capacity; ++i) {
+            if (t->ctrl[i] != 0) epoch.retire(t->slots[i].value);
+        }
+    }
+    static void free_values(Table*, std::false_type) {}
+    static void free_values(Table* t, std::true_type) {
+        for (size_t i = 0; i < t->capacity; ++i) {
+            Node* n = t->slots[i].value;
+            if (t->ctrl[i] != 0) n->pool->destroy(n);
+        }
+    }
+
+    static size_t occupied(const Table* t) {
+        size_t n = 0;
+        for (size_t i = 0; i < t->capacity; ++i) n += t->ctrl[i] != 0;
+        return n;
+    }
+
+    // One slot-order record of save_locked into slot pos of t.
+    bool load_entry(SnapshotReader& in, Table* t, size_t pos) {
+        Slot& s = t->slots[pos];
+        if (kCacheHash) {
+            uint64_t hash = 0;
+            if (!in.read_pod(hash)) return false;
+            set_entry_hash(t, pos, static_cast<size_t>(hash));
+        }
+        return snapshot_codec<Key>::load(in, s.key) &&
+               load_value(in, s, NodeValues());
+    }
+    static bool load_value(SnapshotReader& in, Slot& s, std::false_type) {
+        return snapshot_codec<Value>::load(in, s.value);
+    }
+    bool load_value(SnapshotReader& in, Slot& s, std::true_type) {
+        Value v = Value();
+        if (!snapshot_codec<Value>::load(in, v)) return false;
+        s.value = pool_->create(std::move(v));
+        return true;
+    }
+
+    // Entries not yet migrated out of an old table still have a dist, so
+    // a visit of both tables sees every entry once.  fn(pos, key, value).
+    template <typename F>
+    static void visit_table(const Table* t, F&& fn) {
+        for (size_t i = 0; i < t->capacity; ++i) {
+            if (t->ctrl[i] != 0) {
+                visit_entry(t, i, fn,
+                            std::integral_constant<bool, kAtomicSlots>());
+            }
+        }
+    }
+    template <typename F>
+    static void visit_entry(const Table* t, size_t pos, F& fn,
+                            std::false_type) {
+        fn(pos, t->slots[pos].key, value_of(t->slots[pos]));
+    }
+    template <typename F>
+    CHM_NO_TSAN
+    static void visit_entry(const Table* t, size_t pos, F& fn,
+                            std::true_type) {
+        const std::atomic<uint32_t>& seq = t->seq(pos);
+        for (;;) {
+            uint32_t seq1 = seq.load(std::memory_order_acquire);
+            if (seq1 & 1) {
+                cpu_relax();
+                continue;
+            }
+            Value v = value_of(t->slots[pos]);
+            if (seq.load(std::memory_order_acquire) == seq1) {
+                fn(pos, t->slots[pos].key, static_cast<const Value&>(v));
+                return;
+            }
+        }
+    }
+
+    // ------------------------------------------------------------------
+    // read_slot -- lock-free lookup shared by find, find_into and
+    // contains.  read(value) runs inside the matching slot's seqlock
+    // window and is repeated if that window turns out to be torn.
+    //
+    // During an incremental resize the old table is probed before the
+    // new one: entries only ever move old -> new, so a key missed in the
+    // old table has already been published in the new one.
+    // ------------------------------------------------------------------
+    template <typename K, typename Read>
+    CHM_NO_TSAN
+    bool read_slot(size_t hash, const K& key, Read&& read) const {
+        for (;;) {
+            const Table* t = table_.load(std::memory_order_acquire);
+            const Table* o = old_table_.load(std::memory_order_acquire);
+
+            ProbeResult r = o ? probe_table(o, hash, key, read) : kProbeMissing;
+            if (r == kProbeMissing) r = probe_table(t, hash, key, read);
+            if (r == kProbeFound) return true;
+
+            // A miss on a table that has since been replaced is not
+            // trustworthy: the key may have been moved by a resize.
+            if (r == kProbeMissing &&
+                table_.load(std::memory_order_acquire) == t &&
+                old_table_.load(std::memory_order_acquire) == o) {
+                return false;
+            }
+            stats_.read_retry();
+        }
+    }
+
+    template <typename K, typename Read>
+    CHM_NO_TSAN
+    ProbeResult probe_table(const Table* t, size_t hash, const K& key,
+                            Read& read) const {
+        size_t pos = hash & t->mask;
+        unsigned base_dist = 1;
+        uint8_t tag = fingerprint(hash);
+        uint32_t shifts = t->shift_seq.load(std::memory_order_acquire);
+
+        for (;;) {
+            ProbeMask m = probe_mask(t, pos, base_dist, tag);
+            for (uint32_t c = m.candidates; c != 0; c &= c - 1) {
+                unsigned i = lowest_bit(c);
+                size_t p = (pos + i) & t->mask;
+                const Slot& s = t->slots[p];
+                const std::atomic<uint32_t>& seq = t->seq(p);
+                uint32_t seq1 = seq.load(std::memory_order_acquire);
+                if (seq1 & 1) return kProbeRetry;  // writer active
+
+                bool match = t->ctrl[p] == base_dist + i &&
+                             hash_matches(s, hash) && KeyEqual()(s.key, key);
+                const Node* node = nullptr;
+                if (match) node = read_in_window(s, read, NodeValues());
+
+                uint32_t seq2 = seq.load(std::memory_order_acquire);
+                if (seq2 != seq1) return kProbeRetry;  // slot changed
+
+                if (match) {
+                    if (node) read(node->value);
+                    stats_.probe(true, base_dist + i);
+                    return kProbeFound;
+                }
+            }
+            if (m.stop) return counted_miss(t, shifts, base_dist);
+            pos = (pos + kGroupWidth) & t->mask;
+            base_dist += kGroupWidth;
+            if (base_dist > 255) return counted_miss(t, shifts, base_dist);
+        }
+    }
+
+    // settled_miss, recording the probe length of a miss that stands.
+    ProbeResult counted_miss(const Table* t, uint32_t shifts,
+                             unsigned base_dist) const {
+        ProbeResult r = settled_miss(t, shifts);
+        if (r == kProbeMissing) {
+            stats_.probe(false, base_dist + kGroupWidth - 1);
+        }
+        return r;
+    }
+
+    // A miss only counts if no entry was in transit during the probe;
+    // the ctrl screen skips the per-slot seq checks that would catch it.
+    static ProbeResult settled_miss(const Table* t, uint32_t shifts) {
+        if ((shifts & 1) ||
+            t->shift_seq.load(std::memory_order_acquire) != shifts) {
+            return kProbeRetry;
+        }
+        return kProbeMissing;
+    }
+
+    // probe_slot -- like probe_table, but reports the matching slot, its
+    // seqlock counter and the even seq it was validated at instead of
+    // reading the value.
+    template <typename K>
+    CHM_NO_TSAN
+    ProbeResult probe_slot(Table* t, size_t hash, const K& key,
+                           Slot** found, std::atomic<uint32_t>** found_word,
+                           uint32_t* found_seq) const {
+        size_t pos = hash & t->mask;
+        unsigned base_dist = 1;
+        uint8_t tag = fingerprint(hash);
+        uint32_t shifts = t->shift_seq.load(std::memory_order_acquire);
+
+        for (;;) {
+            ProbeMask m = probe_mask(t, pos, base_dist, tag);
+            for (uint32_t c = m.candidates; c != 0; c &= c - 1) {
+                unsigned i = lowest_bit(c);
+                size_t p = (pos + i) & t->mask;
+                Slot& s = t->slots[p];
+                std::atomic<uint32_t>& seq = t->seq(p);
+                uint32_t seq1 = seq.load(std::memory_order_acquire);
+                if (seq1 & 1) return kProbeRetry;  // writer active
+
+                bool match = t->ctrl[p] == base_dist + i &&
+                             hash_matches(s, hash) && KeyEqual()(s.key, key);
+
+                uint32_t seq2 = seq.load(std::memory_order_acquire);
+                if (seq2 != seq1) return kProbeRetry;  // slot changed
+
+                if (match) {
+                    *found = &s;
+                    *found_word = &seq;
+                    *found_seq = seq1;
+                    return kProbeFound;
+                }
+            }
+            if (m.stop) return settled_miss(t, shifts);
+            pos = (pos + kGroupWidth) & t->mask;
+            base_dist += kGroupWidth;
+            if (base_dist > 255) return settled_miss(t, shifts);
+        }
     }
 
     // ------------------------------------------------------------------
     // find_in_table -- const version, returns const Slot* or nullptr.
     // ------------------------------------------------------------------
+    template <typename K>
     const Slot* find_in_table(const Table* t, size_t hash,
-                              const Key& key) const {
+                              const K& key) const {
         size_t pos = hash & t->mask;
-        uint8_t expected_dist = 1;
+        unsigned base_dist = 1;
+        uint8_t tag = fingerprint(hash);
 
         for (;;) {
-            const Slot& s = t->slots[pos];
-            if (s.dist == 0) return nullptr;
-            if (s.dist < expected_dist) return nullptr;
-            __builtin_prefetch(&t->slots[(pos + 1) & t->mask], 0, 1);
-            if (s.dist == expected_dist && s.hash == hash &&
-                KeyEqual()(s.key, key)) {
-                return &s;
+            ProbeMask m = probe_mask(t, pos, base_dist, tag);
+            for (uint32_t c = m.candidates; c != 0; c &= c - 1) {
+                const Slot& s = t->slots[(pos + lowest_bit(c)) & t->mask];
+                if (hash_matches(s, hash) && KeyEqual()(s.key, key)) {
+                    return &s;
+                }
             }
-            pos = (pos + 1) & t->mask;
-            ++expected_dist;
-            if (expected_dist == 0) return nullptr;
+            if (m.stop) return nullptr;
+            pos = (pos + kGroupWidth) & t->mask;
+            base_dist += kGroupWidth;
+            if (base_dist > 255) return nullptr;
         }
     }
 
     // ------------------------------------------------------------------
     // find_in_table_mut -- mutable version for write operations.
     // ------------------------------------------------------------------
-    Slot* find_in_table_mut(Table* t, size_t hash, const Key& key) {
-        size_t pos = hash & t->mask;
-        uint8_t expected_dist = 1;
+    template <typename K>
+    Slot* find_in_table_mut(Table* t, size_t hash, const K& key) {
+        return const_cast<Slot*>(find_in_table(t, hash, key));
+    }
 
+    // ------------------------------------------------------------------
+    // *_locked -- bodies of the single-key writes.  Must be called under
+    // mutex_.
+    // ------------------------------------------------------------------
+    template <typename KArg, typename VArg>
+    bool insert_locked(size_t hash, KArg&& key, VArg&& value,
+                       EpochManager& epoch) {
+        migrate_step(epoch);
+
+        // Check for existing key first.
+        if (locate(hash, key) != nullptr) {
+            return false;  // key already exists
+        }
+        add_new(hash, Key(std::forward<KArg>(key)),
+                Value(std::forward<VArg>(value)), epoch);
+        return true;
+    }
+
+    template <typename K>
+    bool erase_locked(size_t hash, const K& key, EpochManager& epoch,
+                      bool shrink) {
+        migrate_step(epoch);
+
+        Table* t = nullptr;
+        Slot* found = locate(hash, key, &t);
+        if (found == nullptr) return false;
+
+        erase_at(t, static_cast<size_t>(found - t->slots), epoch);
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        if (shrink) maybe_shrink(epoch);
+        return true;
+    }
+
+    // ------------------------------------------------------------------
+    // locate -- find key in the migrating old table or the current one.
+    // Optionally reports which table holds it.  Must be called under
+    // mutex_.
+    // ------------------------------------------------------------------
+    template <typename K>
+    Slot* locate(size_t hash, const K& key, Table** where = nullptr) {
+        Table* o = old_table_.load(std::memory_order_relaxed);
+        if (o) {
+            if (Slot* s = find_in_table_mut(o, hash, key)) {
+                if (where) *where = o;
+                return s;
+            }
+        }
+        Table* t = table_.load(std::memory_order_relaxed);
+        if (where) *where = t;
+        return find_in_table_mut(t, hash, key);
+    }
+
+    // ------------------------------------------------------------------
+    // erase_at -- backward-shift delete of the element at pos.  Entries
+    // are in transit while they shift, so shift_seq is held odd.  A value
+    // node is retired up front; this writer's own pin keeps it alive
+    // until the shift has unlinked it.
+    // ------------------------------------------------------------------
+    void erase_at(Table* t, size_t pos, EpochManager& epoch) {
+        retire_value(t->slots[pos], epoch, NodeValues());
+        begin_shift(t);
         for (;;) {
-            Slot& s = t->slots[pos];
-            if (s.dist == 0) return nullptr;
-            if (s.dist < expected_dist) return nullptr;
-            __builtin_prefetch(&t->slots[(pos + 1) & t->mask], 0, 1);
-            if (s.dist == expected_dist && s.hash == hash &&
-                KeyEqual()(s.key, key)) {
-                return &s;
+            size_t next_pos = (pos + 1) & t->mask;
+            Slot& next_slot = t->slots[next_pos];
+            uint8_t next_dist = t->ctrl[next_pos];
+            if (next_dist <= 1) {
+                // next is empty (dist==0) or at home (dist==1): stop.
+                // Reset the slot to release held resources.
+                seq_lock(t->seq(pos));
+                t->set_dist(pos, 0);
+                t->slots[pos].key   = Key();
+                t->slots[pos].value = Stored();
+                seq_unlock(t->seq(pos));
+                break;
             }
-            pos = (pos + 1) & t->mask;
-            ++expected_dist;
-            if (expected_dist == 0) return nullptr;
+            // Move next_slot backward into pos, decrement its dist.
+            // Lock both slots: source and destination.
+            lock_pair(t, pos, next_pos);
+            t->slots[pos].key   = std::move(next_slot.key);
+            t->slots[pos].value = std::move(next_slot.value);
+            move_entry_hash(t, pos, next_pos);
+            t->set_dist(pos, static_cast<uint8_t>(next_dist - 1));
+            unlock_pair(t, pos, next_pos);
+            pos = next_pos;
         }
+        end_shift(t);
     }
 
     // ------------------------------------------------------------------
     // insert_into_table -- Robin Hood insertion.  Does NOT check for
     // duplicates.  The caller must do that.
     //
-    // Returns true on success, false if max probe distance exceeded
-    // (caller must resize and retry).
+    // hash/key/value are the element being carried.  Returns true once
+    // it has landed (key and value are then moved-from).  Returns false
+    // if max probe distance was exceeded; the arguments then hold the
+    // element displaced last, which the caller must place after resizing.
+    //
+    // From the first displacement until the carried element lands, an
+    // entry is in no slot at all, so the table's shift_seq is held odd.
     // ------------------------------------------------------------------
-    bool insert_into_table(Table* t, size_t hash,
-                           const Key& key, const Value& value) {
+    bool insert_into_table(Table* t, size_t& hash, Key& key, Stored& value) {
         size_t pos = hash & t->mask;
         uint8_t cur_dist = 1;
-        size_t cur_hash  = hash;
-        Key   cur_key   = key;
-        Value cur_value = value;
+        bool shifting = false;
 
         for (;;) {
             Slot& s = t->slots[pos];
-
-            if (s.dist == 0) {
-                seq_lock(s);
-                s.dist  = cur_dist;
-                s.hash  = cur_hash;
-                s.key   = std::move(cur_key);
-                s.value = std::move(cur_value);
-                seq_unlock(s);
+            uint8_t dist = t->ctrl[pos];
+
+            if (dist == 0) {
+                seq_lock(t->seq(pos));
+                t->set_dist(pos, cur_dist);
+                set_entry_hash(t, pos, hash);
+                s.key   = std::move(key);
+                s.value = std::move(value);
+                seq_unlock(t->seq(pos));
+                if (shifting) end_shift(t);
                 return true;
             }
 
-            if (s.dist < cur_dist) {
+            if (dist < cur_dist) {
                 // Robin Hood: steal from the rich.
-                seq_lock(s);
-                std::swap(cur_dist,  s.dist);
-                std::swap(cur_hash,  s.hash);
-                std::swap(cur_key,   s.key);
-                std::swap(cur_value, s.value);
-                seq_unlock(s);
+                if (!shifting) {
+                    begin_shift(t);
+                    shifting = true;
+                }
+                size_t displaced_hash = entry_hash(t, pos);
+                seq_lock(t->seq(pos));
+                t->set_dist(pos, cur_dist);
+                cur_dist = dist;
+                set_entry_hash(t, pos, hash);
+                hash = displaced_hash;
+                std::swap(key,   s.key);
+                std::swap(value, s.value);
+                seq_unlock(t->seq(pos));
             }
 
             pos = (pos + 1) & t->mask;
             ++cur_dist;
 
             if (cur_dist >= kMaxDist) {
+                if (shifting) end_shift(t);
                 return false;
             }
         }
     }
 
+    // ------------------------------------------------------------------
+    // place -- insert into the current table, doubling it whenever the
+    // probe distance limit is hit.  Must be called under mutex_.
+    // ------------------------------------------------------------------
+    void place(size_t hash, Key& key, Stored& value, EpochManager& epoch) {
+        Table* t = table_.load(std::memory_order_relaxed);
+        while (!insert_into_table(t, hash, key, value)) {
+            stats_.forced_grow();
+            resize(t->capacity * 2, epoch);
+            t = table_.load(std::memory_order_relaxed);
+        }
+    }
+
+    // add_new -- insert a key known to be absent.  key and value are
+    // taken by value so callers can move (or elide) into them; they are
+    // then moved along the Robin Hood chain.  Must be called under mutex_.
+    void add_new(size_t hash, Key key, Value value, EpochManager& epoch) {
+        // Expand before insert to guarantee sufficient capacity.
+        maybe_expand_for_insert(epoch);
+        Stored stored = make_stored(std::move(value), NodeValues());
+        place(hash, key, stored, epoch);
+        size_.fetch_add(1, std::memory_order_relaxed);
+        shrink_counter_ = 0;
+    }
+
+    // Smallest table capacity that holds count entries within
+    // kMaxLoadFactor: capacity >= count / kMaxLoadFactor.
+    static size_t capacity_for(size_t count) {
+        size_t needed = static_cast<size_t>(
+            static_cast<double>(count) / kMaxLoadFactor) + 1;
+        needed = next_power_of_2(needed);
+        return needed < kDefaultCapacity ? kDefaultCapacity : needed;
+    }
+
     // ------------------------------------------------------------------
     // Robin Hood insertion during resize (directly into the given table).
     // Identical logic but operates on an explicit table pointer.
     // ------------------------------------------------------------------
-    void rehash_insert(Table* t, Key key, Value value, size_t hash) {
+    void rehash_insert(Table* t, Key key, Stored value, size_t hash) {
         size_t pos = hash & t->mask;
         uint8_t cur_dist = 1;
         size_t cur_hash  = hash;
-        Key   cur_key   = std::move(key);
-        Value cur_value = std::move(value);
+        Key    cur_key   = std::move(key);
+        Stored cur_value = std::move(value);
 
         for (;;) {
             Slot& s = t->slots[pos];
+            uint8_t dist = t->ctrl[pos];
 
-            if (s.dist == 0) {
-                s.dist  = cur_dist;
-                s.hash  = cur_hash;
+            if (dist == 0) {
+                t->set_dist(pos, cur_dist);
+                set_entry_hash(t, pos, cur_hash);
                 s.key   = std::move(cur_key);
                 s.value = std::move(cur_value);
                 return;
             }
 
-            if (s.dist < cur_dist) {
-                std::swap(cur_dist,  s.dist);
-                std::swap(cur_hash,  s.hash);
+            if (dist < cur_dist) {
+                size_t displaced_hash = entry_hash(t, pos);
+                t->set_dist(pos, cur_dist);
+                cur_dist = dist;
+                set_entry_hash(t, pos, cur_hash);
+                cur_hash = displaced_hash;
                 std::swap(cur_key,   s.key);
                 std::swap(cur_value, s.value);
             }
@@ -508,29 +1776,123 @@ private:
 
     // ------------------------------------------------------------------
     // resize -- allocate new table, rehash, atomic swap, retire old.
-    // Must be called under mutex_.
+    // Only rehashes the current table; an in-progress migration keeps
+    // draining into the replacement.  Must be called under mutex_.
     // ------------------------------------------------------------------
     void resize(size_t new_capacity, EpochManager& epoch) {
+        uint64_t start = stats_clock<Stats::enabled>();
+        size_t old_capacity = table_.load(std::memory_order_relaxed)->capacity;
+        publish_table(new Table(new_capacity, node_, alloc_), epoch);
+        stats_.resized(old_capacity, new_capacity,
+                       stats_clock<Stats::enabled>() - start);
+    }
+
+    // publish_table -- move the current table's entries into new_table
+    // (which may already hold others), publish it and retire the old one.
+    // Must be called under mutex_.
+    void publish_table(Table* new_table, EpochManager& epoch) {
         Table* old_table = table_.load(std::memory_order_relaxed);
-        Table* new_table = new Table(new_capacity);
 
+        // Old slots stay locked (odd) until the new table is published,
+        // so readers retry instead of missing an entry in transit.
+        SeqRun held(old_table);
         for (size_t i = 0; i < old_table->capacity; ++i) {
-            Slot& s = old_table->slots[i];
-            if (s.dist != 0) {
-                // Lock the old slot so concurrent readers see a
-                // consistent state (they will retry on seq mismatch).
-                seq_lock(s);
-                Key   k = std::move(s.key);
-                Value v = std::move(s.value);
-                size_t h = s.hash;
-                s.dist = 0;
-                seq_unlock(s);
-                rehash_insert(new_table, std::move(k), std::move(v), h);
+            if (old_table->ctrl[i] != 0) {
+                Slot& s = old_table->slots[i];
+                size_t h = entry_hash(old_table, i);
+                held.lock(i);
+                rehash_insert(new_table, std::move(s.key), std::move(s.value),
+                              h);
             }
         }
 
         table_.store(new_table, std::memory_order_release);
-        epoch.retire(old_table);
+        SeqRun release(old_table);
+        for (size_t i = 0; i < old_table->capacity; ++i) {
+            if (old_table->ctrl[i] == 0) continue;
+            release.unlock_before(i);
+            old_table->set_dist(i, 0);
+        }
+        release.finish();
+        epoch.retire(old_table, true);
+    }
+
+    // ------------------------------------------------------------------
+    // Incremental resize.
+    //
+    // start_migration publishes an empty table twice the size and keeps
+    // the old one in old_table_.  Each later write calls migrate_step,
+    // which moves at least kMigrateChunk old slots.  A chunk always ends
+    // on an empty slot, so clearing it never cuts a probe chain that
+    // still has unmigrated members; within a chunk every entry is first
+    // published in the new table (its old slot held odd) and only then
+    // cleared.  When the scan wraps around, the old table is retired.
+    // Must be called under mutex_.
+    // ------------------------------------------------------------------
+    void start_migration(size_t new_capacity) {
+        Table* o = table_.load(std::memory_order_relaxed);
+        Table* n = new Table(new_capacity, node_, alloc_);
+
+        // Load factor < 1 guarantees an empty slot; start right after it.
+        size_t start = 0;
+        while (o->ctrl[start] != 0) ++start;
+        migrate_pos_  = (start + 1) & o->mask;
+        migrate_left_ = o->capacity;
+
+        old_table_.store(o, std::memory_order_release);
+        table_.store(n, std::memory_order_release);
+        stats_.migration_started();
+    }
+
+    void migrate_step(EpochManager& epoch) {
+        Table* o = old_table_.load(std::memory_order_relaxed);
+        if (!o) return;
+
+        size_t begin   = migrate_pos_;
+        size_t scanned = 0;
+        SeqRun held(o);
+        for (;;) {
+            size_t pos = migrate_pos_;
+            Slot& s = o->slots[pos];
+            bool empty = o->ctrl[pos] == 0;
+            if (!empty) {
+                size_t h = entry_hash(o, pos);
+                held.lock(pos);
+                Key    k = std::move(s.key);
+                Stored v = std::move(s.value);
+                place(h, k, v, epoch);
+            }
+            migrate_pos_ = (pos + 1) & o->mask;
+            ++scanned;
+            --migrate_left_;
+            if (migrate_left_ == 0 || (empty && scanned >= kMigrateChunk)) {
+                break;
+            }
+        }
+
+        size_t pos = begin;
+        SeqRun release(o);
+        for (size_t i = 0; i < scanned; ++i, pos = (pos + 1) & o->mask) {
+            Slot& s = o->slots[pos];
+            if (o->ctrl[pos] != 0) {
+                release.unlock_before(pos);
+                o->set_dist(pos, 0);
+                s.key   = Key();
+                s.value = Stored();
+            }
+        }
+        release.finish();
+
+        if (migrate_left_ == 0) {
+            old_table_.store(nullptr, std::memory_order_release);
+            epoch.retire(o, true);
+        }
+    }
+
+    void finish_migration(EpochManager& epoch) {
+        while (old_table_.load(std::memory_order_relaxed)) {
+            migrate_step(epoch);
+        }
     }
 
     // ------------------------------------------------------------------
@@ -543,7 +1905,13 @@ private:
         size_t sz = size_.load(std::memory_order_relaxed);
         if (static_cast<double>(sz + 1) >
             static_cast<double>(t->capacity) * kMaxLoadFactor) {
-            resize(t->capacity * 2, epoch);
+            finish_migration(epoch);
+            t = table_.load(std::memory_order_relaxed);
+            if (t->capacity >= kIncrementalResizeMin) {
+                start_migration(t->capacity * 2);
+            } else {
+                resize(t->capacity * 2, epoch);
+            }
         }
     }
 
@@ -552,6 +1920,8 @@ private:
     // Must be called under mutex_.
     // ------------------------------------------------------------------
     void maybe_shrink(EpochManager& epoch) {
+        if (old_table_.load(std::memory_order_relaxed)) return;
+
         Table* t = table_.load(std::memory_order_relaxed);
         size_t sz = size_.load(std::memory_order_relaxed);
         double load = static_cast<double>(sz) /
@@ -1,9 +1,40 @@
 #pragma once
 #include <atomic>
+#include <thread>
 
 namespace concurrent_hashmap {
 namespace detail {
 
+// Hint to the CPU that the caller is busy-waiting.
+inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(_M_X64)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield" ::: "memory");
+#endif
+}
+
+// Exponential backoff for spin-wait loops: pause() busy-waits for twice
+// as long each call, and once that reaches kMaxPauses it yields the
+// timeslice instead, so a waiter whose lock holder has been preempted
+// lets the holder run.
+class Backoff {
+public:
+    static constexpr unsigned kMaxPauses = 64;
+
+    void pause() noexcept {
+        if (pauses_ <= kMaxPauses) {
+            for (unsigned i = 0; i < pauses_; ++i) cpu_relax();
+            pauses_ *= 2;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    unsigned pauses_ = 1;
+};
+
 class SpinLock {
 public:
     SpinLock() noexcept : flag_(false) {}
@@ -17,13 +48,10 @@ public:
             if (!flag_.exchange(true, std::memory_order_acquire)) {
                 return;
             }
-            // Spin on read until released
+            // Spin on read until released, backing off
+            Backoff backoff;
             while (flag_.load(std::memory_order_relaxed)) {
-                #if defined(__x86_64__) || defined(_M_X64)
-                __builtin_ia32_pause();
-                #elif defined(__aarch64__)
-                __asm__ volatile("yield" ::: "memory");
-                #endif
+                backoff.pause();
             }
         }
     }
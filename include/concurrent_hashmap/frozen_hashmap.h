@@ -0,0 +1,263 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <concurrent_hashmap/hash.h>
+#include <concurrent_hashmap/snapshot.h>
+#include <concurrent_hashmap/traits.h>
+#include <concurrent_hashmap/detail/hash_utils.h>
+
+namespace concurrent_hashmap {
+
+// =========================================================================
+// FrozenHashMap
+//
+// An immutable hash map for data that is built once and then only read,
+// typically produced by ConcurrentHashMap::freeze().
+//
+// Layout: entries are stored densely (no empty slots) in one array,
+// sorted by bucket, where a key's bucket is the low bits of its hash and
+// the bucket count is the entry count rounded up to a power of two.
+// offsets[b] .. offsets[b + 1] delimits bucket b, so a lookup is one
+// offsets load followed by a scan of on average at most one entry, and
+// a miss in an empty bucket touches no entry at all.  With cache_hash
+// (see traits.h) a parallel array of full hashes screens entries before
+// the key compare.
+//
+// Nothing is ever written after construction, so any number of threads
+// may read concurrently without seqlocks, epochs or retries: every lookup
+// is wait-free.  To refresh the data, build a new map and publish it,
+// e.g. through std::atomic_store on a std::shared_ptr.
+// =========================================================================
+template <typename Key,
+          typename Value,
+          typename Hash     = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>>
+class FrozenHashMap {
+public:
+    using value_type = std::pair<const Key, Value>;
+
+private:
+    using EntryAlloc = typename std::allocator_traits<
+        Allocator>::template rebind_alloc<value_type>;
+    using SizeAlloc = typename std::allocator_traits<
+        Allocator>::template rebind_alloc<size_t>;
+
+    static constexpr bool kCacheHash = cache_hash<Key, Hash>::value;
+
+public:
+    using const_iterator = typename std::vector<value_type,
+                                                EntryAlloc>::const_iterator;
+
+    // ------------------------------------------------------------------
+    // Construction
+    // ------------------------------------------------------------------
+
+    /// An empty map.
+    FrozenHashMap() : FrozenHashMap(std::vector<std::pair<Key, Value>>()) {}
+
+    /// Build from entries, which are moved into place.  For duplicate
+    /// keys the first entry wins.
+    explicit FrozenHashMap(std::vector<std::pair<Key, Value>>&& entries,
+                           const Hash& hash = Hash(),
+                           const KeyEqual& equal = KeyEqual(),
+                           const Allocator& alloc = Allocator())
+        : hash_(hash), equal_(equal)
+        , entries_(EntryAlloc(alloc)), hashes_(SizeAlloc(alloc))
+        , offsets_(SizeAlloc(alloc)) {
+        build(entries);
+    }
+
+    // ------------------------------------------------------------------
+    // Wait-free reads
+    // ------------------------------------------------------------------
+
+    /// The value for key, or nullptr if absent.  The pointer stays valid
+    /// for the lifetime of the map.
+    const Value* find(const Key& key) const { return find_impl(key); }
+
+    bool contains(const Key& key) const { return find_impl(key) != nullptr; }
+
+    size_t count(const Key& key) const { return contains(key) ? 1 : 0; }
+
+    // Heterogeneous lookup (requires transparent Hash and KeyEqual).
+
+    template <typename K, typename H = Hash,
+              typename = typename std::enable_if<
+                  detail::is_transparent_lookup<H, KeyEqual>::value>::type>
+    const Value* find(const K& key) const { return find_impl(key); }
+
+    template <typename K, typename H = Hash,
+              typename = typename std::enable_if<
+                  detail::is_transparent_lookup<H, KeyEqual>::value>::type>
+    bool contains(const K& key) const { return find_impl(key) != nullptr; }
+
+    template <typename K, typename H = Hash,
+              typename = typename std::enable_if<
+                  detail::is_transparent_lookup<H, KeyEqual>::value>::type>
+    size_t count(const K& key) const { return contains(key) ? 1 : 0; }
+
+    // ------------------------------------------------------------------
+    // Utility
+    // ------------------------------------------------------------------
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+
+    /// Entries in storage (bucket) order.
+    const_iterator begin() const { return entries_.begin(); }
+    const_iterator end() const { return entries_.end(); }
+
+    /// Number of buckets (a power of two >= size()).
+    size_t bucket_count() const { return mask_ + 1; }
+
+    /// Write the map as an image file that MappedFrozenHashMap maps in
+    /// place, so that processes opening it share one copy in the page
+    /// cache (see mapped_frozen_hashmap.h).  Key and Value must be
+    /// trivially copyable.  The image is written beside path and renamed
+    /// over it, so a process that has the old image mapped keeps it.
+    /// Returns false on I/O failure.
+    bool save_image(const char* path) const {
+        static_assert(std::is_trivially_copyable<Key>::value &&
+                      std::is_trivially_copyable<Value>::value,
+                      "frozen images need trivially copyable Key and Value");
+        using Record = detail::FrozenRecord<Key, Value>;
+        size_t n = entries_.size();
+        size_t buckets = mask_ + 1;
+
+        detail::FrozenImageHeader h = {};
+        std::memcpy(h.magic, detail::kFrozenImageMagic, sizeof(h.magic));
+        h.version = detail::kFrozenImageVersion;
+        h.flags = kCacheHash ? detail::kSnapshotCachedHash : 0;
+        h.key_size = sizeof(Key);
+        h.value_size = sizeof(Value);
+        h.record_size = sizeof(Record);
+        h.entries = n;
+        h.buckets = buckets;
+        size_t tables = sizeof(h) +
+                        (buckets + 1 + (kCacheHash ? n : 0)) * sizeof(uint64_t);
+        h.records_offset = (tables + detail::kFrozenImageAlign - 1) &
+                           ~(detail::kFrozenImageAlign - 1);
+        h.check = n ? hash_(entries_[0].first) : 0;
+
+        std::string tmp = std::string(path) + ".tmp";
+        std::FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f) return false;
+        static const char kPad[detail::kFrozenImageAlign] = {};
+        bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 &&
+                  write_words(f, offsets_.data(), buckets + 1) &&
+                  (!kCacheHash || write_words(f, hashes_.data(), n)) &&
+                  std::fwrite(kPad, 1, h.records_offset - tables, f) ==
+                      h.records_offset - tables;
+
+        // Records are built in a zeroed buffer so that padding bytes are
+        // deterministic.
+        const size_t kChunk = 256;
+        typename std::aligned_storage<sizeof(Record), alignof(Record)>::type
+            chunk[kChunk];
+        for (size_t i = 0; ok && i < n; i += kChunk) {
+            size_t m = n - i < kChunk ? n - i : kChunk;
+            std::memset(static_cast<void*>(chunk), 0, sizeof(chunk));
+            for (size_t j = 0; j < m; ++j) {
+                new (&chunk[j]) Record{entries_[i + j].first,
+                                       entries_[i + j].second};
+            }
+            ok = std::fwrite(chunk, sizeof(Record), m, f) == m;
+        }
+        ok = std::fclose(f) == 0 && ok;
+        if (ok && std::rename(tmp.c_str(), path) == 0) return true;
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+private:
+    detail::MixedHash<Key, Hash> hash_;
+    KeyEqual equal_;
+    size_t   mask_ = 0;  // bucket_count() - 1
+    std::vector<value_type, EntryAlloc> entries_;
+    std::vector<size_t, SizeAlloc>      hashes_;   // kCacheHash only
+    std::vector<size_t, SizeAlloc>      offsets_;  // bucket_count() + 1
+
+    template <typename K>
+    const Value* find_impl(const K& key) const {
+        size_t h = hash_(key);
+        size_t b = h & mask_;
+        for (size_t i = offsets_[b], end = offsets_[b + 1]; i < end; ++i) {
+            if ((!kCacheHash || hashes_[i] == h) &&
+                equal_(entries_[i].first, key)) {
+                return &entries_[i].second;
+            }
+        }
+        return nullptr;
+    }
+
+    // Write words as uint64_t, a chunk at a time.
+    static bool write_words(std::FILE* f, const size_t* words, size_t n) {
+        uint64_t chunk[512];
+        for (size_t i = 0; i < n; i += 512) {
+            size_t m = n - i < 512 ? n - i : 512;
+            for (size_t j = 0; j < m; ++j) chunk[j] = words[i + j];
+            if (std::fwrite(chunk, sizeof(uint64_t), m, f) != m) return false;
+        }
+        return true;
+    }
+
+    // Counting sort of the entries by bucket, skipping duplicates.
+    void build(std::vector<std::pair<Key, Value>>& in) {
+        size_t n = in.size();
+        size_t buckets = detail::next_power_of_2(n ? n : 1);
+        mask_ = buckets - 1;
+
+        std::vector<size_t> hash(n);
+        std::vector<size_t> start(buckets + 1, 0);
+        for (size_t i = 0; i < n; ++i) {
+            hash[i] = hash_(in[i].first);
+            ++start[(hash[i] & mask_) + 1];
+        }
+        for (size_t b = 0; b < buckets; ++b) start[b + 1] += start[b];
+
+        // order[start[b] ..] lists bucket b's entries in input order.
+        std::vector<size_t> order(n);
+        std::vector<size_t> fill(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < n; ++i) order[fill[hash[i] & mask_]++] = i;
+
+        entries_.reserve(n);
+        if (kCacheHash) hashes_.reserve(n);
+        offsets_.assign(buckets + 1, 0);
+        for (size_t b = 0; b < buckets; ++b) {
+            offsets_[b] = entries_.size();
+            for (size_t j = start[b]; j < start[b + 1]; ++j) {
+                size_t i = order[j];
+                if (in_bucket(offsets_[b], hash[i], in[i].first)) continue;
+                entries_.emplace_back(std::move(in[i].first),
+                                      std::move(in[i].second));
+                if (kCacheHash) hashes_.push_back(hash[i]);
+            }
+        }
+        offsets_[buckets] = entries_.size();
+    }
+
+    // Whether key was already placed in the bucket being filled, which
+    // starts at entries_[from].
+    bool in_bucket(size_t from, size_t h, const Key& key) const {
+        for (size_t i = from; i < entries_.size(); ++i) {
+            if ((!kCacheHash || hashes_[i] == h) &&
+                equal_(entries_[i].first, key)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+}  // namespace concurrent_hashmap
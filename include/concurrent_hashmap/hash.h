@@ -0,0 +1,338 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+#include <concurrent_hashmap/traits.h>
+
+#if __cplusplus >= 201703L
+#  include <string_view>
+#endif
+
+// With AVX2, long keys are hashed in 64-byte stripes, eight 64-bit lanes
+// at a time.  Narrower vectors do not beat wyhash's scalar loop, so other
+// builds (and CHM_DISABLE_SIMD) use wyhash for every length.
+#if !defined(CHM_DISABLE_SIMD) && defined(__AVX2__)
+#  include <immintrin.h>
+#  define CHM_HASH_AVX2 1
+#endif
+
+// ---------------------------------------------------------------------------
+// Hash family.
+//
+//   hash_int(x)              -- one 64x64->128-bit multiply, folded; spreads
+//                               sequential integers over all 64 bits
+//   hash_bytes(p, len, seed) -- wyhash; with AVX2, keys of kLongKeyBytes
+//                               or more go through an xxh3-style striped
+//                               accumulator instead
+//   FastHash<Key>            -- a Hash for the map built on the two
+//
+// Hashes are not stable across library versions, byte orders or AVX2 and
+// non-AVX2 builds, and are not meant to resist deliberate collisions;
+// pass a random seed to hash_bytes where that matters.
+// ---------------------------------------------------------------------------
+
+namespace concurrent_hashmap {
+namespace detail {
+
+static const uint64_t kWySecret[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+    0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+};
+
+// The 128-bit product a * b: a receives the low half, b the high half.
+inline void mul128(uint64_t& a, uint64_t& b) {
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 uint128;
+    uint128 r = static_cast<uint128>(a) * b;
+    a = static_cast<uint64_t>(r);
+    b = static_cast<uint64_t>(r >> 64);
+#else
+    uint64_t ha = a >> 32, la = static_cast<uint32_t>(a);
+    uint64_t hb = b >> 32, lb = static_cast<uint32_t>(b);
+    uint64_t hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+    uint64_t mid = (ll >> 32) + static_cast<uint32_t>(hl) +
+                   static_cast<uint32_t>(lh);
+    a = (mid << 32) | static_cast<uint32_t>(ll);
+    b = hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+#endif
+}
+
+// High and low halves of a * b, xored together.
+inline uint64_t mum(uint64_t a, uint64_t b) {
+    mul128(a, b);
+    return a ^ b;
+}
+
+inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// wyhash (final version 4).
+inline uint64_t hash_short(const unsigned char* p, size_t len,
+                           uint64_t seed) {
+    seed ^= mum(seed ^ kWySecret[0], kWySecret[1]);
+    uint64_t a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t mid = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + mid);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - mid);
+        } else if (len > 0) {
+            a = (uint64_t{p[0]} << 16) | (uint64_t{p[len >> 1]} << 8) |
+                p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i >= 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = mum(read64(p) ^ kWySecret[1], read64(p + 8) ^ seed);
+                see1 = mum(read64(p + 16) ^ kWySecret[2],
+                           read64(p + 24) ^ see1);
+                see2 = mum(read64(p + 32) ^ kWySecret[3],
+                           read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i >= 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = mum(read64(p) ^ kWySecret[1], read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+    a ^= kWySecret[1];
+    b ^= seed;
+    mul128(a, b);
+    return mum(a ^ kWySecret[0] ^ len, b ^ kWySecret[1]);
+}
+
+#if defined(CHM_HASH_AVX2)
+
+// Per-lane keys for the striped accumulator: stripe s of a block uses
+// lanes [s, s + 8), and the scramble at the end of a block uses the last
+// eight.
+static const uint64_t kStripeSecret[24] = {
+    0x2cb0f69f4abea221ull, 0x9417034723148989ull, 0xdd555950609dfe03ull,
+    0xdbafb150deb12800ull, 0x7e789b2e6c442cb6ull, 0xf41e5636c7e4f8c4ull,
+    0x0959d150f8fba7e4ull, 0xa97316f13cdb9eeaull, 0x74cd8258f9520068ull,
+    0x55c74a62e116868bull, 0xd2f4c799a2023cbdull, 0xdf98cb79a37b51b9ull,
+    0x396f5885524f3905ull, 0xaf1d56386ca3b276ull, 0xa9ffbe6b5104e85aull,
+    0x6bd0c51b9fd533b3ull, 0x980ce91c50ab4b56ull, 0x28ac395780fe62c5ull,
+    0x768912e3a6bcedc7ull, 0x50b3e8c9332c7c88ull, 0xce3bbfe520bd47daull,
+    0xcba6c8e8e0bb7c4full, 0xbf194db8434a346dull, 0x7d8f2a7b60416d7full,
+};
+
+static const size_t kStripeBytes = 64;
+static const size_t kStripesPerBlock = 16;
+
+// Keys at least this long take the striped path, which reaches about 1.6
+// times wyhash's throughput from 4 KiB.
+static const size_t kLongKeyBytes = 512;
+
+// acc[i] += lo32(d ^ k) * hi32(d ^ k) and acc[i ^ 1] += d for the eight
+// 64-bit lanes d of one stripe, k the lane keys.  Adding each lane's raw
+// data to its neighbour keeps the input recoverable when a product is 0.
+inline void accumulate_stripe(uint64_t* acc, const unsigned char* p,
+                              const uint64_t* key) {
+    for (int i = 0; i < 2; ++i) {
+        __m256i a = _mm256_load_si256(reinterpret_cast<__m256i*>(acc) + i);
+        __m256i d = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(p) + i);
+        __m256i k = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(key) + i);
+        __m256i dk = _mm256_xor_si256(d, k);
+        __m256i prod = _mm256_mul_epu32(
+            dk, _mm256_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m256i swap = _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+        a = _mm256_add_epi64(a, _mm256_add_epi64(prod, swap));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(acc) + i, a);
+    }
+}
+
+// Fold high bits back down once per block, so they keep reaching the
+// 32-bit multiplies.
+inline void scramble(uint64_t* acc, const uint64_t* key) {
+    for (int i = 0; i < 8; ++i) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= key[i];
+        acc[i] = a * 0x9E3779B1u;
+    }
+}
+
+inline uint64_t hash_long(const unsigned char* p, size_t len,
+                          uint64_t seed) {
+    alignas(32) uint64_t acc[8];
+    for (int i = 0; i < 8; ++i) acc[i] = kWySecret[i & 3] + seed;
+
+    // Whole stripes, then the last 64 bytes again (overlapping the
+    // previous stripe unless len is a multiple of 64).
+    const size_t block_bytes = kStripeBytes * kStripesPerBlock;
+    size_t stripes = (len - 1) / kStripeBytes;
+    size_t blocks = stripes / kStripesPerBlock;
+    for (size_t b = 0; b < blocks; ++b, p += block_bytes) {
+        for (size_t s = 0; s < kStripesPerBlock; ++s) {
+            accumulate_stripe(acc, p + s * kStripeBytes, kStripeSecret + s);
+        }
+        scramble(acc, kStripeSecret + kStripesPerBlock);
+    }
+    for (size_t s = 0; s < stripes % kStripesPerBlock; ++s) {
+        accumulate_stripe(acc, p + s * kStripeBytes, kStripeSecret + s);
+    }
+    p += len - blocks * block_bytes;
+    accumulate_stripe(acc, p - kStripeBytes,
+                      kStripeSecret + kStripesPerBlock / 2 - 1);
+
+    uint64_t h = seed ^ (len * kWySecret[0]);
+    for (int i = 0; i < 8; i += 2) {
+        h += mum(acc[i] ^ kStripeSecret[i + 1],
+                 acc[i + 1] ^ kStripeSecret[i + 2]);
+    }
+    return mum(h ^ kWySecret[2], len ^ kWySecret[3]);
+}
+
+#endif  // CHM_HASH_AVX2
+
+}  // namespace detail
+
+/// Mix an integer into a hash whose every bit depends on every input
+/// bit (one wide multiply).
+inline uint64_t hash_int(uint64_t x) {
+    return detail::mum(x, 0x9E3779B97F4A7C15ull);
+}
+
+/// Hash len bytes at data.
+inline uint64_t hash_bytes(const void* data, size_t len, uint64_t seed = 0) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+#if defined(CHM_HASH_AVX2)
+    if (len >= detail::kLongKeyBytes) return detail::hash_long(p, len, seed);
+#endif
+    return detail::hash_short(p, len, seed);
+}
+
+// ---------------------------------------------------------------------------
+// FastHash<Key> -- a Hash for ConcurrentHashMap and friends.
+//
+//   integers, enums, pointers  -- hash_int of the value
+//   std::basic_string (and std::basic_string_view in C++17)
+//                              -- hash_bytes of the characters;
+//                                 transparent, so with std::equal_to<>
+//                                 lookups take a C string or string_view
+//                                 without building a std::string
+//   anything else              -- hash_int of std::hash<Key>
+//
+// cache_hash drops the per-slot hash for integer-like keys under
+// FastHash as it does under std::hash.
+// ---------------------------------------------------------------------------
+template <typename Key, typename>
+struct FastHash {
+    size_t operator()(const Key& key) const {
+        return static_cast<size_t>(hash_int(std::hash<Key>()(key)));
+    }
+};
+
+template <typename Key>
+struct FastHash<Key, typename std::enable_if<
+                         std::is_integral<Key>::value ||
+                         std::is_enum<Key>::value>::type> {
+    size_t operator()(Key key) const {
+        return static_cast<size_t>(hash_int(static_cast<uint64_t>(key)));
+    }
+};
+
+template <typename T>
+struct FastHash<T*, void> {
+    size_t operator()(const T* p) const {
+        return static_cast<size_t>(
+            hash_int(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(p))));
+    }
+};
+
+namespace detail {
+
+template <typename CharT, typename Traits>
+struct StringHash {
+    using is_transparent = void;
+
+    template <typename Alloc>
+    size_t operator()(const std::basic_string<CharT, Traits, Alloc>& s) const {
+        return chars(s.data(), s.size());
+    }
+    size_t operator()(const CharT* s) const {
+        return chars(s, Traits::length(s));
+    }
+#if __cplusplus >= 201703L
+    size_t operator()(std::basic_string_view<CharT, Traits> s) const {
+        return chars(s.data(), s.size());
+    }
+#endif
+
+private:
+    static size_t chars(const CharT* s, size_t n) {
+        return static_cast<size_t>(hash_bytes(s, n * sizeof(CharT)));
+    }
+};
+
+}  // namespace detail
+
+template <typename CharT, typename Traits, typename Alloc>
+struct FastHash<std::basic_string<CharT, Traits, Alloc>, void>
+    : detail::StringHash<CharT, Traits> {};
+
+#if __cplusplus >= 201703L
+template <typename CharT, typename Traits>
+struct FastHash<std::basic_string_view<CharT, Traits>, void>
+    : detail::StringHash<CharT, Traits> {};
+#endif
+
+namespace detail {
+
+// ---------------------------------------------------------------------------
+// MixedHash -- Hash as the map applies it: the result goes through
+// hash_int when mix_hash<Key, Hash> marks Hash as weak.  Every table,
+// shard and snapshot path hashes through this, so they all agree.
+// ---------------------------------------------------------------------------
+template <typename Key, typename Hash>
+class MixedHash {
+public:
+    MixedHash() = default;
+    explicit MixedHash(const Hash& hash) : hash_(hash) {}
+
+    template <typename K>
+    size_t operator()(const K& key) const {
+        return finish(hash_(key), mix_hash<Key, Hash>());
+    }
+
+    const Hash& hasher() const { return hash_; }
+
+private:
+    Hash hash_;
+
+    static size_t finish(size_t h, std::true_type) {
+        return static_cast<size_t>(hash_int(h));
+    }
+    static size_t finish(size_t h, std::false_type) { return h; }
+};
+
+}  // namespace detail
+}  // namespace concurrent_hashmap
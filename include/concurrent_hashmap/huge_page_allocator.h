@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+#if defined(__linux__)
+#  include <sys/mman.h>
+#endif
+
+namespace concurrent_hashmap {
+namespace detail {
+
+// Bytes currently held by every HugePageAllocator instantiation.
+inline std::atomic<size_t>& huge_page_bytes() {
+    static std::atomic<size_t> bytes{0};
+    return bytes;
+}
+
+static const size_t kHugePageSize = size_t{2} << 20;
+
+inline size_t huge_page_round(size_t bytes) {
+    return (bytes + kHugePageSize - 1) & ~(kHugePageSize - 1);
+}
+
+// Map `bytes` (a multiple of kHugePageSize) backed by huge pages if at all
+// possible.  Reserved hugetlbfs pages are tried first; failing that, a
+// 2MB-aligned anonymous mapping is marked for transparent huge pages.
+// Throws std::bad_alloc if no mapping can be made.
+inline void* huge_page_map(size_t bytes) {
+#if defined(__linux__)
+#  if defined(MAP_HUGETLB)
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) return p;
+#  endif
+    // Over-map by one huge page and trim, so the range is 2MB-aligned and
+    // every page of it can be backed by a THP.
+    size_t span = bytes + kHugePageSize;
+    void* raw = mmap(nullptr, span, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) throw std::bad_alloc();
+    size_t begin = reinterpret_cast<size_t>(raw);
+    size_t aligned = (begin + kHugePageSize - 1) & ~(kHugePageSize - 1);
+    if (aligned > begin) munmap(raw, aligned - begin);
+    size_t tail = begin + span - (aligned + bytes);
+    if (tail) munmap(reinterpret_cast<void*>(aligned + bytes), tail);
+#  if defined(MADV_HUGEPAGE)
+    madvise(reinterpret_cast<void*>(aligned), bytes, MADV_HUGEPAGE);
+#  endif
+    return reinterpret_cast<void*>(aligned);
+#else
+    (void)bytes;
+    throw std::bad_alloc();
+#endif
+}
+
+inline void huge_page_unmap(void* p, size_t bytes) {
+#if defined(__linux__)
+    munmap(p, bytes);
+#else
+    (void)p;
+    (void)bytes;
+#endif
+}
+
+} // namespace detail
+
+// =========================================================================
+// HugePageAllocator
+//
+// Allocator for ConcurrentHashMap's Allocator parameter.  On Linux,
+// requests of at least Threshold bytes (the big slot arrays of large
+// tables) are served by their own 2MB-aligned mmap backed by huge pages --
+// hugetlbfs if pages are reserved, otherwise transparent huge pages via
+// madvise.  Smaller requests, and every request elsewhere, use operator
+// new.  Fresh mappings are zero-filled by the kernel and faulted in on
+// first touch.
+//
+// bytes_allocated() reports the memory currently held through this
+// allocator (all instantiations), for accounting map memory separately
+// from the rest of the process.  Stateless: all instances are equal.
+// =========================================================================
+template <typename T, size_t Threshold = detail::kHugePageSize>
+class HugePageAllocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = HugePageAllocator<U, Threshold>;
+    };
+
+    HugePageAllocator() noexcept = default;
+
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U, Threshold>&) noexcept {}
+
+    T* allocate(size_t n) {
+        size_t bytes = n * sizeof(T);
+#if defined(__linux__)
+        if (bytes >= Threshold) {
+            size_t mapped = detail::huge_page_round(bytes);
+            void* p = detail::huge_page_map(mapped);
+            detail::huge_page_bytes().fetch_add(mapped,
+                                                std::memory_order_relaxed);
+            return static_cast<T*>(p);
+        }
+#endif
+        void* p = ::operator new(bytes);
+        detail::huge_page_bytes().fetch_add(bytes, std::memory_order_relaxed);
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        size_t bytes = n * sizeof(T);
+#if defined(__linux__)
+        if (bytes >= Threshold) {
+            size_t mapped = detail::huge_page_round(bytes);
+            detail::huge_page_unmap(p, mapped);
+            detail::huge_page_bytes().fetch_sub(mapped,
+                                                std::memory_order_relaxed);
+            return;
+        }
+#endif
+        ::operator delete(p);
+        detail::huge_page_bytes().fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    static size_t bytes_allocated() {
+        return detail::huge_page_bytes().load(std::memory_order_relaxed);
+    }
+};
+
+template <typename T, typename U, size_t N>
+bool operator==(const HugePageAllocator<T, N>&,
+                const HugePageAllocator<U, N>&) noexcept {
+    return true;
+}
+
+template <typename T, typename U, size_t N>
+bool operator!=(const HugePageAllocator<T, N>&,
+                const HugePageAllocator<U, N>&) noexcept {
+    return false;
+}
+
+}  // namespace concurrent_hashmap
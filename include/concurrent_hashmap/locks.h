@@ -0,0 +1,301 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+
+#include <concurrent_hashmap/detail/numa.h>
+#include <concurrent_hashmap/detail/spinlock.h>
+
+#if defined(__linux__)
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Shard mutexes for the Mutex template parameter.  All are Lockable
+// (lock / try_lock / unlock) and one word or one cache line in size.
+//
+//   detail::SpinLock -- test-and-test-and-set with backoff (the default)
+//   FutexLock        -- spins briefly, then sleeps in the kernel
+//   AdaptiveLock     -- FutexLock whose spin budget follows recent waits
+//   TicketLock       -- FIFO spin lock
+//   McsLock          -- FIFO queued lock; each waiter spins on its own line
+//
+// Parking uses futex(2) on Linux; elsewhere a parked waiter yields its
+// timeslice in a loop instead.
+// ---------------------------------------------------------------------------
+
+namespace concurrent_hashmap {
+namespace detail {
+
+// Sleep while word == expected, until futex_wake_one(word).  May return
+// spuriously.
+inline void futex_wait(std::atomic<uint32_t>& word, uint32_t expected) {
+#if defined(__linux__)
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                  "futex word must be a plain 32-bit integer");
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word),
+            FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+    if (word.load(std::memory_order_relaxed) == expected) {
+        std::this_thread::yield();
+    }
+#endif
+}
+
+inline void futex_wake_one(std::atomic<uint32_t>& word) {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word),
+            FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// ParkingLock -- the three-state futex mutex (0 free, 1 held, 2 held with
+// sleepers).  A waiter spins on the word for up to spin_limit() rounds of
+// backoff and then sleeps; unlock issues a wake only when someone may be
+// asleep.  SpinPolicy supplies the budget and learns how long waits were.
+// ---------------------------------------------------------------------------
+template <typename SpinPolicy>
+class ParkingLock : private SpinPolicy {
+public:
+    ParkingLock() noexcept : state_(0) {}
+
+    ParkingLock(const ParkingLock&) = delete;
+    ParkingLock& operator=(const ParkingLock&) = delete;
+
+    void lock() noexcept {
+        uint32_t c = 0;
+        if (state_.compare_exchange_strong(c, 1, std::memory_order_acquire,
+                                           std::memory_order_relaxed)) {
+            return;
+        }
+        lock_slow();
+    }
+
+    bool try_lock() noexcept {
+        uint32_t c = 0;
+        return state_.compare_exchange_strong(c, 1,
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed);
+    }
+
+    void unlock() noexcept {
+        if (state_.exchange(0, std::memory_order_release) == 2) {
+            futex_wake_one(state_);
+        }
+    }
+
+private:
+    std::atomic<uint32_t> state_;
+
+    void lock_slow() noexcept {
+        unsigned limit = this->spin_limit();
+        Backoff backoff;
+        for (unsigned spins = 0; spins < limit; ++spins) {
+            backoff.pause();
+            uint32_t c = state_.load(std::memory_order_relaxed);
+            if (c == 2) break;  // others are already asleep: queue up
+            if (c == 0 && state_.compare_exchange_weak(
+                              c, 1, std::memory_order_acquire,
+                              std::memory_order_relaxed)) {
+                this->spun(spins);
+                return;
+            }
+        }
+        this->spun(limit);
+        // Mark the lock contended before sleeping, so its holder wakes us.
+        while (state_.exchange(2, std::memory_order_acquire) != 0) {
+            futex_wait(state_, 2);
+        }
+    }
+};
+
+struct FixedSpin {
+    static constexpr unsigned kSpins = 16;
+    unsigned spin_limit() const { return kSpins; }
+    void spun(unsigned) {}
+};
+
+// Budget tracks a running average of the spins successful waits needed,
+// as glibc's PTHREAD_MUTEX_ADAPTIVE_NP does: short critical sections keep
+// waiters spinning, long ones (a resize, a preempted holder) send them to
+// sleep almost at once.
+class AdaptiveSpin {
+public:
+    static constexpr unsigned kMaxSpins = 128;
+
+    unsigned spin_limit() const {
+        unsigned avg = average_.load(std::memory_order_relaxed);
+        unsigned limit = 2 * avg + 8;
+        return limit < kMaxSpins ? limit : kMaxSpins;
+    }
+    void spun(unsigned spins) {
+        int avg = static_cast<int>(average_.load(std::memory_order_relaxed));
+        avg += (static_cast<int>(spins) - avg) / 8;
+        average_.store(static_cast<unsigned>(avg), std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<unsigned> average_{0};
+};
+
+}  // namespace detail
+
+// Spin-then-sleep mutex: one 32-bit word, no syscall when uncontended.
+using FutexLock = detail::ParkingLock<detail::FixedSpin>;
+
+// FutexLock whose spin phase adapts to how long recent waits took.
+using AdaptiveLock = detail::ParkingLock<detail::AdaptiveSpin>;
+
+// ---------------------------------------------------------------------------
+// TicketLock -- first come, first served.  A waiter backs off in
+// proportion to its place in line, and yields once it is far back or has
+// waited long enough that the thread ahead of it is likely preempted.
+// ---------------------------------------------------------------------------
+class TicketLock {
+public:
+    TicketLock() noexcept : next_(0), serving_(0) {}
+
+    TicketLock(const TicketLock&) = delete;
+    TicketLock& operator=(const TicketLock&) = delete;
+
+    void lock() noexcept {
+        uint32_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+        for (unsigned rounds = 0;; ++rounds) {
+            uint32_t serving = serving_.load(std::memory_order_acquire);
+            if (serving == ticket) return;
+            uint32_t ahead = ticket - serving;
+            if (ahead > kYieldDistance || rounds > kSpinRounds) {
+                std::this_thread::yield();
+            } else {
+                for (uint32_t i = 0; i < ahead * kPausePerWaiter; ++i) {
+                    detail::cpu_relax();
+                }
+            }
+        }
+    }
+
+    bool try_lock() noexcept {
+        uint32_t serving = serving_.load(std::memory_order_acquire);
+        uint32_t expected = serving;
+        return next_.compare_exchange_strong(expected, serving + 1,
+                                             std::memory_order_acquire,
+                                             std::memory_order_relaxed);
+    }
+
+    void unlock() noexcept {
+        // Only the holder writes serving_.
+        serving_.store(serving_.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_release);
+    }
+
+private:
+    static constexpr uint32_t kPausePerWaiter = 32;
+    static constexpr uint32_t kYieldDistance = 4;
+    static constexpr unsigned kSpinRounds = 64;  // then the holder may be off-CPU
+
+    std::atomic<uint32_t> next_;
+    std::atomic<uint32_t> serving_;
+};
+
+// ---------------------------------------------------------------------------
+// McsLock -- Mellor-Crummey/Scott queue lock.  Waiters form a list and each
+// spins on a flag in its own node, so a handoff moves one cache line to
+// one waiter rather than invalidating every spinner.  Queue nodes come
+// from a small per-thread stack: a thread may hold up to kMaxHeld
+// McsLocks at once and must release them in reverse order, as
+// std::lock_guard does.
+// ---------------------------------------------------------------------------
+class McsLock {
+public:
+    static constexpr unsigned kMaxHeld = 8;
+
+    McsLock() noexcept : tail_(nullptr), holder_(nullptr) {}
+
+    McsLock(const McsLock&) = delete;
+    McsLock& operator=(const McsLock&) = delete;
+
+    void lock() noexcept {
+        Node* n = push_node();
+        Node* prev = tail_.exchange(n, std::memory_order_acq_rel);
+        if (prev) {
+            prev->next.store(n, std::memory_order_release);
+            detail::Backoff backoff;
+            while (n->waiting.load(std::memory_order_acquire)) {
+                backoff.pause();
+            }
+        }
+        holder_ = n;
+    }
+
+    bool try_lock() noexcept {
+        Node* n = push_node();
+        Node* expected = nullptr;
+        if (tail_.compare_exchange_strong(expected, n,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed)) {
+            holder_ = n;
+            return true;
+        }
+        pop_node();
+        return false;
+    }
+
+    void unlock() noexcept {
+        Node* n = holder_;
+        Node* succ = n->next.load(std::memory_order_acquire);
+        if (!succ) {
+            Node* expected = n;
+            if (tail_.compare_exchange_strong(expected, nullptr,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+                pop_node();
+                return;
+            }
+            // A waiter swapped itself in but has not linked up yet.
+            while (!(succ = n->next.load(std::memory_order_acquire))) {
+                detail::cpu_relax();
+            }
+        }
+        succ->waiting.store(false, std::memory_order_release);
+        pop_node();
+    }
+
+private:
+    struct alignas(detail::kCacheLineSize) Node {
+        std::atomic<Node*> next;
+        std::atomic<bool>  waiting;
+    };
+
+    struct NodeStack {
+        Node     nodes[kMaxHeld];
+        unsigned depth = 0;
+    };
+
+    static NodeStack& node_stack() {
+        static thread_local NodeStack stack;
+        return stack;
+    }
+
+    static Node* push_node() noexcept {
+        NodeStack& s = node_stack();
+        if (s.depth == kMaxHeld) std::abort();
+        Node* n = &s.nodes[s.depth++];
+        n->next.store(nullptr, std::memory_order_relaxed);
+        n->waiting.store(true, std::memory_order_relaxed);
+        return n;
+    }
+
+    static void pop_node() noexcept { --node_stack().depth; }
+
+    std::atomic<Node*> tail_;
+    Node*              holder_;  // written and read only by the holder
+};
+
+}  // namespace concurrent_hashmap
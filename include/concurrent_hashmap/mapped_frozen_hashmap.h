@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <type_traits>
+
+#include <concurrent_hashmap/hash.h>
+#include <concurrent_hashmap/snapshot.h>
+#include <concurrent_hashmap/traits.h>
+#include <concurrent_hashmap/detail/hash_utils.h>
+
+namespace concurrent_hashmap {
+
+// =========================================================================
+// MappedFrozenHashMap
+//
+// A FrozenHashMap read in place from an image file written by
+// FrozenHashMap::save_image.  The file is mapped read-only, so every
+// process that opens the same image shares one copy of it in the page
+// cache: a host running N workers over the same data holds it once, and
+// a new worker is ready as soon as the header has been checked -- pages
+// fault in as lookups touch them.
+//
+// The image holds bucket offsets and records, never pointers, so it
+// reads the same at any address.  Key and Value must be trivially
+// copyable, and the image must come from the same build (the same Hash,
+// layout and byte order); an image whose version, sizes or hash check
+// differ is refused.  Lookups are wait-free, as for FrozenHashMap, and
+// bounds-checked against the file's size.  To refresh the data, write a
+// new image over the path and open it again: save_image renames the new
+// file into place, so maps already open keep the old one.
+//
+// Only the read-only frozen form is shared between processes.  A
+// mutable ConcurrentHashMap stays private to its process.
+// =========================================================================
+template <typename Key,
+          typename Value,
+          typename Hash     = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class MappedFrozenHashMap {
+    static_assert(std::is_trivially_copyable<Key>::value &&
+                  std::is_trivially_copyable<Value>::value,
+                  "frozen images need trivially copyable Key and Value");
+
+    using Record = detail::FrozenRecord<Key, Value>;
+    static_assert(alignof(Record) <= detail::kFrozenImageAlign,
+                  "record alignment exceeds the image's");
+
+    static constexpr bool kCacheHash = cache_hash<Key, Hash>::value;
+
+public:
+    // ------------------------------------------------------------------
+    // Construction
+    // ------------------------------------------------------------------
+
+    /// Map the image at path.  ok() is false, and the map empty, if the
+    /// file is missing, truncated, or was written for other types or
+    /// another Hash.
+    explicit MappedFrozenHashMap(const char* path, const Hash& hash = Hash(),
+                                 const KeyEqual& equal = KeyEqual())
+        : hash_(hash), equal_(equal)
+        , file_(new detail::MappedFile(path, false)) {
+        if (!open()) file_.reset();
+    }
+
+    bool ok() const { return file_ != nullptr; }
+
+    // ------------------------------------------------------------------
+    // Wait-free reads
+    // ------------------------------------------------------------------
+
+    /// The value for key, or nullptr if absent.  The pointer points into
+    /// the mapping and stays valid for the lifetime of the map.
+    const Value* find(const Key& key) const { return find_impl(key); }
+
+    bool contains(const Key& key) const { return find_impl(key) != nullptr; }
+
+    size_t count(const Key& key) const { return contains(key) ? 1 : 0; }
+
+    // Heterogeneous lookup (requires transparent Hash and KeyEqual).
+
+    template <typename K, typename H = Hash,
+              typename = typename std::enable_if<
+                  detail::is_transparent_lookup<H, KeyEqual>::value>::type>
+    const Value* find(const K& key) const { return find_impl(key); }
+
+    template <typename K, typename H = Hash,
+              typename = typename std::enable_if<
+                  detail::is_transparent_lookup<H, KeyEqual>::value>::type>
+    bool contains(const K& key) const { return find_impl(key) != nullptr; }
+
+    // ------------------------------------------------------------------
+    // Utility
+    // ------------------------------------------------------------------
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    /// Number of buckets (a power of two >= size()).
+    size_t bucket_count() const { return mask_ + 1; }
+
+    /// Calls fn(key, value) for every entry, in storage (bucket) order.
+    template <typename F>
+    void for_each(F&& fn) const {
+        for (size_t i = 0; i < size_; ++i) {
+            fn(records_[i].key, records_[i].value);
+        }
+    }
+
+private:
+    detail::MixedHash<Key, Hash> hash_;
+    KeyEqual         equal_;
+    std::unique_ptr<detail::MappedFile> file_;
+    size_t           size_ = 0;
+    size_t           mask_ = 0;                  // bucket_count() - 1
+    const uint64_t*  offsets_ = kNoOffsets;      // bucket_count() + 1
+    const uint64_t*  hashes_ = nullptr;          // kCacheHash only
+    const Record*    records_ = nullptr;
+
+    static constexpr uint64_t kNoOffsets[2] = {0, 0};
+
+    template <typename K>
+    const Value* find_impl(const K& key) const {
+        size_t h = hash_(key);
+        size_t b = h & mask_;
+        size_t end = static_cast<size_t>(offsets_[b + 1]);
+        if (end > size_) end = size_;  // a corrupt image reads no further
+        for (size_t i = static_cast<size_t>(offsets_[b]); i < end; ++i) {
+            if ((!kCacheHash || hashes_[i] == h) &&
+                equal_(records_[i].key, key)) {
+                return &records_[i].value;
+            }
+        }
+        return nullptr;
+    }
+
+    // Check the header against this map's types and the file's size and
+    // point the tables into the mapping.  Offsets are not scanned here
+    // (that would touch every page up front); find clamps them instead.
+    bool open() {
+        if (!file_->ok()) return false;
+        const unsigned char* base =
+            static_cast<const unsigned char*>(file_->data());
+        size_t bytes = file_->size();
+
+        detail::FrozenImageHeader h;
+        if (bytes < sizeof(h)) return false;
+        std::memcpy(&h, base, sizeof(h));
+        uint32_t flags = kCacheHash ? detail::kSnapshotCachedHash : 0;
+        if (std::memcmp(h.magic, detail::kFrozenImageMagic,
+                        sizeof(h.magic)) ||
+            h.version != detail::kFrozenImageVersion || h.flags != flags ||
+            h.key_size != sizeof(Key) || h.value_size != sizeof(Value) ||
+            h.record_size != sizeof(Record) || h.buckets == 0 ||
+            (h.buckets & (h.buckets - 1)) || h.entries > h.buckets ||
+            h.records_offset % detail::kFrozenImageAlign) {
+            return false;
+        }
+        // Bound the counts by the file before sizing the tables, so a
+        // crafted header cannot wrap the arithmetic below.
+        uint64_t words = (bytes - sizeof(h)) / sizeof(uint64_t);
+        if (h.buckets >= words ||
+            (kCacheHash && h.entries >= words - h.buckets)) {
+            return false;
+        }
+        uint64_t tables = sizeof(h) + (h.buckets + 1 +
+                                       (kCacheHash ? h.entries : 0)) *
+                                      sizeof(uint64_t);
+        if (h.records_offset < tables || h.records_offset > bytes ||
+            (bytes - h.records_offset) / sizeof(Record) != h.entries) {
+            return false;
+        }
+
+        offsets_ = reinterpret_cast<const uint64_t*>(base + sizeof(h));
+        if (kCacheHash) hashes_ = offsets_ + h.buckets + 1;
+        records_ = reinterpret_cast<const Record*>(base + h.records_offset);
+        size_ = static_cast<size_t>(h.entries);
+        mask_ = static_cast<size_t>(h.buckets - 1);
+        if (offsets_[0] != 0 || offsets_[h.buckets] != h.entries ||
+            (size_ && hash_(records_[0].key) != h.check)) {
+            offsets_ = kNoOffsets;
+            hashes_ = nullptr;
+            records_ = nullptr;
+            size_ = mask_ = 0;
+            return false;
+        }
+        return true;
+    }
+};
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+constexpr uint64_t
+    MappedFrozenHashMap<Key, Value, Hash, KeyEqual>::kNoOffsets[2];
+
+}  // namespace concurrent_hashmap
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__linux__)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace concurrent_hashmap {
+
+// ---------------------------------------------------------------------------
+// Snapshot I/O -- the byte streams behind ConcurrentHashMap::save / load.
+//
+// SnapshotWriter appends to an in-memory buffer (a shard is encoded under
+// its lock, then written out after the lock is released); SnapshotReader
+// walks a mapped file, bounds-checking every read so that a truncated or
+// corrupt file fails the load instead of crashing it.
+// ---------------------------------------------------------------------------
+class SnapshotWriter {
+public:
+    void write(const void* p, size_t n) {
+        const char* c = static_cast<const char*>(p);
+        buf_.insert(buf_.end(), c, c + n);
+    }
+    template <typename T>
+    void write_pod(const T& v) { write(&v, sizeof(T)); }
+
+    const char* data() const { return buf_.data(); }
+    size_t size() const { return buf_.size(); }
+    void clear() { buf_.clear(); }
+
+private:
+    std::vector<char> buf_;
+};
+
+class SnapshotReader {
+public:
+    SnapshotReader(const void* data, size_t size)
+        : p_(static_cast<const unsigned char*>(data)), left_(size) {}
+
+    // The next n bytes, or nullptr (and nothing consumed) if the input
+    // is too short.
+    const unsigned char* take(size_t n) {
+        if (n > left_) return nullptr;
+        const unsigned char* p = p_;
+        p_ += n;
+        left_ -= n;
+        return p;
+    }
+    bool read(void* out, size_t n) {
+        const unsigned char* p = take(n);
+        if (!p) return false;
+        std::memcpy(out, p, n);
+        return true;
+    }
+    template <typename T>
+    bool read_pod(T& v) { return read(&v, sizeof(T)); }
+
+    size_t remaining() const { return left_; }
+
+private:
+    const unsigned char* p_;
+    size_t               left_;
+};
+
+// ---------------------------------------------------------------------------
+// snapshot_codec -- how save/load encode one Key or Value.  The default
+// copies the bytes of trivially copyable types; specialise it (in
+// namespace concurrent_hashmap) for anything else.  load returns false
+// on malformed input.
+// ---------------------------------------------------------------------------
+template <typename T>
+struct snapshot_codec {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "specialise snapshot_codec for non-trivially-copyable types");
+    static void save(SnapshotWriter& out, const T& v) { out.write_pod(v); }
+    static bool load(SnapshotReader& in, T& v) { return in.read_pod(v); }
+};
+
+// Length-prefixed bytes.
+template <typename CharT, typename Traits, typename Alloc>
+struct snapshot_codec<std::basic_string<CharT, Traits, Alloc>> {
+    using String = std::basic_string<CharT, Traits, Alloc>;
+    static void save(SnapshotWriter& out, const String& s) {
+        out.write_pod(static_cast<uint64_t>(s.size()));
+        out.write(s.data(), s.size() * sizeof(CharT));
+    }
+    static bool load(SnapshotReader& in, String& s) {
+        uint64_t n = 0;
+        if (!in.read_pod(n) || n > in.remaining() / sizeof(CharT)) {
+            return false;
+        }
+        const unsigned char* p = in.take(static_cast<size_t>(n) * sizeof(CharT));
+        s.assign(reinterpret_cast<const CharT*>(p), static_cast<size_t>(n));
+        return true;
+    }
+};
+
+namespace detail {
+
+// File header.  Snapshots are in native byte order and layout: they are
+// meant for restarting the same build on the same machine type, and are
+// refused when the version, Key/Value sizes or slot flags differ.  check
+// is the low 32 bits of the hash of the first slot-order entry of the
+// first shard that has one (0 for an empty map), so that a snapshot is
+// refused under a different Hash, as for frozen images.
+struct SnapshotHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t depth;        // directory depth
+    uint32_t check;
+    uint64_t shards;
+};
+
+static const char     kSnapshotMagic[8] = {'C', 'H', 'M', 'S', 'N', 'A', 'P', 0};
+static const uint32_t kSnapshotVersion = 2;
+static const uint32_t kSnapshotCachedHash = 1u << 0;
+
+// Per-shard header, followed by capacity ctrl bytes, then (without cached
+// hashes) capacity fingerprint bytes, then `entries` records in slot
+// order (cached hash, key, value) and `loose` records of entries still
+// in an old table (hash, key, value).
+struct SnapshotShardHeader {
+    uint32_t local_depth;
+    uint32_t reserved;
+    uint64_t capacity;
+    uint64_t entries;
+    uint64_t loose;
+};
+
+// Frozen image (FrozenHashMap::save_image, MappedFrozenHashMap): this
+// header, then buckets + 1 bucket offsets, then (with cached hashes) one
+// hash per entry, all uint64_t; then, from records_offset, the entries
+// as FrozenRecords in bucket order.  check is the hash of the first
+// entry's key, so that an image is refused under a different Hash.
+struct FrozenImageHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t flags;        // kSnapshotCachedHash
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t entries;
+    uint64_t buckets;
+    uint64_t records_offset;
+    uint64_t check;
+};
+
+static const char     kFrozenImageMagic[8] = {'C', 'H', 'M', 'F', 'R', 'O', 'Z', 0};
+static const uint32_t kFrozenImageVersion = 1;
+static const size_t   kFrozenImageAlign = 64;
+
+template <typename Key, typename Value>
+struct FrozenRecord {
+    Key   key;
+    Value value;
+};
+
+// ---------------------------------------------------------------------------
+// MappedFile -- a whole file, read-only.  mmap'd on Linux (so loading
+// costs page faults, not a copy into a buffer, and processes mapping the
+// same file share its page cache), read into memory elsewhere.  ok() is
+// false if the file could not be opened.  sequential asks the kernel for
+// aggressive read-ahead; leave it off for random lookups.
+// ---------------------------------------------------------------------------
+class MappedFile {
+public:
+    explicit MappedFile(const char* path, bool sequential = true) {
+#if defined(__linux__)
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            size_ = static_cast<size_t>(st.st_size);
+            void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                if (sequential) ::madvise(p, size_, MADV_SEQUENTIAL);
+                data_ = p;
+            }
+        }
+        ::close(fd);
+#else
+        (void)sequential;
+        if (std::FILE* f = std::fopen(path, "rb")) {
+            char chunk[1 << 16];
+            size_t n;
+            while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0) {
+                buf_.insert(buf_.end(), chunk, chunk + n);
+            }
+            if (!std::ferror(f) && !buf_.empty()) {
+                data_ = buf_.data();
+                size_ = buf_.size();
+            }
+            std::fclose(f);
+        }
+#endif
+    }
+
+    ~MappedFile() {
+#if defined(__linux__)
+        if (data_) ::munmap(data_, size_);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool ok() const { return data_ != nullptr; }
+    const void* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    void*  data_ = nullptr;
+    size_t size_ = 0;
+#if !defined(__linux__)
+    std::vector<char> buf_;
+#endif
+};
+
+}  // namespace detail
+}  // namespace concurrent_hashmap
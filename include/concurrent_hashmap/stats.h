@@ -0,0 +1,222 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace concurrent_hashmap {
+
+// ---------------------------------------------------------------------------
+// StatsSnapshot -- plain counters for one shard, or summed over a map.
+//
+// Probe lengths are in slots: from the home slot to the match for a hit,
+// and to the end of the last group screened for a miss.  Histogram bucket
+// b counts probes of length in (2^(b-1), 2^b]: 1, 2, 3-4, 5-8, ..., with
+// the last bucket open-ended.  A read retry is one restart of a lock-free
+// probe because a writer was active or had moved entries meanwhile.
+// ---------------------------------------------------------------------------
+struct StatsSnapshot {
+    static constexpr size_t kProbeBuckets = 9;
+
+    // Filled for every Stats policy.
+    uint64_t entries = 0;
+    uint64_t capacity = 0;  // slots in the current table
+
+    // Filled by an enabled policy (e.g. CountingStats), zero otherwise.
+    uint64_t hit_probes[kProbeBuckets] = {};
+    uint64_t miss_probes[kProbeBuckets] = {};
+    uint64_t read_retries = 0;
+    uint64_t grows = 0;              // full rehashes to a larger table
+    uint64_t shrinks = 0;
+    uint64_t forced_grows = 0;       // of grows: probe distance limit hit
+    uint64_t incremental_grows = 0;  // migrations started
+    uint64_t resize_nanos = 0;       // time in full rehashes
+    uint64_t lock_acquisitions = 0;
+    uint64_t lock_contended = 0;     // the lock was held by another thread
+    uint64_t lock_wait_nanos = 0;
+
+    static size_t probe_bucket(unsigned length) {
+        size_t b = 0;
+        while (b + 1 < kProbeBuckets && (1u << b) < length) ++b;
+        return b;
+    }
+
+    StatsSnapshot& operator+=(const StatsSnapshot& o) {
+        entries += o.entries;
+        capacity += o.capacity;
+        for (size_t b = 0; b < kProbeBuckets; ++b) {
+            hit_probes[b] += o.hit_probes[b];
+            miss_probes[b] += o.miss_probes[b];
+        }
+        read_retries += o.read_retries;
+        grows += o.grows;
+        shrinks += o.shrinks;
+        forced_grows += o.forced_grows;
+        incremental_grows += o.incremental_grows;
+        resize_nanos += o.resize_nanos;
+        lock_acquisitions += o.lock_acquisitions;
+        lock_contended += o.lock_contended;
+        lock_wait_nanos += o.lock_wait_nanos;
+        return *this;
+    }
+};
+
+// Returned by ConcurrentHashMap::stats().
+struct MapStats {
+    StatsSnapshot              total;
+    std::vector<StatsSnapshot> shards;  // indexed by shard id
+    // Retired tables and nodes handed to the epoch manager but not yet
+    // freed; each thread may also buffer a few not counted here.
+    size_t                     retired_pending = 0;
+};
+
+// ---------------------------------------------------------------------------
+// Stats policies -- the Stats template parameter of ConcurrentHashMap.
+// Each shard owns one instance and calls its hooks; hooks on the read
+// path run concurrently on many threads.  With enabled == false the map
+// never reads a clock for them, and the empty inline hooks compile away.
+// ---------------------------------------------------------------------------
+
+// The default: records nothing.
+struct NoStats {
+    static constexpr bool enabled = false;
+
+    void probe(bool /*hit*/, unsigned /*length*/) const {}
+    void read_retry() const {}
+    void resized(size_t /*from*/, size_t /*to*/, uint64_t /*nanos*/) const {}
+    void forced_grow() const {}
+    void migration_started() const {}
+    void lock_acquired(bool /*contended*/, uint64_t /*wait_nanos*/) const {}
+    void collect(StatsSnapshot&) const {}
+};
+
+// Relaxed atomic counters.  Every hook is a fetch_add on a counter shared
+// by the shard's threads, so reads pay for cache-line traffic: enable it
+// to diagnose, not by default.
+class CountingStats {
+public:
+    static constexpr bool enabled = true;
+
+    void probe(bool hit, unsigned length) const {
+        size_t b = StatsSnapshot::probe_bucket(length);
+        add(hit ? hit_probes_[b] : miss_probes_[b]);
+    }
+    void read_retry() const { add(read_retries_); }
+    void resized(size_t from, size_t to, uint64_t nanos) const {
+        add(to > from ? grows_ : shrinks_);
+        add(resize_nanos_, nanos);
+    }
+    void forced_grow() const { add(forced_grows_); }
+    void migration_started() const { add(incremental_grows_); }
+    void lock_acquired(bool contended, uint64_t wait_nanos) const {
+        add(lock_acquisitions_);
+        if (contended) add(lock_contended_);
+        if (wait_nanos) add(lock_wait_nanos_, wait_nanos);
+    }
+
+    void collect(StatsSnapshot& out) const {
+        for (size_t b = 0; b < StatsSnapshot::kProbeBuckets; ++b) {
+            out.hit_probes[b] += get(hit_probes_[b]);
+            out.miss_probes[b] += get(miss_probes_[b]);
+        }
+        out.read_retries += get(read_retries_);
+        out.grows += get(grows_);
+        out.shrinks += get(shrinks_);
+        out.forced_grows += get(forced_grows_);
+        out.incremental_grows += get(incremental_grows_);
+        out.resize_nanos += get(resize_nanos_);
+        out.lock_acquisitions += get(lock_acquisitions_);
+        out.lock_contended += get(lock_contended_);
+        out.lock_wait_nanos += get(lock_wait_nanos_);
+    }
+
+private:
+    using Counter = std::atomic<uint64_t>;
+
+    static void add(Counter& c, uint64_t n = 1) {
+        c.fetch_add(n, std::memory_order_relaxed);
+    }
+    static uint64_t get(const Counter& c) {
+        return c.load(std::memory_order_relaxed);
+    }
+
+    mutable Counter hit_probes_[StatsSnapshot::kProbeBuckets] = {};
+    mutable Counter miss_probes_[StatsSnapshot::kProbeBuckets] = {};
+    mutable Counter read_retries_{0};
+    mutable Counter grows_{0};
+    mutable Counter shrinks_{0};
+    mutable Counter forced_grows_{0};
+    mutable Counter incremental_grows_{0};
+    mutable Counter resize_nanos_{0};
+    mutable Counter lock_acquisitions_{0};
+    mutable Counter lock_contended_{0};
+    mutable Counter lock_wait_nanos_{0};
+};
+
+namespace detail {
+
+// Nanoseconds since an arbitrary point, for timing only when Enabled.
+template <bool Enabled>
+inline uint64_t stats_clock() {
+    return Enabled ? static_cast<uint64_t>(
+                         std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now()
+                                 .time_since_epoch()).count())
+                   : 0;
+}
+
+template <typename M, typename = void>
+struct has_try_lock : std::false_type {};
+template <typename M>
+struct has_try_lock<M, decltype(void(std::declval<M&>().try_lock()))>
+    : std::true_type {};
+
+// ---------------------------------------------------------------------------
+// StatLock -- a shard mutex that reports each acquisition to Stats.  A
+// failed try_lock marks it contended and the wait that follows is timed;
+// a Mutex without try_lock has every acquisition timed instead.
+// ---------------------------------------------------------------------------
+template <typename Mutex, typename Stats>
+class StatLock {
+public:
+    StatLock() = default;
+    StatLock(const StatLock&) = delete;
+    StatLock& operator=(const StatLock&) = delete;
+
+    void set_stats(const Stats* stats) { stats_ = stats; }
+
+    void lock() { lock(has_try_lock<Mutex>()); }
+    void unlock() { mutex_.unlock(); }
+
+    bool try_lock() {
+        if (!mutex_.try_lock()) return false;
+        stats_->lock_acquired(false, 0);
+        return true;
+    }
+
+private:
+    Mutex        mutex_;
+    const Stats* stats_ = nullptr;
+
+    void lock(std::true_type) {
+        if (mutex_.try_lock()) {
+            stats_->lock_acquired(false, 0);
+            return;
+        }
+        uint64_t start = stats_clock<true>();
+        mutex_.lock();
+        stats_->lock_acquired(true, stats_clock<true>() - start);
+    }
+    void lock(std::false_type) {
+        uint64_t start = stats_clock<true>();
+        mutex_.lock();
+        stats_->lock_acquired(false, stats_clock<true>() - start);
+    }
+};
+
+}  // namespace detail
+}  // namespace concurrent_hashmap
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+
+namespace concurrent_hashmap {
+
+template <typename Key, typename = void>
+struct FastHash;  // hash.h
+
+// ---------------------------------------------------------------------------
+// Customisation traits.  Specialise these in namespace concurrent_hashmap
+// to override the defaults for a particular Key/Value combination.
+// ---------------------------------------------------------------------------
+
+// use_atomic_slots -- lets writers that only change the value of an
+// existing entry (insert_or_assign, update, fetch_add) skip the shard
+// mutex and claim the slot with a CAS on its sequence counter instead.
+// Only sound when a slot can be read while a CAS-holder writes it, hence
+// the default: trivially copyable Key and Value of at most 8 bytes each.
+template <typename Key, typename Value>
+struct use_atomic_slots
+    : std::integral_constant<bool,
+          std::is_trivially_copyable<Key>::value &&
+          std::is_trivially_copyable<Value>::value &&
+          sizeof(Key) <= 8 && sizeof(Value) <= 8> {};
+
+// seq_stripe_slots -- number of consecutive slots that share one seqlock
+// counter.  0 (the default) keeps a counter in every slot.  A power of two
+// N moves the counters to a side array with one per N slots: each slot
+// loses its counter and padding, at the cost of readers retrying when a
+// neighbour in the same stripe is written.
+template <typename Key, typename Value>
+struct seq_stripe_slots : std::integral_constant<size_t, 0> {};
+
+// cache_hash -- whether each slot keeps the key's full hash.  When false,
+// a slot keeps only a one-byte fingerprint (in a dense array beside the
+// probe distances) and hashes are recomputed whenever entries move, so
+// Hash must be cheap and default-constructible, and a default instance
+// must agree with the map's.  The default drops the cache for integral,
+// enum and pointer keys hashed by std::hash or FastHash.
+template <typename Key, typename Hash>
+struct cache_hash
+    : std::integral_constant<bool,
+          !((std::is_integral<Key>::value || std::is_enum<Key>::value ||
+             std::is_pointer<Key>::value) &&
+            (std::is_same<Hash, std::hash<Key>>::value ||
+             std::is_same<Hash, FastHash<Key>>::value))> {};
+
+// mix_hash -- whether the map passes Hash's result through hash_int
+// before using it.  Shards are chosen by the top bits of a hash and slots
+// by the low bits, so both must be well spread; std::hash of an integer,
+// enum or pointer is the value itself on libstdc++ and libc++, which puts
+// every small key in shard 0.  The default mixes exactly those hashes.
+// Specialise it to true for any other Hash with weak high or low bits.
+template <typename Key, typename Hash>
+struct mix_hash
+    : std::integral_constant<bool,
+          (std::is_integral<Key>::value || std::is_enum<Key>::value ||
+           std::is_pointer<Key>::value) &&
+          std::is_same<Hash, std::hash<Key>>::value> {};
+
+// node_values -- store each value in an out-of-line node from a
+// per-shard pool and keep only a pointer in the slot.  Robin Hood
+// displacement, backward-shift delete, resize and split then move 8 bytes
+// instead of the value, readers copy the value outside the seqlock window
+// (so a concurrent writer never makes them start over), and find_ref can
+// hand out references.  Published nodes are never modified: writes build
+// a replacement and retire the old node through the epoch manager, so
+// updates pay an allocation and a copy.  The value is moved once, into
+// its node, and never assigned.  The default picks nodes for values
+// larger than two cache lines or without move assignment.
+template <typename Key, typename Value>
+struct node_values
+    : std::integral_constant<bool,
+          !std::is_move_assignable<Value>::value || (sizeof(Value) > 128)> {};
+
+}  // namespace concurrent_hashmap
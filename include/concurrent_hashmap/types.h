@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+namespace concurrent_hashmap {
+
+// Returned by a compute() functor to say what happens to the entry.
+enum class ComputeAction {
+    keep,   // keep (or, if the key was absent, insert) the value
+    erase,  // remove the entry (or, if the key was absent, insert nothing)
+};
+
+// Returned by the non-blocking writes (try_insert, try_erase, ...).
+enum class TryResult {
+    would_block,  // the shard lock was held: nothing was done
+    no,           // done; the blocking form would have returned false
+    yes,          // done; the blocking form would have returned true
+};
+
+// Where each shard's table memory is placed on a multi-socket machine.
+enum class NumaPolicy {
+    none,            // default allocation (first touch)
+    interleave,      // shard i on node i % nodes
+    shard_affinity,  // contiguous blocks of shards per node
+};
+
+// Who frees retired tables once no reader can still see them.
+enum class Reclamation {
+    on_advance,  // the thread that advances the epoch (default)
+    manual,      // only callers of collect()
+    background,  // a reclaimer thread owned by the map
+};
+
+// Optional map construction parameters.
+struct MapOptions {
+    // Number of shards, rounded up to a power of two; 0 selects the
+    // map's compile-time default (1 << ShardBits).  A few per hardware
+    // thread is a good starting point.
+    size_t shards = 0;
+
+    // Upper bound for shard-directory growth.  When larger than shards, a
+    // shard that grows past split_threshold entries is split in two on
+    // the next hash bit, until max_shards shards exist.  0 disables it.
+    size_t max_shards = 0;
+    size_t split_threshold = size_t{1} << 16;
+
+    NumaPolicy numa = NumaPolicy::none;
+
+    // With manual or background reclamation, request threads never run
+    // the destructors of retired tables.  reclaim_interval is the
+    // background thread's period.
+    Reclamation reclaim = Reclamation::on_advance;
+    std::chrono::milliseconds reclaim_interval{10};
+
+    // Flat combining for locked writes: a writer that finds its shard's
+    // lock held publishes the operation for the holder to apply, rather
+    // than waiting for the lock itself.  Pays off when many threads
+    // write to a few hot shards.  Needs a Mutex with try_lock; ignored
+    // otherwise.
+    bool flat_combining = false;
+};
+
+// Optional cache construction parameters (see ConcurrentCache).
+struct CacheOptions {
+    // Number of shards, rounded up to a power of two and to at most the
+    // capacity; 0 selects the cache's compile-time default.  Capacity is
+    // split evenly, so each shard evicts on its own.
+    size_t shards = 0;
+
+    // Expiry for entries written without an explicit TTL; 0 means they
+    // never expire.
+    std::chrono::nanoseconds default_ttl{0};
+
+    NumaPolicy numa = NumaPolicy::none;
+
+    // As in MapOptions.
+    Reclamation reclaim = Reclamation::on_advance;
+    std::chrono::milliseconds reclaim_interval{10};
+};
+
+}  // namespace concurrent_hashmap
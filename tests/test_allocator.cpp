@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+#include <concurrent_hashmap/huge_page_allocator.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::HugePageAllocator;
+using concurrent_hashmap::MapOptions;
+
+// Stateful allocator that tallies live bytes into a caller-owned counter,
+// to check that every table allocation goes through the map's allocator.
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    std::atomic<long>* live;
+
+    explicit CountingAllocator(std::atomic<long>* counter) : live(counter) {}
+    CountingAllocator() : live(nullptr) {}
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>& o) : live(o.live) {}
+
+    T* allocate(size_t n) {
+        if (live) live->fetch_add(static_cast<long>(n * sizeof(T)));
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, size_t n) {
+        if (live) live->fetch_sub(static_cast<long>(n * sizeof(T)));
+        std::allocator<T>().deallocate(p, n);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const CountingAllocator<T>& a, const CountingAllocator<U>& b) {
+    return a.live == b.live;
+}
+template <typename T, typename U>
+bool operator!=(const CountingAllocator<T>& a, const CountingAllocator<U>& b) {
+    return a.live != b.live;
+}
+
+using CountingMap = ConcurrentHashMap<
+    int, std::string, std::hash<int>, std::equal_to<int>, 2,
+    concurrent_hashmap::detail::SpinLock,
+    CountingAllocator<std::pair<const int, std::string>>>;
+
+TEST(AllocatorTest, TablesComeFromMapAllocator) {
+    std::atomic<long> live{0};
+    {
+        CountingAllocator<std::pair<const int, std::string>> alloc(&live);
+        CountingMap map(alloc);
+        EXPECT_EQ(map.get_allocator().live, &live);
+        long initial = live.load();
+        EXPECT_GT(initial, 0);  // one empty table per shard
+
+        for (int i = 0; i < 10000; ++i) map.insert(i, std::to_string(i));
+        EXPECT_GT(live.load(), initial);
+        for (int i = 0; i < 10000; ++i) {
+            ASSERT_EQ(map.find(i).first, std::to_string(i));
+        }
+        map.clear();
+    }
+    // Retired tables are released on destruction as well.
+    EXPECT_EQ(live.load(), 0);
+}
+
+using HugeMap = ConcurrentHashMap<
+    uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>, 1,
+    concurrent_hashmap::detail::SpinLock,
+    HugePageAllocator<std::pair<const uint64_t, uint64_t>>>;
+
+TEST(AllocatorTest, HugePageAllocatorBacksLargeTables) {
+    size_t before = HugePageAllocator<char>::bytes_allocated();
+    {
+        std::unique_ptr<HugeMap> map(new HugeMap());
+        const uint64_t kN = 200000;  // two shards, each table above 2MB
+        map->reserve(kN);
+        EXPECT_GE(HugePageAllocator<char>::bytes_allocated() - before,
+                  size_t{2} << 20);
+        for (uint64_t i = 0; i < kN; ++i) ASSERT_TRUE(map->insert(i, i * 3));
+        for (uint64_t i = 0; i < kN; ++i) {
+            auto r = map->find(i);
+            ASSERT_TRUE(r.second);
+            ASSERT_EQ(r.first, i * 3);
+        }
+    }
+    EXPECT_EQ(HugePageAllocator<char>::bytes_allocated(), before);
+}
+
+TEST(AllocatorTest, HugePageAllocatorSmallRequests) {
+    HugePageAllocator<int> a;
+    size_t before = HugePageAllocator<int>::bytes_allocated();
+    int* p = a.allocate(16);
+    for (int i = 0; i < 16; ++i) p[i] = i;
+    EXPECT_EQ(HugePageAllocator<int>::bytes_allocated() - before,
+              16 * sizeof(int));
+    a.deallocate(p, 16);
+    EXPECT_EQ(HugePageAllocator<int>::bytes_allocated(), before);
+}
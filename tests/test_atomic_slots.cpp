@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::use_atomic_slots;
+
+using WordMap = ConcurrentHashMap<uint64_t, uint64_t, std::hash<uint64_t>,
+                                  std::equal_to<uint64_t>, 2>;
+
+static_assert(use_atomic_slots<uint64_t, uint64_t>::value,
+              "word-sized entries use atomic slots");
+static_assert(use_atomic_slots<int, double>::value,
+              "small arithmetic entries use atomic slots");
+static_assert(!use_atomic_slots<int, std::string>::value,
+              "non-trivial values keep the locked path");
+
+struct Wide { uint64_t a, b; };
+static_assert(!use_atomic_slots<uint64_t, Wide>::value,
+              "values over 8 bytes keep the locked path");
+
+// Single map for the whole suite (see test_basic.cpp for the rationale).
+class AtomicSlotsTest : public ::testing::Test {
+protected:
+    static WordMap* map_;
+
+    static void SetUpTestSuite() { map_ = new WordMap(); }
+    static void TearDownTestSuite() {
+        delete map_;
+        map_ = nullptr;
+    }
+
+    void SetUp() override { map_->clear(); }
+
+    WordMap& map() { return *map_; }
+};
+
+WordMap* AtomicSlotsTest::map_ = nullptr;
+
+TEST_F(AtomicSlotsTest, FetchAddReturnsPrevious) {
+    EXPECT_EQ(map().fetch_add(1, 5), 0u);   // inserted
+    EXPECT_EQ(map().fetch_add(1, 3), 5u);
+    EXPECT_EQ(map().find(1).first, 8u);
+    EXPECT_EQ(map().size(), 1u);
+}
+
+TEST_F(AtomicSlotsTest, InsertOrAssignExisting) {
+    EXPECT_TRUE(map().insert_or_assign(7, 1));
+    EXPECT_FALSE(map().insert_or_assign(7, 2));
+    EXPECT_EQ(map().find(7).first, 2u);
+    EXPECT_FALSE(map().insert(7, 3));
+    EXPECT_EQ(map().find(7).first, 2u);
+}
+
+TEST_F(AtomicSlotsTest, ConcurrentFetchAddIsExact) {
+    const int kThreads = 4;
+    const int kKeys = 64;
+    const int kRounds = 5000;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&] {
+            for (int r = 0; r < kRounds; ++r) {
+                map().fetch_add(static_cast<uint64_t>(r % kKeys), 1);
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    uint64_t total = 0;
+    for (int k = 0; k < kKeys; ++k) total += map().find(k).first;
+    EXPECT_EQ(total, static_cast<uint64_t>(kThreads) * kRounds);
+}
+
+// Lock-free value updates racing with inserts that displace the counters
+// (Robin Hood shifts, resizes) and with erases of unrelated keys.
+TEST_F(AtomicSlotsTest, FetchAddDuringStructuralWrites) {
+    const uint64_t kCounters = 32;
+    const int kAdds = 20000;
+    for (uint64_t k = 0; k < kCounters; ++k) map().insert(k, 0);
+
+    std::atomic<bool> stop{false};
+    std::thread churn([&] {
+        uint64_t next = 1u << 20;
+        while (!stop.load(std::memory_order_relaxed)) {
+            for (int i = 0; i < 256; ++i) map().insert(next + i, 0);
+            for (int i = 0; i < 256; i += 2) map().erase(next + i);
+            next += 256;
+        }
+    });
+
+    std::vector<std::thread> adders;
+    for (int t = 0; t < 2; ++t) {
+        adders.emplace_back([&] {
+            for (int i = 0; i < kAdds; ++i) {
+                map().fetch_add(static_cast<uint64_t>(i) % kCounters, 1);
+            }
+        });
+    }
+    for (auto& th : adders) th.join();
+    stop.store(true);
+    churn.join();
+
+    uint64_t total = 0;
+    for (uint64_t k = 0; k < kCounters; ++k) {
+        auto r = map().find(k);
+        ASSERT_TRUE(r.second) << "key " << k;
+        total += r.first;
+    }
+    EXPECT_EQ(total, 2u * kAdds);
+}
@@ -1,6 +1,11 @@
 #include <gtest/gtest.h>
 #include <concurrent_hashmap/concurrent_hashmap.h>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
 #include <string>
+#include <thread>
 
 using concurrent_hashmap::ConcurrentHashMap;
 
@@ -12,15 +17,8 @@ using TestMap = ConcurrentHashMap<int, std::string, std::hash<int>,
 // Default-parameter map for verifying default template instantiation.
 using DefaultMap = ConcurrentHashMap<int, int>;
 
-// Use a single ConcurrentHashMap for the entire test suite to avoid
-// use-after-free in thread_local ThreadHandle across test instances.
-// The EpochManager::get_thread_entry() caches a ThreadEntry in a
-// thread_local; destroying one EpochManager and creating another
-// leaves a dangling pointer in that thread_local.
-//
-// Both map types are held in the same fixture so they share a single
-// destruction point, avoiding the dangling-pointer problem between
-// different test suites.
+// Use a single ConcurrentHashMap of each type for the entire test suite;
+// SetUp() clears them between tests.
 class ConcurrentHashMapTest : public ::testing::Test {
 protected:
     static TestMap*    map_;
@@ -293,3 +291,157 @@ TEST_F(ConcurrentHashMapTest, DefaultShardBits) {
 
     EXPECT_EQ(default_map().size(), 2u);
 }
+
+TEST_F(ConcurrentHashMapTest, FindIntoExisting) {
+    map().insert(7, "seven");
+    std::string out = "stale";
+    EXPECT_TRUE(map().find_into(7, out));
+    EXPECT_EQ(out, "seven");
+}
+
+TEST_F(ConcurrentHashMapTest, FindIntoMissing) {
+    map().insert(7, "seven");
+    std::string out;
+    EXPECT_FALSE(map().find_into(8, out));
+}
+
+TEST_F(ConcurrentHashMapTest, FindIntoReusesCapacity) {
+    map().insert(1, std::string(64, 'a'));
+    map().insert(2, std::string(32, 'b'));
+
+    std::string out;
+    out.reserve(256);
+    const char* buffer = out.data();
+    EXPECT_TRUE(map().find_into(1, out));
+    EXPECT_EQ(out, std::string(64, 'a'));
+    EXPECT_TRUE(map().find_into(2, out));
+    EXPECT_EQ(out, std::string(32, 'b'));
+    EXPECT_EQ(out.data(), buffer);
+}
+
+namespace {
+
+// Counts copies so the read path can be checked for stray value copies.
+struct CopyCounted {
+    static int copies;
+    int v = 0;
+    CopyCounted() = default;
+    explicit CopyCounted(int x) : v(x) {}
+    CopyCounted(const CopyCounted& o) : v(o.v) { ++copies; }
+    CopyCounted(CopyCounted&&) = default;
+    CopyCounted& operator=(const CopyCounted& o) { v = o.v; ++copies; return *this; }
+    CopyCounted& operator=(CopyCounted&&) = default;
+};
+int CopyCounted::copies = 0;
+
+}  // namespace
+
+TEST(ConcurrentHashMapReadPath, CopiesOnlyMatchingValue) {
+    static auto* counted = new ConcurrentHashMap<int, CopyCounted>();
+    for (int i = 0; i < 100; ++i) {
+        counted->insert(i, CopyCounted(i));
+    }
+
+    CopyCounted::copies = 0;
+    EXPECT_FALSE(counted->contains(1000));
+    EXPECT_FALSE(counted->find(1000).second);
+    EXPECT_TRUE(counted->contains(5));
+    EXPECT_EQ(CopyCounted::copies, 0);
+
+    auto r = counted->find(42);
+    EXPECT_TRUE(r.second);
+    EXPECT_EQ(r.first.v, 42);
+    EXPECT_EQ(CopyCounted::copies, 1);
+}
+
+TEST(ConcurrentHashMapMoves, RvalueInsertDoesNotCopy) {
+    static auto* counted = new ConcurrentHashMap<std::string, CopyCounted>();
+    counted->clear();
+    CopyCounted::copies = 0;
+
+    // Enough entries to force Robin Hood displacement and resizes.
+    for (int i = 0; i < 500; ++i) {
+        EXPECT_TRUE(counted->insert(std::to_string(i), CopyCounted(i)));
+    }
+    EXPECT_TRUE(counted->insert_or_assign(std::string("new"), CopyCounted(1)));
+    EXPECT_FALSE(counted->insert_or_assign(std::string("new"), CopyCounted(2)));
+    std::string key = "lvalue-key";
+    EXPECT_TRUE(counted->insert(key, CopyCounted(3)));
+    EXPECT_TRUE(counted->emplace(std::string("emplaced"), 4));
+    EXPECT_FALSE(counted->emplace(std::string("emplaced"), 5));
+    EXPECT_EQ(CopyCounted::copies, 0);
+
+    EXPECT_EQ(counted->find("new").first.v, 2);
+    EXPECT_EQ(counted->find("emplaced").first.v, 4);
+    EXPECT_EQ(counted->find("499").first.v, 499);
+}
+
+TEST(ConcurrentHashMapMoves, FailedInsertLeavesRvalueIntact) {
+    static auto* strings = new ConcurrentHashMap<int, std::string>();
+    strings->insert(1, "kept");
+    std::string value(100, 'x');
+    EXPECT_FALSE(strings->insert(1, std::move(value)));
+    EXPECT_EQ(value, std::string(100, 'x'));
+    EXPECT_EQ(strings->find(1).first, "kept");
+}
+
+TEST_F(ConcurrentHashMapTest, EmplaceConstructsFromArgs) {
+    EXPECT_TRUE(map().emplace(1, 3, 'z'));
+    EXPECT_EQ(map().find(1).first, "zzz");
+    EXPECT_FALSE(map().emplace(1, 5, 'y'));
+    EXPECT_EQ(map().find(1).first, "zzz");
+}
+
+TEST(ConcurrentHashMapBasic, PlacementNew) {
+    // Shards are allocated separately, so the map itself needs no more
+    // than fundamental alignment and builds in any suitable buffer.
+    static_assert(alignof(DefaultMap) <= alignof(std::max_align_t),
+                  "map object is over-aligned");
+    alignas(DefaultMap) unsigned char buf[sizeof(DefaultMap)];
+    DefaultMap* m = new (buf) DefaultMap();
+    EXPECT_TRUE(m->insert(1, 10));
+    EXPECT_EQ(m->find(1).first, 10);
+    m->~DefaultMap();
+
+    std::unique_ptr<DefaultMap> heap(new DefaultMap());
+    EXPECT_TRUE(heap->insert(2, 20));
+}
+
+TEST(ConcurrentHashMapReclaim, ManualCollectFreesRetiredTables) {
+    concurrent_hashmap::MapOptions options;
+    options.shards = 1;
+    options.reclaim = concurrent_hashmap::Reclamation::manual;
+    ConcurrentHashMap<int, int> m(options);
+    for (int i = 0; i < 10000; ++i) EXPECT_TRUE(m.insert(i, i));
+
+    size_t freed = 0;
+    for (int i = 0; i < 4; ++i) freed += m.collect();
+    EXPECT_GT(freed, 0u);
+    EXPECT_EQ(m.collect(), 0u);
+    for (int i = 0; i < 10000; ++i) EXPECT_EQ(m.find(i).first, i);
+}
+
+TEST(ConcurrentHashMapReclaim, CollectFreesTablesRetiredByAnIdleThread) {
+    concurrent_hashmap::MapOptions options;
+    options.shards = 1;
+    options.reclaim = concurrent_hashmap::Reclamation::manual;
+    ConcurrentHashMap<int, int> m(options);
+    for (int i = 0; i < 10000; ++i) EXPECT_TRUE(m.insert(i, i));
+    while (m.collect() != 0) {}
+
+    // The worker retires the table and then idles without exiting.
+    std::atomic<bool> cleared{false}, done{false};
+    std::thread worker([&] {
+        m.clear();
+        cleared = true;
+        while (!done.load()) std::this_thread::yield();
+    });
+    while (!cleared.load()) std::this_thread::yield();
+
+    size_t freed = 0;
+    for (int i = 0; i < 4; ++i) freed += m.collect();
+    done = true;
+    worker.join();
+    EXPECT_GT(freed, 0u);
+    EXPECT_TRUE(m.empty());
+}
@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using concurrent_hashmap::ConcurrentHashMap;
+
+// std::hash<int> is mixed by the map, so small keys spread over all
+// shards and batches really get grouped.
+using TestMap = ConcurrentHashMap<int, std::string, std::hash<int>,
+                                  std::equal_to<int>, 3>;
+
+// Single map for the whole suite (see test_basic.cpp for the rationale).
+class BatchTest : public ::testing::Test {
+protected:
+    static TestMap* map_;
+
+    static void SetUpTestSuite() { map_ = new TestMap(); }
+    static void TearDownTestSuite() {
+        delete map_;
+        map_ = nullptr;
+    }
+
+    void SetUp() override { map_->clear(); }
+
+    TestMap& map() { return *map_; }
+};
+
+TestMap* BatchTest::map_ = nullptr;
+
+TEST_F(BatchTest, InsertManyThenFindMany) {
+    // More than one chunk, so grouping restarts mid-batch.
+    const int N = 1500;
+    std::vector<int> keys(N);
+    std::vector<std::string> values(N);
+    for (int i = 0; i < N; ++i) {
+        keys[i] = i;
+        values[i] = std::to_string(i);
+    }
+
+    std::unique_ptr<bool[]> inserted(new bool[N]);
+    EXPECT_EQ(map().insert_many(keys.data(), values.data(), N, inserted.get()),
+              static_cast<size_t>(N));
+    for (int i = 0; i < N; ++i) EXPECT_TRUE(inserted[i]);
+    EXPECT_EQ(map().size(), static_cast<size_t>(N));
+
+    std::vector<std::string> out(N);
+    std::unique_ptr<bool[]> found(new bool[N]);
+    EXPECT_EQ(map().find_many(keys.data(), N, out.data(), found.get()),
+              static_cast<size_t>(N));
+    for (int i = 0; i < N; ++i) {
+        EXPECT_TRUE(found[i]) << "key " << i;
+        EXPECT_EQ(out[i], values[i]);
+    }
+}
+
+TEST_F(BatchTest, InsertManyReportsDuplicates) {
+    map().insert(2, "existing");
+    int keys[] = {1, 2, 3, 1};
+    std::string values[] = {"a", "b", "c", "d"};
+    bool inserted[4];
+
+    EXPECT_EQ(map().insert_many(keys, values, 4, inserted), 2u);
+    EXPECT_TRUE(inserted[0]);
+    EXPECT_FALSE(inserted[1]);
+    EXPECT_TRUE(inserted[2]);
+    EXPECT_FALSE(inserted[3]);  // duplicate within the batch
+    EXPECT_EQ(map().find(1).first, "a");
+    EXPECT_EQ(map().find(2).first, "existing");
+
+    // Large enough that the sort is not an insertion sort: the first
+    // copy of each repeated key still wins.
+    map().clear();
+    const int kBatch = 64, kDistinct = 8;
+    int many[kBatch];
+    std::string vals[kBatch];
+    bool ins[kBatch];
+    for (int i = 0; i < kBatch; ++i) {
+        many[i] = (i * 5) % kDistinct;
+        vals[i] = std::to_string(i);
+    }
+    EXPECT_EQ(map().insert_many(many, vals, kBatch, ins), size_t(kDistinct));
+    for (int i = 0; i < kBatch; ++i) {
+        EXPECT_EQ(ins[i], i < kDistinct) << "item " << i;
+    }
+    for (int i = 0; i < kDistinct; ++i) {
+        EXPECT_EQ(map().find(many[i]).first, std::to_string(i));
+    }
+}
+
+TEST_F(BatchTest, FindManyMixedHitsAndMisses) {
+    for (int i = 0; i < 100; i += 2) {
+        map().insert(i, std::to_string(i));
+    }
+    int keys[100];
+    for (int i = 0; i < 100; ++i) keys[i] = i;
+    std::string out[100];
+    bool found[100];
+
+    EXPECT_EQ(map().find_many(keys, 100, out, found), 50u);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(found[i], i % 2 == 0) << "key " << i;
+        if (found[i]) {
+            EXPECT_EQ(out[i], std::to_string(i));
+        }
+    }
+}
+
+TEST_F(BatchTest, EraseMany) {
+    for (int i = 0; i < 600; ++i) {
+        map().insert(i, std::to_string(i));
+    }
+    std::vector<int> keys;
+    for (int i = 0; i < 700; i += 2) keys.push_back(i);
+    std::unique_ptr<bool[]> erased(new bool[keys.size()]);
+
+    EXPECT_EQ(map().erase_many(keys.data(), keys.size(), erased.get()), 300u);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        EXPECT_EQ(erased[i], keys[i] < 600) << "key " << keys[i];
+    }
+    EXPECT_EQ(map().size(), 300u);
+    for (int i = 0; i < 600; ++i) {
+        EXPECT_EQ(map().contains(i), i % 2 == 1) << "key " << i;
+    }
+}
+
+TEST_F(BatchTest, NullResultArraysAndEmptyBatch) {
+    int keys[] = {5, 6};
+    std::string values[] = {"five", "six"};
+    EXPECT_EQ(map().insert_many(keys, values, 0), 0u);
+    EXPECT_EQ(map().insert_many(keys, values, 2), 2u);
+    EXPECT_EQ(map().erase_many(keys, 2), 2u);
+    EXPECT_TRUE(map().empty());
+}
+
+TEST_F(BatchTest, ConcurrentBatches) {
+    const int kThreads = 4;
+    const int kPerThread = 2000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([this, t] {
+            std::vector<int> keys(kPerThread);
+            std::vector<std::string> values(kPerThread);
+            for (int i = 0; i < kPerThread; ++i) {
+                keys[i] = t * kPerThread + i;
+                values[i] = std::to_string(keys[i]);
+            }
+            map().insert_many(keys.data(), values.data(), kPerThread);
+            std::vector<std::string> out(kPerThread);
+            std::unique_ptr<bool[]> found(new bool[kPerThread]);
+            EXPECT_EQ(map().find_many(keys.data(), kPerThread, out.data(),
+                                      found.get()),
+                      static_cast<size_t>(kPerThread));
+        });
+    }
+    for (auto& th : threads) th.join();
+    EXPECT_EQ(map().size(), static_cast<size_t>(kThreads * kPerThread));
+}
@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::MapOptions;
+
+using StringMap = ConcurrentHashMap<int, std::string>;
+using WordMap   = ConcurrentHashMap<uint64_t, uint64_t>;
+
+namespace {
+
+std::vector<std::pair<uint64_t, uint64_t>> words(uint64_t from, uint64_t to) {
+    std::vector<std::pair<uint64_t, uint64_t>> v;
+    for (uint64_t i = from; i < to; ++i) v.emplace_back(i, i * 3);
+    return v;
+}
+
+// A value whose copy throws once `fuse` copies have been made.
+struct Fragile {
+    static std::atomic<int> fuse;
+    int v = 0;
+    Fragile() = default;
+    explicit Fragile(int x) : v(x) {}
+    Fragile(const Fragile& o) : v(o.v) {
+        if (fuse.fetch_sub(1) <= 0) throw std::runtime_error("copy");
+    }
+    Fragile& operator=(const Fragile&) = default;
+};
+std::atomic<int> Fragile::fuse{1 << 30};
+
+}  // namespace
+
+TEST(BulkLoadTest, LoadsEmptyMap) {
+    WordMap map;
+    const uint64_t N = 200000;
+    auto in = words(0, N);
+    EXPECT_EQ(map.bulk_load(in.begin(), in.end()), N);
+    EXPECT_EQ(map.size(), N);
+    for (uint64_t i = 0; i < N; ++i) {
+        auto r = map.find(i);
+        ASSERT_TRUE(r.second) << "key " << i;
+        EXPECT_EQ(r.first, i * 3);
+    }
+    EXPECT_FALSE(map.contains(N));
+
+    // Each shard's table was sized once for its share.
+    auto stats = map.stats();
+    EXPECT_LE(stats.total.entries, stats.total.capacity * 3 / 4);
+}
+
+TEST(BulkLoadTest, FirstValueWinsLikeInsert) {
+    StringMap map;
+    for (int i = 0; i < 1000; ++i) map.insert(i, "old");
+
+    std::vector<std::pair<int, std::string>> in;
+    for (int i = 500; i < 3000; ++i) in.emplace_back(i, "first");
+    for (int i = 2000; i < 4000; ++i) in.emplace_back(i, "second");
+
+    EXPECT_EQ(map.bulk_load(in.begin(), in.end()), 3000u);
+    EXPECT_EQ(map.size(), 4000u);
+    EXPECT_EQ(map.find(0).first, "old");
+    EXPECT_EQ(map.find(999).first, "old");
+    EXPECT_EQ(map.find(1000).first, "first");
+    EXPECT_EQ(map.find(2999).first, "first");
+    EXPECT_EQ(map.find(3000).first, "second");
+
+    // Normal writes keep working on the loaded tables.
+    EXPECT_TRUE(map.insert(5000, "x"));
+    EXPECT_TRUE(map.erase(0));
+    EXPECT_EQ(map.size(), 4000u);
+}
+
+TEST(BulkLoadTest, UniqueSkipsChecks) {
+    WordMap map;
+    for (uint64_t i = 0; i < 100; ++i) map.insert(i, i * 3);
+    auto in = words(100, 50000);
+    EXPECT_EQ(map.bulk_load_unique(in.begin(), in.end()), in.size());
+    EXPECT_EQ(map.size(), 50000u);
+    for (uint64_t i = 0; i < 50000; ++i) {
+        ASSERT_EQ(map.find(i).first, i * 3) << "key " << i;
+    }
+}
+
+TEST(BulkLoadTest, CallerSuppliedExecutor) {
+    WordMap map;
+    auto in = words(0, 30000);
+    std::vector<std::thread> pool;
+    EXPECT_EQ(map.bulk_load(in.begin(), in.end(),
+                            [&](std::function<void()> task) {
+                                pool.emplace_back(std::move(task));
+                            }, 4),
+              in.size());
+    for (auto& th : pool) th.join();
+    EXPECT_EQ(pool.size(), 3u * 3);  // three phases; the caller is the fourth
+    EXPECT_EQ(map.size(), in.size());
+
+    // Inline executor, and more tasks than entries.
+    WordMap small;
+    auto few = words(0, 5);
+    EXPECT_EQ(small.bulk_load(few.begin(), few.end(),
+                              [](std::function<void()> task) { task(); }, 64),
+              5u);
+    EXPECT_EQ(small.size(), 5u);
+    EXPECT_EQ(small.bulk_load(few.begin(), few.begin()), 0u);
+}
+
+TEST(BulkLoadTest, NodeValuesAndSplitting) {
+    struct Big {
+        uint64_t v[32];
+    };
+    using BigMap = ConcurrentHashMap<uint64_t, Big>;
+    MapOptions opts;
+    opts.shards = 2;
+    opts.max_shards = 64;
+    opts.split_threshold = 1000;
+    BigMap map(opts);
+
+    std::vector<std::pair<uint64_t, Big>> in(20000);
+    for (uint64_t i = 0; i < in.size(); ++i) {
+        in[i].first = i;
+        in[i].second.v[0] = i + 1;
+    }
+    EXPECT_EQ(map.bulk_load(in.begin(), in.end()), in.size());
+    EXPECT_GT(map.shard_count(), 2u);
+    for (uint64_t i = 0; i < in.size(); ++i) {
+        auto r = map.find(i);
+        ASSERT_TRUE(r.second) << "key " << i;
+        EXPECT_EQ(r.first.v[0], i + 1);
+    }
+}
+
+TEST(BulkLoadTest, ReadersAndWritersDuringLoad) {
+    WordMap map;
+    const uint64_t kStable = 20000;
+    for (uint64_t i = 0; i < kStable; ++i) map.insert(i, i * 3);
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> misses{0};
+    std::thread reader([&] {
+        while (!stop.load()) {
+            for (uint64_t i = 0; i < kStable; i += 7) {
+                if (map.find(i).first != i * 3) misses.fetch_add(1);
+            }
+        }
+    });
+    std::thread writer([&] {
+        for (uint64_t i = 0; i < 20000; ++i) map.insert(1000000 + i, i);
+    });
+
+    auto in = words(kStable, 300000);
+    EXPECT_EQ(map.bulk_load(in.begin(), in.end()), in.size());
+    writer.join();
+    stop = true;
+    reader.join();
+
+    EXPECT_EQ(misses.load(), 0u);
+    EXPECT_EQ(map.size(), 300000u + 20000u);
+    for (uint64_t i = 0; i < 300000; ++i) {
+        ASSERT_EQ(map.find(i).first, i * 3) << "key " << i;
+    }
+}
+
+TEST(BulkLoadTest, ThrowingCopyLeavesMapConsistent) {
+    ConcurrentHashMap<int, Fragile> map;
+    std::vector<std::pair<int, Fragile>> in;
+    for (int i = 0; i < 10000; ++i) in.emplace_back(i, Fragile(i));
+
+    Fragile::fuse = 5000;
+    EXPECT_THROW(map.bulk_load(in.begin(), in.end(),
+                               [](std::function<void()> task) { task(); }, 1),
+                 std::runtime_error);
+    Fragile::fuse = 1 << 30;
+
+    // Shards built before the throw are complete; the rest are untouched.
+    size_t found = 0;
+    for (int i = 0; i < 10000; ++i) {
+        auto r = map.find(i);
+        if (r.second) {
+            EXPECT_EQ(r.first.v, i);
+            ++found;
+        }
+    }
+    EXPECT_EQ(found, map.size());
+    EXPECT_LT(found, 10000u);
+
+    EXPECT_EQ(map.bulk_load(in.begin(), in.end()), 10000u - found);
+    EXPECT_EQ(map.size(), 10000u);
+}
@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_cache.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using concurrent_hashmap::CacheOptions;
+using concurrent_hashmap::ConcurrentCache;
+
+// A clock the tests advance by hand.
+struct TestClock {
+    using duration   = std::chrono::nanoseconds;
+    using rep        = duration::rep;
+    using period     = duration::period;
+    using time_point = std::chrono::time_point<TestClock>;
+    static const bool is_steady = true;
+
+    static std::atomic<rep> ticks;
+    static time_point now() { return time_point(duration(ticks.load())); }
+    static void advance(duration d) { ticks += d.count(); }
+};
+std::atomic<TestClock::rep> TestClock::ticks{1000};
+
+using WordCache  = ConcurrentCache<uint64_t, uint64_t>;
+using TimedCache = ConcurrentCache<uint64_t, uint64_t, std::hash<uint64_t>,
+                                   std::equal_to<uint64_t>, 2,
+                                   concurrent_hashmap::detail::SpinLock,
+                                   std::allocator<std::pair<const uint64_t,
+                                                            uint64_t>>,
+                                   TestClock>;
+using StringCache = ConcurrentCache<std::string, std::string>;
+
+static CacheOptions with_shards(size_t shards) {
+    CacheOptions opts;
+    opts.shards = shards;
+    return opts;
+}
+
+TEST(CacheTest, BasicOperations) {
+    StringCache cache(100, with_shards(4));
+    EXPECT_EQ(cache.capacity(), 100u);
+    EXPECT_TRUE(cache.insert("a", "1"));
+    EXPECT_FALSE(cache.insert("a", "2"));
+    EXPECT_EQ(cache.find("a").first, "1");
+    EXPECT_FALSE(cache.insert_or_assign("a", "3"));
+    EXPECT_EQ(cache.find("a").first, "3");
+    EXPECT_TRUE(cache.contains("a"));
+    EXPECT_FALSE(cache.find("b").second);
+    EXPECT_TRUE(cache.erase("a"));
+    EXPECT_FALSE(cache.erase("a"));
+    EXPECT_TRUE(cache.empty());
+}
+
+TEST(CacheTest, LargeValuesInNodes) {
+    struct Blob {
+        uint64_t words[32];
+    };
+    ConcurrentCache<uint64_t, Blob> cache(64, with_shards(2));
+    for (uint64_t i = 0; i < 1000; ++i) {
+        Blob b;
+        for (uint64_t& w : b.words) w = i;
+        cache.insert_or_assign(i, b);
+    }
+    EXPECT_EQ(cache.size(), 64u);
+    auto got = cache.find(999);
+    ASSERT_TRUE(got.second);
+    EXPECT_EQ(got.first.words[31], 999u);
+}
+
+TEST(CacheTest, SizeStaysBounded) {
+    WordCache cache(1000, with_shards(8));
+    for (uint64_t i = 0; i < 100000; ++i) {
+        EXPECT_TRUE(cache.insert(i, i));
+        ASSERT_LE(cache.size(), cache.capacity());
+    }
+    EXPECT_EQ(cache.size(), cache.capacity());
+    // The newest key always survives its own insertion.
+    EXPECT_EQ(cache.find(99999).first, 99999u);
+
+    cache.clear();
+    EXPECT_TRUE(cache.empty());
+    for (uint64_t i = 0; i < 5000; ++i) cache.insert(i, i);
+    EXPECT_LE(cache.size(), cache.capacity());
+}
+
+TEST(CacheTest, ClockKeepsReferencedEntries) {
+    WordCache cache(1024, with_shards(1));
+    const uint64_t kHot = 256;
+    for (uint64_t i = 0; i < 1024; ++i) cache.insert(i, i);
+
+    // Read the hot keys between every batch of new ones; they should
+    // outlast a stream of keys that are never read.
+    for (uint64_t round = 0; round < 40; ++round) {
+        for (uint64_t i = 0; i < kHot; ++i) cache.find(i);
+        for (uint64_t i = 0; i < 256; ++i) {
+            cache.insert(100000 + round * 256 + i, i);
+        }
+    }
+    size_t hot = 0;
+    for (uint64_t i = 0; i < kHot; ++i) hot += cache.contains(i) ? 1 : 0;
+    EXPECT_GE(hot, static_cast<size_t>(kHot * 9 / 10));
+}
+
+TEST(CacheTest, ClockEvictsEntriesThatWentCold) {
+    WordCache cache(1024, with_shards(1));
+    const uint64_t kSet = 256;
+    for (uint64_t i = 0; i < 1024; ++i) cache.insert(i, i);
+
+    // Keys [0, kSet) are hot for a while; then a new set, from kNew, is
+    // inserted and only it is read.  Once the hand has gone round a few
+    // times, the old hot set must have been evicted ahead of the new one.
+    const uint64_t kNew = 50000;
+    uint64_t next = 100000;
+    for (uint64_t round = 0; round < 80; ++round) {
+        if (round == 10) {
+            for (uint64_t i = 0; i < kSet; ++i) cache.insert(kNew + i, i);
+        }
+        uint64_t base = round < 10 ? 0 : kNew;
+        for (uint64_t i = 0; i < kSet; ++i) cache.find(base + i);
+        for (uint64_t i = 0; i < 256; ++i) cache.insert(next++, i);
+    }
+    size_t cold = 0, hot = 0;
+    for (uint64_t i = 0; i < kSet; ++i) {
+        cold += cache.contains(i) ? 1 : 0;
+        hot += cache.contains(kNew + i) ? 1 : 0;
+    }
+    EXPECT_LE(cold, static_cast<size_t>(kSet / 10));
+    EXPECT_GE(hot, static_cast<size_t>(kSet * 9 / 10));
+}
+
+TEST(CacheTest, EraseKeepsTheReservedTable) {
+    WordCache cache(1024, with_shards(1));
+    for (int round = 0; round < 8; ++round) {
+        for (uint64_t i = 0; i < 1024; ++i) cache.insert(round * 1024 + i, i);
+        for (uint64_t i = 0; i < 1024; ++i) cache.erase(round * 1024 + i);
+        EXPECT_TRUE(cache.empty());
+    }
+    // Eviction still works on the table reserved up front.
+    for (uint64_t i = 0; i < 5000; ++i) cache.insert(i, i);
+    EXPECT_EQ(cache.size(), cache.capacity());
+}
+
+TEST(CacheTest, EntriesExpire) {
+    CacheOptions opts = with_shards(2);
+    opts.default_ttl = std::chrono::seconds(10);
+    TimedCache cache(100, opts);
+
+    cache.insert(1, 1);                             // default ttl
+    cache.insert(2, 2, std::chrono::seconds(1));
+    cache.insert(3, 3, std::chrono::nanoseconds(0));  // never expires
+    TestClock::advance(std::chrono::seconds(2));
+    EXPECT_TRUE(cache.contains(1));
+    EXPECT_FALSE(cache.find(2).second);
+    EXPECT_FALSE(cache.contains(2));
+
+    // An expired key is overwritten by insert and counts as new.
+    EXPECT_TRUE(cache.insert(2, 20, std::chrono::seconds(1)));
+    EXPECT_EQ(cache.find(2).first, 20u);
+    EXPECT_FALSE(cache.insert_or_assign(2, 21, std::chrono::seconds(20)));
+
+    TestClock::advance(std::chrono::seconds(9));
+    EXPECT_FALSE(cache.contains(1));
+    EXPECT_TRUE(cache.contains(2));
+    EXPECT_TRUE(cache.contains(3));
+    EXPECT_EQ(cache.size(), 3u);
+    EXPECT_EQ(cache.purge_expired(), 1u);
+    EXPECT_EQ(cache.size(), 2u);
+}
+
+TEST(CacheTest, ExpiredEntriesAreEvictedFirst) {
+    TimedCache cache(64, with_shards(1));
+    for (uint64_t i = 0; i < 64; ++i) {
+        cache.insert(i, i, std::chrono::seconds(i % 2 ? 1 : 100));
+    }
+    for (uint64_t i = 0; i < 64; ++i) cache.find(i);  // all referenced
+    TestClock::advance(std::chrono::seconds(2));
+    for (uint64_t i = 0; i < 32; ++i) cache.insert(1000 + i, i);
+    for (uint64_t i = 0; i < 64; i += 2) EXPECT_TRUE(cache.contains(i));
+    EXPECT_EQ(cache.size(), 64u);
+}
+
+TEST(CacheTest, ConcurrentReadersAndWriters) {
+    WordCache cache(4096, with_shards(16));
+    std::atomic<bool> stop{false};
+    std::atomic<int> bad{0};
+    std::vector<std::thread> threads;
+    for (int w = 0; w < 2; ++w) {
+        threads.emplace_back([&, w] {
+            for (uint64_t i = 0; i < 100000; ++i) {
+                uint64_t k = (i * 2 + w) % 20000;
+                cache.insert_or_assign(k, k * 3);
+                if (i % 7 == 0) cache.erase(k / 2);
+            }
+        });
+    }
+    for (int r = 0; r < 2; ++r) {
+        threads.emplace_back([&] {
+            while (!stop) {
+                for (uint64_t k = 0; k < 20000; k += 13) {
+                    auto got = cache.find(k);
+                    if (got.second && got.first != k * 3) ++bad;
+                }
+            }
+        });
+    }
+    threads[0].join();
+    threads[1].join();
+    stop = true;
+    threads[2].join();
+    threads[3].join();
+    EXPECT_EQ(bad.load(), 0);
+    EXPECT_LE(cache.size(), cache.capacity());
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+#include <concurrent_hashmap/locks.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::MapOptions;
+
+static MapOptions combining(size_t shards = 1) {
+    MapOptions opts;
+    opts.shards = shards;
+    opts.flat_combining = true;
+    return opts;
+}
+
+// String values keep every write on the locked (combinable) path.
+using StringMap = ConcurrentHashMap<int, std::string, std::hash<int>,
+                                    std::equal_to<int>, 1>;
+using CounterMap = ConcurrentHashMap<int, uint64_t, std::hash<int>,
+                                     std::equal_to<int>, 1>;
+
+TEST(CombiningTest, SingleThreadedWritesBehaveAsUsual) {
+    StringMap map(combining());
+    EXPECT_TRUE(map.insert(1, "a"));
+    EXPECT_FALSE(map.insert(1, "b"));
+    EXPECT_FALSE(map.insert_or_assign(1, "c"));
+    EXPECT_EQ(map.get_or_set(2, "d"), "d");
+    EXPECT_EQ(map.get_or_set(2, "e"), "d");
+    EXPECT_TRUE(map.erase(1));
+    EXPECT_FALSE(map.erase(1));
+    EXPECT_EQ(map.size(), 1u);
+    EXPECT_EQ(map.find(2).first, "d");
+}
+
+TEST(CombiningTest, HotKeyCountersAreExact) {
+    CounterMap map(combining());
+    const int kThreads = 8;
+    const int kPerThread = 20000;
+    const int kKeys = 4;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < kPerThread; ++i) {
+                int key = (t + i) % kKeys;
+                map.compute(key, [](uint64_t& v, bool) {
+                    ++v;
+                    return concurrent_hashmap::ComputeAction::keep;
+                });
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    uint64_t total = 0;
+    for (int k = 0; k < kKeys; ++k) total += map.find(k).first;
+    EXPECT_EQ(total, static_cast<uint64_t>(kThreads) * kPerThread);
+}
+
+TEST(CombiningTest, EachKeyInsertedOnce) {
+    StringMap map(combining());
+    const int kThreads = 8;
+    const int kKeys = 2000;
+    std::atomic<int> inserted{0};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int k = 0; k < kKeys; ++k) {
+                if (map.insert(k, std::to_string(t))) inserted.fetch_add(1);
+                map.erase(k + kKeys);
+                map.insert(k + kKeys, "x");
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    EXPECT_EQ(inserted.load(), kKeys);
+    EXPECT_EQ(map.size(), static_cast<size_t>(2 * kKeys));
+}
+
+TEST(CombiningTest, WorksWithSplitsAndOtherMutexes) {
+    using Map = ConcurrentHashMap<int, std::string, std::hash<int>,
+                                  std::equal_to<int>, 1, std::mutex>;
+    MapOptions opts = combining(2);
+    opts.max_shards = 16;
+    opts.split_threshold = 512;
+    Map map(opts);
+    const int kThreads = 4;
+    const int kPerThread = 5000;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < kPerThread; ++i) {
+                int k = t * kPerThread + i;
+                map.insert(k * 2654435761u, std::to_string(k));
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    EXPECT_GT(map.shard_count(), 2u);
+    EXPECT_EQ(map.size(), static_cast<size_t>(kThreads * kPerThread));
+    for (int k = 0; k < kThreads * kPerThread; ++k) {
+        ASSERT_EQ(map.find(k * 2654435761u).first, std::to_string(k));
+    }
+}
+
+TEST(CombiningTest, ExceptionsReachTheWriter) {
+    CounterMap map(combining());
+    map.insert(0, 0);
+    const int kThreads = 4;
+    const int kPerThread = 5000;
+    std::atomic<int> caught{0};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < kPerThread; ++i) {
+                try {
+                    map.compute(0, [i](uint64_t& v, bool) {
+                        if (i % 2) throw std::runtime_error("odd");
+                        ++v;
+                        return concurrent_hashmap::ComputeAction::keep;
+                    });
+                } catch (const std::runtime_error&) {
+                    caught.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    EXPECT_EQ(caught.load(), kThreads * kPerThread / 2);
+    EXPECT_EQ(map.find(0).first,
+              static_cast<uint64_t>(kThreads * kPerThread / 2));
+}
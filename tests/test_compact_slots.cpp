@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Counts calls, so tests can see hashes being recomputed.
+struct CountingHash {
+    static std::atomic<size_t> calls;
+    size_t operator()(uint64_t k) const {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        return static_cast<size_t>(k * 0xBF58476D1CE4E5B9ull);
+    }
+};
+std::atomic<size_t> CountingHash::calls{0};
+
+// Keys that are multiples of 8 share one hash, and so one home slot and
+// fingerprint: only the key compare tells them apart.
+struct CollidingHash {
+    size_t operator()(uint64_t k) const {
+        return static_cast<size_t>(k & 0x7);
+    }
+};
+
+namespace concurrent_hashmap {
+template <>
+struct cache_hash<uint64_t, CountingHash> : std::false_type {};
+template <>
+struct cache_hash<uint64_t, CollidingHash> : std::false_type {};
+// Opt an integer key back into the cached hash.
+template <>
+struct cache_hash<int16_t, std::hash<int16_t>> : std::true_type {};
+}  // namespace concurrent_hashmap
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::cache_hash;
+using concurrent_hashmap::detail::Shard;
+
+static_assert(!cache_hash<int, std::hash<int>>::value,
+              "integer keys with std::hash drop the cached hash");
+static_assert(!cache_hash<const void*, std::hash<const void*>>::value,
+              "pointer keys with std::hash drop the cached hash");
+static_assert(cache_hash<std::string, std::hash<std::string>>::value,
+              "string keys keep the cached hash");
+static_assert(cache_hash<uint64_t, std::function<size_t(uint64_t)>>::value,
+              "custom hashers keep the cached hash");
+
+static_assert(sizeof(Shard<int, int>::Slot) == 12,
+              "compact int slot: seq, key, value");
+static_assert(sizeof(Shard<int16_t, int16_t>::Slot) >
+                  sizeof(Shard<int, int>::Slot),
+              "opting back in restores the cached hash");
+
+using CountingMap = ConcurrentHashMap<uint64_t, uint64_t, CountingHash,
+                                      std::equal_to<uint64_t>, 1>;
+using CollidingMap = ConcurrentHashMap<uint64_t, uint64_t, CollidingHash,
+                                       std::equal_to<uint64_t>, 1>;
+using IntMap = ConcurrentHashMap<int, int, std::hash<int>,
+                                 std::equal_to<int>, 1>;
+
+// Single map per type for the whole suite (see test_basic.cpp).
+class CompactSlotsTest : public ::testing::Test {
+protected:
+    static CountingMap*  counting_;
+    static CollidingMap* colliding_;
+    static IntMap*       ints_;
+
+    static void SetUpTestSuite() {
+        counting_ = new CountingMap();
+        colliding_ = new CollidingMap();
+        ints_ = new IntMap();
+    }
+    static void TearDownTestSuite() {
+        delete ints_;
+        delete colliding_;
+        delete counting_;
+        ints_ = nullptr;
+        colliding_ = nullptr;
+        counting_ = nullptr;
+    }
+
+    void SetUp() override {
+        counting_->clear();
+        colliding_->clear();
+        ints_->clear();
+    }
+
+    CountingMap&  counting()  { return *counting_; }
+    CollidingMap& colliding() { return *colliding_; }
+    IntMap&       ints()      { return *ints_; }
+};
+
+CountingMap*  CompactSlotsTest::counting_ = nullptr;
+CollidingMap* CompactSlotsTest::colliding_ = nullptr;
+IntMap*       CompactSlotsTest::ints_ = nullptr;
+
+TEST_F(CompactSlotsTest, ResizeRecomputesHashes) {
+    const uint64_t N = 5000;
+    CountingHash::calls = 0;
+    for (uint64_t i = 0; i < N; ++i) EXPECT_TRUE(counting().insert(i, i));
+    // One call per insert from the map, plus recomputation by every
+    // rehash and Robin Hood displacement along the way.
+    EXPECT_GT(CountingHash::calls.load(), N);
+    for (uint64_t i = 0; i < N; ++i) {
+        EXPECT_EQ(counting().find(i).first, i);
+    }
+    EXPECT_FALSE(counting().contains(N));
+}
+
+TEST_F(CompactSlotsTest, EqualFingerprintsFallBackToKeys) {
+    const uint64_t N = 64;  // long chains, well within kMaxDist
+    for (uint64_t i = 0; i < N; ++i) {
+        EXPECT_TRUE(colliding().insert(i * 8, i));
+    }
+    for (uint64_t i = 0; i < N; ++i) {
+        EXPECT_EQ(colliding().find(i * 8).first, i);
+        EXPECT_FALSE(colliding().contains(i * 8 + 8 * N));
+    }
+    for (uint64_t i = 0; i < N; i += 2) EXPECT_TRUE(colliding().erase(i * 8));
+    for (uint64_t i = 0; i < N; ++i) {
+        EXPECT_EQ(colliding().contains(i * 8), (i & 1) != 0);
+    }
+}
+
+TEST_F(CompactSlotsTest, ReadersNeverMissDuringGrowth) {
+    const int kStable = 1000;
+    for (int i = 0; i < kStable; ++i) ints().insert(i, -i);
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> bad{0};
+    std::thread writer([&] {
+        for (int round = 0; round < 3; ++round) {
+            for (int i = 0; i < 30000; ++i) ints().insert(kStable + i, i);
+            for (int i = 0; i < 30000; ++i) ints().erase(kStable + i);
+        }
+        stop = true;
+    });
+    std::thread reader([&] {
+        while (!stop) {
+            for (int i = 0; i < kStable; ++i) {
+                auto got = ints().find(i);
+                if (!got.second || got.first != -i) ++bad;
+            }
+        }
+    });
+    writer.join();
+    reader.join();
+    EXPECT_EQ(bad.load(), 0);
+    EXPECT_EQ(ints().size(), static_cast<size_t>(kStable));
+}
@@ -243,6 +243,48 @@ TEST_F(ConcurrentTest, ConcurrentInsertTriggersResizeNoDataLoss) {
     }
 }
 
+// ===========================================================================
+// Test 5b: Concurrent find during incremental resize -> no garbage, no loss
+//
+// Uses the small map (4 shards) so each shard grows past the incremental
+// resize threshold.  Finders only probe keys inserted before they start.
+// ===========================================================================
+TEST_F(ConcurrentTest, ConcurrentFindDuringIncrementalResize) {
+    const int kPrefill   = 2000;
+    const int kInserters = 4;
+    const int kPerThread = 8000;
+    const int kFinders   = 4;
+
+    for (int i = 0; i < kPrefill; ++i) {
+        smap().insert(i, i);
+    }
+
+    run_threads(kInserters + kFinders, [&](int tid) {
+        if (tid < kInserters) {
+            int base = kPrefill + tid * kPerThread;
+            for (int i = 0; i < kPerThread; ++i) {
+                smap().insert(base + i, base + i);
+            }
+        } else {
+            unsigned seed = static_cast<unsigned>(tid);
+            for (int op = 0; op < 20000; ++op) {
+                seed = seed * 1103515245u + 12345u;
+                int key = static_cast<int>((seed >> 16) % kPrefill);
+                auto result = smap().find(key);
+                if (result.second) {
+                    EXPECT_EQ(result.first, key);
+                }
+            }
+        }
+    });
+
+    EXPECT_EQ(smap().size(),
+              static_cast<size_t>(kPrefill + kInserters * kPerThread));
+    for (int i = 0; i < kPrefill + kInserters * kPerThread; ++i) {
+        ASSERT_TRUE(smap().contains(i)) << "key " << i << " lost";
+    }
+}
+
 // ===========================================================================
 // Test 6: Mixed insert + erase + find -> no crash, size >= 0
 //
@@ -2,6 +2,8 @@
 #include <concurrent_hashmap/detail/epoch.h>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <memory>
 #include <vector>
 
 using namespace concurrent_hashmap::detail;
@@ -67,3 +69,137 @@ TEST(Epoch, MultiThreadRetire) {
     }
     EXPECT_EQ(deleted.load(), N * T);
 }
+
+TEST(Epoch, AlternatingManagersReuseEntries) {
+    EpochManager a;
+    EpochManager b;
+    for (int i = 0; i < 1000; ++i) {
+        EpochGuard ga(a);
+        EpochGuard gb(b);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        { EpochGuard g(a); }
+        { EpochGuard g(b); }
+    }
+    EXPECT_EQ(a.registered_threads(), 1u);
+    EXPECT_EQ(b.registered_threads(), 1u);
+}
+
+TEST(Epoch, DestroyedManagersAreForgotten) {
+    EpochManager keep;
+    { EpochGuard g(keep); }
+    for (int i = 0; i < 100; ++i) {
+        EpochManager temp;
+        EpochGuard g(temp);
+        EpochGuard gk(keep);
+    }
+    // A new manager may reuse a destroyed one's address; it must get
+    // a fresh entry rather than the stale one.
+    for (int i = 0; i < 10; ++i) {
+        std::unique_ptr<EpochManager> temp(new EpochManager);
+        { EpochGuard g(*temp); }
+        EXPECT_EQ(temp->registered_threads(), 1u);
+    }
+    EXPECT_EQ(keep.registered_threads(), 1u);
+}
+
+TEST(Epoch, DeadThreadEntriesAreRecycled) {
+    EpochManager mgr;
+    constexpr int T = 32;
+    for (int t = 0; t < T; ++t) {
+        std::thread([&] { EpochGuard g(mgr); }).join();
+    }
+    // Each thread reuses the entry its predecessor left behind.
+    EXPECT_EQ(mgr.registered_threads(), 1u);
+    { EpochGuard g(mgr); }
+    EXPECT_EQ(mgr.registered_threads(), 1u);
+}
+
+namespace {
+
+struct Counted : EpochManager::Retired {
+    std::atomic<int>& counter;
+    std::thread::id*  freed_by;
+    Counted(std::atomic<int>& c, std::thread::id* by = nullptr)
+        : counter(c), freed_by(by) {}
+    ~Counted() {
+        if (freed_by) *freed_by = std::this_thread::get_id();
+        counter.fetch_add(1);
+    }
+};
+
+}  // namespace
+
+TEST(Epoch, ManualReclamationWaitsForCollect) {
+    EpochManager mgr(concurrent_hashmap::Reclamation::manual);
+    std::atomic<int> deleted{0};
+    {
+        EpochGuard g(mgr);
+        for (int i = 0; i < 100; ++i) mgr.retire(new Counted(deleted));
+    }
+    for (int i = 0; i < 256; ++i) {
+        EpochGuard g(mgr);
+    }
+    EXPECT_EQ(deleted.load(), 0);
+
+    size_t freed = 0;
+    for (int i = 0; i < 4; ++i) freed += mgr.collect();
+    EXPECT_EQ(freed, 100u);
+    EXPECT_EQ(deleted.load(), 100);
+}
+
+TEST(Epoch, CollectRespectsPinnedReaders) {
+    EpochManager mgr(concurrent_hashmap::Reclamation::manual);
+    std::atomic<int> deleted{0};
+    std::atomic<bool> pinned{false};
+    std::atomic<bool> done{false};
+    std::thread reader([&] {
+        EpochGuard g(mgr);
+        pinned = true;
+        while (!done) std::this_thread::yield();
+    });
+    while (!pinned) std::this_thread::yield();
+
+    mgr.retire(new Counted(deleted));
+    for (int i = 0; i < 8; ++i) mgr.collect();
+    EXPECT_EQ(deleted.load(), 0);
+
+    done = true;
+    reader.join();
+    for (int i = 0; i < 4; ++i) mgr.collect();
+    EXPECT_EQ(deleted.load(), 1);
+}
+
+TEST(Epoch, OrphanedBuffersAreCollected) {
+    EpochManager mgr(concurrent_hashmap::Reclamation::manual);
+    std::atomic<int> deleted{0};
+    std::thread([&] {
+        EpochGuard g(mgr);
+        for (int i = 0; i < 5; ++i) mgr.retire(new Counted(deleted));
+    }).join();
+    for (int i = 0; i < 4; ++i) mgr.collect();
+    EXPECT_EQ(deleted.load(), 5);
+}
+
+TEST(Epoch, BackgroundReclaimerFreesOffThread) {
+    std::atomic<int> deleted{0};
+    std::thread::id freed_by;
+    {
+        EpochManager mgr(concurrent_hashmap::Reclamation::background,
+                         std::chrono::milliseconds(1));
+        {
+            EpochGuard g(mgr);
+            mgr.retire(new Counted(deleted, &freed_by));
+        }
+        // Hand the buffer over through the periodic unpin path.
+        for (int i = 0; i < 64; ++i) {
+            EpochGuard g(mgr);
+        }
+        for (int i = 0; i < 5000 && deleted.load() == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        EXPECT_EQ(deleted.load(), 1);
+        EXPECT_NE(freed_by, std::this_thread::get_id());
+    }
+    EXPECT_EQ(deleted.load(), 1);
+}
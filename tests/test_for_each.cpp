@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::MapOptions;
+
+using StringMap = ConcurrentHashMap<int, std::string, std::hash<int>,
+                                    std::equal_to<int>, 2>;
+using WordMap   = ConcurrentHashMap<uint64_t, uint64_t>;
+
+TEST(ForEachTest, VisitsEveryEntryOnce) {
+    StringMap map;
+    const int N = 10000;
+    for (int i = 0; i < N; ++i) map.insert(i, std::to_string(i));
+    for (int i = 0; i < N; i += 3) map.erase(i);
+
+    std::vector<int> seen(N, 0);
+    map.for_each([&](int k, const std::string& v) {
+        EXPECT_EQ(v, std::to_string(k));
+        ++seen[k];
+    });
+    for (int i = 0; i < N; ++i) EXPECT_EQ(seen[i], i % 3 ? 1 : 0);
+
+    StringMap empty;
+    empty.for_each([](int, const std::string&) { FAIL(); });
+}
+
+TEST(ForEachTest, ShardsPartitionTheMap) {
+    WordMap map;
+    const uint64_t N = 20000;
+    for (uint64_t i = 0; i < N; ++i) map.insert(i, i);
+
+    size_t total = 0;
+    for (size_t s = 0; s < map.shard_count(); ++s) {
+        map.for_each_shard(s, [&](uint64_t k, uint64_t) {
+            EXPECT_EQ(map.shard_of(k), s);
+            ++total;
+        });
+    }
+    EXPECT_EQ(total, static_cast<size_t>(N));
+}
+
+TEST(ForEachTest, ParallelOnExecutor) {
+    WordMap map;
+    const uint64_t N = 50000;
+    for (uint64_t i = 0; i < N; ++i) map.insert(i, i * 2);
+
+    std::vector<std::atomic<int>> seen(N);
+    for (auto& c : seen) c = 0;
+    std::vector<std::thread> pool;
+    std::atomic<uint64_t> sum{0};
+    map.parallel_for_each([&](uint64_t k, uint64_t v) {
+        EXPECT_EQ(v, k * 2);
+        seen[k].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(v, std::memory_order_relaxed);
+    }, [&](std::function<void()> task) {
+        pool.emplace_back(std::move(task));
+    }, 4);
+    for (auto& th : pool) th.join();
+    EXPECT_EQ(pool.size(), 3u);  // the caller is the fourth worker
+    for (uint64_t i = 0; i < N; ++i) EXPECT_EQ(seen[i].load(), 1);
+    EXPECT_EQ(sum.load(), N * (N - 1));
+
+    // An executor that runs tasks inline, and the std::thread default.
+    size_t count = 0;
+    map.parallel_for_each([&](uint64_t, uint64_t) { ++count; },
+                          [](std::function<void()> task) { task(); }, 8);
+    EXPECT_EQ(count, static_cast<size_t>(N));
+    std::atomic<size_t> again{0};
+    map.parallel_for_each([&](uint64_t, uint64_t) { ++again; });
+    EXPECT_EQ(again.load(), static_cast<size_t>(N));
+}
+
+TEST(ForEachTest, SplitsDuringScan) {
+    MapOptions opts;
+    opts.shards = 1;
+    opts.max_shards = 64;
+    opts.split_threshold = 300;
+    WordMap map(opts);
+    const uint64_t kStable = 3000;
+    for (uint64_t i = 0; i < kStable; ++i) map.insert(i, i);
+
+    std::atomic<bool> stop{false};
+    std::thread writer([&] {
+        for (uint64_t i = 0; i < 20000; ++i) map.insert(100000 + i, i);
+        stop = true;
+    });
+    int rounds = 0;
+    while (!stop || rounds < 2) {
+        std::vector<std::atomic<int>> seen(kStable);
+        for (auto& c : seen) c = 0;
+        auto visit = [&](uint64_t k, uint64_t) {
+            if (k < kStable) seen[k].fetch_add(1, std::memory_order_relaxed);
+        };
+        if (rounds & 1) {
+            map.parallel_for_each(visit);
+        } else {
+            map.for_each(visit);
+        }
+        for (uint64_t i = 0; i < kStable; ++i) {
+            ASSERT_EQ(seen[i].load(), 1) << "key " << i;
+        }
+        ++rounds;
+    }
+    writer.join();
+    EXPECT_GT(map.shard_count(), 1u);
+}
@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+#include <concurrent_hashmap/frozen_hashmap.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::FrozenHashMap;
+using concurrent_hashmap::MapOptions;
+
+using StringMap = ConcurrentHashMap<int, std::string, std::hash<int>,
+                                    std::equal_to<int>, 2>;
+using WordMap   = ConcurrentHashMap<uint64_t, uint64_t>;
+
+TEST(FrozenTest, EmptyMap) {
+    FrozenHashMap<int, int> frozen;
+    EXPECT_TRUE(frozen.empty());
+    EXPECT_EQ(frozen.find(1), nullptr);
+    EXPECT_FALSE(frozen.contains(0));
+    EXPECT_EQ(frozen.begin(), frozen.end());
+
+    StringMap map;
+    EXPECT_EQ(map.freeze().size(), 0u);
+}
+
+TEST(FrozenTest, FreezeMatchesMap) {
+    StringMap map;
+    const int N = 10000;
+    for (int i = 0; i < N; ++i) map.insert(i, std::to_string(i));
+    for (int i = 0; i < N; i += 4) map.erase(i);
+
+    StringMap::frozen_type frozen = map.freeze();
+    EXPECT_EQ(frozen.size(), map.size());
+    EXPECT_GE(frozen.bucket_count(), frozen.size());
+    for (int i = 0; i < N; ++i) {
+        const std::string* v = frozen.find(i);
+        if (i % 4 == 0) {
+            EXPECT_EQ(v, nullptr);
+        } else {
+            ASSERT_NE(v, nullptr);
+            EXPECT_EQ(*v, std::to_string(i));
+        }
+    }
+    EXPECT_FALSE(frozen.contains(N));
+
+    // The snapshot is independent of later writes.
+    map.clear();
+    EXPECT_EQ(*frozen.find(1), "1");
+
+    size_t seen = 0;
+    for (const auto& e : frozen) {
+        EXPECT_EQ(e.second, std::to_string(e.first));
+        ++seen;
+    }
+    EXPECT_EQ(seen, frozen.size());
+}
+
+TEST(FrozenTest, DuplicatesKeepFirst) {
+    std::vector<std::pair<std::string, int>> entries;
+    entries.emplace_back("a", 1);
+    entries.emplace_back("b", 2);
+    entries.emplace_back("a", 3);
+    FrozenHashMap<std::string, int> frozen(std::move(entries));
+    EXPECT_EQ(frozen.size(), 2u);
+    EXPECT_EQ(*frozen.find("a"), 1);
+    EXPECT_EQ(*frozen.find("b"), 2);
+    EXPECT_EQ(frozen.find("c"), nullptr);
+}
+
+TEST(FrozenTest, FreezeDuringSplitsAndUpdates) {
+    MapOptions opts;
+    opts.shards = 1;
+    opts.max_shards = 16;
+    opts.split_threshold = 500;
+    WordMap map(opts);
+    const uint64_t kStable = 2000;
+    for (uint64_t i = 0; i < kStable; ++i) map.insert(i, 1);
+
+    std::atomic<bool> stop{false};
+    std::thread writer([&] {
+        for (uint64_t i = 0; i < 20000; ++i) {
+            map.insert(100000 + i, i);
+            map.fetch_add(i % kStable, 1);  // lock-free on atomic slots
+        }
+        stop = true;
+    });
+    int rounds = 0;
+    while (!stop || rounds == 0) {
+        WordMap::frozen_type frozen = map.freeze();
+        std::set<uint64_t> keys;
+        for (const auto& e : frozen) keys.insert(e.first);
+        EXPECT_EQ(keys.size(), frozen.size());  // no key copied twice
+        for (uint64_t i = 0; i < kStable; ++i) {
+            const uint64_t* v = frozen.find(i);
+            ASSERT_NE(v, nullptr);
+            EXPECT_GE(*v, 1u);
+        }
+        ++rounds;
+    }
+    writer.join();
+    EXPECT_EQ(map.freeze().size(), map.size());
+}
+
+TEST(FrozenTest, ReadersSwapSnapshots) {
+    WordMap map;
+    for (uint64_t i = 0; i < 1000; ++i) map.insert(i, 0);
+    using Frozen = WordMap::frozen_type;
+    std::shared_ptr<const Frozen> current =
+        std::make_shared<const Frozen>(map.freeze());
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> bad{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; ++r) {
+        readers.emplace_back([&] {
+            uint64_t last = 0;
+            while (!stop) {
+                std::shared_ptr<const Frozen> snap = std::atomic_load(&current);
+                // Every snapshot holds one generation for all keys.
+                const uint64_t* first = snap->find(0);
+                if (!first || *first < last) ++bad;
+                last = first ? *first : last;
+                for (uint64_t i = 1; i < 1000; ++i) {
+                    const uint64_t* v = snap->find(i);
+                    if (!v || *v != last) ++bad;
+                }
+            }
+        });
+    }
+    for (uint64_t gen = 1; gen <= 50; ++gen) {
+        for (uint64_t i = 0; i < 1000; ++i) map.insert_or_assign(i, gen);
+        std::atomic_store(&current,
+                          std::make_shared<const Frozen>(map.freeze()));
+    }
+    stop = true;
+    for (auto& th : readers) th.join();
+    EXPECT_EQ(bad.load(), 0);
+    EXPECT_EQ(*std::atomic_load(&current)->find(999), 50u);
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/detail/group.h>
+#include <concurrent_hashmap/detail/shard.h>
+#include <concurrent_hashmap/detail/epoch.h>
+#include <vector>
+
+using namespace concurrent_hashmap::detail;
+
+TEST(Group, EmptyGroupStopsImmediately) {
+    std::vector<uint8_t> ctrl(kGroupWidth, 0);
+    ProbeMask m = match_probe_group(ctrl.data(), 1);
+    EXPECT_EQ(m.candidates, 0u);
+    EXPECT_TRUE(m.stop);
+}
+
+TEST(Group, CandidatesBeforeStop) {
+    // Chain starting at dist 1: slots 0..3 belong to the chain, slot 1
+    // and 3 share the probed home (dist == expected), slot 4 is empty.
+    std::vector<uint8_t> ctrl(kGroupWidth, 0);
+    ctrl[0] = 1;
+    ctrl[1] = 2;
+    ctrl[2] = 5;
+    ctrl[3] = 4;
+    ctrl[5] = 6;  // past the stop, must be ignored
+    ProbeMask m = match_probe_group(ctrl.data(), 1);
+    EXPECT_EQ(m.candidates, 0xBu);
+    EXPECT_TRUE(m.stop);
+}
+
+TEST(Group, PoorerSlotStopsChain) {
+    // dist lower than expected means the key would have displaced it.
+    std::vector<uint8_t> ctrl(kGroupWidth, 3);
+    ctrl[0] = 3;
+    ctrl[1] = 2;
+    ProbeMask m = match_probe_group(ctrl.data(), 3);
+    EXPECT_EQ(m.candidates, 0x1u);
+    EXPECT_TRUE(m.stop);
+}
+
+TEST(Group, FullGroupContinues) {
+    std::vector<uint8_t> ctrl(kGroupWidth);
+    for (size_t i = 0; i < kGroupWidth; ++i) {
+        ctrl[i] = static_cast<uint8_t>(20 + i + 1);  // all richer, none equal
+    }
+    ProbeMask m = match_probe_group(ctrl.data(), 20);
+    EXPECT_EQ(m.candidates, 0u);
+    EXPECT_FALSE(m.stop);
+}
+
+TEST(Group, SaturatesNearMaxDist) {
+    std::vector<uint8_t> ctrl(kGroupWidth, 255);
+    ProbeMask m = match_probe_group(ctrl.data(), 250);
+    EXPECT_FALSE(m.stop);
+    EXPECT_NE(m.candidates, 0u);
+}
+
+TEST(Group, ByteMatchSelectsEqualBytes) {
+    std::vector<uint8_t> tags(kGroupWidth, 7);
+    tags[0] = 200;
+    tags[3] = 200;
+    tags[kGroupWidth - 1] = 200;
+    uint32_t expected = 1u | (1u << 3) | (uint32_t{1} << (kGroupWidth - 1));
+    EXPECT_EQ(match_byte_group(tags.data(), 200), expected);
+    EXPECT_EQ(match_byte_group(tags.data(), 8), 0u);
+}
+
+TEST(Group, ControlBytesTrackWrappedChains) {
+    // Every key hashes to the last slot, so the chain wraps around the
+    // table and crosses the mirrored control bytes.
+    using TestShard = Shard<int, int>;
+    EpochManager epoch;
+    TestShard shard(16);
+    EpochGuard g(epoch);
+
+    const size_t h = 15;
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_TRUE(shard.insert(h, i, i * 10, epoch));
+    }
+    for (int i = 0; i < 10; ++i) {
+        auto r = shard.find(h, i);
+        EXPECT_TRUE(r.second) << "key " << i;
+        EXPECT_EQ(r.first, i * 10);
+    }
+    EXPECT_FALSE(shard.contains(h, 42));
+
+    for (int i = 0; i < 10; i += 2) {
+        EXPECT_TRUE(shard.erase(h, i, epoch));
+    }
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(shard.contains(h, i), i % 2 == 1) << "key " << i;
+    }
+}
@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+#include <concurrent_hashmap/hash.h>
+
+#include <cstring>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::FastHash;
+using concurrent_hashmap::FrozenHashMap;
+using concurrent_hashmap::hash_bytes;
+using concurrent_hashmap::hash_int;
+
+namespace {
+
+std::vector<unsigned char> pattern(size_t n) {
+    std::vector<unsigned char> v(n);
+    for (size_t i = 0; i < n; ++i) v[i] = static_cast<unsigned char>(i * 131 + 7);
+    return v;
+}
+
+// Lengths around every branch of hash_bytes: wyhash's 0-3, 4-16, 17-47
+// and 48-byte loop, and (with AVX2) the striped path's threshold, block
+// and tail boundaries.
+const size_t kLengths[] = {0,   1,   3,   4,   8,    15,   16,   17,
+                           47,  48,  63,  64,  511,  512,  513,  1023,
+                           1024, 1025, 1088, 4096, 4097};
+
+}  // namespace
+
+static_assert(concurrent_hashmap::mix_hash<int, std::hash<int>>::value,
+              "identity std::hash must be mixed");
+static_assert(concurrent_hashmap::mix_hash<int*, std::hash<int*>>::value,
+              "identity std::hash must be mixed");
+static_assert(!concurrent_hashmap::mix_hash<int, FastHash<int>>::value,
+              "FastHash is already mixed");
+static_assert(!concurrent_hashmap::mix_hash<std::string,
+                                            std::hash<std::string>>::value,
+              "string hashes are left alone");
+static_assert(!concurrent_hashmap::cache_hash<int, FastHash<int>>::value,
+              "integer keys under FastHash need no cached hash");
+static_assert(concurrent_hashmap::cache_hash<std::string,
+                                             FastHash<std::string>>::value,
+              "string keys keep their cached hash");
+
+TEST(HashTest, HashIntSpreadsTopAndBottomBits) {
+    // 64 top-bit buckets (shards) and 64 low-bit buckets (slots), 4096
+    // sequential keys: every bucket should get close to 64.
+    int top[64] = {}, low[64] = {};
+    for (uint64_t i = 0; i < 4096; ++i) {
+        uint64_t h = hash_int(i);
+        ++top[h >> 58];
+        ++low[h & 63];
+    }
+    for (int b = 0; b < 64; ++b) {
+        EXPECT_GT(top[b], 32) << "top bucket " << b;
+        EXPECT_LT(top[b], 96) << "top bucket " << b;
+        EXPECT_GT(low[b], 32) << "low bucket " << b;
+        EXPECT_LT(low[b], 96) << "low bucket " << b;
+    }
+}
+
+TEST(HashTest, HashBytesDependsOnEveryByteAndTheLength) {
+    std::set<uint64_t> seen;
+    for (size_t len : kLengths) {
+        std::vector<unsigned char> buf = pattern(len);
+        uint64_t h = hash_bytes(buf.data(), len);
+        EXPECT_TRUE(seen.insert(h).second) << "length " << len;
+        EXPECT_EQ(h, hash_bytes(buf.data(), len));
+        EXPECT_NE(h, hash_bytes(buf.data(), len, 1)) << "length " << len;
+        for (size_t i = 0; i < len; ++i) {
+            buf[i] ^= 1;
+            EXPECT_NE(h, hash_bytes(buf.data(), len))
+                << "length " << len << ", byte " << i;
+            buf[i] ^= 1;
+        }
+    }
+}
+
+TEST(HashTest, HashBytesIgnoresAlignment) {
+    for (size_t len : kLengths) {
+        std::vector<unsigned char> src = pattern(len);
+        std::vector<unsigned char> shifted(len + 7);
+        for (size_t offset = 1; offset < 8; ++offset) {
+            if (len) std::memcpy(shifted.data() + offset, src.data(), len);
+            EXPECT_EQ(hash_bytes(src.data(), len),
+                      hash_bytes(shifted.data() + offset, len))
+                << "length " << len << ", offset " << offset;
+        }
+    }
+}
+
+TEST(HashTest, FastHashOfStrings) {
+    FastHash<std::string> h;
+    std::string s(300, 'x');
+    EXPECT_EQ(h(s), hash_bytes(s.data(), s.size()));
+    EXPECT_EQ(h(s), h(s.c_str()));
+    EXPECT_NE(h(std::string("a")), h(std::string("b")));
+
+    FastHash<std::u16string> wide;
+    std::u16string w(u"key");
+    EXPECT_EQ(wide(w), hash_bytes(w.data(), w.size() * sizeof(char16_t)));
+}
+
+TEST(HashTest, DefaultHashSpreadsIntegerKeysOverShards) {
+    // std::hash<int> is the identity on common standard libraries; the
+    // map mixes it, so small keys do not all route to shard 0.
+    ConcurrentHashMap<int, int> map;
+    std::vector<int> per_shard(map.shard_count(), 0);
+    for (int i = 0; i < 4096; ++i) {
+        map.insert(i, i);
+        ++per_shard[map.shard_of(i)];
+    }
+    for (size_t s = 0; s < per_shard.size(); ++s) {
+        EXPECT_GT(per_shard[s], 0) << "shard " << s;
+    }
+    for (int i = 0; i < 4096; ++i) {
+        auto r = map.find(i);
+        ASSERT_TRUE(r.second);
+        EXPECT_EQ(r.first, i);
+    }
+
+    // The mixed hash is used on the paths that recompute it, too.
+    map.reserve(1 << 16);
+    for (int i = 0; i < 4096; i += 2) EXPECT_TRUE(map.erase(i));
+    for (int i = 0; i < 4096; ++i) EXPECT_EQ(map.contains(i), (i & 1) != 0);
+    auto frozen = map.freeze();
+    for (int i = 0; i < 4096; ++i) {
+        EXPECT_EQ(frozen.contains(i), (i & 1) != 0);
+    }
+}
+
+TEST(HashTest, FastHashMapWithTransparentLookup) {
+    ConcurrentHashMap<std::string, int, FastHash<std::string>,
+                      std::equal_to<>> map;
+    for (int i = 0; i < 1000; ++i) {
+        map.insert("key-" + std::to_string(i), i);
+    }
+    EXPECT_EQ(map.find("key-42").first, 42);
+    EXPECT_TRUE(map.contains("key-999"));
+    EXPECT_FALSE(map.contains("key-1000"));
+    EXPECT_EQ(map.size(), 1000u);
+}
+
+TEST(HashTest, FastHashIntegerMap) {
+    ConcurrentHashMap<uint64_t, uint64_t, FastHash<uint64_t>> map;
+    for (uint64_t i = 0; i < 10000; ++i) map.insert(i << 20, i);
+    for (uint64_t i = 0; i < 10000; ++i) {
+        EXPECT_EQ(map.find(i << 20).first, i);
+    }
+    FrozenHashMap<uint64_t, uint64_t, FastHash<uint64_t>> frozen =
+        map.freeze();
+    EXPECT_EQ(*frozen.find(uint64_t{5} << 20), 5u);
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <cstring>
+#include <string>
+
+using concurrent_hashmap::ConcurrentHashMap;
+
+namespace {
+
+// A non-owning string slice, standing in for std::string_view (C++17).
+struct StrRef {
+    const char* data;
+    size_t size;
+    explicit StrRef(const char* s) : data(s), size(std::strlen(s)) {}
+    StrRef(const char* s, size_t n) : data(s), size(n) {}
+};
+
+// FNV-1a over the characters, identical for std::string and StrRef.
+struct StrHash {
+    using is_transparent = void;
+    size_t hash(const char* p, size_t n) const {
+        uint64_t h = 1469598103934665603ULL;
+        for (size_t i = 0; i < n; ++i) {
+            h ^= static_cast<unsigned char>(p[i]);
+            h *= 1099511628211ULL;
+        }
+        return static_cast<size_t>(h);
+    }
+    size_t operator()(const std::string& s) const { return hash(s.data(), s.size()); }
+    size_t operator()(const StrRef& s) const { return hash(s.data, s.size); }
+};
+
+struct StrEqual {
+    using is_transparent = void;
+    static bool eq(const char* a, size_t an, const char* b, size_t bn) {
+        return an == bn && std::memcmp(a, b, an) == 0;
+    }
+    bool operator()(const std::string& a, const std::string& b) const { return a == b; }
+    bool operator()(const std::string& a, const StrRef& b) const {
+        return eq(a.data(), a.size(), b.data, b.size);
+    }
+    bool operator()(const StrRef& a, const std::string& b) const {
+        return eq(a.data, a.size, b.data(), b.size());
+    }
+};
+
+using StrMap = ConcurrentHashMap<std::string, int, StrHash, StrEqual, 2>;
+
+}  // namespace
+
+// Single map for the whole suite (see test_basic.cpp for the rationale).
+class HeterogeneousTest : public ::testing::Test {
+protected:
+    static StrMap* map_;
+
+    static void SetUpTestSuite() { map_ = new StrMap(); }
+    static void TearDownTestSuite() {
+        delete map_;
+        map_ = nullptr;
+    }
+
+    void SetUp() override { map_->clear(); }
+
+    StrMap& map() { return *map_; }
+};
+
+StrMap* HeterogeneousTest::map_ = nullptr;
+
+TEST_F(HeterogeneousTest, FindBySlice) {
+    map().insert("alpha", 1);
+    map().insert("beta", 2);
+
+    const char buffer[] = "xxalphabetayy";
+    auto r = map().find(StrRef(buffer + 2, 5));
+    EXPECT_TRUE(r.second);
+    EXPECT_EQ(r.first, 1);
+
+    int out = 0;
+    EXPECT_TRUE(map().find_into(StrRef(buffer + 7, 4), out));
+    EXPECT_EQ(out, 2);
+
+    EXPECT_FALSE(map().find(StrRef(buffer, 4)).second);
+}
+
+TEST_F(HeterogeneousTest, ContainsAndCount) {
+    map().insert("gamma", 3);
+    EXPECT_TRUE(map().contains(StrRef("gamma")));
+    EXPECT_FALSE(map().contains(StrRef("gamm")));
+    EXPECT_EQ(map().count(StrRef("gamma")), 1u);
+    EXPECT_EQ(map().count(StrRef("delta")), 0u);
+}
+
+TEST_F(HeterogeneousTest, EraseBySlice) {
+    map().insert("epsilon", 5);
+    EXPECT_FALSE(map().erase(StrRef("eps")));
+    EXPECT_TRUE(map().erase(StrRef("epsilon")));
+    EXPECT_FALSE(map().contains(std::string("epsilon")));
+    EXPECT_EQ(map().size(), 0u);
+}
+
+TEST_F(HeterogeneousTest, KeyTypeLookupStillWorks) {
+    map().insert("zeta", 6);
+    EXPECT_EQ(map().find(std::string("zeta")).first, 6);
+    EXPECT_TRUE(map().erase(std::string("zeta")));
+}
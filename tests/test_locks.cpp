@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+#include <concurrent_hashmap/locks.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using concurrent_hashmap::AdaptiveLock;
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::FutexLock;
+using concurrent_hashmap::McsLock;
+using concurrent_hashmap::TicketLock;
+using concurrent_hashmap::detail::SpinLock;
+
+template <typename Lock>
+class LockTest : public ::testing::Test {};
+
+using LockTypes = ::testing::Types<SpinLock, FutexLock, AdaptiveLock,
+                                   TicketLock, McsLock>;
+TYPED_TEST_SUITE(LockTest, LockTypes);
+
+TYPED_TEST(LockTest, TryLock) {
+    TypeParam lock;
+    EXPECT_TRUE(lock.try_lock());
+    EXPECT_FALSE(lock.try_lock());
+    lock.unlock();
+    lock.lock();
+    EXPECT_FALSE(lock.try_lock());
+    lock.unlock();
+    EXPECT_TRUE(lock.try_lock());
+    lock.unlock();
+}
+
+TYPED_TEST(LockTest, NestedLocksOfTheSameType) {
+    TypeParam a, b;
+    std::lock_guard<TypeParam> ga(a);
+    std::lock_guard<TypeParam> gb(b);
+    EXPECT_FALSE(a.try_lock());
+    EXPECT_FALSE(b.try_lock());
+}
+
+// More threads than cores, so holders get preempted while waiters queue.
+TYPED_TEST(LockTest, MutualExclusionOversubscribed) {
+    TypeParam lock;
+    uint64_t counter = 0;
+    const int kThreads = 4 * static_cast<int>(
+        std::max(2u, std::thread::hardware_concurrency()));
+    const int kIters = 2000;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < kIters; ++i) {
+                if (i % 3 == 0) {
+                    while (!lock.try_lock()) std::this_thread::yield();
+                } else {
+                    lock.lock();
+                }
+                ++counter;
+                lock.unlock();
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    EXPECT_EQ(counter, static_cast<uint64_t>(kThreads) * kIters);
+}
+
+TYPED_TEST(LockTest, AsShardMutex) {
+    using Map = ConcurrentHashMap<int, int, std::hash<int>,
+                                  std::equal_to<int>, 2, TypeParam>;
+    Map map;
+    const int kThreads = 4;
+    const int kPerThread = 2000;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < kPerThread; ++i) {
+                map.insert(t * kPerThread + i, i);
+                map.get_or_set(i % 64, i);
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    EXPECT_EQ(map.size(), static_cast<size_t>(kThreads * kPerThread));
+    for (int t = 0; t < kThreads; ++t) {
+        ASSERT_EQ(map.find(t * kPerThread + 7).first, 7);
+    }
+}
+
+TEST(TicketLockTest, ServesInArrivalOrder) {
+    TicketLock lock;
+    std::vector<int> order;
+    std::atomic<int> queued{0};
+    lock.lock();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        // Start each waiter only once the previous one holds a ticket.
+        while (queued.load() != t) std::this_thread::yield();
+        threads.emplace_back([&, t] {
+            queued.fetch_add(1);
+            lock.lock();
+            order.push_back(t);
+            lock.unlock();
+        });
+        while (queued.load() != t + 1) std::this_thread::yield();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    lock.unlock();
+    for (auto& th : threads) th.join();
+    EXPECT_EQ(order, (std::vector<int>{0, 1, 2, 3}));
+}
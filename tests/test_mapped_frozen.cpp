@@ -0,0 +1,228 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+#include <concurrent_hashmap/mapped_frozen_hashmap.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::FastHash;
+using concurrent_hashmap::FrozenHashMap;
+using concurrent_hashmap::MappedFrozenHashMap;
+
+using WordMap    = ConcurrentHashMap<uint64_t, uint64_t>;
+using Frozen     = FrozenHashMap<uint64_t, uint64_t>;
+using Mapped     = MappedFrozenHashMap<uint64_t, uint64_t>;
+
+namespace {
+
+std::string temp_path(const char* name) {
+    return ::testing::TempDir() + "chm_image_" + name;
+}
+
+struct OtherHash {
+    size_t operator()(uint64_t k) const {
+        return static_cast<size_t>(k * 0xC2B2AE3D27D4EB4Full);
+    }
+};
+
+struct Point {
+    int32_t x;
+    int16_t y;  // padded: records carry padding bytes
+};
+
+}  // namespace
+
+TEST(MappedFrozenTest, MatchesFrozenMap) {
+    const std::string path = temp_path("words");
+    const uint64_t N = 100000;
+    WordMap map;
+    for (uint64_t i = 0; i < N; ++i) map.insert(i * 3, i);
+    Frozen frozen = map.freeze();
+    ASSERT_TRUE(frozen.save_image(path.c_str()));
+
+    Mapped mapped(path.c_str());
+    ASSERT_TRUE(mapped.ok());
+    EXPECT_EQ(mapped.size(), frozen.size());
+    EXPECT_EQ(mapped.bucket_count(), frozen.bucket_count());
+    for (uint64_t k = 0; k < N * 3; ++k) {
+        const uint64_t* v = mapped.find(k);
+        if (k % 3) {
+            ASSERT_EQ(v, nullptr) << "key " << k;
+        } else {
+            ASSERT_NE(v, nullptr) << "key " << k;
+            EXPECT_EQ(*v, k / 3);
+        }
+    }
+    EXPECT_EQ(mapped.count(3), 1u);
+    EXPECT_FALSE(mapped.contains(N * 3));
+
+    size_t seen = 0;
+    auto it = frozen.begin();
+    mapped.for_each([&](uint64_t k, uint64_t v) {
+        EXPECT_EQ(k, it->first);
+        EXPECT_EQ(v, it->second);
+        ++it;
+        ++seen;
+    });
+    EXPECT_EQ(seen, N);
+    std::remove(path.c_str());
+}
+
+TEST(MappedFrozenTest, EmptyAndPaddedRecords) {
+    const std::string empty_path = temp_path("empty");
+    ASSERT_TRUE(Frozen().save_image(empty_path.c_str()));
+    Mapped empty(empty_path.c_str());
+    ASSERT_TRUE(empty.ok());
+    EXPECT_TRUE(empty.empty());
+    EXPECT_EQ(empty.find(1), nullptr);
+
+    const std::string path = temp_path("points");
+    std::vector<std::pair<uint32_t, Point>> in;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        in.push_back({i, Point{int32_t(i) * 2, int16_t(i % 100)}});
+    }
+    FrozenHashMap<uint32_t, Point, FastHash<uint32_t>> frozen(std::move(in));
+    ASSERT_TRUE(frozen.save_image(path.c_str()));
+    MappedFrozenHashMap<uint32_t, Point, FastHash<uint32_t>> mapped(
+        path.c_str());
+    ASSERT_TRUE(mapped.ok());
+    for (uint32_t i = 0; i < 1000; ++i) {
+        const Point* p = mapped.find(i);
+        ASSERT_NE(p, nullptr);
+        EXPECT_EQ(p->x, int32_t(i) * 2);
+        EXPECT_EQ(p->y, int16_t(i % 100));
+    }
+    std::remove(empty_path.c_str());
+    std::remove(path.c_str());
+}
+
+TEST(MappedFrozenTest, RejectsBadImages) {
+    const std::string path = temp_path("bad");
+    EXPECT_FALSE(Mapped(path.c_str()).ok());  // missing
+
+    WordMap map;
+    for (uint64_t i = 0; i < 1000; ++i) map.insert(i, i);
+    ASSERT_TRUE(map.freeze().save_image(path.c_str()));
+    ASSERT_TRUE(Mapped(path.c_str()).ok());
+
+    // Other value type, other Hash.
+    EXPECT_FALSE((MappedFrozenHashMap<uint64_t, uint32_t>(path.c_str()).ok()));
+    EXPECT_FALSE((MappedFrozenHashMap<uint64_t, uint64_t, OtherHash>(
+                      path.c_str()).ok()));
+
+    // Truncated.
+    std::string bytes;
+    {
+        std::ifstream f(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(f),
+                     std::istreambuf_iterator<char>());
+    }
+    {
+        std::ofstream f(path, std::ios::binary | std::ios::trunc);
+        f.write(bytes.data(), bytes.size() - 8);
+    }
+    Mapped truncated(path.c_str());
+    EXPECT_FALSE(truncated.ok());
+    EXPECT_EQ(truncated.find(1), nullptr);
+
+    // A map snapshot is not an image.
+    ASSERT_TRUE(map.save(path.c_str()));
+    EXPECT_FALSE(Mapped(path.c_str()).ok());
+    std::remove(path.c_str());
+}
+
+TEST(MappedFrozenTest, RejectsCorruptHeaders) {
+    const std::string path = temp_path("corrupt");
+    ASSERT_TRUE(Frozen().save_image(path.c_str()));
+    concurrent_hashmap::detail::FrozenImageHeader good;
+    {
+        std::ifstream f(path, std::ios::binary);
+        ASSERT_TRUE(f.read(reinterpret_cast<char*>(&good), sizeof(good)));
+    }
+    auto write = [&](const concurrent_hashmap::detail::FrozenImageHeader& h) {
+        std::string bytes(128, '\0');
+        std::memcpy(&bytes[0], &h, sizeof(h));
+        std::ofstream f(path, std::ios::binary | std::ios::trunc);
+        f.write(bytes.data(), bytes.size());
+    };
+
+    // A bucket count whose table size wraps around to fit the file.
+    auto h = good;
+    h.entries = 0;
+    h.buckets = uint64_t(1) << 61;
+    h.records_offset = 128;
+    write(h);
+    Mapped wrapped(path.c_str());
+    EXPECT_FALSE(wrapped.ok());
+    EXPECT_EQ(wrapped.find(1), nullptr);
+
+    // More buckets than the file has room for.
+    h.buckets = 64;
+    write(h);
+    EXPECT_FALSE(Mapped(path.c_str()).ok());
+    std::remove(path.c_str());
+}
+
+TEST(MappedFrozenTest, OpenMapsKeepTheirImageAcrossRefresh) {
+    const std::string path = temp_path("refresh");
+    ASSERT_TRUE(Frozen({{1, 10}, {2, 20}}).save_image(path.c_str()));
+    Mapped before(path.c_str());
+    ASSERT_TRUE(before.ok());
+
+    ASSERT_TRUE(Frozen({{1, 11}, {3, 33}}).save_image(path.c_str()));
+    Mapped after(path.c_str());
+    ASSERT_TRUE(after.ok());
+
+    EXPECT_EQ(*before.find(1), 10u);
+    EXPECT_EQ(*before.find(2), 20u);
+    EXPECT_EQ(*after.find(1), 11u);
+    EXPECT_EQ(after.find(2), nullptr);
+    EXPECT_EQ(*after.find(3), 33u);
+    std::remove(path.c_str());
+}
+
+#if defined(__linux__)
+TEST(MappedFrozenTest, SharedBetweenProcesses) {
+    const std::string path = temp_path("shared");
+    const uint64_t N = 50000;
+    {
+        WordMap map;
+        for (uint64_t i = 0; i < N; ++i) map.insert(i, ~i);
+        ASSERT_TRUE(map.freeze().save_image(path.c_str()));
+    }
+
+    std::vector<pid_t> workers;
+    for (int w = 0; w < 3; ++w) {
+        pid_t pid = ::fork();
+        ASSERT_GE(pid, 0);
+        if (pid == 0) {
+            Mapped mapped(path.c_str());
+            bool good = mapped.ok() && mapped.size() == N;
+            for (uint64_t i = 0; good && i < N; ++i) {
+                const uint64_t* v = mapped.find(i);
+                good = v && *v == ~i;
+            }
+            ::_exit(good ? 0 : 1);
+        }
+        workers.push_back(pid);
+    }
+    for (pid_t pid : workers) {
+        int status = 0;
+        ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    std::remove(path.c_str());
+}
+#endif
@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::MapOptions;
+using concurrent_hashmap::node_values;
+using concurrent_hashmap::detail::Shard;
+
+// 256 bytes: well past the inline threshold.  Every word holds the same
+// number, so a torn copy is easy to spot.
+struct Big {
+    uint64_t words[32];
+
+    Big() : Big(0) {}
+    explicit Big(uint64_t n) {
+        for (uint64_t& w : words) w = n;
+    }
+    uint64_t id() const { return words[0]; }
+    bool whole() const {
+        for (uint64_t w : words) {
+            if (w != words[0]) return false;
+        }
+        return true;
+    }
+};
+
+// A const member rules out assignment, and so inline slots.
+struct Pinned {
+    const int   id;
+    std::string name;
+
+    Pinned() : id(0) {}
+    Pinned(int i, std::string n) : id(i), name(std::move(n)) {}
+};
+
+static_assert(node_values<int, Big>::value, "large values use nodes");
+static_assert(node_values<int, Pinned>::value,
+              "non-assignable values use nodes");
+static_assert(!node_values<int, std::string>::value,
+              "small movable values stay inline");
+static_assert(sizeof(Shard<uint64_t, Big>::Slot) ==
+                  sizeof(Shard<uint64_t, uint64_t>::Slot),
+              "a node slot holds a pointer in place of the value");
+
+using BigMap    = ConcurrentHashMap<uint64_t, Big, std::hash<uint64_t>,
+                                    std::equal_to<uint64_t>, 2>;
+using SplitMap  = ConcurrentHashMap<uint64_t, Big>;
+using PinnedMap = ConcurrentHashMap<int, Pinned>;
+
+TEST(NodeValuesTest, GrowShrinkAndErase) {
+    BigMap map;
+    // 20000 entries pass the incremental-growth threshold.
+    const uint64_t N = 20000;
+    for (uint64_t i = 0; i < N; ++i) EXPECT_TRUE(map.insert(i, Big(i)));
+    EXPECT_FALSE(map.insert(0, Big(7)));
+    for (uint64_t i = 0; i < N; i += 2) EXPECT_TRUE(map.erase(i));
+    for (uint64_t i = 0; i < N; ++i) {
+        auto got = map.find(i);
+        EXPECT_EQ(got.second, (i & 1) != 0);
+        if (got.second) {
+            EXPECT_EQ(got.first.id(), i);
+        }
+    }
+    EXPECT_EQ(map.size(), static_cast<size_t>(N / 2));
+
+    for (uint64_t i = 1; i < N; i += 2) EXPECT_TRUE(map.erase(i));
+    EXPECT_TRUE(map.empty());
+    EXPECT_FALSE(map.contains(1));
+}
+
+TEST(NodeValuesTest, WritesReplaceNodes) {
+    BigMap map;
+    EXPECT_TRUE(map.insert_or_assign(1, Big(1)));
+    EXPECT_FALSE(map.insert_or_assign(1, Big(2)));
+    EXPECT_EQ(map.find(1).first.id(), 2u);
+
+    EXPECT_TRUE(map.update(1, [](Big& b) { b = Big(b.id() + 1); }));
+    EXPECT_EQ(map.find(1).first.id(), 3u);
+    EXPECT_FALSE(map.update(2, [](Big&) {}));
+
+    EXPECT_FALSE(map.upsert(1, Big(0), [](Big& b) { b = Big(10); }));
+    EXPECT_TRUE(map.upsert(2, Big(20), [](Big&) {}));
+    EXPECT_EQ(map.get_or_set(2, Big(0)).id(), 20u);
+
+    using concurrent_hashmap::ComputeAction;
+    EXPECT_FALSE(map.compute(1, [](Big&, bool) {
+        return ComputeAction::erase;
+    }));
+    EXPECT_FALSE(map.contains(1));
+    EXPECT_TRUE(map.compute(3, [](Big& b, bool exists) {
+        if (!exists) b = Big(30);
+        return ComputeAction::keep;
+    }));
+    EXPECT_EQ(map.find(3).first.id(), 30u);
+    EXPECT_EQ(map.find(10).second, false);
+}
+
+TEST(NodeValuesTest, RefsOutliveEraseAndReplace) {
+    BigMap map;
+    map.insert(5, Big(5));
+
+    BigMap::ValueRef ref = map.find_ref(5);
+    ASSERT_TRUE(ref);
+    EXPECT_EQ(ref->id(), 5u);
+    EXPECT_FALSE(map.find_ref(6));
+
+    // Retire plenty of nodes, including the referenced one, and collect.
+    EXPECT_TRUE(map.erase(5));
+    for (uint64_t round = 0; round < 1000; ++round) {
+        map.insert_or_assign(5, Big(round));
+        map.update(5, [](Big& b) { b = Big(b.id() + 1); });
+    }
+    map.collect();
+    EXPECT_EQ((*ref).id(), 5u);
+    EXPECT_TRUE(ref->whole());
+
+    BigMap::ValueRef moved = std::move(ref);
+    EXPECT_EQ(moved->id(), 5u);
+    EXPECT_EQ(map.find_ref(5)->id(), 1000u);
+}
+
+TEST(NodeValuesTest, ReadersSeeWholeValues) {
+    BigMap map;
+    const uint64_t kStable = 500;
+    for (uint64_t i = 0; i < kStable; ++i) map.insert(i, Big(i));
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> bad{0};
+    std::thread writer([&] {
+        // Replace the stable values and churn around them, so nodes are
+        // both swapped and carried by displacement and growth.
+        for (uint64_t round = 0; round < 3; ++round) {
+            for (uint64_t i = 0; i < 20000; ++i) {
+                map.insert(100000 + i, Big(i));
+                map.insert_or_assign(i % kStable, Big(i % kStable));
+            }
+            for (uint64_t i = 0; i < 20000; ++i) map.erase(100000 + i);
+        }
+        stop = true;
+    });
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; ++r) {
+        readers.emplace_back([&, r] {
+            while (!stop) {
+                for (uint64_t i = 0; i < kStable; ++i) {
+                    if (r == 0) {
+                        auto got = map.find(i);
+                        if (!got.second || got.first.id() != i ||
+                            !got.first.whole()) {
+                            ++bad;
+                        }
+                    } else {
+                        BigMap::ValueRef ref = map.find_ref(i);
+                        if (!ref || ref->id() != i || !ref->whole()) ++bad;
+                    }
+                }
+            }
+        });
+    }
+    writer.join();
+    for (auto& th : readers) th.join();
+    EXPECT_EQ(bad.load(), 0);
+    EXPECT_EQ(map.size(), static_cast<size_t>(kStable));
+}
+
+TEST(NodeValuesTest, SplitsCarryNodesAcrossShards) {
+    // Nodes move into the sibling on a split but stay with the pool that
+    // made them; both must outlive the map's shards.
+    MapOptions opts;
+    opts.shards = 1;
+    opts.max_shards = 8;
+    opts.split_threshold = 1000;
+    SplitMap map(opts);
+
+    const uint64_t N = 10000;
+    for (uint64_t i = 0; i < N; ++i) EXPECT_TRUE(map.insert(i, Big(i)));
+    EXPECT_EQ(map.shard_count(), 8u);
+    for (uint64_t i = 0; i < N; i += 3) {
+        EXPECT_TRUE(map.update(i, [](Big& b) { b = Big(b.id() + N); }));
+    }
+    for (uint64_t i = 0; i < N; i += 2) EXPECT_TRUE(map.erase(i));
+    for (uint64_t i = 0; i < N; ++i) {
+        auto got = map.find(i);
+        EXPECT_EQ(got.second, (i & 1) != 0);
+        if (got.second) {
+            EXPECT_EQ(got.first.id(), i % 3 ? i : i + N);
+        }
+    }
+}
+
+TEST(NodeValuesTest, NonAssignableValues) {
+    PinnedMap map;
+    EXPECT_TRUE(map.insert(1, Pinned(1, "one")));
+    EXPECT_TRUE(map.emplace(2, 2, "two"));
+    EXPECT_FALSE(map.insert_or_assign(1, Pinned(1, "uno")));
+    EXPECT_TRUE(map.update(2, [](Pinned& p) { p.name += "!"; }));
+
+    EXPECT_EQ(map.find(1).first.name, "uno");
+    EXPECT_EQ(map.find(2).first.name, "two!");
+    EXPECT_EQ(map.find_ref(2)->id, 2);
+    for (int i = 3; i < 1000; ++i) map.insert(i, Pinned(i, "x"));
+    EXPECT_TRUE(map.erase(1));
+    EXPECT_EQ(map.find(2).first.name, "two!");
+    EXPECT_EQ(map.size(), 998u);
+}
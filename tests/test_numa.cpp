@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::MapOptions;
+using concurrent_hashmap::NumaPolicy;
+namespace detail = concurrent_hashmap::detail;
+
+using ShardType = detail::Shard<int, int>;
+static_assert(alignof(ShardType) == detail::kCacheLineSize,
+              "shards start on a cache line");
+static_assert(sizeof(ShardType) % detail::kCacheLineSize == 0,
+              "neighbouring shards never share a cache line");
+
+using TestMap = ConcurrentHashMap<int, std::string, std::hash<int>,
+                                  std::equal_to<int>, 3>;
+
+TEST(NumaTest, ShardStorageIsCacheLineAligned) {
+    for (int i = 0; i < 16; ++i) {
+        void* p = detail::cache_line_alloc(sizeof(ShardType));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % detail::kCacheLineSize,
+                  0u);
+        detail::cache_line_free(p);
+    }
+    std::unique_ptr<TestMap> map(new TestMap());
+    EXPECT_TRUE(map->insert(1, "one"));
+}
+
+TEST(NumaTest, NodeCountIsPositive) {
+    EXPECT_GE(detail::numa_node_count(), 1);
+}
+
+TEST(NumaTest, PolicyAssignsNodes) {
+    const int nodes = detail::numa_node_count();
+    for (size_t i = 0; i < 8; ++i) {
+        EXPECT_EQ(detail::numa_node_for_shard(NumaPolicy::none, i, 8), -1);
+        int inter = detail::numa_node_for_shard(NumaPolicy::interleave, i, 8);
+        EXPECT_EQ(inter, static_cast<int>(i % nodes));
+        int aff = detail::numa_node_for_shard(NumaPolicy::shard_affinity, i, 8);
+        EXPECT_GE(aff, 0);
+        EXPECT_LT(aff, nodes);
+    }
+    // Affinity keeps node ids non-decreasing across the shard range.
+    EXPECT_EQ(detail::numa_node_for_shard(NumaPolicy::shard_affinity, 0, 8), 0);
+    EXPECT_EQ(detail::numa_node_for_shard(NumaPolicy::shard_affinity, 7, 8),
+              nodes >= 8 ? 7 : nodes - 1);
+}
+
+TEST(NumaTest, DefaultMapHasNoNodes) {
+    TestMap map;
+    for (size_t i = 0; i < TestMap::kNumShards; ++i) {
+        EXPECT_EQ(map.shard_numa_node(i), -1);
+    }
+}
+
+// Placement must not change behaviour, including across resizes that
+// allocate page-sized (and therefore node-bound) tables.
+TEST(NumaTest, PlacedMapWorksAcrossResizes) {
+    const NumaPolicy policies[] = {NumaPolicy::interleave,
+                                   NumaPolicy::shard_affinity};
+    for (NumaPolicy policy : policies) {
+        MapOptions opts;
+        opts.numa = policy;
+        TestMap map(opts);
+        for (size_t i = 0; i < TestMap::kNumShards; ++i) {
+            EXPECT_EQ(map.shard_numa_node(i),
+                      detail::numa_node_for_shard(policy, i,
+                                                  TestMap::kNumShards));
+        }
+
+        const int kN = 20000;
+        for (int i = 0; i < kN; ++i) {
+            ASSERT_TRUE(map.insert(i, std::to_string(i)));
+        }
+        EXPECT_EQ(map.size(), static_cast<size_t>(kN));
+        for (int i = 0; i < kN; ++i) {
+            auto r = map.find(i);
+            ASSERT_TRUE(r.second);
+            EXPECT_EQ(r.first, std::to_string(i));
+        }
+        for (int i = 0; i < kN; i += 2) ASSERT_TRUE(map.erase(i));
+        EXPECT_EQ(map.size(), static_cast<size_t>(kN / 2));
+        map.clear();
+        EXPECT_TRUE(map.empty());
+    }
+}
+
+TEST(NumaTest, ShardOfMatchesRouting) {
+    TestMap map;
+    const size_t shards = TestMap::kNumShards;
+    for (int k = 0; k < 100; ++k) {
+        EXPECT_LT(map.shard_of(k), shards);
+    }
+}
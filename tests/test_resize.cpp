@@ -6,8 +6,9 @@
 using namespace concurrent_hashmap::detail;
 using TestShard = Shard<int, std::string, std::hash<int>, std::equal_to<int>, SpinLock>;
 
+// Shards expect hashes as the map computes them.
 static size_t h(int key) {
-    return std::hash<int>{}(key);
+    return MixedHash<int, std::hash<int>>{}(key);
 }
 
 // Use a single EpochManager for the entire test suite to avoid
@@ -49,6 +50,25 @@ TEST_F(ResizeTest, InsertTriggersExpansion) {
     }
 }
 
+TEST_F(ResizeTest, EraseNoShrinkKeepsCapacity) {
+    // The bounded cache erases with erase_no_shrink: its table stays at
+    // the capacity it reserved, however many entries leave.
+    TestShard shard(1024);
+    EpochGuard g(epoch());
+    const size_t capacity = shard.capacity();
+
+    for (int round = 0; round < 4; ++round) {
+        for (int i = 0; i < 700; ++i) {
+            shard.insert(h(i), i, std::to_string(i), epoch());
+        }
+        for (int i = 0; i < 700; ++i) {
+            EXPECT_TRUE(shard.erase_no_shrink(h(i), i, epoch()));
+        }
+        EXPECT_EQ(shard.size(), 0u);
+        EXPECT_EQ(shard.capacity(), capacity);
+    }
+}
+
 TEST_F(ResizeTest, EraseTriggersDelayedShrink) {
     // Insert enough to cause multiple expansions, then erase most elements.
     // The delayed shrink counter should eventually trigger a shrink.
@@ -129,3 +149,78 @@ TEST_F(ResizeTest, ExpandAndShrinkCycle) {
     EXPECT_TRUE(result.second);
     EXPECT_EQ(result.first, "final");
 }
+
+TEST_F(ResizeTest, IncrementalGrowthMigratesEverything) {
+    // Large tables grow incrementally: writes drain the old table a chunk
+    // at a time while lookups consult both tables.
+    TestShard shard;
+    EpochGuard g(epoch());
+
+    const int N = 20000;
+    bool saw_migration = false;
+    for (int i = 0; i < N; ++i) {
+        EXPECT_TRUE(shard.insert(h(i), i, std::to_string(i), epoch()));
+        if (shard.migrating()) {
+            saw_migration = true;
+            // Keys inserted before the resize started must stay visible.
+            ASSERT_TRUE(shard.contains(h(i / 2), i / 2)) << "key " << i / 2;
+        }
+    }
+    EXPECT_TRUE(saw_migration);
+    EXPECT_EQ(shard.size(), static_cast<size_t>(N));
+
+    for (int i = 0; i < N; ++i) {
+        auto result = shard.find(h(i), i);
+        EXPECT_TRUE(result.second) << "key " << i << " lost during migration";
+        EXPECT_EQ(result.first, std::to_string(i));
+    }
+}
+
+TEST_F(ResizeTest, WritesDuringIncrementalGrowth) {
+    TestShard shard;
+    EpochGuard g(epoch());
+
+    // Fill right up to the incremental threshold, then trigger growth.
+    int next = 0;
+    while (!shard.migrating()) {
+        shard.insert(h(next), next, std::to_string(next), epoch());
+        ++next;
+    }
+
+    // Updates, erases and duplicate inserts must find keys that still
+    // live in the old table.
+    EXPECT_FALSE(shard.insert(h(1), 1, "dup", epoch()));
+    EXPECT_FALSE(shard.insert_or_assign(h(2), 2, "two", epoch()));
+    EXPECT_EQ(shard.get_or_set(h(3), 3, "x", epoch()), "3");
+    EXPECT_TRUE(shard.erase(h(4), 4, epoch()));
+    EXPECT_FALSE(shard.erase(h(4), 4, epoch()));
+
+    while (shard.migrating()) {
+        shard.insert(h(next), next, std::to_string(next), epoch());
+        ++next;
+    }
+
+    EXPECT_EQ(shard.size(), static_cast<size_t>(next - 1));
+    EXPECT_EQ(shard.find(h(1), 1).first, "1");
+    EXPECT_EQ(shard.find(h(2), 2).first, "two");
+    EXPECT_FALSE(shard.contains(h(4), 4));
+    for (int i = 5; i < next; ++i) {
+        ASSERT_TRUE(shard.contains(h(i), i)) << "key " << i;
+    }
+}
+
+TEST_F(ResizeTest, ReserveFinishesMigration) {
+    TestShard shard;
+    EpochGuard g(epoch());
+
+    int next = 0;
+    while (!shard.migrating()) {
+        shard.insert(h(next), next, std::to_string(next), epoch());
+        ++next;
+    }
+    shard.reserve(100000, epoch());
+    EXPECT_FALSE(shard.migrating());
+    for (int i = 0; i < next; ++i) {
+        ASSERT_TRUE(shard.contains(h(i), i)) << "key " << i;
+    }
+}
@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::MapOptions;
+
+using TestMap = ConcurrentHashMap<int, std::string>;
+using WordMap = ConcurrentHashMap<uint64_t, uint64_t>;
+
+static MapOptions splitting(size_t shards, size_t max_shards,
+                            size_t threshold) {
+    MapOptions opts;
+    opts.shards = shards;
+    opts.max_shards = max_shards;
+    opts.split_threshold = threshold;
+    return opts;
+}
+
+TEST(ShardsTest, DefaultUsesShardBits) {
+    TestMap map;
+    EXPECT_EQ(map.shard_count(), static_cast<size_t>(TestMap::kNumShards));
+}
+
+TEST(ShardsTest, RuntimeCountRoundsUpToPowerOfTwo) {
+    MapOptions opts;
+    opts.shards = 5;
+    TestMap map(opts);
+    EXPECT_EQ(map.shard_count(), 8u);
+    for (int i = 0; i < 1000; ++i) ASSERT_TRUE(map.insert(i, std::to_string(i)));
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(map.find(i).first, std::to_string(i));
+        EXPECT_LT(map.shard_of(i), map.shard_count());
+    }
+    EXPECT_EQ(map.size(), 1000u);
+}
+
+TEST(ShardsTest, SingleShard) {
+    MapOptions opts;
+    opts.shards = 1;
+    TestMap map(opts);
+    EXPECT_EQ(map.shard_count(), 1u);
+    for (int i = 0; i < 500; ++i) map.insert(i, "x");
+    EXPECT_EQ(map.size(), 500u);
+    EXPECT_TRUE(map.erase(7));
+    EXPECT_FALSE(map.contains(7));
+}
+
+TEST(ShardsTest, FromHardwareConcurrency) {
+    MapOptions opts;
+    opts.shards = std::thread::hardware_concurrency() * 4;
+    TestMap map(opts);
+    EXPECT_GE(map.shard_count(), 1u);
+    EXPECT_TRUE(map.insert(1, "one"));
+}
+
+TEST(ShardsTest, NoSplitWithoutMaxShards) {
+    MapOptions opts;
+    opts.shards = 2;
+    opts.split_threshold = 10;
+    WordMap map(opts);
+    for (uint64_t i = 0; i < 1000; ++i) map.insert(i, i);
+    EXPECT_EQ(map.shard_count(), 2u);
+}
+
+TEST(ShardsTest, HotShardsSplit) {
+    WordMap map(splitting(2, 64, 1000));
+    const uint64_t kN = 50000;
+    for (uint64_t i = 0; i < kN; ++i) ASSERT_TRUE(map.insert(i, i * 2));
+
+    EXPECT_GT(map.shard_count(), 2u);
+    EXPECT_LE(map.shard_count(), 64u);
+    EXPECT_EQ(map.size(), kN);
+    for (uint64_t i = 0; i < kN; ++i) {
+        auto r = map.find(i);
+        ASSERT_TRUE(r.second) << "key " << i;
+        ASSERT_EQ(r.first, i * 2);
+        ASSERT_LT(map.shard_of(i), map.shard_count());
+    }
+    for (uint64_t i = 0; i < kN; i += 2) ASSERT_TRUE(map.erase(i));
+    EXPECT_EQ(map.size(), kN / 2);
+    for (uint64_t i = 0; i < kN; ++i) {
+        ASSERT_EQ(map.contains(i), (i % 2) == 1);
+    }
+}
+
+TEST(ShardsTest, BatchedWritesAcrossSplits) {
+    WordMap map(splitting(1, 32, 500));
+    const size_t kN = 20000;
+    std::vector<uint64_t> keys(kN), values(kN);
+    for (size_t i = 0; i < kN; ++i) {
+        keys[i] = i;
+        values[i] = i + 1;
+    }
+    EXPECT_EQ(map.insert_many(keys.data(), values.data(), kN), kN);
+    EXPECT_GT(map.shard_count(), 1u);
+
+    std::vector<uint64_t> out(kN);
+    std::unique_ptr<bool[]> found(new bool[kN]);
+    EXPECT_EQ(map.find_many(keys.data(), kN, out.data(), found.get()), kN);
+    for (size_t i = 0; i < kN; ++i) ASSERT_EQ(out[i], i + 1);
+    EXPECT_EQ(map.erase_many(keys.data(), kN), kN);
+    EXPECT_TRUE(map.empty());
+}
+
+// Keys inserted before the readers start must stay visible while
+// writers keep splitting shards underneath them.
+TEST(ShardsTest, ReadersNeverMissDuringSplits) {
+    WordMap map(splitting(1, 256, 256));
+    const uint64_t kStable = 2000;
+    for (uint64_t i = 0; i < kStable; ++i) map.insert(i, i);
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> misses{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 2; ++t) {
+        readers.emplace_back([&] {
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (uint64_t i = 0; i < kStable; ++i) {
+                    auto r = map.find(i);
+                    if (!r.second || r.first != i) misses.fetch_add(1);
+                }
+            }
+        });
+    }
+    std::thread writer([&] {
+        for (uint64_t i = kStable; i < kStable + 60000; ++i) map.insert(i, i);
+    });
+    writer.join();
+    stop.store(true);
+    for (auto& th : readers) th.join();
+
+    EXPECT_EQ(misses.load(), 0u);
+    EXPECT_GT(map.shard_count(), 1u);
+    EXPECT_EQ(map.size(), kStable + 60000);
+}
+
+// Locked and lock-free writers racing with splits lose no updates.
+TEST(ShardsTest, CountersExactAcrossSplits) {
+    WordMap map(splitting(1, 64, 512));
+    const int kThreads = 3;
+    const uint64_t kKeys = 8000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&] {
+            for (uint64_t i = 0; i < kKeys; ++i) map.fetch_add(i, 1);
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    EXPECT_GT(map.shard_count(), 1u);
+    for (uint64_t i = 0; i < kKeys; ++i) {
+        ASSERT_EQ(map.find(i).first, static_cast<uint64_t>(kThreads)) << i;
+    }
+}
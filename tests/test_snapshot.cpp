@@ -0,0 +1,256 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::MapOptions;
+
+using WordMap   = ConcurrentHashMap<uint64_t, uint64_t>;
+using StringMap = ConcurrentHashMap<std::string, std::string,
+                                    std::hash<std::string>,
+                                    std::equal_to<std::string>, 0>;
+
+// A Hash other than the map's default.
+struct OtherHash {
+    size_t operator()(uint64_t k) const {
+        return static_cast<size_t>(k * 0xC2B2AE3D27D4EB4Full);
+    }
+};
+
+// 256 bytes: stored in nodes (see test_node_values.cpp).
+struct Blob {
+    uint64_t words[32];
+};
+using BlobMap = ConcurrentHashMap<uint64_t, Blob>;
+
+static std::string temp_path(const char* name) {
+    return ::testing::TempDir() + "chm_snapshot_" + name;
+}
+
+static MapOptions splitting(size_t shards, size_t max_shards,
+                            size_t threshold) {
+    MapOptions opts;
+    opts.shards = shards;
+    opts.max_shards = max_shards;
+    opts.split_threshold = threshold;
+    return opts;
+}
+
+TEST(SnapshotTest, RoundTripTrivialEntries) {
+    const std::string path = temp_path("words");
+    const uint64_t N = 100000;
+    {
+        WordMap map;
+        for (uint64_t i = 0; i < N; ++i) map.insert(i, i * 7);
+        for (uint64_t i = 0; i < N; i += 5) map.erase(i);
+        ASSERT_TRUE(map.save(path.c_str()));
+    }
+    WordMap map;
+    ASSERT_TRUE(map.load(path.c_str()));
+    EXPECT_EQ(map.size(), static_cast<size_t>(N - N / 5));
+    for (uint64_t i = 0; i < N; ++i) {
+        auto got = map.find(i);
+        EXPECT_EQ(got.second, i % 5 != 0);
+        if (got.second) {
+            EXPECT_EQ(got.first, i * 7);
+        }
+    }
+
+    // The loaded tables take writes, growth and shrinking as usual.
+    for (uint64_t i = N; i < 2 * N; ++i) EXPECT_TRUE(map.insert(i, i));
+    for (uint64_t i = 0; i < 2 * N; ++i) map.erase(i);
+    EXPECT_TRUE(map.empty());
+    std::remove(path.c_str());
+}
+
+TEST(SnapshotTest, StringsAndMigratingTables) {
+    const std::string path = temp_path("strings");
+    // One shard; 3100 entries start an incremental resize (at 3073) and
+    // leave it part-way, so the save has entries in both tables.
+    const int N = 3100;
+    {
+        StringMap map;
+        for (int i = 0; i < N; ++i) {
+            map.insert("key" + std::to_string(i), std::string(i % 50, 'v'));
+        }
+        ASSERT_TRUE(map.save(path.c_str()));
+    }
+    StringMap map;
+    ASSERT_TRUE(map.load(path.c_str()));
+    EXPECT_EQ(map.size(), static_cast<size_t>(N));
+    for (int i = 0; i < N; ++i) {
+        auto got = map.find("key" + std::to_string(i));
+        ASSERT_TRUE(got.second);
+        EXPECT_EQ(got.first, std::string(i % 50, 'v'));
+    }
+    EXPECT_FALSE(map.contains("key" + std::to_string(N)));
+    std::remove(path.c_str());
+}
+
+TEST(SnapshotTest, RestoresSplitShards) {
+    const std::string path = temp_path("splits");
+    const uint64_t N = 20000;
+    size_t shards = 0;
+    {
+        WordMap map(splitting(2, 16, 1000));
+        for (uint64_t i = 0; i < N; ++i) map.insert(i, i + 1);
+        shards = map.shard_count();
+        ASSERT_GT(shards, 2u);
+        ASSERT_TRUE(map.save(path.c_str()));
+    }
+
+    WordMap small(splitting(2, 4, 1000));
+    EXPECT_FALSE(small.load(path.c_str()));  // too many shards
+    EXPECT_TRUE(small.empty());
+
+    WordMap map(splitting(2, 64, 1000));
+    ASSERT_TRUE(map.load(path.c_str()));
+    EXPECT_EQ(map.shard_count(), shards);
+    for (uint64_t i = 0; i < N; ++i) EXPECT_EQ(map.find(i).first, i + 1);
+    // Splitting carries on from the restored layout.
+    for (uint64_t i = N; i < 3 * N; ++i) map.insert(i, i + 1);
+    EXPECT_GT(map.shard_count(), shards);
+    for (uint64_t i = 0; i < 3 * N; ++i) EXPECT_EQ(map.find(i).first, i + 1);
+    std::remove(path.c_str());
+}
+
+TEST(SnapshotTest, NodeValues) {
+    const std::string path = temp_path("blobs");
+    {
+        BlobMap map;
+        for (uint64_t i = 0; i < 2000; ++i) {
+            Blob b;
+            for (uint64_t& w : b.words) w = i;
+            map.insert(i, b);
+        }
+        ASSERT_TRUE(map.save(path.c_str()));
+    }
+    BlobMap map;
+    ASSERT_TRUE(map.load(path.c_str()));
+    for (uint64_t i = 0; i < 2000; ++i) {
+        BlobMap::ValueRef ref = map.find_ref(i);
+        ASSERT_TRUE(ref);
+        EXPECT_EQ(ref->words[31], i);
+    }
+    std::remove(path.c_str());
+}
+
+TEST(SnapshotTest, RejectsBadInput) {
+    const std::string path = temp_path("bad");
+    WordMap map;
+    EXPECT_FALSE(map.load(temp_path("missing").c_str()));
+
+    {
+        WordMap src;
+        for (uint64_t i = 0; i < 1000; ++i) src.insert(i, i);
+        ASSERT_TRUE(src.save(path.c_str()));
+    }
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+    }
+    auto rewrite = [&](const std::string& b) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(b.data(), static_cast<std::streamsize>(b.size()));
+    };
+
+    // Truncated anywhere, including mid-record.
+    for (size_t cut : {size_t{4}, bytes.size() / 2, bytes.size() - 1}) {
+        rewrite(bytes.substr(0, cut));
+        EXPECT_FALSE(map.load(path.c_str()));
+        EXPECT_TRUE(map.empty());
+    }
+    // Wrong value type.
+    rewrite(bytes);
+    ConcurrentHashMap<uint64_t, uint32_t> narrow;
+    EXPECT_FALSE(narrow.load(path.c_str()));
+
+    // Another Hash: same layout, but every entry would sit at the wrong
+    // home slot.
+    ConcurrentHashMap<uint64_t, uint64_t, OtherHash> other_hash;
+    EXPECT_FALSE(other_hash.load(path.c_str()));
+    EXPECT_TRUE(other_hash.empty());
+
+    // A directory in which a shard appears twice and another not at all.
+    {
+        std::string bad = bytes;
+        size_t ids = sizeof(concurrent_hashmap::detail::SnapshotHeader);
+        bad.replace(ids + 4, 4, bad, ids, 4);
+        rewrite(bad);
+        EXPECT_FALSE(map.load(path.c_str()));
+        EXPECT_TRUE(map.empty());
+    }
+    rewrite(bytes);
+
+    // Only into an empty map.
+    map.insert(5000, 1);
+    EXPECT_FALSE(map.load(path.c_str()));
+    map.erase(5000);
+    EXPECT_TRUE(map.load(path.c_str()));
+    EXPECT_EQ(map.size(), 1000u);
+    std::remove(path.c_str());
+}
+
+TEST(SnapshotTest, SaveReplacesTheFileWhole) {
+    const std::string path = temp_path("replace");
+    const std::string tmp = path + ".tmp";
+    WordMap map;
+    for (uint64_t i = 0; i < 1000; ++i) map.insert(i, i);
+    ASSERT_TRUE(map.save(path.c_str()));
+    EXPECT_FALSE(std::ifstream(tmp).good());  // renamed into place
+
+#if defined(__linux__)
+    // A save that cannot write its file leaves the last one intact.
+    ASSERT_EQ(::mkdir(tmp.c_str(), 0700), 0);
+    map.insert(5000, 5000);
+    EXPECT_FALSE(map.save(path.c_str()));
+    ::rmdir(tmp.c_str());
+    WordMap copy;
+    ASSERT_TRUE(copy.load(path.c_str()));
+    EXPECT_EQ(copy.size(), 1000u);
+    EXPECT_FALSE(copy.contains(5000));
+#endif
+    std::remove(path.c_str());
+}
+
+TEST(SnapshotTest, SaveWhileWriting) {
+    const std::string path = temp_path("live");
+    WordMap map(splitting(1, 16, 2000));
+    const uint64_t kStable = 3000;
+    for (uint64_t i = 0; i < kStable; ++i) map.insert(i, i);
+
+    std::atomic<bool> stop{false};
+    std::thread writer([&] {
+        for (uint64_t i = 0; !stop && i < 40000; ++i) {
+            map.insert(100000 + i, i);
+            map.fetch_add(i % kStable, kStable);
+        }
+    });
+    for (int round = 0; round < 5; ++round) {
+        ASSERT_TRUE(map.save(path.c_str()));
+        WordMap copy(splitting(1, 16, 2000));
+        ASSERT_TRUE(copy.load(path.c_str()));
+        for (uint64_t i = 0; i < kStable; ++i) {
+            auto got = copy.find(i);
+            ASSERT_TRUE(got.second);
+            EXPECT_EQ(got.first % kStable, i);
+        }
+    }
+    stop = true;
+    writer.join();
+    std::remove(path.c_str());
+}
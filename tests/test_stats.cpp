@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::CountingStats;
+using concurrent_hashmap::MapOptions;
+using concurrent_hashmap::MapStats;
+using concurrent_hashmap::Reclamation;
+using concurrent_hashmap::StatsSnapshot;
+
+using PlainMap = ConcurrentHashMap<int, int, std::hash<int>,
+                                   std::equal_to<int>, 1>;
+using CountedMap = ConcurrentHashMap<
+    int, int, std::hash<int>, std::equal_to<int>, 1,
+    concurrent_hashmap::detail::SpinLock,
+    std::allocator<std::pair<const int, int>>, CountingStats>;
+// String values take no lock-free pre-check or CAS path, so every probe
+// and lock below comes from the call being counted.
+using CountedStringMap = ConcurrentHashMap<
+    int, std::string, std::hash<int>, std::equal_to<int>, 1,
+    concurrent_hashmap::detail::SpinLock,
+    std::allocator<std::pair<const int, std::string>>, CountingStats>;
+
+static_assert(std::is_same<
+                  concurrent_hashmap::detail::Shard<int, int>::Lock,
+                  concurrent_hashmap::detail::SpinLock>::value,
+              "NoStats leaves the shard mutex unwrapped");
+
+static uint64_t sum(const uint64_t (&buckets)[StatsSnapshot::kProbeBuckets]) {
+    uint64_t n = 0;
+    for (uint64_t b : buckets) n += b;
+    return n;
+}
+
+TEST(StatsTest, ProbeBuckets) {
+    EXPECT_EQ(StatsSnapshot::probe_bucket(0), 0u);
+    EXPECT_EQ(StatsSnapshot::probe_bucket(1), 0u);
+    EXPECT_EQ(StatsSnapshot::probe_bucket(2), 1u);
+    EXPECT_EQ(StatsSnapshot::probe_bucket(3), 2u);
+    EXPECT_EQ(StatsSnapshot::probe_bucket(4), 2u);
+    EXPECT_EQ(StatsSnapshot::probe_bucket(5), 3u);
+    EXPECT_EQ(StatsSnapshot::probe_bucket(100000),
+              StatsSnapshot::kProbeBuckets - 1);
+}
+
+TEST(StatsTest, NoStatsReportsOnlySizes) {
+    PlainMap map;
+    for (int i = 0; i < 1000; ++i) map.insert(i, i);
+    for (int i = 0; i < 2000; ++i) map.contains(i);
+
+    MapStats s = map.stats();
+    ASSERT_EQ(s.shards.size(), map.shard_count());
+    EXPECT_EQ(s.total.entries, 1000u);
+    EXPECT_GE(s.total.capacity, 1000u);
+    EXPECT_EQ(sum(s.total.hit_probes), 0u);
+    EXPECT_EQ(sum(s.total.miss_probes), 0u);
+    EXPECT_EQ(s.total.grows, 0u);
+    EXPECT_EQ(s.total.lock_acquisitions, 0u);
+}
+
+TEST(StatsTest, CountsProbesAndLocks) {
+    CountedStringMap map;
+    const int kN = 1000;  // small enough that every grow is a full rehash
+    for (int i = 0; i < kN; ++i) map.insert(i, std::to_string(i));
+    for (int i = 0; i < kN; ++i) ASSERT_TRUE(map.find(i).second);
+    for (int i = kN; i < 3 * kN; ++i) ASSERT_FALSE(map.contains(i));
+
+    MapStats s = map.stats();
+    EXPECT_EQ(s.total.entries, static_cast<uint64_t>(kN));
+    EXPECT_EQ(sum(s.total.hit_probes), static_cast<uint64_t>(kN));
+    EXPECT_EQ(sum(s.total.miss_probes), static_cast<uint64_t>(2 * kN));
+    EXPECT_EQ(s.total.read_retries, 0u);
+    EXPECT_EQ(s.total.lock_acquisitions, static_cast<uint64_t>(kN));
+    EXPECT_EQ(s.total.lock_contended, 0u);
+    EXPECT_GT(s.total.grows, 0u);
+    EXPECT_GT(s.total.resize_nanos, 0u);
+    EXPECT_EQ(s.total.shrinks, 0u);
+
+    // The total is the sum of the shards.
+    StatsSnapshot sum_of_shards;
+    for (const StatsSnapshot& shard : s.shards) sum_of_shards += shard;
+    EXPECT_EQ(sum_of_shards.grows, s.total.grows);
+    EXPECT_EQ(sum(sum_of_shards.hit_probes), sum(s.total.hit_probes));
+}
+
+TEST(StatsTest, ReportsRetiredBacklog) {
+    MapOptions opts;
+    opts.reclaim = Reclamation::manual;
+    CountedMap map(opts);
+    // Each clear retires every shard's table; enough to flush a batch.
+    for (int round = 0; round < 40; ++round) {
+        map.insert(round, round);
+        map.clear();
+    }
+    size_t pending = map.stats().retired_pending;
+    EXPECT_GT(pending, 0u);
+    map.collect();
+    map.collect();
+    EXPECT_LT(map.stats().retired_pending, pending);
+}
+
+TEST(StatsTest, ConcurrentWritersSeeContention) {
+    MapOptions opts;
+    opts.shards = 1;
+    CountedStringMap map(opts);
+    const int kThreads = 4;
+    const int kPerThread = 20000;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < kPerThread; ++i) {
+                map.insert_or_assign(i % 512, std::to_string(t));
+                map.contains(i % 1024);
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    MapStats s = map.stats();
+    EXPECT_EQ(s.total.lock_acquisitions,
+              static_cast<uint64_t>(kThreads) * kPerThread);
+    EXPECT_LE(s.total.lock_contended, s.total.lock_acquisitions);
+    EXPECT_GE(sum(s.total.hit_probes) + sum(s.total.miss_probes),
+              static_cast<uint64_t>(kThreads) * kPerThread);
+}
@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace concurrent_hashmap {
+template <>
+struct seq_stripe_slots<uint64_t, uint64_t>
+    : std::integral_constant<size_t, 8> {};
+template <>
+struct seq_stripe_slots<int, std::string>
+    : std::integral_constant<size_t, 8> {};
+// Wider than the smallest table: one counter covers it all.
+template <>
+struct seq_stripe_slots<uint32_t, uint32_t>
+    : std::integral_constant<size_t, 64> {};
+}  // namespace concurrent_hashmap
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::detail::Shard;
+
+using WordMap   = ConcurrentHashMap<uint64_t, uint64_t, std::hash<uint64_t>,
+                                    std::equal_to<uint64_t>, 1>;
+using StringMap = ConcurrentHashMap<int, std::string, std::hash<int>,
+                                    std::equal_to<int>, 1>;
+using NarrowMap = ConcurrentHashMap<uint32_t, uint32_t, std::hash<uint32_t>,
+                                    std::equal_to<uint32_t>, 1>;
+
+static_assert(sizeof(Shard<uint64_t, uint64_t>::Slot) == 2 * sizeof(uint64_t),
+              "striped integer slots hold only key and value");
+static_assert(sizeof(Shard<uint64_t, uint64_t>::Slot) <
+                  sizeof(Shard<int64_t, int64_t>::Slot),
+              "striping drops the per-slot counter");
+
+// Single map per type for the whole suite (see test_basic.cpp).
+class StripedSeqTest : public ::testing::Test {
+protected:
+    static WordMap*   words_;
+    static StringMap* strings_;
+    static NarrowMap* narrow_;
+
+    static void SetUpTestSuite() {
+        words_ = new WordMap();
+        strings_ = new StringMap();
+        narrow_ = new NarrowMap();
+    }
+    static void TearDownTestSuite() {
+        delete narrow_;
+        delete strings_;
+        delete words_;
+        narrow_ = nullptr;
+        strings_ = nullptr;
+        words_ = nullptr;
+    }
+
+    void SetUp() override {
+        words_->clear();
+        strings_->clear();
+        narrow_->clear();
+    }
+
+    WordMap&   words()   { return *words_; }
+    StringMap& strings() { return *strings_; }
+    NarrowMap& narrow()  { return *narrow_; }
+};
+
+WordMap*   StripedSeqTest::words_ = nullptr;
+StringMap* StripedSeqTest::strings_ = nullptr;
+NarrowMap* StripedSeqTest::narrow_ = nullptr;
+
+TEST_F(StripedSeqTest, GrowShrinkAndErase) {
+    // 20000 entries pass the incremental-growth threshold.
+    const int N = 20000;
+    for (int i = 0; i < N; ++i) {
+        EXPECT_TRUE(words().insert(i, i * 3));
+        EXPECT_TRUE(strings().insert(i, std::to_string(i)));
+        EXPECT_TRUE(narrow().insert(i, i + 1));
+    }
+    for (int i = 0; i < N; i += 2) {
+        EXPECT_TRUE(words().erase(i));
+        EXPECT_TRUE(strings().erase(i));
+        EXPECT_TRUE(narrow().erase(i));
+    }
+    for (int i = 0; i < N; ++i) {
+        bool odd = (i & 1) != 0;
+        EXPECT_EQ(words().contains(i), odd);
+        EXPECT_EQ(strings().contains(i), odd);
+        EXPECT_EQ(narrow().contains(i), odd);
+        if (odd) {
+            EXPECT_EQ(words().find(i).first, static_cast<uint64_t>(i) * 3);
+            EXPECT_EQ(strings().find(i).first, std::to_string(i));
+            EXPECT_EQ(narrow().find(i).first, static_cast<uint32_t>(i) + 1);
+        }
+    }
+    EXPECT_EQ(words().size(), static_cast<size_t>(N / 2));
+}
+
+TEST_F(StripedSeqTest, ReadersNeverMissDuringGrowth) {
+    const int kStable = 2000;
+    for (int i = 0; i < kStable; ++i) {
+        strings().insert(i, std::to_string(i));
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> bad{0};
+    std::thread writer([&] {
+        // Growth, migration and backward-shift erases around the stable
+        // keys, so their stripes are bumped constantly.
+        for (int round = 0; round < 3; ++round) {
+            for (int i = 0; i < 30000; ++i) {
+                strings().insert(100000 + i, std::string(20, 'x'));
+            }
+            for (int i = 0; i < 30000; ++i) strings().erase(100000 + i);
+        }
+        stop = true;
+    });
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; ++r) {
+        readers.emplace_back([&] {
+            while (!stop) {
+                for (int i = 0; i < kStable; ++i) {
+                    auto got = strings().find(i);
+                    if (!got.second || got.first != std::to_string(i)) ++bad;
+                }
+            }
+        });
+    }
+    writer.join();
+    for (auto& th : readers) th.join();
+    EXPECT_EQ(bad.load(), 0);
+    EXPECT_EQ(strings().size(), static_cast<size_t>(kStable));
+}
+
+TEST_F(StripedSeqTest, LockFreeCountersShareStripes) {
+    // Neighbouring counters share a stripe; fetch_add claims the stripe
+    // by CAS, so racing updates on different keys must still be exact.
+    const int kThreads = 4;
+    const int kKeys = 32;
+    const int kRounds = 20000;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int r = 0; r < kRounds; ++r) {
+                words().fetch_add(static_cast<uint64_t>((r + t) % kKeys), 1);
+                if (t == 0 && r % 16 == 0) {
+                    // Growth moves the counters under the updaters.
+                    words().insert(1000 + r, r);
+                }
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    uint64_t total = 0;
+    for (int k = 0; k < kKeys; ++k) total += words().find(k).first;
+    EXPECT_EQ(total, static_cast<uint64_t>(kThreads) * kRounds);
+}
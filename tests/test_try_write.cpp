@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(CHM_HAS_COROUTINES)
+#include <coroutine>
+#include <exception>
+#endif
+
+using concurrent_hashmap::ConcurrentHashMap;
+using concurrent_hashmap::MapOptions;
+using concurrent_hashmap::TryResult;
+
+using StringMap = ConcurrentHashMap<int, std::string>;
+using CounterMap = ConcurrentHashMap<int, uint64_t>;
+
+namespace {
+
+// A key, other than `avoid`, that does not live in shard `shard`.
+template <typename Map>
+int key_outside(const Map& map, size_t shard, int avoid) {
+    int k = avoid + 1;
+    while (map.shard_of(k) == shard) ++k;
+    return k;
+}
+
+}  // namespace
+
+TEST(TryWriteTest, UncontendedWritesMatchBlockingForms) {
+    StringMap map;
+    EXPECT_EQ(map.try_insert(1, "a"), TryResult::yes);
+    EXPECT_EQ(map.try_insert(1, "b"), TryResult::no);
+    EXPECT_EQ(map.find(1).first, "a");
+
+    EXPECT_EQ(map.try_insert_or_assign(1, "c"), TryResult::no);
+    EXPECT_EQ(map.try_insert_or_assign(2, "d"), TryResult::yes);
+    EXPECT_EQ(map.find(1).first, "c");
+    EXPECT_EQ(map.find(2).first, "d");
+
+    EXPECT_EQ(map.try_erase(1), TryResult::yes);
+    EXPECT_EQ(map.try_erase(1), TryResult::no);
+    EXPECT_EQ(map.size(), 1u);
+}
+
+TEST(TryWriteTest, WouldBlockWhileShardLockIsHeld) {
+    // for_each_shard holds the shard's lock while it runs the callback.
+    CounterMap map;
+    map.insert(7, 70);
+    size_t shard = map.shard_of(7);
+    int other = key_outside(map, shard, 7);
+
+    map.for_each_shard(shard, [&](int, uint64_t) {
+        EXPECT_EQ(map.try_insert(7, 1), TryResult::would_block);
+        EXPECT_EQ(map.try_insert_or_assign(7, 1), TryResult::would_block);
+        EXPECT_EQ(map.try_erase(7), TryResult::would_block);
+        EXPECT_EQ(map.try_insert(other, 1), TryResult::yes);
+    });
+    EXPECT_EQ(map.find(7).first, 70u);
+    EXPECT_EQ(map.find(other).first, 1u);
+    EXPECT_EQ(map.try_erase(7), TryResult::yes);
+}
+
+TEST(TryWriteTest, WouldBlockBehindAnotherThread) {
+    StringMap map;
+    map.insert(1, "held");
+    std::atomic<bool> holding{false}, release{false};
+    std::thread holder([&] {
+        map.for_each_shard(map.shard_of(1), [&](int, const std::string&) {
+            holding = true;
+            while (!release.load()) std::this_thread::yield();
+        });
+    });
+    while (!holding.load()) std::this_thread::yield();
+
+    EXPECT_EQ(map.try_insert_or_assign(1, "new"), TryResult::would_block);
+    EXPECT_EQ(map.find(1).first, "held");  // reads still go through
+    release = true;
+    holder.join();
+    EXPECT_EQ(map.try_insert_or_assign(1, "new"), TryResult::no);
+    EXPECT_EQ(map.find(1).first, "new");
+}
+
+TEST(TryWriteTest, ConcurrentRetryLoops) {
+    MapOptions opts;
+    opts.shards = 2;
+    opts.max_shards = 16;
+    opts.split_threshold = 2000;
+    CounterMap map(opts);
+    const int kThreads = 4, kPerThread = 10000;
+
+    std::atomic<uint64_t> blocked{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < kPerThread; ++i) {
+                int k = i * kThreads + t;
+                TryResult r;
+                while ((r = map.try_insert(k, k)) == TryResult::would_block) {
+                    blocked.fetch_add(1, std::memory_order_relaxed);
+                    std::this_thread::yield();
+                }
+                EXPECT_EQ(r, TryResult::yes);
+                if (k % 3 == 0) {
+                    while ((r = map.try_erase(k)) == TryResult::would_block) {
+                        std::this_thread::yield();
+                    }
+                    EXPECT_EQ(r, TryResult::yes);
+                }
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    EXPECT_GT(map.shard_count(), 2u);
+    for (int k = 0; k < kThreads * kPerThread; ++k) {
+        ASSERT_EQ(map.contains(k), k % 3 != 0) << "key " << k;
+    }
+}
+
+#if defined(CHM_HAS_COROUTINES)
+
+namespace {
+
+// A coroutine that starts at once and frees itself when it finishes.
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// A single-threaded event loop.
+struct Loop {
+    std::deque<std::function<void()>> tasks;
+
+    auto scheduler() {
+        return [this](std::function<void()> task) {
+            tasks.push_back(std::move(task));
+        };
+    }
+
+    size_t run() {
+        size_t ran = 0;
+        while (!tasks.empty()) {
+            auto task = std::move(tasks.front());
+            tasks.pop_front();
+            task();
+            ++ran;
+        }
+        return ran;
+    }
+};
+
+Detached write_all(StringMap* map, Loop* loop, int key,
+                   std::vector<int>* log) {
+    log->push_back(co_await map->async_insert(key, "a", loop->scheduler()));
+    log->push_back(co_await map->async_insert(key, "b", loop->scheduler()));
+    log->push_back(
+        co_await map->async_insert_or_assign(key, "c", loop->scheduler()));
+    log->push_back(co_await map->async_erase(key, loop->scheduler()));
+    log->push_back(co_await map->async_erase(key, loop->scheduler()));
+}
+
+}  // namespace
+
+TEST(AsyncWriteTest, UncontendedCompletesWithoutSuspending) {
+    StringMap map;
+    Loop loop;
+    std::vector<int> log;
+    write_all(&map, &loop, 5, &log);
+    EXPECT_EQ(log, (std::vector<int>{1, 0, 0, 1, 0}));
+    EXPECT_TRUE(loop.tasks.empty());
+    EXPECT_TRUE(map.empty());
+}
+
+TEST(AsyncWriteTest, SuspendsOnContendedShardAndResumesFromLoop) {
+    StringMap map;
+    Loop loop;
+    map.insert(1, "x");
+    int key = 1;
+    while (map.shard_of(key) != map.shard_of(1) || key == 1) ++key;
+
+    std::vector<int> log;
+    map.for_each_shard(map.shard_of(1), [&](int, const std::string&) {
+        write_all(&map, &loop, key, &log);
+        // Suspended on the first write; one retry is queued.
+        EXPECT_TRUE(log.empty());
+        EXPECT_EQ(loop.tasks.size(), 1u);
+        // Retries while the lock is still held requeue themselves.
+        loop.tasks.front()();
+        loop.tasks.pop_front();
+        EXPECT_TRUE(log.empty());
+        EXPECT_EQ(loop.tasks.size(), 1u);
+    });
+    EXPECT_FALSE(map.contains(key));
+
+    EXPECT_EQ(loop.run(), 1u);  // the rest completes without suspending
+    EXPECT_EQ(log, (std::vector<int>{1, 0, 0, 1, 0}));
+    EXPECT_EQ(map.size(), 1u);
+}
+
+TEST(AsyncWriteTest, ManyCoroutinesOnOneHotShard) {
+    MapOptions opts;
+    opts.shards = 1;
+    CounterMap map(opts);
+    Loop loop;
+    const int kCoroutines = 200;
+
+    struct Run {
+        static Detached go(CounterMap* map, Loop* loop, int k, int* done) {
+            bool inserted =
+                co_await map->async_insert(k, uint64_t(k), loop->scheduler());
+            if (inserted) ++*done;
+        }
+    };
+
+    int done = 0;
+    map.insert(-1, 0);
+    map.for_each_shard(0, [&](int, uint64_t) {
+        for (int k = 0; k < kCoroutines; ++k) Run::go(&map, &loop, k, &done);
+    });
+    EXPECT_EQ(done, 0);
+    EXPECT_EQ(loop.run(), size_t(kCoroutines));
+    EXPECT_EQ(done, kCoroutines);
+    EXPECT_EQ(map.size(), size_t(kCoroutines) + 1);
+}
+
+#endif  // CHM_HAS_COROUTINES
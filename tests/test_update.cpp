@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include <concurrent_hashmap/concurrent_hashmap.h>
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using concurrent_hashmap::ComputeAction;
+using concurrent_hashmap::ConcurrentHashMap;
+
+using TestMap = ConcurrentHashMap<int, std::string, std::hash<int>,
+                                  std::equal_to<int>, 2>;
+using CounterMap = ConcurrentHashMap<int, long, std::hash<int>,
+                                     std::equal_to<int>, 2>;
+
+// Single maps for the whole suite (see test_basic.cpp for the rationale).
+class UpdateTest : public ::testing::Test {
+protected:
+    static TestMap*    map_;
+    static CounterMap* counters_;
+
+    static void SetUpTestSuite() {
+        map_ = new TestMap();
+        counters_ = new CounterMap();
+    }
+    static void TearDownTestSuite() {
+        delete counters_;
+        counters_ = nullptr;
+        delete map_;
+        map_ = nullptr;
+    }
+
+    void SetUp() override {
+        map_->clear();
+        counters_->clear();
+    }
+
+    TestMap&    map()      { return *map_; }
+    CounterMap& counters() { return *counters_; }
+};
+
+TestMap*    UpdateTest::map_ = nullptr;
+CounterMap* UpdateTest::counters_ = nullptr;
+
+TEST_F(UpdateTest, UpdateExisting) {
+    map().insert(1, "a");
+    EXPECT_TRUE(map().update(1, [](std::string& v) { v += "b"; }));
+    EXPECT_EQ(map().find(1).first, "ab");
+}
+
+TEST_F(UpdateTest, UpdateMissing) {
+    bool called = false;
+    EXPECT_FALSE(map().update(1, [&](std::string&) { called = true; }));
+    EXPECT_FALSE(called);
+    EXPECT_FALSE(map().contains(1));
+}
+
+TEST_F(UpdateTest, UpsertInsertsThenUpdates) {
+    auto append = [](std::string& v) { v += "+"; };
+    EXPECT_TRUE(map().upsert(1, "init", append));
+    EXPECT_EQ(map().find(1).first, "init");
+    EXPECT_FALSE(map().upsert(1, std::string("ignored"), append));
+    EXPECT_EQ(map().find(1).first, "init+");
+    EXPECT_EQ(map().size(), 1u);
+}
+
+TEST_F(UpdateTest, ComputeInsertsKeepsAndErases) {
+    // Absent + keep -> insert.
+    EXPECT_TRUE(map().compute(1, [](std::string& v, bool exists) {
+        EXPECT_FALSE(exists);
+        EXPECT_TRUE(v.empty());
+        v = "new";
+        return ComputeAction::keep;
+    }));
+    EXPECT_EQ(map().find(1).first, "new");
+
+    // Present + keep -> modify.
+    EXPECT_TRUE(map().compute(1, [](std::string& v, bool exists) {
+        EXPECT_TRUE(exists);
+        v += "er";
+        return ComputeAction::keep;
+    }));
+    EXPECT_EQ(map().find(1).first, "newer");
+
+    // Present + erase -> remove.
+    EXPECT_FALSE(map().compute(1, [](std::string&, bool) {
+        return ComputeAction::erase;
+    }));
+    EXPECT_FALSE(map().contains(1));
+    EXPECT_EQ(map().size(), 0u);
+
+    // Absent + erase -> nothing inserted.
+    EXPECT_FALSE(map().compute(2, [](std::string&, bool) {
+        return ComputeAction::erase;
+    }));
+    EXPECT_TRUE(map().empty());
+}
+
+TEST_F(UpdateTest, ThrowingFunctorReleasesSlot) {
+    map().insert(1, "a");
+    EXPECT_THROW(map().update(1, [](std::string&) {
+        throw std::runtime_error("boom");
+    }), std::runtime_error);
+    // A stuck seqlock would make this lookup spin forever.
+    EXPECT_EQ(map().find(1).first, "a");
+}
+
+TEST_F(UpdateTest, ConcurrentCountersAreExact) {
+    const int kThreads = 8;
+    const int kIncrements = 2000;
+    const int kKeys = 16;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([this, t] {
+            for (int i = 0; i < kIncrements; ++i) {
+                int key = (t + i) % kKeys;
+                counters().upsert(key, 1L, [](long& v) { ++v; });
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    long total = 0;
+    for (int k = 0; k < kKeys; ++k) {
+        auto r = counters().find(k);
+        EXPECT_TRUE(r.second);
+        total += r.first;
+    }
+    EXPECT_EQ(total, static_cast<long>(kThreads) * kIncrements);
+}